@@ -1,139 +1,205 @@
-
-#ifndef __DB_BPlusTree_H__
-#define __DB_BPlusTree_H__
-
-#include <iostream>
-#include <vector>
-#include <string>
-#include <stack>
-#include <algorithm>
-#include <cstring>
-#include "datatype.h"
-#define MAX_CHILDREN 48
-#define MIN_CHILDREN 24
-
-namespace db{
-
-/*
-b+树上的节点是TreeNode
-
-b+树的一个节点上，需要记录父节点和子节点的相关信息（非叶子），叶子节点记录父节点和该block的信息
-
-
-pkey，nextNode:该节点的键值，下一个节点。
-对于非叶子节点：例如，根节点root现在size=3，root[0].nextNode表示 0号的Node 指向的子节点 满足 其最小键值是root[0].pkey
-对于叶子节点：pkey就是插入的record的键值，nextNode置为nullptr，leaf[lastNode].nextNode=leafRight(用叶子节点的最后一个Node的nextNode指向其右边的节点)
-
-blkid：只有是叶子节点才存有blockid的信息
-
-大致结构如下：
-                      (root)
-                   [father=NULL]
-    [pkey0]      |  [pkey1]        |      [pkey2]
-    [child0]     |  [child1]       |      [child2]
-________________________________________________________
-   (child0)      |   (child1)      |   (child2)
-[father=root]    |[father=root]    |[father=root]
-[k0] [k1] [k2]   |[k0] [k1] [k2]   |[k0] [k1] [k2]
-[c0] [c1] [c2]   |[c0] [c1] [c2]   |[c0] [c1] [c2]     
-.......
-.......
-.......
-.......
-leaf TreeNode:
-   [father]                         |   [father]                         |...
-[k0] [k1] [k2]                      |[k0] [k1] [k2]                      |...
-[]   []    [(指向其右边的节点)]     |[]   []    [(指向其右边的节点)]     |...
-    [blkid]                         |    [blkid]                         |...
-    
-
-*/
-struct TreeNode; 
-
-struct Node {
-    unsigned char* pkey;
-    unsigned int len;
-    TreeNode* nextNode;
-
-    Node() : pkey(nullptr), len(0), nextNode(nullptr) {}
-
-    Node(unsigned char* key, unsigned int len) : len(len), nextNode(nullptr) {
-        pkey = new unsigned char[len];
-        std::memcpy(pkey, key, len);
+////
+// @file BPlusTree.h
+// @brief
+// 内存中的b+树索引，键 --> blockid
+// 采用乐观锁耦合(optimistic lock coupling)实现并发：
+// 1. 每个节点有一个版本号，bit0表示节点已废弃，bit1表示节点被写锁定；
+// 2. 读者不加锁，只读版本号，读完节点后再校验版本号，版本变化则从根重新开始；
+// 3. 写者沿途乐观下降，只锁定需要修改的节点和其父节点；
+// 4. 插入时遇到满节点先分裂(eager split)，保证父节点总有空间容纳分隔键；
+// 5. 叶子之间有右兄弟指针(B-link)，便于范围扫描；
+// 6. 删除不合并节点，节点在树析构时才释放，读者不会访问到已释放的内存。
+//
+// 节点内的键存放在节点自带的键空间中，键最长BPT_MAXKEY字节。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_BPLUSTREE_H__
+#define __DB_BPLUSTREE_H__
+
+#include <atomic>
+
+namespace db {
+
+const unsigned int BPT_FANOUT = 64;     // 节点最多键数
+const unsigned int BPT_KEYSPACE = 4096; // 节点键空间大小
+const unsigned int BPT_MAXKEY = 1024;   // 键的最大长度
+
+////
+// @brief
+// 乐观锁，版本号每次写解锁后加4
+//
+struct OptLock
+{
+    std::atomic<unsigned long long> version;
+
+    OptLock()
+        : version(4)
+    {}
+
+    static inline bool isLocked(unsigned long long v) { return (v & 2) == 2; }
+    static inline bool isObsolete(unsigned long long v) { return (v & 1) == 1; }
+
+    // 读版本号，被锁定或废弃则需要重启
+    inline unsigned long long readLock(bool &restart) const
+    {
+        unsigned long long v = version.load(std::memory_order_acquire);
+        if (isLocked(v) || isObsolete(v)) restart = true;
+        return v;
     }
-
-    ~Node() {
-        delete[] pkey;
+    // 校验读到的数据是否一致
+    inline void checkOrRestart(unsigned long long v, bool &restart) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) != v) restart = true;
     }
-
-    // 添加拷贝构造函数
-    Node(const Node& other) : len(other.len), nextNode(other.nextNode) {
-        pkey = new unsigned char[len];
-        std::memcpy(pkey, other.pkey, len);
+    // 读锁升级为写锁
+    inline void upgrade(unsigned long long v, bool &restart)
+    {
+        if (!version.compare_exchange_strong(v, v + 2)) restart = true;
     }
+    // 直接加写锁
+    inline void writeLock(bool &restart)
+    {
+        unsigned long long v = readLock(restart);
+        if (restart) return;
+        upgrade(v, restart);
+    }
+    inline void writeUnlock() { version.fetch_add(2); }
+    inline void writeUnlockObsolete() { version.fetch_add(3); }
+};
 
-    // 添加拷贝赋值运算符
-    Node& operator=(const Node& other) {
-        if (this != &other) {
-            delete[] pkey;
-            len = other.len;
-            nextNode = other.nextNode;
-            pkey = new unsigned char[len];
-            std::memcpy(pkey, other.pkey, len);
-        }
-        return *this;
+////
+// @brief
+// 树节点，键按升序存放
+//
+struct BTreeNode
+{
+    OptLock lock;
+    bool leaf;                            // 是否叶子
+    unsigned short count;                 // 键个数
+    unsigned short used;                  // 键空间已用
+    unsigned short live;                  // 有效键的总长
+    unsigned short offsets[BPT_FANOUT];   // 键在键空间中的偏移量
+    unsigned short lengths[BPT_FANOUT];   // 键长度
+    unsigned char keyspace[BPT_KEYSPACE]; // 键空间
+
+    BTreeNode(bool isleaf)
+        : leaf(isleaf)
+        , count(0)
+        , used(0)
+        , live(0)
+    {}
+
+    // 节点是否需要先分裂，保证任意键都能插入
+    inline bool full() const
+    {
+        return count >= BPT_FANOUT - 1 || live + BPT_MAXKEY > BPT_KEYSPACE;
     }
+    // 第pos个键，读者可能读到不一致的数据，这里做边界保护
+    inline const unsigned char *key(unsigned int pos, unsigned int &len) const
+    {
+        if (pos >= BPT_FANOUT) pos = BPT_FANOUT - 1;
+        unsigned int off = offsets[pos];
+        len = lengths[pos];
+        if (off > BPT_KEYSPACE) off = BPT_KEYSPACE;
+        if (off + len > BPT_KEYSPACE) len = BPT_KEYSPACE - off;
+        return keyspace + off;
+    }
+    // 有效键个数
+    inline unsigned int size() const
+    {
+        unsigned int n = count;
+        return n > BPT_FANOUT ? BPT_FANOUT : n;
+    }
+
+    // 第1个不小于key的位置
+    unsigned int lowerBound(const unsigned char *k, unsigned int len) const;
+    // 第1个大于key的位置
+    unsigned int upperBound(const unsigned char *k, unsigned int len) const;
+    // 在pos处放入一个键，调用者保证空间足够
+    void putKey(unsigned int pos, const unsigned char *k, unsigned int len);
+    // 删除pos处的键
+    void eraseKey(unsigned int pos);
+    // 整理键空间
+    void compact();
 };
 
-struct TreeNode {
-    TreeNode* father;
-    std::vector<Node> children;
-    unsigned int blkid;
+// 内部节点，count个键，count+1个孩子
+// children[i]中的键k满足：key[i-1] <= k < key[i]
+struct BTreeInner : BTreeNode
+{
+    BTreeNode *children[BPT_FANOUT + 1];
+
+    BTreeInner()
+        : BTreeNode(false)
+    {}
+};
 
-    TreeNode(unsigned int blkid = -1) : father(nullptr), blkid(blkid) {}
+// 叶子节点
+struct BTreeLeaf : BTreeNode
+{
+    unsigned int blkids[BPT_FANOUT]; // 键所在的blockid
+    BTreeLeaf *right;                // 右兄弟
 
-    ~TreeNode() {
-        delete father;
-    }
+    BTreeLeaf()
+        : BTreeNode(true)
+        , right(nullptr)
+    {}
 };
 
+// 比较键，按字节序比较，相同前缀则短者小
+int compareKey(
+    const unsigned char *x,
+    unsigned int xlen,
+    const unsigned char *y,
+    unsigned int ylen);
 
 // table层在对bpt初始化时调用insert方法
 // 迭代器：BlockIterator,RecordIterator
 // 增删改查时同步更新bpt
-class BPlusTree{
-private:
-    TreeNode* root;//根节点
-   
-    
-private:    
-    std::pair<bool,TreeNode*> find(TreeNode* start,unsigned char* pkey, unsigned int len);
-    void insertLeafNode(TreeNode* newLeafNode);//叶子节点插入逻辑
-    void insertInternalNode(TreeNode* parent, unsigned char* pkey, TreeNode* child);//内部节点插入逻辑
-    void handleNodeUnderflow(TreeNode* node);//处理节点欠载
-    
-
-public:
+// 所有接口都可以多线程并发调用
+class BPlusTree
+{
+  private:
+    std::atomic<BTreeNode *> root_; // 根节点
+
+  public:
     BPlusTree();
     ~BPlusTree();
 
-    //向树中插入一条记录
-    void insert(unsigned char* pkey, unsigned int len, unsigned int blkid);
-
-    //从树中查找一个关键字序号为key的blkid
-    unsigned int search(unsigned char* pkey, unsigned int len);
-
-    //删除一条记录
-    void remove(unsigned char* pkey, unsigned int len,unsigned int blkid);
-
-    //更新一条记录的关键字
-    void update(unsigned char* pkey, unsigned int len,unsigned int blkid);
+    // 向树中插入一条记录，键已存在返回false
+    bool insert(unsigned char *pkey, unsigned int len, unsigned int blkid);
+    // 从树中查找关键字所在的blkid，找不到返回0
+    unsigned int search(unsigned char *pkey, unsigned int len);
+    // 查找不大于关键字的最大键所在的blkid，找不到返回0；删除不合并节点，
+    // 这样的键在左边的叶子中时也返回0
+    unsigned int floor(unsigned char *pkey, unsigned int len);
+    // 查找小于关键字的最大键所在的blkid，限制与floor相同
+    unsigned int below(unsigned char *pkey, unsigned int len);
+    // 删除一条记录，键唯一，不需要blkid
+    void remove(unsigned char *pkey, unsigned int len);
+    // 更新关键字所在的blkid
+    void update(unsigned char *pkey, unsigned int len, unsigned int blkid);
+
+  private:
+    // floor与below的实现，strict表示不含等于key的键
+    unsigned int nearest(unsigned char *pkey, unsigned int len, bool strict);
+    // 分裂节点，返回新的右兄弟，sep返回分隔键
+    BTreeNode *split(BTreeNode *node, unsigned char *sep, unsigned int &seplen);
+    // 在父节点中插入分隔键，调用者锁定父节点
+    void insertChild(
+        BTreeInner *parent,
+        const unsigned char *sep,
+        unsigned int seplen,
+        BTreeNode *child);
+    // 在叶子中找到key并加写锁，找不到返回nullptr
+    BTreeLeaf *lockLeaf(unsigned char *pkey, unsigned int len, unsigned int &pos);
+    // 释放子树
+    static void destroy(BTreeNode *node);
 };
 
-}
-
-
-
-#endif // __DB_BPlusTree_H__
+} // namespace db
 
-#define __DB_BPlusTree_H__
\ No newline at end of file
+#endif // __DB_BPLUSTREE_H__
@@ -38,15 +38,22 @@
 
 namespace db {
 
-const unsigned short BLOCK_TYPE_IDLE = 0;  // 空闲
-const unsigned short BLOCK_TYPE_SUPER = 1; // 超块
-const unsigned short BLOCK_TYPE_DATA = 2;  // 数据
-const unsigned short BLOCK_TYPE_INDEX = 3; // 索引
-const unsigned short BLOCK_TYPE_META = 4;  // 元数据
-const unsigned short BLOCK_TYPE_LOG = 5;   // wal日志
+const unsigned short BLOCK_TYPE_IDLE = 0;     // 空闲
+const unsigned short BLOCK_TYPE_SUPER = 1;    // 超块
+const unsigned short BLOCK_TYPE_DATA = 2;     // 数据
+const unsigned short BLOCK_TYPE_INDEX = 3;    // 索引
+const unsigned short BLOCK_TYPE_META = 4;     // 元数据
+const unsigned short BLOCK_TYPE_LOG = 5;      // wal日志
+const unsigned short BLOCK_TYPE_OVERFLOW = 6; // 行外字段的溢出块
+const unsigned short BLOCK_TYPE_FSM = 7;      // 空闲空间映射
 
 const unsigned int SUPER_SIZE = 1024 * 4;  // 超块大小为4KB
 const unsigned int BLOCK_SIZE = 1024 * 16; // 一般块大小为16KB
+// 每个溢出块存放的字节数，留出头部、trailer和记录头
+const unsigned int OVERFLOW_CHUNK = BLOCK_SIZE - 256;
+// 文件按extent预分配，block在extent内顺序分配，文件在磁盘上保持连续
+const unsigned int EXTENT_SIZE = 1024 * 1024;     // 缺省extent为1MB
+const unsigned int EXTENT_MAX = 1024 * 1024 * 64; // extent最大为64MB
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 static const int MAGIC_NUMBER = 0x31306264; // magic number
@@ -88,8 +95,10 @@ struct SuperHeader : CommonHeader
     unsigned int idlecounts; // 空闲块个数
     unsigned int self;       // 本块id(4B)
     unsigned int maxid;      // 最大的blockid(4B)
-    unsigned int pad;        // 填充位(4B)
+    unsigned int fsm;        // 空闲空间映射的首页(4B)
     long long records;       // 记录数目(8B)
+    unsigned int extent;     // 每次预分配的block数(4B)
+    unsigned int reserved;   // 已预分配的最大blockid(4B)
 };
 
 // 空闲块头部
@@ -185,7 +194,7 @@ class SuperBlock : public Block
     // 关联buffer
     inline void attach(unsigned char *buffer) { buffer_ = buffer; }
     // 清超块
-    void clear(unsigned short spaceid);
+    void clear(unsigned int spaceid);
 
     // 获取第1个数据块
     inline unsigned int getFirst()
@@ -213,6 +222,19 @@ class SuperBlock : public Block
         header->idle = htobe32(idle);
     }
 
+    // 获取空闲空间映射的首页
+    inline unsigned int getFsm()
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        return be32toh(header->fsm);
+    }
+    // 设定空闲空间映射的首页
+    inline void setFsm(unsigned int fsm)
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        header->fsm = htobe32(fsm);
+    }
+
     // 获取最大blockid
     inline unsigned int getMaxid()
     {
@@ -226,6 +248,32 @@ class SuperBlock : public Block
         header->maxid = htobe32(maxid);
     }
 
+    // 获取每次预分配的block数，0表示缺省
+    inline unsigned int getExtent()
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        return be32toh(header->extent);
+    }
+    // 设定每次预分配的block数
+    inline void setExtent(unsigned int extent)
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        header->extent = htobe32(extent);
+    }
+
+    // 获取已预分配的最大blockid
+    inline unsigned int getReserved()
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        return be32toh(header->reserved);
+    }
+    // 设定已预分配的最大blockid
+    inline void setReserved(unsigned int reserved)
+    {
+        SuperHeader *header = reinterpret_cast<SuperHeader *>(buffer_);
+        header->reserved = htobe32(reserved);
+    }
+
     // 获取时戳
     inline TimeStamp getTimeStamp()
     {
@@ -333,7 +381,7 @@ class MetaBlock : public Block
 {
   public:
     // 清数据块
-    void clear(unsigned short spaceid, unsigned int self, unsigned short type);
+    void clear(unsigned int spaceid, unsigned int self, unsigned short type);
 
     // 获取空闲块
     inline unsigned int getNext()
@@ -378,6 +426,13 @@ class MetaBlock : public Block
         header->freesize = htobe16(size);
     }
 
+    // 已占用的空间，含记录和slots[]
+    inline unsigned short getUsedSize()
+    {
+        return BLOCK_SIZE - sizeof(MetaHeader) - sizeof(Trailer) -
+               getFreeSize();
+    }
+
     // 设置slots数目
     inline void setSlots(unsigned short slots)
     {
@@ -454,7 +509,7 @@ class MetaBlock : public Block
         MetaHeader *header = reinterpret_cast<MetaHeader *>(buffer_);
         // 判断是不是超过了Trailer的界限
         unsigned short upper = BLOCK_SIZE - getTrailerSize();
-        if (freespace >= upper) freespace = 0; //超过界限则设置为0
+        if (freespace > upper) freespace = 0; //超过界限则设置为0
         header->freespace = htobe16(freespace);
     }
 
@@ -466,9 +521,12 @@ class MetaBlock : public Block
     // 回收删除记录的资源，回收了slots资源，后续需要重排slots[]
     void shrink();
     // 对slots[]重排
-    inline void reorder(DataType *type, unsigned int key)
+    inline void reorder(
+        DataType *type,
+        unsigned int key,
+        const RecordFormat *format = NULL)
     {
-        type->sort(buffer_, key);
+        type->sort(buffer_, key, format);
     }
 
     // 引用slots[]
@@ -529,6 +587,10 @@ class DataBlock : public MetaBlock
     inline void setTable(Table *table) { table_ = table; }
     // 获取table
     inline Table *getTable() { return table_; }
+    // 表的定长记录格式，变长表或未设定table时返回NULL
+    const RecordFormat *format();
+    // 引用slots[]，按表的记录格式解释记录
+    bool refslots(unsigned short index, Record &record);
 
     // 查询记录
     // 给定一个关键字，从slots[]上搜索到该记录：
@@ -547,13 +609,18 @@ class DataBlock : public MetaBlock
     // 返回值：
     // true - 表示记录完全插入
     // false - 表示block被分裂
-    std::pair<bool, unsigned short>insertRecord(std::vector<struct iovec> &iov);
+    // header是新记录的头部，有行外字段的记录为RECORD_FULL_START
+    std::pair<bool, unsigned short> insertRecord(
+        std::vector<struct iovec> &iov,
+        unsigned char header = RECORD_FULL_ALL);
 
     // 修改记录
     // 修改一条存在的记录
     // 先标定原记录为tomestone
     // 然后插入新记录
-    std::pair<bool, unsigned short> updateRecord(std::vector<struct iovec> &iov);
+    std::pair<bool, unsigned short> updateRecord(
+        std::vector<struct iovec> &iov,
+        unsigned char header = RECORD_FULL_ALL);
     
     // 分裂块位置
     // 给定新增的记录大小和位置，计算从何处开始分裂该block
@@ -11,15 +11,26 @@
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <functional>
+#include "./file.h"
 
 namespace db {
+const unsigned int IO_THREADS = 4; // 异步读入的线程数
+
 // buffer描述符
 struct BufDesp
 {
     BufDesp *next;                  // 下一个描述符
     BufDesp *prev;                  // 前一个描述符
-    const char *name;               // 表名
+    TableId table;                  // 表的编号
+    unsigned int spaceid;           // block应属的表空间
     unsigned char *buffer;          // 缓冲
     unsigned int blockid;           // block的id
     unsigned short size;            // 大小
@@ -29,11 +40,13 @@ struct BufDesp
     BufDesp()
         : next(NULL)
         , prev(NULL)
-        , name(NULL)
-        , blockid(0)
+        , table(TABLE_NONE)
+        , spaceid(SPACE_NONE)
         , buffer(NULL)
+        , blockid(0)
         , size(0)
         , type(0)
+        , ref(0)
     {}
     inline void addref() { ++ref; }
     inline void relref() { --ref; }
@@ -46,24 +59,51 @@ struct BufDesp
 // 3. 上层调用write接口写，调用release释放buffer；
 // 4. 完整的实现，Buffer应该由一个协程控制，上层用户通过rpc请求block；
 // 5. Buffer应该自主刷盘，同时设置两个通道
+// 6. borrow/writeBuf可以多线程调用，由mutex_保护块表和lru队列；
+// 7. 读文件时不持有mutex_，正在读入的buffer标记为BUFFER_LOADING，同步借用者
+//    在loaded_上睡眠等待，异步借用者的回调挂在waiters_上；
+// 8. borrowAsync不阻塞调用者，未命中时读文件的工作交给Buffer自己的IO线程，
+//    读完后回调提交到kScheduler，阻塞的读不占用调度器的工作线程；一个线程
+//    可以同时发起大量点查，但同时在读的block不超过IO_THREADS个；
+// 9. 空闲buffer用完时，从lru尾部淘汰没有被借用的buffer，脏buffer先写回文件；
+// 10. 块表以TableId和blockid拼成的64位整数为键，散列查找；按表名借用的
+//    接口先intern，热路径上应直接用TableId；
+// 11. 描述符记下block应属的表空间，读入和写回时与block头部的spaceid核对，
+//    不一致说明block写错了位置：读入的当作读错清零，写回的丢弃不写。
+// 12. 超块写回前经钩子填入表层在内存中维护的统计，淘汰时也不丢计数。
 // TODO: 日志刷盘
-class FilePool;
 class Buffer
 {
   public:
-    using BlockMap = std::map<std::pair<std::string, unsigned int>, BufDesp *>;
+    using BlockMap = std::unordered_map<unsigned long long, BufDesp *>;
+    using Callback = std::function<void(BufDesp *desp)>;
+    using WaitMap = std::map<BufDesp *, std::vector<Callback>>;
+    using Hook = std::function<bool(BufDesp *desp)>;
 
     unsigned char BUFFER_LOCKED = 0x1; // 锁定buffer
     unsigned char BUFFER_DIRTY = 0x2;  // 脏buffer
     unsigned char BUFFER_READY = 0x4;  // 可回写buffer
+    unsigned char BUFFER_LOADING = 0x8; // 正在从文件读入
 
   private:
     BufDesp *idle_;         // 空闲buffer
-    BufDesp lru_;           // 最近访问队列
-    BlockMap map_;          // 块表 table+blockid --> BufDesp
+    BufDesp lru_;           // 最近访问队列，next是头，prev是尾
+    BlockMap map_;          // 块表 table:blockid --> BufDesp
     unsigned char *buffer_; // 所有buffer
     FilePool *filepool_;    // 文件池
     size_t idleCount_;      // 空闲块个数
+    std::mutex mutex_;      // 保护块表和lru队列
+    WaitMap waiters_;       // 等待读入完成的回调
+    std::condition_variable loaded_;  // 读入完成时唤醒同步借用者
+    std::atomic<size_t> misdirected_; // 表空间不符的block数
+    Hook superHook_;                  // 超块写回前的钩子
+
+    using Read = std::pair<BufDesp *, File *>;
+    std::mutex ioMutex_;              // 保护reads_和ioStop_
+    std::condition_variable ioReady_; // 唤醒IO线程
+    std::deque<Read> reads_;          // 等待IO线程读入的block
+    std::vector<std::thread> io_;     // IO线程，首次异步读入时启动
+    bool ioStop_;                     // 停止IO线程
 
   public:
     Buffer()
@@ -71,24 +111,68 @@ class Buffer
         , buffer_(NULL)
         , filepool_(NULL)
         , idleCount_(0)
+        , misdirected_(0)
+        , ioStop_(false)
     {}
     ~Buffer();
 
     // 初始化缺省大小为256MB
     void init(FilePool *fp, size_t defaultSize = 256);
     // 用户请求一个block
+    BufDesp *borrow(TableId table, unsigned int blockid);
     BufDesp *borrow(const char *table, unsigned int blockid);
+    // 异步请求一个block，命中时直接回调，否则读入后在调度器线程上回调
+    // 回调的参数与borrow的返回值相同，用完后同样需要releaseBuf
+    void borrowAsync(TableId table, unsigned int blockid, Callback callback);
+    void borrowAsync(const char *table, unsigned int blockid, Callback callback);
     // 写一个block
     void writeBuf(BufDesp *desp);
     // 释放block
     inline void releaseBuf(BufDesp *desp) { desp->relref(); }
+    // 丢弃一个文件所有未借用的buffer，不写回，删除临时文件前调用
+    void discard(TableId table);
+    void discard(const char *table);
+    // 丢弃blockid大于maxid的buffer并截断文件，整理后收缩文件时调用；
+    // 这些block还有人借用时返回EBUSY，不截断
+    int truncate(TableId table, unsigned int maxid);
+    // 在文件中为blockid开始的count个block预分配空间，扩展文件时调用
+    int allocate(TableId table, unsigned int blockid, unsigned int count);
+    // 把脏buffer写回文件，buffer仍留在内存中，关闭时调用；缺省写回所有表，
+    // 给定table时只写回这张表的；返回第一个写错误
+    int flush(TableId table = TABLE_NONE);
+
+    // 超块写回文件前先调用hook，hook改写了超块时返回true，未脏的超块也写回；
+    // 表层借此把内存中的统计写进超块。调用时持有mutex_，hook不能借用buffer
+    void setSuperHook(Hook hook);
 
     // 空闲块个数
     inline size_t idles() { return idleCount_; }
+    // 读入或写回时发现表空间不符的block数
+    inline size_t misdirected() const { return misdirected_.load(); }
     // 分配buffer
     BufDesp *allocFromIdle();
     // prepend到lru头部
     void prependLru(BufDesp *ptr);
+
+  private:
+    // 将描述符移到lru头部，调用者持有mutex_
+    void touchLru(BufDesp *desp);
+    // 将描述符从lru中摘下，调用者持有mutex_
+    void unlinkLru(BufDesp *desp);
+    // 描述符从块表和lru中删除，buffer放回idle，调用者持有mutex_
+    void recycle(BlockMap::iterator it);
+    // 超块写回前调用钩子，改写了超块就标为脏，调用者持有mutex_
+    void saveSuper(BufDesp *desp);
+    // 从lru尾部淘汰一个未借用的buffer，脏buffer先写回，调用者持有mutex_
+    // 没有可淘汰的buffer返回false
+    bool evict();
+    // 从文件读入block，完成后唤醒同步借用者，异步回调提交到调度器，
+    // 调用者不持有mutex_
+    void load(BufDesp *desp, File *file);
+    // 把读入交给IO线程，调用者不持有mutex_
+    void submit(BufDesp *desp, File *file);
+    // IO线程主循环
+    void serve();
 };
 
 // 全局buffer管理器
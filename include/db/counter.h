@@ -0,0 +1,89 @@
+////
+// @file counter.h
+// @brief
+// 分片计数器
+// 多个线程同时修改一个计数器时，计数器所在的cache line会在各核之间来回迁移。这里将计数
+// 器按核分片，每个线程只修改自己的分片，读取时再累加所有分片。适合写多读少的统计量。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_COUNTER_H__
+#define __DB_COUNTER_H__
+
+#include <stdint.h>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+namespace db {
+
+const size_t CACHELINE_SIZE = 64; // cache line大小
+const size_t COUNTER_SHARDS = 32; // 计数器分片个数
+
+// C++11的new只保证基本对齐，按cache line对齐的对象在堆上分配时用这一对
+// 函数，原始指针存放在对齐地址的前面
+inline void *cachelineNew(size_t size)
+{
+    unsigned char *raw =
+        (unsigned char *) ::operator new(size + CACHELINE_SIZE);
+    uintptr_t aligned = ((uintptr_t) raw + CACHELINE_SIZE) &
+                        ~(uintptr_t) (CACHELINE_SIZE - 1);
+    ((void **) aligned)[-1] = raw;
+    return (void *) aligned;
+}
+inline void cachelineDelete(void *ptr)
+{
+    if (ptr) ::operator delete(((void **) ptr)[-1]);
+}
+
+class ShardedCounter
+{
+  private:
+    // 每个分片独占一个cache line，只填充不够，数组的起点也要对齐
+    struct alignas(CACHELINE_SIZE) Shard
+    {
+        std::atomic<long long> value;
+    };
+    Shard shards_[COUNTER_SHARDS];
+
+  public:
+    ShardedCounter() { reset(0); }
+
+    // 增减计数，只修改当前线程的分片
+    inline void add(long long delta)
+    {
+        shards_[shard()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+    inline void sub(long long delta) { add(-delta); }
+
+    // 累加所有分片
+    inline long long load() const
+    {
+        long long sum = 0;
+        for (size_t i = 0; i < COUNTER_SHARDS; ++i)
+            sum += shards_[i].value.load(std::memory_order_relaxed);
+        return sum;
+    }
+    // 重置计数，不能与add并发
+    inline void reset(long long value)
+    {
+        shards_[0].value.store(value, std::memory_order_relaxed);
+        for (size_t i = 1; i < COUNTER_SHARDS; ++i)
+            shards_[i].value.store(0, std::memory_order_relaxed);
+    }
+
+    // 当前线程的分片号，首次调用时计算
+    static inline size_t shard()
+    {
+        static thread_local size_t index =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) %
+            COUNTER_SHARDS;
+        return index;
+    }
+};
+
+} // namespace db
+
+#endif // __DB_COUNTER_H__
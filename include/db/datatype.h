@@ -14,21 +14,32 @@
 
 namespace db {
 
+struct RecordFormat;
+
 // sql数据类型
 struct DataType
 {
     // slots[]排序函数
     // block - datablock缓冲
     // key - 键的位置
-    using Sort = void (*)(unsigned char *block, unsigned int key);
+    // format - 定长记录的格式，NULL表示变长记录
+    using Sort = void (*)(
+        unsigned char *block,
+        unsigned int key,
+        const RecordFormat *format);
     // slots[]查找函数
     // block - datablock缓冲
     // key - 键的位置
     // val - 指向键的指针
     // len - 键val的长度
+    // format - 定长记录的格式，NULL表示变长记录
     // 返回值：返回lowerbound的位置
-    using Search = unsigned short (
-            *)(unsigned char *block, unsigned int key, void *val, size_t len);
+    using Search = unsigned short (*)(
+        unsigned char *block,
+        unsigned int key,
+        void *val,
+        size_t len,
+        const RecordFormat *format);
     // 比较键
     using Less = bool (*)(
         unsigned char *x,
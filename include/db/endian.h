@@ -24,6 +24,7 @@
 #if defined(__linux__) || defined(__CYGWIN__)
 
 #    include <endian.h>
+#    include <arpa/inet.h>
 
 #elif defined(__APPLE__)
 
@@ -0,0 +1,737 @@
+////
+// @file exec.h
+// @brief
+// 向量化执行器
+// 算子之间以批(Batch)为单位交换数据，一批最多BATCH_SIZE行，按列存放：
+// 1. Scan一次解码整个block，把需要的列写入列向量，整数列解码成long long数组，
+//    字节串列只记录指向block的指针和长度，block在批释放前保持借用；
+// 2. Filter在列数组上做紧凑的循环，结果写入选择向量，不搬动数据；
+// 3. Project只交换列向量；
+// 4. Aggregate在选择向量上累加；
+// 5. HashAggregate做分组聚集，见类的说明；
+// 6. HashJoin、MergeJoin连接两个输入，输出左边的列之后是右边的列；
+// 7. Sort按任意一列排序，内存放不下时做外排序。
+// 整数按无符号解码，与存储层中键的排序一致。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_EXEC_H__
+#define __DB_EXEC_H__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include "./sql.h"
+#include "./scan.h"
+#include "./table.h"
+
+namespace db {
+
+const size_t BATCH_SIZE = 1024;          // 一批最多行数
+const unsigned int AGG_PARTITION_BITS = 4; // 分组聚集的radix分区位数
+const unsigned int AGG_PARTITIONS = 1 << AGG_PARTITION_BITS; // 分区个数
+const size_t AGG_MEMORY = 64 * 1024 * 1024; // 分组聚集的缺省内存上限
+const size_t JOIN_MEMORY = 64 * 1024 * 1024; // hash连接的缺省内存上限
+const size_t SORT_MEMORY = 64 * 1024 * 1024; // 排序的缺省内存上限
+
+// 列向量
+struct ColumnVector
+{
+    bool integer;                            // 是否整数列
+    std::vector<long long> ints;             // 整数列的值
+    std::vector<const unsigned char *> data; // 字节串列，指向block中的值
+    std::vector<unsigned int> lengths;       // 字节串列的长度
+
+    ColumnVector()
+        : integer(false)
+    {}
+    void clear()
+    {
+        ints.clear();
+        data.clear();
+        lengths.clear();
+    }
+};
+
+////
+// @brief
+// 一批记录，按列存放
+// 选择向量记录有效行的下标，selected为false表示所有行都有效
+// 字节串列或者指向pins中借用的block，或者指向拷贝到批内arena的副本
+//
+struct Batch
+{
+    size_t rows;                           // 行数
+    std::vector<ColumnVector> columns;     // 各列，未解码的列为空
+    std::vector<unsigned short> selection; // 选择向量
+    bool selected;                         // 是否使用选择向量
+    std::vector<BufDesp *> pins;           // 字节串列引用的block
+    std::vector<std::unique_ptr<unsigned char[]>> arena; // 拷贝的字节串
+    std::vector<std::unique_ptr<unsigned char[]>> large; // 超过一块的字节串
+    size_t chunk;                          // arena中正在用的块
+    size_t used;                           // 该块已用的字节
+
+    Batch()
+        : rows(0)
+        , selected(false)
+        , chunk(0)
+        , used(0)
+    {}
+    ~Batch() { clear(); }
+    Batch(const Batch &) = delete;
+    Batch &operator=(const Batch &) = delete;
+
+    // 清空并归还借用的block，arena留着重用
+    void clear();
+    // 在arena中预留length字节，clear之前有效
+    unsigned char *reserve(unsigned int length);
+    // 字节串拷贝到arena，返回副本，clear之前有效
+    const unsigned char *copy(const unsigned char *data, unsigned int length);
+    // 有效行数
+    inline size_t count() const { return selected ? selection.size() : rows; }
+    // 第i个有效行的下标
+    inline size_t row(size_t i) const { return selected ? selection[i] : i; }
+};
+
+// 判断域是否按整数解码
+bool isIntegerField(const FieldInfo &field);
+// 大序的整数值解码成long long。整数类型都是无符号的，1、2、4字节零扩展，
+// 与存储层、过滤和聚集的无符号比较一致
+long long decodeInteger(const unsigned char *data, unsigned int length);
+
+////
+// @brief
+// 算子接口
+//
+class Operator
+{
+  public:
+    virtual ~Operator() {}
+    // 取下一批，没有更多数据返回false
+    virtual bool next(Batch &batch) = 0;
+};
+
+////
+// @brief
+// 多个Scan并行扫描一张表时共享的block分配器
+// 与ParallelScan一样枚举[1, maxid]上的blockid，每次领取一个morsel
+//
+class Morsels
+{
+  private:
+    std::atomic<unsigned int> next_; // 下一个未分配的blockid
+    unsigned int maxid_;             // 最大blockid
+    unsigned int size_;              // morsel大小
+
+  public:
+    Morsels(Table *table, unsigned int size = MORSEL_BLOCKS);
+
+    // 领取一个morsel，[start, stop)，没有剩余返回false
+    bool take(unsigned int &start, unsigned int &stop);
+};
+
+////
+// @brief
+// 扫描，按Plan选择的访问路径读取block
+// 每批持有表latch的共享锁，批之间不持有；其间表被修改过时，block可能已
+// 分裂、合并或回收，下一批按上一批最后的键重新定位。不是快照，批之间
+// 插入或删除的记录可能读到也可能读不到，按键有序的扫描不会重复。不拷贝
+// 的批指向借用的block，用完前调用者须持有共享锁，如SELECT整条语句持有。
+//
+class Scan : public Operator
+{
+  private:
+    Table *table_;                     // 表
+    std::vector<bool> needed_;         // 需要解码的列
+    int access_;                       // 访问路径
+    std::string low_;                  // 键的下界
+    std::string high_;                 // 键的上界
+    bool highInclusive_;               // 上界是否包含
+    unsigned int blkid_;               // 当前block
+    unsigned short index_;             // 当前block中下一条记录
+    bool done_;                        // 是否结束
+    std::shared_ptr<Morsels> morsels_; // 并行扫描的block分配器
+    unsigned int stop_;                // 当前morsel的结束
+    bool copying_;                     // 字节串拷进批，不保持借用
+    bool started_;                     // 是否已定位第1个block
+    unsigned long long epoch_;         // 上一批结束时表latch的epoch
+    std::string last_;                 // 上一批最后一条记录的键
+    const unsigned char *lastKey_;     // decode中最后一条记录的键
+    unsigned int lastLength_;          // 及其长度
+
+  public:
+    // fields是需要解码的列，plan为NULL表示全表扫描
+    // copying为true时每个block解码完就归还，最多借用一个block
+    Scan(
+        Table *table,
+        const std::vector<unsigned int> &fields,
+        const Plan *plan = NULL,
+        bool copying = false);
+    // 从morsels领取block的全表扫描，不沿数据链，输出不按键有序
+    Scan(
+        Table *table,
+        const std::vector<unsigned int> &fields,
+        std::shared_ptr<Morsels> morsels);
+    bool next(Batch &batch);
+
+  private:
+    // 定位第1个block
+    void start();
+    // 上一批之后表被修改过，按上一批最后的键重新定位blkid_和index_
+    void relocate();
+    // 解码block中从index_开始的记录，返回是否还有剩余记录
+    bool decode(DataBlock &block, Batch &batch);
+};
+
+////
+// @brief
+// 过滤，条件之间是AND
+//
+class Filter : public Operator
+{
+  private:
+    // 预先解码的条件
+    struct Condition
+    {
+        unsigned int field; // 列
+        int op;             // 运算符
+        bool integer;       // 是否整数比较
+        long long value;    // 整数值
+        std::string key;    // 字节串值
+    };
+
+  private:
+    std::unique_ptr<Operator> child_;   // 输入
+    RelationInfo *info_;                // 元数据
+    std::vector<Condition> conditions_; // 条件
+
+  public:
+    Filter(
+        std::unique_ptr<Operator> child,
+        RelationInfo *info,
+        const std::vector<Predicate> &predicates);
+    bool next(Batch &batch);
+
+  private:
+    // 在选择向量上应用一个条件
+    void apply(const Condition &cond, Batch &batch);
+};
+
+////
+// @brief
+// 投影，输出的第i列是输入的第fields[i]列
+//
+class Project : public Operator
+{
+  private:
+    std::unique_ptr<Operator> child_;  // 输入
+    std::vector<unsigned int> fields_; // 输出列
+
+  public:
+    Project(
+        std::unique_ptr<Operator> child,
+        const std::vector<unsigned int> &fields)
+        : child_(std::move(child))
+        , fields_(fields)
+    {}
+    bool next(Batch &batch);
+};
+
+////
+// @brief
+// 最多输出limit行
+//
+class Limit : public Operator
+{
+  private:
+    std::unique_ptr<Operator> child_; // 输入
+    long long remain_;                // 剩余行数
+
+  public:
+    Limit(std::unique_ptr<Operator> child, long long limit)
+        : child_(std::move(child))
+        , remain_(limit)
+    {}
+    bool next(Batch &batch);
+};
+
+////
+// @brief
+// 不分组的聚集，输出一批一行，每个聚集一个整数列
+// SUM/MIN/MAX只支持整数列
+//
+class Aggregate : public Operator
+{
+  private:
+    std::unique_ptr<Operator> child_;        // 输入
+    std::vector<Aggregation> aggregations_; // 聚集
+    bool done_;                              // 是否已输出
+
+  public:
+    Aggregate(
+        std::unique_ptr<Operator> child,
+        const std::vector<Aggregation> &aggregations)
+        : child_(std::move(child))
+        , aggregations_(aggregations)
+        , done_(false)
+    {}
+    bool next(Batch &batch);
+};
+
+////
+// @brief
+// 分组聚集用的开放寻址hash表，线性探查
+// 每个分组占entries_中定长的一项，前面是分组键，后面是各聚集的状态(long long)；
+// 槽位只存hash值和项的下标，探查时先比较hash，命中再比较键，探查序列上的槽位连续。
+//
+class GroupTable
+{
+  private:
+    struct Slot
+    {
+        unsigned int hash;  // 分组键的hash
+        unsigned int entry; // 项的下标+1，0表示空槽
+    };
+
+  private:
+    size_t keyWidth_;                   // 键的宽度
+    size_t width_;                      // 项的宽度，8字节对齐
+    std::vector<Slot> slots_;           // 槽位，个数是2的幂
+    std::vector<unsigned char> entries_; // 项
+    size_t count_;                      // 项数
+
+  public:
+    GroupTable(size_t keyWidth = 0, size_t width = 0)
+        : keyWidth_(keyWidth)
+        , width_(width)
+        , count_(0)
+    {}
+
+    // 查找分组，不存在则插入，inserted返回是否新插入
+    // 返回的指针在下一次插入前有效
+    unsigned char *upsert(
+        const unsigned char *key,
+        unsigned int hash,
+        bool &inserted);
+    // 释放所有内存
+    void clear();
+
+    inline size_t count() const { return count_; }
+    inline unsigned char *entry(size_t index)
+    {
+        return entries_.data() + index * width_;
+    }
+    // 占用的内存
+    inline size_t memory() const
+    {
+        return slots_.capacity() * sizeof(Slot) + entries_.capacity();
+    }
+
+  private:
+    // 槽位加倍，按保存的hash重新放置
+    void grow();
+};
+
+////
+// @brief
+// 分组聚集
+// 1. 每个输入是一条独立的流水线，各自作为kScheduler上的任务运行，线程之间不共享状态；
+// 2. 每个线程按分组键hash的高AGG_PARTITION_BITS位把分组分到AGG_PARTITIONS个分区，
+//    每个分区一张GroupTable，在线程内预聚集；
+// 3. 一个线程占用的内存超过memory/线程数时，把各分区的部分结果追加到该分区的临时文件
+//    (FilePool::temporary)，然后清空；
+// 4. 输入结束后，各分区并行合并：合并所有线程在内存中的部分结果和溢出的部分结果，
+//    不同分区的分组互不相交，合并时不需要加锁；
+// 5. 输出各分组，分组列在前，之后每个聚集一个整数列，分组的顺序不确定。
+// 合并时假定单个分区能放进内存。字节串分组列指向聚集内部，Batch在算子析构前有效。
+//
+class HashAggregate : public Operator
+{
+  private:
+    // 一个线程的局部状态
+    struct Local
+    {
+        std::vector<GroupTable> partitions; // 各分区
+        std::vector<std::string> spills;    // 各分区的临时文件，空表示没有
+        std::vector<unsigned long long> sizes; // 各分区溢出的字节数
+    };
+
+  private:
+    std::vector<std::unique_ptr<Operator>> children_; // 输入，每个线程一个
+    RelationInfo *info_;                               // 输入的元数据
+    std::vector<unsigned int> groups_;                 // 分组列
+    std::vector<Aggregation> aggregations_;            // 聚集
+    size_t memory_;                                    // 内存上限
+    size_t keyWidth_;                                  // 分组键的宽度
+    size_t width_;                                     // 项的宽度
+    std::vector<Local> locals_;                        // 各线程的局部状态
+    std::vector<GroupTable> results_;                  // 合并后的各分区
+    bool built_;                                       // 是否已聚集
+    size_t partition_;                                 // 正在输出的分区
+    size_t index_;                                     // 分区中下一个分组
+    std::atomic<size_t> spilled_;                      // 溢出的次数
+
+  public:
+    HashAggregate(
+        std::vector<std::unique_ptr<Operator>> children,
+        RelationInfo *info,
+        const std::vector<unsigned int> &groups,
+        const std::vector<Aggregation> &aggregations,
+        size_t memory = AGG_MEMORY);
+    ~HashAggregate();
+    bool next(Batch &batch);
+
+    // 溢出到临时文件的次数
+    inline size_t spilled() const { return spilled_.load(); }
+
+  private:
+    // 一个线程消费一条输入
+    void consume(size_t worker);
+    // 聚集一批
+    void accumulate(Local &local, Batch &batch);
+    // 局部结果写入临时文件
+    void spill(Local &local);
+    // 合并一个分区
+    void merge(size_t partition);
+    // 把项合并到分区中
+    void combine(GroupTable &table, const unsigned char *entry);
+};
+
+////
+// @brief
+// hash连接，等值连接，build端建hash表，probe端逐批探测
+// 1. build端的行序列化后按hash的高位分到AGG_PARTITIONS个分区，每个分区一张hash表，
+//    行的开头是hash和连接键，探测时先比较hash再比较键；
+// 2. build端超过内存上限时，把最大的分区写到临时文件，之后该分区的行都追加到文件；
+// 3. probe端落在溢出分区的行也写到该分区的临时文件，其它行直接探测；
+// 4. probe端结束后，逐个装入溢出的分区，再读回该分区的probe行探测。
+// 字节串连接键忽略CHAR末尾补的0。
+// 输出的字节串列指向probe批或内部缓冲，在下一次调用next()前有效。
+//
+class HashJoin : public Operator
+{
+  private:
+    // 一个分区
+    struct Partition
+    {
+        std::vector<unsigned char> rows;  // 序列化的build行，溢出后作写缓冲
+        std::vector<size_t> offsets;      // 各行的开始
+        std::vector<unsigned int> heads;  // hash表，行号+1，0表示空
+        std::vector<unsigned int> nexts;  // 同一槽位上的下一行
+        std::vector<unsigned char> probe; // 溢出分区的probe行写缓冲
+        std::string files[2];             // build、probe的临时文件
+        unsigned long long sizes[2];      // 临时文件的长度
+        bool spilled;                     // 是否溢出
+
+        Partition()
+            : spilled(false)
+        {
+            sizes[0] = sizes[1] = 0;
+        }
+    };
+
+  private:
+    std::unique_ptr<Operator> children_[2]; // build、probe输入
+    RelationInfo *infos_[2];                // build、probe的元数据
+    std::vector<unsigned int> fields_[2];   // build、probe解码的列
+    unsigned int keys_[2];                  // build、probe的连接列
+    unsigned int offsets_[2];               // build、probe在输出中的开始列
+    unsigned int columns_;                  // 输出的列数
+    size_t memory_;                         // 内存上限
+    std::vector<Partition> partitions_;     // 各分区
+    bool integer_;                          // 连接列是否整数
+    bool built_;                            // build端是否已处理
+    bool probing_;                          // 是否还在读probe输入
+    Batch probe_;                           // 当前probe批
+    size_t row_;                            // probe批中的下一行
+    int partition_;                         // 正在处理的溢出分区
+    std::vector<unsigned char> chunk_;      // 读回的probe行
+    size_t chunkPos_;                       // chunk_中下一行
+    size_t chunkLen_;                       // chunk_中的字节数
+    unsigned long long fileOffset_;         // probe临时文件的读位置
+    std::vector<unsigned char> scratch_;    // probe批中行的连接键
+    const unsigned char *current_;          // 正在匹配的probe行，序列化格式
+    bool fromBatch_;                        // current_是否来自probe批
+    size_t probeRow_;                       // current_在probe批中的行
+    Partition *matching_;                   // current_所在的分区
+    unsigned int match_;                    // 匹配的build行，行号+1
+    size_t spilled_;                        // 溢出的分区数
+
+  public:
+    // buildLeft表示build端是连接的左边
+    HashJoin(
+        std::unique_ptr<Operator> build,
+        std::unique_ptr<Operator> probe,
+        RelationInfo *buildInfo,
+        RelationInfo *probeInfo,
+        const std::vector<unsigned int> &buildFields,
+        const std::vector<unsigned int> &probeFields,
+        unsigned int buildKey,
+        unsigned int probeKey,
+        bool buildLeft,
+        size_t memory = JOIN_MEMORY);
+    ~HashJoin();
+    bool next(Batch &batch);
+
+    // 溢出的分区数
+    inline size_t spilled() const { return spilled_; }
+
+  private:
+    // 把批中的一行追加到out，side为0表示build端，keyOnly表示只要hash和连接键
+    void serialize(
+        int side,
+        const Batch &batch,
+        size_t row,
+        bool keyOnly,
+        std::vector<unsigned char> &out);
+    // 读取build输入，建立hash表
+    void build();
+    // build端内存超过上限时，把最大的未溢出分区写到临时文件
+    void spillLargest();
+    // 缓冲追加到临时文件，side为0表示build端
+    void flush(Partition &partition, int side);
+    // 为一个分区建立hash表
+    void index(Partition &partition);
+    // 装入溢出的build行
+    void load(Partition &partition);
+    // 读回更多溢出的probe行
+    bool readChunk();
+    // 从match_开始找current_的匹配，没有返回false
+    bool findMatch();
+    // 取下一个有匹配的probe行，reload表示可以换批，没有返回false
+    bool advance(bool reload);
+    // 输出current_和match_
+    void emit(Batch &batch);
+    // 序列化的列写入批，side为0表示build端
+    void deserialize(int side, const unsigned char *row, Batch &batch);
+};
+
+////
+// @brief
+// 归并连接，两边的输入都按连接列升序且连接列没有重复，即按主键连接
+// 输出的字节串列指向两边的输入批，在下一次调用next()前有效。
+//
+class MergeJoin : public Operator
+{
+  private:
+    std::unique_ptr<Operator> children_[2]; // 左右输入
+    RelationInfo *infos_[2];                // 左右的元数据
+    unsigned int keys_[2];                  // 左右的连接列
+    Batch batches_[2];                      // 左右的当前批
+    size_t rows_[2];                        // 左右批中的下一行
+    bool done_;                             // 是否结束
+
+  public:
+    MergeJoin(
+        std::unique_ptr<Operator> left,
+        std::unique_ptr<Operator> right,
+        RelationInfo *leftInfo,
+        RelationInfo *rightInfo,
+        unsigned int leftKey,
+        unsigned int rightKey);
+    bool next(Batch &batch);
+};
+
+////
+// @brief
+// 外排序，按一列排序
+// 1. 与HashAggregate一样，每个输入是一条独立的流水线，各自作为kScheduler上的任务运行；
+// 2. 行序列化后追加到线程的缓冲，同时算出8字节的规范化前缀：整数是无符号值，
+//    字节串是前8个字节按大序拼成的整数，降序时取反。排序只搬动16字节的(前缀, 偏移)，
+//    前缀相同时字节串再比较完整的值；
+// 3. 线程的缓冲超过memory/线程数时，排好序作为一个run，经kBuffer按block写入
+//    临时文件(FilePool::temporary)，block由buffer淘汰时写回；
+// 4. 输入结束后，各线程最后的缓冲在内存中排序，与所有run一起用败者树多路归并；
+// 5. 有LIMIT时只需要前limit行：缓冲超过2*limit行时截断，run也只写前limit行。
+// 归并时每个文件run借用一个block，假定run的个数不超过buffer的容量。
+// 输出的字节串列指向内部缓冲，在下一次调用next()前有效。
+//
+class Sort : public Operator
+{
+  private:
+    // 缓冲中的一行
+    struct Entry
+    {
+        unsigned long long prefix; // 规范化前缀
+        size_t offset;             // 行在缓冲中的开始
+    };
+    // 一个线程的局部状态
+    struct Local
+    {
+        std::vector<unsigned char> rows;       // 序列化的行
+        std::vector<Entry> entries;            // 各行
+        std::vector<std::string> files;        // 写出的run
+        std::vector<unsigned long long> sizes; // 各run的字节数
+    };
+    // 归并的一路
+    struct Run
+    {
+        Local *local;                   // 内存中的run，NULL表示文件
+        size_t index;                   // 内存run中的下一项
+        std::string file;               // 临时文件
+        TableId id;                     // 临时文件的编号
+        unsigned long long size;        // 文件长度
+        unsigned long long offset;      // 文件中的读位置
+        BufDesp *pin;                   // 借用的block
+        std::vector<unsigned char> row; // 从文件读出的当前行
+        const unsigned char *current;   // 当前行，NULL表示结束
+
+        Run()
+            : local(NULL)
+            , index(0)
+            , id(TABLE_NONE)
+            , size(0)
+            , offset(0)
+            , pin(NULL)
+            , current(NULL)
+        {}
+    };
+
+  private:
+    std::vector<std::unique_ptr<Operator>> children_; // 输入，每个线程一个
+    std::vector<bool> integers_;       // 输出各列是否整数
+    std::vector<unsigned int> fields_; // 带上的列，排序列在最前
+    unsigned int key_;                 // 排序列
+    bool integer_;                     // 排序列是否整数
+    bool desc_;                        // 是否降序
+    long long limit_;                  // 只需要的行数，-1表示全部
+    size_t memory_;                    // 内存上限
+    std::vector<Local> locals_;        // 各线程的局部状态
+    std::vector<Run> runs_;            // 归并的各路
+    std::vector<int> tree_;            // 败者树，tree_[0]是胜者
+    bool built_;                       // 是否已生成run
+    long long emitted_;                // 已输出的行数
+    std::vector<unsigned char> output_; // 当前批的行
+    std::atomic<size_t> spilled_;      // 写出的run个数
+
+  public:
+    // integers给出输入各列是否整数，fields是需要带到输出的列
+    Sort(
+        std::vector<std::unique_ptr<Operator>> children,
+        const std::vector<bool> &integers,
+        const std::vector<unsigned int> &fields,
+        unsigned int key,
+        bool desc,
+        long long limit = -1,
+        size_t memory = SORT_MEMORY);
+    ~Sort();
+    bool next(Batch &batch);
+
+    // 写到临时文件的run个数
+    inline size_t spilled() const { return spilled_.load(); }
+
+  private:
+    // 一个线程消费一条输入
+    void consume(size_t worker);
+    // 批中的一行追加到缓冲
+    void append(Local &local, const Batch &batch, size_t row);
+    // 排序缓冲，有LIMIT时只留前limit行
+    void arrange(Local &local);
+    // 只留前limit行并压缩缓冲
+    void truncate(Local &local);
+    // 缓冲排序后写成run
+    void spill(Local &local);
+    // 比较两个序列化的行，x排在y前面返回true
+    bool less(const unsigned char *x, const unsigned char *y) const;
+    // 从run的读位置读length字节
+    bool read(Run &run, unsigned char *out, size_t length);
+    // 取run的下一行
+    void fetch(Run &run);
+    // run的当前行变化后，从叶子到根重新比赛
+    void replay(int run);
+    // 序列化的行写入批
+    void deserialize(const unsigned char *row, Batch &batch);
+};
+
+////
+// @brief
+// 游标，由消费者逐批拉取SELECT的结果
+// 消费者不拉取时执行就停在原处，只占当前一批的内存；扫描把字节串拷进批，
+// 每个block解码完就归还，任何时候最多借用一个block。
+// 取一批时持有表latch的共享锁，停在原处时不持有，也不指向任何block，
+// 增删改可以照常进行；下一批由扫描按上一批最后的键重新定位。
+// 游标引用执行器打开的表，不能比打开它的执行器活得长。
+//
+class Cursor
+{
+    friend class Executor;
+
+  private:
+    Plan plan_;                      // 计划的副本，算子引用其中的元数据
+    std::unique_ptr<Operator> root_; // 算子树，NULL表示没有更多结果
+    Batch batch_;                    // 当前批
+    size_t rows_;                    // 已取出的行数
+    Table *tables_[2];               // 读的表，连接时有两张
+
+  public:
+    Cursor()
+        : rows_(0)
+    {
+        tables_[0] = tables_[1] = NULL;
+    }
+    ~Cursor() { close(); }
+    Cursor(const Cursor &) = delete;
+    Cursor &operator=(const Cursor &) = delete;
+
+    // 取下一批，结果取完返回false并关闭游标
+    bool next();
+    // 当前批，下一次next前有效
+    inline Batch &batch() { return batch_; }
+    // 已取出的行数
+    inline size_t rows() const { return rows_; }
+    // 是否还有结果
+    inline bool active() const { return root_ != nullptr; }
+    // 提前关闭，释放算子和当前批
+    void close();
+};
+
+////
+// @brief
+// 执行器，执行planner生成的计划
+// 执行器缓存打开的表，各执行器打开的是进程内共享的同一个Table，表的b+树
+// 在首次打开时初始化，之后由增删改维护；增删改整条语句持有表latch_的
+// 排他锁，SELECT整条语句持有共享锁，visitor中不能修改读的表
+//
+class Executor
+{
+  public:
+    using Visitor = std::function<void(Batch &batch)>;
+
+  private:
+    std::map<std::string, Table *> tables_; // 打开的表，指向共享的表
+
+  public:
+    // 对打开过的表做checkpoint
+    ~Executor();
+
+    // 打开表，表不存在返回NULL
+    Table *open(const std::string &name);
+    // 为SELECT计划构建算子树，copying见Scan
+    int build(
+        Plan &plan,
+        std::unique_ptr<Operator> &root,
+        bool copying = false);
+    // 执行计划，SELECT的结果逐批交给visitor，affected返回增删改的行数
+    int execute(Plan &plan, const Visitor &visitor, size_t *affected = NULL);
+    // 执行计划，SELECT在cursor上打开，由调用者拉取；其它语句直接执行
+    int open(Plan &plan, Cursor &cursor, size_t *affected = NULL);
+
+  private:
+    // 为连接计划构建两边的输入和连接算子
+    int join(
+        Plan &plan,
+        const std::vector<unsigned int> &fields,
+        std::unique_ptr<Operator> &root,
+        bool copying);
+    int insert(Plan &plan);
+    int remove(Plan &plan, size_t &affected);
+    int update(Plan &plan, size_t &affected);
+};
+
+} // namespace db
+
+#endif // __DB_EXEC_H__
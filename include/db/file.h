@@ -10,7 +10,10 @@
 #define __DB_FILE_H__
 
 #include "./config.h"
-#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace db {
 
@@ -35,27 +38,62 @@ class File
     int write(unsigned long long offset, const char *buffer, size_t length);
     // 文件长度
     int length(unsigned long long &len);
+    // 截断到len字节
+    int truncate(unsigned long long len);
+    // 为[offset, offset+length)预分配磁盘空间，文件不足时延长，内容读出为0
+    int allocate(unsigned long long offset, unsigned long long length);
     // 删除文件
     static int remove(const char *path);
 };
 
+// 表的编号，表名由Schema::intern一次性换成编号，目录、文件池和buffer都以
+// 编号为键，热路径上不再做字符串操作
+using TableId = unsigned int;
+const TableId TABLE_NONE = (TableId) -1; // 无效编号
+// 不属于任何表空间的文件，例如临时文件，其block不做表空间校验
+const unsigned int SPACE_NONE = (unsigned int) -1;
+
 // 文件池
 class Schema;
 class FilePool
 {
   private:
-    Schema *schema_;                   // 指向元数据
-    std::map<const char *, File> map_; // 表名 --> 描述符
+    // 打开的文件
+    struct Entry
+    {
+        std::unique_ptr<File> file; // 描述符
+        unsigned int spaceid;       // 表空间id
+
+        Entry()
+            : spaceid(SPACE_NONE)
+        {}
+    };
+
+  private:
+    Schema *schema_;           // 指向元数据
+    std::vector<Entry> files_; // 表编号 --> 文件
+    std::mutex mutex_;         // 保护files_
+    unsigned int temporaries_;                 // 临时文件编号
 
   public:
     FilePool()
         : schema_(NULL)
+        , temporaries_(0)
     {}
 
     // 初始化
     void init(Schema *schema);
-    // 打开table
+    // 打开table，已打开的直接返回，spaceid返回表空间id
+    File *open(TableId table, unsigned int *spaceid = NULL);
     File *open(const char *table);
+    // 已打开的文件，未打开返回NULL，不查schema
+    File *find(TableId table, unsigned int *spaceid = NULL);
+    // 表名换成编号
+    TableId intern(const char *table);
+    // 创建临时文件，name返回文件名，用完后调用drop删除
+    File *temporary(std::string &name);
+    // 关闭并删除临时文件
+    void drop(const std::string &name);
 };
 
 // 全局文件池
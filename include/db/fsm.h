@@ -0,0 +1,82 @@
+////
+// @file fsm.h
+// @brief
+// 空闲空间映射(free space map)
+// 1. 每个block在映射中占1个字节，FSM_IDLE表示空闲块，数据块记录至少还有
+//    value*FSM_UNIT字节的空闲空间，超块、溢出块等其它block记为0；
+// 2. 映射整个缓存在内存中，分配空闲块、判断一个block能否放下一条记录都不用
+//    读block；
+// 3. 映射按FSM_ENTRIES切成页，每页另记空闲块的个数作为第二级摘要，找空闲块
+//    时跳过没有空闲块的页；
+// 4. 页存放在BLOCK_TYPE_FSM类型的block中，从超块的fsm开始用next相连。空闲
+//    与否的变化由Table随即写到页上，空闲空间只是提示，checkpoint时才写回。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_FSM_H__
+#define __DB_FSM_H__
+
+#include <vector>
+#include "./block.h"
+
+namespace db {
+
+const unsigned char FSM_IDLE = 0xff;           // 空闲块
+const unsigned int FSM_UNIT = BLOCK_SIZE / 256; // 空闲空间的粒度
+// 每页的项数，页中留出头部和trailer
+const unsigned int FSM_ENTRIES =
+    BLOCK_SIZE - sizeof(MetaHeader) - sizeof(Trailer);
+
+class FreeSpaceMap
+{
+  private:
+    std::vector<unsigned char> map_;  // blockid --> 空闲空间
+    std::vector<unsigned int> idles_; // 每页的空闲块个数
+    std::vector<unsigned int> pages_; // 每页所在的blockid
+
+  public:
+    // 映射覆盖的block个数
+    inline size_t size() const { return map_.size(); }
+    // 改变覆盖的block个数，新增的记为0
+    void resize(size_t count);
+    // 一个block的值，超出范围的记为0
+    inline unsigned char get(unsigned int blockid) const
+    {
+        return blockid < map_.size() ? map_[blockid] : 0;
+    }
+    // 设定一个block的值，超出范围时先扩展
+    void set(unsigned int blockid, unsigned char value);
+
+    // 不小于start的最小空闲块，没有返回0
+    unsigned int findIdle(unsigned int start = 1) const;
+    // 空闲块个数
+    size_t idles() const;
+    // block是否还能放下length字节
+    inline bool room(unsigned int blockid, size_t length) const
+    {
+        unsigned char value = get(blockid);
+        return value != FSM_IDLE && value * FSM_UNIT >= length;
+    }
+    // 数据块的空闲空间对应的值，向下取整
+    static inline unsigned char encode(size_t freesize)
+    {
+        size_t value = freesize / FSM_UNIT;
+        return (unsigned char) (value < FSM_IDLE ? value : FSM_IDLE - 1);
+    }
+
+    // 页数
+    inline size_t pages() const { return pages_.size(); }
+    // 第index页所在的blockid
+    inline unsigned int page(size_t index) const { return pages_[index]; }
+    // 追加一页
+    inline void addPage(unsigned int blockid) { pages_.push_back(blockid); }
+    // 把第index页的内容写到data，不足一页的部分填0
+    void store(size_t index, unsigned char *data) const;
+    // 从data读入第index页
+    void load(size_t index, const unsigned char *data);
+};
+
+} // namespace db
+
+#endif // __DB_FSM_H__
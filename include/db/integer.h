@@ -2,6 +2,9 @@
 // @file integer.h
 // @brief
 // 压缩整数
+// 首字节高2位表示长度，00/01/10/11分别是1/2/4/8字节，其余位按大序存放值。
+// 记录的偏移数组由一串压缩整数组成，encodeBatch/decodeBatch一次处理一串，
+// x86上解码用SSE2一次处理16字节的连续1字节整数或8个连续2字节整数。
 //
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
@@ -53,6 +56,22 @@ class Integer
     bool encode(char *buf, size_t len) const;
     // 解码
     bool decode(char *buf, size_t len);
+
+    // 连续编码count个整数，返回占用的字节数，空间不够或值太大返回0
+    static size_t encodeBatch(
+        const unsigned long long *values,
+        size_t count,
+        char *buf,
+        size_t len);
+    // 解码连续存放的整数，至多max个，zero为真时解码到第一个0(含)为止；
+    // 返回解码的个数，used返回占用的字节数，出错返回0
+    static size_t decodeBatch(
+        const char *buf,
+        size_t len,
+        unsigned long long *values,
+        size_t max,
+        size_t *used,
+        bool zero = false);
 };
 
 } // namespace db
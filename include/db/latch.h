@@ -0,0 +1,123 @@
+////
+// @file latch.h
+// @brief
+// 读写latch
+// C++11没有shared_mutex，这里用mutex和条件变量实现：
+// 1. 增删改和整理持有排他锁，扫描持有共享锁；
+// 2. 读者优先，只要没有写者持有就可以加共享锁。同一线程可以重复加共享锁，
+//    SELECT整条语句持有共享锁时，其中的扫描还能再加，并行扫描的工作线程
+//    也不会因为有写者在等待而死锁；
+// 3. 持有排他锁的线程可以再加共享锁，增删改内部的扫描照常工作；
+// 4. 每次释放排他锁时epoch加1，读者据此判断两次加锁之间表是否被修改过。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_LATCH_H__
+#define __DB_LATCH_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace db {
+
+////
+// @brief
+// 读者优先的读写latch
+//
+class RWLatch
+{
+  private:
+    std::mutex mutex_;                      // 保护以下状态
+    std::condition_variable cond_;          // 等待锁释放
+    unsigned int readers_;                  // 持有共享锁的个数
+    bool writing_;                          // 是否有写者持有
+    std::thread::id owner_;                 // 持有排他锁的线程
+    unsigned int nested_;                   // 写者自己加的共享锁
+    std::atomic<unsigned long long> epoch_; // 排他锁释放的次数
+
+  public:
+    RWLatch()
+        : readers_(0)
+        , writing_(false)
+        , nested_(0)
+        , epoch_(0)
+    {}
+    RWLatch(const RWLatch &) = delete;
+    RWLatch &operator=(const RWLatch &) = delete;
+
+    // 排他锁，可以配合std::lock_guard
+    inline void lock()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return !writing_ && readers_ == 0; });
+        writing_ = true;
+        owner_ = std::this_thread::get_id();
+    }
+    inline void unlock()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writing_ = false;
+            owner_ = std::thread::id();
+            epoch_.fetch_add(1);
+        }
+        cond_.notify_all();
+    }
+
+    // 共享锁
+    inline void lock_shared()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (writing_ && owner_ == std::this_thread::get_id()) {
+            ++nested_;
+            return;
+        }
+        cond_.wait(lock, [this]() { return !writing_; });
+        ++readers_;
+    }
+    inline void unlock_shared()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (nested_ && owner_ == std::this_thread::get_id()) {
+                --nested_;
+                return;
+            }
+            if (--readers_ > 0) return;
+        }
+        cond_.notify_all();
+    }
+
+    // 排他锁释放的次数
+    inline unsigned long long epoch() const { return epoch_.load(); }
+};
+
+////
+// @brief
+// 作用域内持有共享锁，latch为NULL时什么也不做
+//
+class SharedGuard
+{
+  private:
+    RWLatch *latch_;
+
+  public:
+    explicit SharedGuard(RWLatch *latch)
+        : latch_(latch)
+    {
+        if (latch_) latch_->lock_shared();
+    }
+    ~SharedGuard()
+    {
+        if (latch_) latch_->unlock_shared();
+    }
+    SharedGuard(const SharedGuard &) = delete;
+    SharedGuard &operator=(const SharedGuard &) = delete;
+};
+
+} // namespace db
+
+#endif // __DB_LATCH_H__
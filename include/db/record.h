@@ -18,6 +18,14 @@
 //
 // 记录的分配按照4B对齐，同时要求block头部至少按照4B对齐
 //
+// 表的所有字段都定长时采用定长格式，记录只有Header+各字段，没有总长度和
+// 字段偏移数组，各字段的位置由RecordFormat给出，读字段不用解码。
+//
+// 变长记录中过长的非键字段存到行外，记录的Header标为RECORD_FULL_START，
+// 该字段换成8B的指针(首个溢出块+总长度，大序)，末尾多一个位图字段标出
+// 哪些字段在行外；字段内容按块切开，依次存为溢出块中的MID记录，最后一块
+// 存为END记录，溢出块之间用next相连。
+//
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
@@ -28,6 +36,7 @@
 #include <vector>
 #include "./config.h"
 #include "./integer.h"
+#include "./buffer.h"
 
 const int ALIGN_SIZE = 8; // 按8B对齐
 #define ALIGN_TO_SIZE(x) ((x + ALIGN_SIZE - 1) / ALIGN_SIZE * ALIGN_SIZE)
@@ -40,14 +49,50 @@ const unsigned char RECORD_FULL_START = 0x01; // 记录开始
 const unsigned char RECORD_FULL_MID = 0x02;   // 记录中间
 const unsigned char RECORD_FULL_END = 0x03;   // 记录结束
 
+#if defined(WIN32)
 struct iovec
 {
     void *iov_base; /* Pointer to data.  */
     size_t iov_len; /* Length of data.  */
 };
+#else
+#    include <sys/uio.h>
+#endif
 
 namespace db {
 
+// RecordLayout能解码的最大字段数，meta记录的字段数也受此限制
+const unsigned int RECORD_MAX_FIELDS = 256;
+
+////
+// @brief
+// 定长记录的格式，建表时由各字段的长度算出
+//
+struct RecordFormat
+{
+    // 各字段从Header开始的偏移，多出的最后一项是记录长度
+    std::vector<unsigned short> offsets;
+
+    // 按各字段长度生成格式，记录超过max时返回false
+    bool init(const std::vector<unsigned int> &widths, size_t max);
+    // 各字段的长度是否与格式一致
+    bool match(const std::vector<struct iovec> &iov) const;
+
+    // 字段个数
+    inline size_t count() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+    // 记录长度，含头部，未对齐
+    inline unsigned short length() const { return offsets.back(); }
+    // 第i个字段的偏移和长度
+    inline unsigned short offset(size_t i) const { return offsets[i]; }
+    inline unsigned short width(size_t i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+};
+
 // 物理记录
 class Record
 {
@@ -55,28 +100,36 @@ class Record
     static const int HEADER_SIZE = 1; // 头部1B
 
   public:
-    unsigned char *buffer_; // 记录buffer
-    unsigned short length_; // buffer长度
+    unsigned char *buffer_;      // 记录buffer
+    unsigned short length_;      // buffer长度
+    const RecordFormat *format_; // 定长格式，NULL表示变长记录
 
   public:
     Record()
         : buffer_(NULL)
         , length_(0)
+        , format_(NULL)
     {}
 
-    // 关联buffer
-    inline void attach(unsigned char *buffer, unsigned short length)
+    // 关联buffer，format为NULL表示变长记录
+    inline void attach(
+        unsigned char *buffer,
+        unsigned short length,
+        const RecordFormat *format = NULL)
     {
         buffer_ = buffer;
         length_ = length;
+        format_ = format;
     }
     inline void detach()
     {
         buffer_ = nullptr;
         length_ = 0;
+        format_ = NULL;
     }
-    // 整个记录长度+header偏移量
-    static size_t size(std::vector<struct iovec> &iov);
+    // 整个记录长度+header偏移量，定长记录就是格式中的长度
+    static size_t
+    size(std::vector<struct iovec> &iov, const RecordFormat *format = NULL);
 
     // 向buffer里写各个域，返回按照对齐后的长度
     bool set(std::vector<struct iovec> &iov, const unsigned char *header);
@@ -128,6 +181,115 @@ class Record
     {
         return (*buffer_ & RECORD_MASK_FULL) == RECORD_FULL_END;
     }
+
+  private:
+    // 按定长格式写各字段
+    bool setFixed(std::vector<struct iovec> &iov, const unsigned char *header);
+};
+
+////
+// @brief
+// 记录的字段位置表
+// 单趟解码变长记录的逆序偏移数组，各字段的位置放在对象内的定长数组中，
+// 此后取任意字段都是O(1)，不分配内存；定长记录直接取RecordFormat中的偏移，
+// 格式不变时重用上次的偏移表，只换记录指针。
+//
+class RecordLayout
+{
+  private:
+    unsigned char *buffer_;      // 记录
+    const RecordFormat *format_; // 偏移表对应的定长格式，NULL表示变长
+    unsigned int count_;         // 字段个数，0表示未解码或出错
+    // 各字段从Header开始的偏移，多出的一项是记录长度
+    unsigned short offsets_[RECORD_MAX_FIELDS + 1];
+
+  public:
+    RecordLayout()
+        : buffer_(NULL)
+        , format_(NULL)
+        , count_(0)
+    {}
+
+    // 解码record的字段位置，失败返回false
+    bool decode(const Record &record);
+    inline void clear()
+    {
+        buffer_ = NULL;
+        format_ = NULL;
+        count_ = 0;
+    }
+
+    // 字段个数
+    inline size_t count() const { return count_; }
+    // 第i个字段
+    inline unsigned char *data(size_t i) const { return buffer_ + offsets_[i]; }
+    inline unsigned int length(size_t i) const
+    {
+        return offsets_[i + 1] - offsets_[i];
+    }
+    // 第i个字段从Header开始的偏移
+    inline unsigned short offset(size_t i) const { return offsets_[i]; }
+    // 记录长度，未对齐
+    inline unsigned short total() const { return offsets_[count_]; }
+};
+
+////
+// @brief
+// 行视图，直接引用block中记录的各字段，不拷贝
+// 视图借用记录所在的block一次，release或析构时归还，期间字段指针一直有效；
+// 视图只读，调用者要保证借用期间记录不被修改。
+//
+class RowView
+{
+  private:
+    BufDesp *desp_;        // 借用的block，NULL表示空视图
+    unsigned char header_; // 记录头部
+    RecordLayout layout_;  // 各字段在block中的位置
+
+  public:
+    RowView()
+        : desp_(NULL)
+        , header_(0)
+    {}
+    ~RowView() { release(); }
+    // 拷贝的视图再借用一次block
+    RowView(const RowView &other);
+    RowView &operator=(const RowView &other);
+
+    // 解码desp中的记录，成功时借用desp一次
+    bool attach(BufDesp *desp, Record &record);
+    // 归还借用的block，视图变空
+    void release();
+
+    // 是否引用了记录
+    inline bool valid() const { return desp_ != NULL; }
+    // 字段个数，不含行外字段的位图
+    inline size_t count() const
+    {
+        return spanning() ? layout_.count() - 1 : layout_.count();
+    }
+    // 第i个字段是否在行外，此时字段是溢出链的指针，用Table::fetch读出
+    inline bool overflowed(size_t i) const
+    {
+        if (!spanning() || i >= count()) return false;
+        return (layout_.data(count())[i / 8] >> (i % 8)) & 1;
+    }
+    // 第i个字段
+    inline const unsigned char *data(size_t i) const { return layout_.data(i); }
+    inline unsigned int length(size_t i) const { return layout_.length(i); }
+    // 记录头部
+    inline unsigned char header() const { return header_; }
+    inline bool isactive() const
+    {
+        return !(header_ & RECORD_MASK_TOMBSTONE);
+    }
+    // 是否有行外字段
+    inline bool spanning() const
+    {
+        return (header_ & RECORD_MASK_FULL) == RECORD_FULL_START;
+    }
+    // 记录所在的block
+    inline unsigned int blockid() const { return desp_ ? desp_->blockid : 0; }
 };
 
 } // namespace db
@@ -0,0 +1,53 @@
+////
+// @file scan.h
+// @brief
+// 并行表扫描
+// 数据链是单链表，只能顺序遍历。并行扫描不走数据链，而是枚举[1, maxid]上所有的blockid，
+// 跳过非数据块。blockid区间被切成若干morsel(若干个连续block)，每个工作线程先处理分给自
+// 己的区间，处理完后再从其它线程的区间里窃取morsel，直到所有morsel处理完毕。
+// 除当前线程外，其它worker以任务的形式运行在kScheduler上。
+// 扫描不保证记录按键的顺序输出。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SCAN_H__
+#define __DB_SCAN_H__
+
+#include <functional>
+#include "./block.h"
+
+namespace db {
+
+const unsigned int MORSEL_BLOCKS = 16; // 每个morsel的block个数
+
+class Table;
+class ParallelScan
+{
+  public:
+    // 处理一个数据块，worker是线程号，[0, workers)
+    // 通过block.beginrecord()/endrecord()遍历该块上的记录
+    using Visitor = std::function<void(unsigned int worker, DataBlock &block)>;
+
+  private:
+    Table *table_;         // 被扫描的表
+    unsigned int workers_; // 线程个数
+    unsigned int morsel_;  // morsel大小
+
+  public:
+    // workers为0表示采用调度器的线程数+1
+    ParallelScan(
+        Table *table,
+        unsigned int workers = 0,
+        unsigned int morsel = MORSEL_BLOCKS);
+
+    // 线程个数
+    inline unsigned int workers() const { return workers_; }
+
+    // 扫描所有数据块，返回扫描的数据块个数
+    size_t run(const Visitor &visitor);
+};
+
+} // namespace db
+
+#endif // __DB_SCAN_H__
@@ -0,0 +1,127 @@
+////
+// @file scheduler.h
+// @brief
+// 任务调度器
+// 引擎内所有后台和并行工作(并行扫描、刷盘、预读、索引构建等)都提交到一个全局调度器，
+// 而不是各自创建线程：
+// 1. 每个核一个工作线程，每个线程有自己的任务队列；
+// 2. 线程优先从自己的队列尾部取任务(LIFO)，队列空了再从其它线程队列头部窃取(FIFO)；
+// 3. 任务分为前台查询、刷盘、预读三个优先级，高优先级任务总是先被取走；
+// 4. 长任务可以调用yield()让出，在当前线程上执行一个等待中的任务；
+// 5. 等待TaskGroup的线程不会阻塞，而是帮忙执行任务；
+// 6. 异步读block的阻塞读由Buffer自己的IO线程完成，读完后回调才提交到这里。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SCHEDULER_H__
+#define __DB_SCHEDULER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace db {
+
+const int TASK_FOREGROUND = 0; // 前台查询
+const int TASK_FLUSH = 1;      // 刷盘、日志
+const int TASK_PREFETCH = 2;   // 预读
+const int TASK_PRIORITIES = 3; // 优先级个数
+
+using Task = std::function<void()>;
+
+////
+// @brief
+// 任务组，用于等待一组任务结束
+//
+class TaskGroup
+{
+  private:
+    std::atomic<size_t> pending_; // 未完成的任务数
+
+  public:
+    TaskGroup()
+        : pending_(0)
+    {}
+
+    inline void add() { pending_.fetch_add(1); }
+    inline void done() { pending_.fetch_sub(1); }
+    inline bool finished() const { return pending_.load() == 0; }
+};
+
+class Scheduler
+{
+  private:
+    // 队列中的任务
+    struct Entry
+    {
+        Task task;        // 任务
+        TaskGroup *group; // 所属任务组，可以为NULL
+    };
+    // 工作线程
+    struct Worker
+    {
+        std::mutex mutex;                         // 保护queues
+        std::deque<Entry> queues[TASK_PRIORITIES]; // 各优先级任务队列
+        std::thread thread;                       // 线程
+    };
+
+  private:
+    std::vector<Worker *> workers_;   // 工作线程
+    std::atomic<bool> stop_;          // 停止标志
+    std::atomic<size_t> queued_;      // 排队中的任务数
+    std::atomic<unsigned int> round_; // 外部线程提交任务时轮转
+    std::mutex sleepMutex_;           // 空闲线程睡眠
+    std::condition_variable sleep_;   // 唤醒空闲线程
+    std::once_flag once_;             // 只初始化一次
+
+  public:
+    Scheduler()
+        : stop_(false)
+        , queued_(0)
+        , round_(0)
+    {}
+    ~Scheduler() { shutdown(); }
+
+    // 启动工作线程，threads为0表示采用硬件线程数，多次调用只有第1次生效
+    void init(unsigned int threads = 0);
+    // 停止所有工作线程，未执行的任务被丢弃
+    void shutdown();
+
+    // 提交任务
+    void spawn(
+        Task task,
+        int priority = TASK_FOREGROUND,
+        TaskGroup *group = NULL);
+    // 等待任务组结束，等待期间执行其它任务
+    void wait(TaskGroup &group);
+    // 让出当前线程，执行一个等待中的任务，没有任务返回false
+    bool yield();
+
+    // 工作线程个数
+    inline unsigned int workers() const
+    {
+        return (unsigned int) workers_.size();
+    }
+    // 当前线程在调度器中的编号，非工作线程返回-1
+    static int current();
+
+  private:
+    // 工作线程主循环
+    void loop(int index);
+    // 取一个任务，index是当前线程编号
+    bool take(int index, Entry &entry);
+    // 执行任务
+    void run(Entry &entry);
+};
+
+// 全局调度器
+extern Scheduler kScheduler;
+
+} // namespace db
+
+#endif // __DB_SCHEDULER_H__
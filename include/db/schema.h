@@ -8,6 +8,17 @@
 // 3. 域的个数；
 // 4. 各域的描述；（变长）
 // 5. 各种统计信息，表的大小，行数等；
+// 6. 表空间id，放在最后，老版本的记录没有这一项。
+//
+// 每张表create时分配一个表空间id，盖在该表所有block的头部。Buffer借用时
+// 记下block应属的表空间，读入和写回时核对，发现写错位置的block。
+//
+// meta.db的超块first指向第1个meta块，meta块通过next串成链，一个块满了
+// 就在链尾再接一个。open时只扫描各块中记录的表名，记下记录所在的块和
+// slot，表的定义在第一次lookup时才解码，表很多时启动不必反序列化全部定义。
+//
+// 表名intern成TableId，表空间、FilePool和Buffer都以TableId为键，
+// 按表名查找只在入口处做一次散列。
 //
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
@@ -16,13 +27,25 @@
 #define __DB_SCHEMA_H__
 
 #include <string>
-#include <map>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
+#include <atomic>
 #include "./datatype.h"
+#include "./file.h"
 #include "./record.h"
 
 namespace db {
 
+// 关系的类型，决定记录格式
+const unsigned short RELATION_VARIABLE = 0; // 变长记录
+const unsigned short RELATION_FIXED = 1;    // 所有字段定长，采用定长记录
+
+// 表空间id
+const unsigned int SPACE_META = 0;   // meta.db
+const unsigned int SPACE_LEGACY = 1; // 分配表空间id之前建的表都盖的是1
+
 // 描述关系的域
 // 持久化的信息包括：name、index、length、type->name
 // name是字段名，index是字段的下标，length表示字段的长度，type->name是字段的类型名
@@ -50,6 +73,8 @@ struct RelationInfo
     unsigned long long size;       // 大小
     unsigned long long rows;       // 行数
     std::vector<FieldInfo> fields; // 各域的描述
+    unsigned int spaceid;          // 表空间id
+    RecordFormat format;           // 定长记录的格式，不持久化，由fields算出
 
     RelationInfo()
         : count(0)
@@ -57,6 +82,7 @@ struct RelationInfo
         , key(0)
         , size(0)
         , rows(0)
+        , spaceid(SPACE_META)
     {}
     RelationInfo(const char *p)
         : path(p)
@@ -65,9 +91,15 @@ struct RelationInfo
         , key(0)
         , size(0)
         , rows(0)
+        , spaceid(SPACE_META)
     {}
     // 根据关系属性得到iov的维度
-    int iovSize() { return 7 + count * 4; }
+    int iovSize() { return 8 + count * 4; }
+    // 定长表返回记录格式，变长表返回NULL
+    inline const RecordFormat *recordFormat() const
+    {
+        return type == RELATION_FIXED ? &format : NULL;
+    }
 };
 
 ////
@@ -78,17 +110,36 @@ class Buffer;
 class Schema
 {
   public:
-    using TableSpace = std::map<std::string, RelationInfo>;
+    using TableSpace = std::unordered_map<TableId, RelationInfo>;
 
   public:
-    static const char *META_FILE; // "_meta.db"
+    static const char *META_FILE;    // "_meta.db"
+    static const TableId META_ID = 0; // meta.db总是第一个intern
+
+  private:
+    // 尚未加载的表定义在meta.db中的位置
+    struct Location
+    {
+        unsigned int blockid; // meta块
+        unsigned short slot;  // 块内的slot
+    };
+    using Catalog = std::unordered_map<TableId, Location>;
 
   private:
     Buffer *buffer_;        // 缓冲层
-    TableSpace tablespace_; // 表空间
+    std::mutex mutex_;      // 保护以下四个成员，不跨越borrow
+    std::unordered_map<std::string, TableId> ids_; // 表名 --> 编号
+    std::deque<std::string> names_; // 编号 --> 表名，引用不会失效
+    TableSpace tablespace_; // 表空间，已加载的表
+    Catalog catalog_;       // 未加载的表
+    std::mutex meta_;       // 串行化create，保护meta链
     unsigned int maxid_;    // 最大的blockid
     unsigned int idle_;     // 空闲链
     unsigned int first_;    // meta链
+    unsigned int last_;     // meta链的最后一块，新表写在这里
+    unsigned int blocks_;   // meta链的块数
+    unsigned int maxspace_; // 已分配的最大表空间id，受meta_保护
+    std::atomic<unsigned long long> version_; // 目录的版本，create后递增
 
   public:
     Schema()
@@ -96,17 +147,38 @@ class Schema
         , maxid_(0)
         , idle_(0)
         , first_(0)
-    {}
+        , last_(0)
+        , blocks_(0)
+        , maxspace_(SPACE_LEGACY)
+        , version_(0)
+    {
+        ids_[META_FILE] = META_ID;
+        names_.push_back(META_FILE);
+    }
 
     // 初始化全局schema
     void init(Buffer *buffer);
 
-    // 打开并加载元数据
+    // 打开元数据，只登记表名和位置
     void open();
     // 创建表
     int create(const char *table, RelationInfo &rel);
-    // 搜索表
+    // 搜索表，定义未加载时从meta块解码
+    std::pair<TableSpace::iterator, bool> lookup(TableId table);
     std::pair<TableSpace::iterator, bool> lookup(const char *table);
+    // 表名换成编号，同一个名字总是得到同一个编号，不要求表存在
+    TableId intern(const char *table);
+    // 编号对应的表名
+    const std::string &name(TableId table);
+    // 目录的版本，缓存的计划据此判断是否失效
+    inline unsigned long long version() const { return version_.load(); }
+
+    // 表的个数，包括meta自身
+    size_t size();
+    // 已加载定义的表的个数
+    size_t loaded();
+    // meta链的块数
+    size_t blocks();
 
   public:
     // 将table的关系的相关属性，塞到iov里
@@ -120,6 +192,14 @@ class Schema
         std::vector<struct iovec> &iov);
     void betoh(std::vector<struct iovec> &iov);
     void htobe(std::vector<struct iovec> &iov);
+
+  private:
+    // 从meta块解码一张表的定义
+    void load(const Location &loc, RelationInfo &info);
+    // 在meta链尾接上一块，调用者持有meta_
+    void extend();
+    // 表名换成编号，没有则分配，调用者持有mutex_
+    TableId assign(const std::string &table);
 };
 
 // 初始化数据库全局变量，缺省buffer大小为256MB
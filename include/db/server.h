@@ -0,0 +1,244 @@
+////
+// @file server.h
+// @brief
+// 网络服务器
+// 1. 一个accept线程加上若干reactor线程，每个reactor有自己的epoll，
+//    新连接轮流分给各reactor，此后只在该reactor上处理；
+// 2. 每个连接对应一个Session，预备语句和执行器随连接存活；
+// 3. 请求和响应都是帧，客户可以连发多个请求不等响应(pipelining)，
+//    服务器按顺序处理读缓冲中所有完整的帧，响应按请求的顺序返回，
+//    一轮处理完再统一发送；
+// 4. SELECT在会话的游标上打开，逐批拉取并编码成ROWS帧，写缓冲积累到一定
+//    大小就尝试发送；客户不读时响应积压，超过SERVER_PENDING就停止拉取，
+//    也不再读该连接的请求，等积压发出后从游标停下的地方继续，
+//    所以再大的结果集每个连接也只占常数内存。
+//
+// 帧格式，整数都是大序：
+// | length(4) | type(1) | payload |
+// length不含自身的4B，包括type和payload。
+//
+// 请求：
+// QUERY    SQL文本
+// PREPARE  SQL文本
+// EXECUTE  id(4) count(2) 参数...
+// CLOSE    id(4)
+// 参数和结果中的值：tag(1)，0是整数，后跟value(8)；1是字节串，
+// 后跟len(4)和字节。
+//
+// 响应：
+// ROWS     count(2) columns(2) 值...，按行存放
+// DONE     affected(8)，SELECT是返回的行数
+// PREPARED id(4) params(2)
+// ERROR    code(4) 错误信息
+// 一个请求的响应是若干ROWS之后跟DONE，或者是PREPARED、ERROR。
+//
+// epoll只在linux上有，服务器只在linux上编译。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#ifndef __DB_SERVER_H__
+#define __DB_SERVER_H__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./session.h"
+
+namespace db {
+
+// 请求类型
+const unsigned char MSG_QUERY = 1;   // 执行SQL
+const unsigned char MSG_PREPARE = 2; // 准备语句
+const unsigned char MSG_EXECUTE = 3; // 执行预备语句
+const unsigned char MSG_CLOSE = 4;   // 关闭预备语句
+// 响应类型
+const unsigned char MSG_ROWS = 0x81;     // 一批结果
+const unsigned char MSG_DONE = 0x82;     // 执行完毕
+const unsigned char MSG_PREPARED = 0x83; // 语句已准备
+const unsigned char MSG_ERROR = 0x84;    // 出错
+
+// 值的tag
+const unsigned char VALUE_INTEGER = 0; // 整数
+const unsigned char VALUE_BYTES = 1;   // 字节串
+
+const size_t FRAME_HEADER = 5;                 // 帧头长度
+const size_t FRAME_MAX = 16 * 1024 * 1024;     // 请求帧的最大长度
+const size_t SERVER_FLUSH = 256 * 1024;        // 写缓冲超过该值就尝试发送
+const size_t SERVER_PENDING = 4 * 1024 * 1024; // 积压超过该值暂停读请求
+const unsigned int SERVER_PORT = 5432;         // 缺省端口
+const unsigned int SERVER_BACKLOG = 128;       // listen队列长度
+const unsigned int SERVER_EVENTS = 64;         // 一次epoll_wait取的事件数
+
+class Server
+{
+  private:
+    // 连接
+    struct Connection
+    {
+        int fd;              // socket
+        std::string in;      // 读缓冲
+        std::string out;     // 写缓冲
+        size_t sent;         // 写缓冲中已发送的字节
+        unsigned int events; // 在epoll上登记的事件
+        bool closing;        // 协议出错，发完响应后关闭
+        Session session;     // 会话
+        Cursor cursor;       // 正在返回的结果，引用session，须在其后析构
+
+        Connection()
+            : fd(-1)
+            , sent(0)
+            , events(0)
+            , closing(false)
+        {}
+    };
+
+    // reactor，连接只在所属的reactor线程上访问
+    struct Reactor
+    {
+        int epoll;                // epoll描述符
+        int wakeup;               // eventfd，唤醒reactor
+        std::thread thread;       // 线程
+        std::mutex mutex;         // 保护pending
+        std::vector<int> pending; // accept线程交过来的新连接
+        std::map<int, std::unique_ptr<Connection>> connections; // fd --> 连接
+
+        Reactor()
+            : epoll(-1)
+            , wakeup(-1)
+        {}
+    };
+
+  private:
+    int listen_;                     // 监听socket
+    int epoll_;                      // accept线程的epoll
+    int wakeup_;                     // 唤醒accept线程
+    unsigned short port_;            // 监听的端口
+    std::atomic<bool> running_;      // 是否在运行
+    std::thread acceptor_;           // accept线程
+    std::vector<std::unique_ptr<Reactor>> reactors_; // reactor
+    std::atomic<size_t> accepted_;   // 累计接受的连接数
+    std::atomic<size_t> paused_;     // 累计因积压暂停的次数
+
+  public:
+    Server()
+        : listen_(-1)
+        , epoll_(-1)
+        , wakeup_(-1)
+        , port_(0)
+        , running_(false)
+        , accepted_(0)
+        , paused_(0)
+    {}
+    ~Server() { stop(); }
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    // 在address:port上监听，port为0时由系统分配，reactors为0时取cpu个数
+    int start(
+        const char *address,
+        unsigned short port = SERVER_PORT,
+        unsigned int reactors = 0);
+    // 关闭所有连接并停止
+    void stop();
+
+    // 监听的端口
+    inline unsigned short port() const { return port_; }
+    // 累计接受的连接数
+    inline size_t accepted() const { return accepted_.load(); }
+    // 累计因响应积压暂停拉取结果或处理请求的次数
+    inline size_t paused() const { return paused_.load(); }
+
+  private:
+    // accept线程
+    void acceptLoop();
+    // reactor线程
+    void reactorLoop(Reactor &reactor);
+    // 接收reactor上的新连接
+    void adopt(Reactor &reactor);
+    // 读socket，返回false表示关闭连接
+    bool receive(Connection &conn);
+    // 按顺序处理读缓冲中完整的帧，未发出的响应太多时暂停
+    void process(Connection &conn);
+    // 从游标拉取结果直到取完或积压太多
+    void stream(Connection &conn);
+    // 处理一个请求帧
+    void dispatch(
+        Connection &conn,
+        unsigned char type,
+        const unsigned char *payload,
+        size_t length);
+    // 尽量发送写缓冲，返回false表示连接出错
+    bool flush(Connection &conn);
+    // 按写缓冲是否发完调整EPOLLOUT，返回false表示关闭连接
+    bool rearm(Reactor &reactor, Connection &conn);
+    // 关闭连接
+    void drop(Reactor &reactor, int fd);
+};
+
+////
+// @brief
+// 阻塞的客户端，请求先放入写缓冲，flush一次发出，可以连发多个请求
+//
+class Client
+{
+  public:
+    // 一个响应
+    struct Response
+    {
+        unsigned char type;                    // 响应类型
+        long long affected;                    // DONE的行数
+        unsigned int id;                       // PREPARED的语句编号
+        unsigned int params;                   // PREPARED的参数个数
+        int code;                              // ERROR的错误码
+        std::string error;                     // ERROR的错误信息
+        std::vector<std::vector<Value>> rows;  // ROWS的结果
+
+        Response()
+            : type(0)
+            , affected(0)
+            , id(0)
+            , params(0)
+            , code(0)
+        {}
+    };
+
+  private:
+    int fd_;          // socket
+    std::string out_; // 待发的请求
+    std::string in_;  // 读缓冲
+
+  public:
+    Client()
+        : fd_(-1)
+    {}
+    ~Client() { close(); }
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    // 连接服务器
+    int connect(const char *address, unsigned short port);
+    // 关闭连接
+    void close();
+
+    // 把请求放入写缓冲
+    void query(const char *sql);
+    void prepare(const char *sql);
+    void execute(unsigned int id, const std::vector<Value> &params);
+    void closeStatement(unsigned int id);
+    // 发出写缓冲中的所有请求
+    int flush();
+
+    // 读一个响应帧
+    int receive(Response &response);
+    // 读一个请求的完整响应，ROWS合并到response.rows中
+    int result(Response &response);
+};
+
+} // namespace db
+
+#endif // __DB_SERVER_H__
@@ -2,6 +2,12 @@
 // @file session.h
 // @brief
 // 客户会话
+// 1. Session持有预备语句，语句用"?"表示参数，执行时绑定；
+// 2. 所有会话共享一个计划缓存，以规范化的语句文本为键，重复执行同一语句时
+//    跳过解析和planner，只拷贝计划并绑定参数；
+// 3. 缓存的计划记录生成时的schema版本，Schema::create改变目录后全部失效，
+//    预备语句在执行时发现版本变化则重新生成计划；
+// 4. SELECT可以在游标上打开，结果由调用者按需拉取。
 //
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
@@ -9,10 +15,143 @@
 #ifndef __DB_SESSION_H__
 #define __DB_SESSION_H__
 
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "./exec.h"
+#include "./sql.h"
+
 namespace db {
+
+const size_t PLAN_CACHE_SIZE = 1024; // 计划缓存的缺省容量
+
+////
+// @brief
+// 计划缓存，按lru淘汰，多个会话并发访问
+//
+class PlanCache
+{
+  private:
+    struct Item
+    {
+        std::shared_ptr<const Plan> plan;           // 计划
+        std::list<std::string>::iterator position; // 在lru中的位置
+    };
+
+  private:
+    std::mutex mutex_;               // 保护以下成员
+    std::map<std::string, Item> map_; // 语句文本 --> 计划
+    std::list<std::string> lru_;     // 最近使用的在头部
+    size_t capacity_;                // 容量
+    unsigned long long version_;     // 缓存的计划对应的schema版本
+    size_t hits_;                    // 命中次数
+    size_t misses_;                  // 未命中次数
+
+  public:
+    PlanCache(size_t capacity = PLAN_CACHE_SIZE)
+        : capacity_(capacity)
+        , version_(0)
+        , hits_(0)
+        , misses_(0)
+    {}
+
+    // 查找计划，version是当前的schema版本，版本变化时先清空缓存
+    std::shared_ptr<const Plan>
+    find(const std::string &text, unsigned long long version);
+    // 加入计划，version是生成计划前的schema版本，已过时则不加入
+    void insert(
+        const std::string &text,
+        unsigned long long version,
+        const std::shared_ptr<const Plan> &plan);
+    // 清空
+    void clear();
+
+    // 缓存的计划个数，命中和未命中次数
+    size_t size();
+    size_t hits();
+    size_t misses();
+};
+
+// 全局计划缓存
+extern PlanCache kPlans;
+
 // 每个会话对应于一个客户连接，代理客户的SQL请求
+// 会话不是线程安全的，一个会话同一时刻只在一个线程上执行
 class Session
-{};
+{
+  public:
+    using Visitor = Executor::Visitor;
+
+  private:
+    // 预备语句
+    struct Prepared
+    {
+        std::string text;                 // 规范化的语句
+        std::shared_ptr<const Plan> plan; // 计划，NULL表示已关闭
+        unsigned long long version;       // 计划对应的schema版本
+
+        Prepared()
+            : version(0)
+        {}
+    };
+
+  private:
+    SQL sql_;                          // 解析和planner
+    Executor executor_;                // 执行器，缓存打开的表
+    std::vector<Prepared> statements_; // 预备语句，下标是语句编号
+    std::string error_;                // 最近一次错误
+
+  public:
+    // 准备一条语句，id返回语句编号
+    int prepare(const char *sql, unsigned int &id);
+    // 绑定参数执行预备语句，SELECT的结果逐批交给visitor
+    int execute(
+        unsigned int id,
+        const std::vector<Value> &params,
+        const Visitor &visitor = Visitor(),
+        size_t *affected = NULL);
+    // 直接执行一条不带参数的语句，同样经过计划缓存
+    int execute(
+        const char *sql,
+        const Visitor &visitor = Visitor(),
+        size_t *affected = NULL);
+    // 与execute相同，但SELECT的结果在cursor上打开，由调用者逐批拉取，
+    // 调用者不拉取时执行就暂停；游标不能比会话活得长
+    int open(
+        unsigned int id,
+        const std::vector<Value> &params,
+        Cursor &cursor,
+        size_t *affected = NULL);
+    int open(const char *sql, Cursor &cursor, size_t *affected = NULL);
+    // 关闭预备语句
+    int close(unsigned int id);
+
+    // 语句的参数个数
+    size_t params(unsigned int id) const;
+    // 最近一次错误
+    inline const std::string &error() const { return error_; }
+
+  private:
+    // 从缓存中取计划，没有则解析并生成，version返回计划对应的schema版本
+    int lookup(
+        const std::string &text,
+        std::shared_ptr<const Plan> &plan,
+        unsigned long long &version);
+    // 取预备语句的计划并绑定参数
+    int bound(
+        unsigned int id,
+        const std::vector<Value> &params,
+        Plan &plan);
+    // 取不带参数的语句的计划
+    int parsed(const char *sql, Plan &plan);
+    // 执行计划的副本
+    int run(Plan &plan, const Visitor &visitor, size_t *affected);
+    // 在游标上打开计划的副本
+    int start(Plan &plan, Cursor &cursor, size_t *affected);
+};
 } // namespace db
 
-#endif //  __DB_SESSION_H__
\ No newline at end of file
+#endif //  __DB_SESSION_H__
@@ -2,6 +2,26 @@
 // @file sql.h
 // @brief
 // 解析SQL语句，生成执行计划
+// 支持的SQL子集：
+// 1. CREATE TABLE t (col type [PRIMARY KEY], ... [, PRIMARY KEY (col)])
+// 2. INSERT INTO t [(col, ...)] VALUES (v, ...)
+// 3. SELECT * | item, ... FROM t [[INNER] JOIN t2 ON col = col] [WHERE ...]
+//    [GROUP BY col, ...] [ORDER BY col [ASC|DESC]] [LIMIT n]
+//    item是列名或聚集函数COUNT(*)、COUNT(col)、SUM(col)、MIN(col)、MAX(col)
+//    列名可以写成t.col
+// 4. UPDATE t SET col = v, ... [WHERE ...]
+// 5. DELETE FROM t [WHERE ...]
+// WHERE是若干个"col op 字面值"用AND连接，op为= != <> < <= > >=。
+// INSERT、SET和WHERE中的字面值可以写成参数"?"，执行前由bind绑定。
+//
+// 解析得到Statement，再由planner结合schema生成逻辑计划Plan，计划选择访问路径：
+// 1. 键上有等值条件，走b+树点查(Table::search)；
+// 2. 键上有范围条件，从locate(下界)开始沿数据链扫描，超过上界停止；
+// 3. 否则全表扫描。
+// 连接时左表按上述规则选择访问路径，右表全表扫描；两边都按主键连接用归并连接，
+// 否则用hash连接，行数少的表建hash表。
+// 字面值在计划中已按域的类型编码成记录中的格式(大序)，执行时可以直接比较；
+// 参数在计划中只记下位置，绑定时编码，左表条件中有参数时绑定后重新选择访问路径。
 //
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
@@ -9,9 +29,346 @@
 #ifndef __DB_SQL_H__
 #define __DB_SQL_H__
 
+#include <string>
+#include <vector>
+#include "./schema.h"
+
 namespace db {
+
+// 词法单元类型
+const int TOKEN_END = 0;    // 结束
+const int TOKEN_IDENT = 1;  // 标识符或关键字
+const int TOKEN_NUMBER = 2; // 整数
+const int TOKEN_STRING = 3; // 字符串
+const int TOKEN_SYMBOL = 4; // 符号
+
+// 比较运算符
+const int OP_EQ = 0; // =
+const int OP_NE = 1; // != <>
+const int OP_LT = 2; // <
+const int OP_LE = 3; // <=
+const int OP_GT = 4; // >
+const int OP_GE = 5; // >=
+
+// 语句类型
+const int STMT_CREATE = 1;
+const int STMT_INSERT = 2;
+const int STMT_SELECT = 3;
+const int STMT_UPDATE = 4;
+const int STMT_DELETE = 5;
+
+// 聚集函数
+const int AGG_COUNT = 0;
+const int AGG_SUM = 1;
+const int AGG_MIN = 2;
+const int AGG_MAX = 3;
+
+// 连接方法
+const int JOIN_NONE = 0;  // 没有连接
+const int JOIN_HASH = 1;  // hash连接
+const int JOIN_MERGE = 2; // 归并连接，两边都按连接列有序
+
+// 参数在计划中的位置
+const int PARAM_ROW = 0;    // INSERT的记录
+const int PARAM_FILTER = 1; // 左表条件
+const int PARAM_RIGHT = 2;  // 右表条件
+const int PARAM_SET = 3;    // UPDATE的赋值
+
+// 访问路径
+const int ACCESS_NONE = 0;  // 不访问表，CREATE/INSERT
+const int ACCESS_INDEX = 1; // b+树点查
+const int ACCESS_RANGE = 2; // 键范围扫描
+const int ACCESS_FULL = 3;  // 全表扫描
+
+struct Token
+{
+    int type;         // 类型
+    std::string text; // 文本，字符串已去掉引号
+    size_t pos;       // 在语句中的位置
+
+    Token()
+        : type(TOKEN_END)
+        , pos(0)
+    {}
+};
+
+// 字面值
+struct Value
+{
+    bool string;      // 是否字符串
+    long long number; // 整数值
+    std::string text; // 字符串值
+    int param;        // 参数"?"的序号，-1表示字面值
+
+    Value()
+        : string(false)
+        , number(0)
+        , param(-1)
+    {}
+};
+
+// 条件 column op value
+struct Predicate
+{
+    std::string column; // 列名
+    int op;             // 运算符
+    Value value;        // 字面值
+    unsigned int field; // 列的下标，planner填写
+    std::string key;    // 按列类型编码后的值，planner填写
+
+    Predicate()
+        : op(OP_EQ)
+        , field(0)
+    {}
+};
+
+// UPDATE中的 column = value
+struct Assignment
+{
+    std::string column; // 列名
+    Value value;        // 字面值
+    unsigned int field; // 列的下标，planner填写
+    std::string data;   // 编码后的值，planner填写
+
+    Assignment()
+        : field(0)
+    {}
+};
+
+// SELECT中的聚集函数
+struct AggregateCall
+{
+    int func;           // 聚集函数
+    std::string column; // 列名，COUNT(*)为空
+    size_t position;    // 在SELECT列表中的位置
+
+    AggregateCall()
+        : func(AGG_COUNT)
+        , position(0)
+    {}
+};
+
+// 聚集描述
+struct Aggregation
+{
+    int func;  // 聚集函数
+    int field; // 输入列，COUNT(*)为-1
+
+    Aggregation(int f = AGG_COUNT, int c = -1)
+        : func(f)
+        , field(c)
+    {}
+};
+
+// 列定义
+struct ColumnDef
+{
+    std::string name; // 列名
+    std::string type; // 类型名，大写
+    long long length; // 括号中的长度，没有为0
+    bool primary;     // 是否主键
+
+    ColumnDef()
+        : length(0)
+        , primary(false)
+    {}
+};
+
+// 解析结果
+struct Statement
+{
+    int kind;          // 语句类型
+    std::string table; // 表名
+    std::string join;  // JOIN的表，空表示没有
+    std::string on[2]; // ON两边的列
+
+    std::vector<ColumnDef> defs; // CREATE的列
+
+    std::vector<std::string> columns; // INSERT的列，SELECT的投影，空表示全部
+    std::vector<Value> values;        // INSERT的值
+
+    std::vector<AggregateCall> aggregates; // SELECT中的聚集
+    std::vector<std::string> groupBy;      // GROUP BY的列
+
+    std::vector<Assignment> sets; // UPDATE的赋值
+    std::vector<Predicate> where; // WHERE，AND连接
+
+    std::string orderBy; // ORDER BY列，空表示没有
+    bool desc;           // 是否降序
+    long long limit;     // LIMIT，-1表示没有
+    size_t params;       // 参数个数
+
+    Statement()
+        : kind(0)
+        , desc(false)
+        , limit(-1)
+        , params(0)
+    {}
+};
+
+// 参数在计划中的位置，绑定时按列的类型编码后写入
+struct Parameter
+{
+    int target;             // 写入的位置，PARAM_*
+    size_t index;           // 记录的域，或者条件、赋值的下标
+    const FieldInfo *field; // 列
+
+    Parameter()
+        : target(PARAM_ROW)
+        , index(0)
+        , field(NULL)
+    {}
+};
+
+// 逻辑计划
+struct Plan
+{
+    int kind;            // 语句类型
+    std::string table;   // 表名
+    RelationInfo *info;  // 表的元数据，CREATE为NULL
+    RelationInfo create; // CREATE生成的关系
+
+    std::vector<std::string> row; // INSERT编码后的记录，按域的顺序
+
+    int join;                // 连接方法
+    std::string right;       // 右表名
+    RelationInfo *rightInfo; // 右表的元数据
+    RelationInfo joined;     // 连接的输出，左表的域之后是右表的域
+    unsigned int leftKey;    // 左表的连接列
+    unsigned int rightKey;   // 右表的连接列
+    bool buildLeft;          // hash连接时用左表建hash表
+    std::vector<Predicate> rightFilters; // 右表上的条件，下标是右表中的
+
+    int access;            // 访问路径
+    std::string low;       // 键的下界，空表示没有
+    bool lowInclusive;     // 下界是否包含
+    std::string high;      // 键的上界，空表示没有
+    bool highInclusive;    // 上界是否包含
+    std::vector<Predicate> filters; // 所有条件，含已用于访问路径的键条件；
+                                    // 连接时只含左表上的条件
+
+    std::vector<Assignment> sets;        // UPDATE的赋值
+    std::vector<unsigned int> groupBy;    // 分组列
+    std::vector<Aggregation> aggregates;  // 聚集
+    // 输出的列；有聚集或分组时下标指向聚集的输出，即分组列之后是各聚集；
+    // 分组、聚集、排序的列在连接时是joined中的下标
+    std::vector<unsigned int> projection;
+    int orderField; // 排序列，-1表示不排序；有分组时是聚集输出中的下标
+    bool desc;                            // 是否降序
+    bool sorted; // 访问路径的输出已按排序列有序，不需要再排序
+    long long limit; // LIMIT，-1表示没有
+    std::vector<Parameter> params; // 各参数的位置，按序号
+
+    Plan()
+        : kind(0)
+        , info(NULL)
+        , join(JOIN_NONE)
+        , rightInfo(NULL)
+        , leftKey(0)
+        , rightKey(0)
+        , buildLeft(false)
+        , access(ACCESS_NONE)
+        , lowInclusive(false)
+        , highInclusive(false)
+        , orderField(-1)
+        , desc(false)
+        , sorted(false)
+        , limit(-1)
+    {}
+};
+
+////
+// @brief
+// SQL前端，手写的递归下降解析器和planner
+// 出错时返回EINVAL等错误码，error()给出原因
+//
 class SQL
-{};
+{
+  private:
+    std::vector<Token> tokens_; // 词法单元
+    size_t current_;            // 当前词法单元
+    std::string error_;         // 错误信息
+    size_t params_;             // 已解析的参数个数
+
+  public:
+    SQL()
+        : current_(0)
+        , params_(0)
+    {}
+
+    // 解析一条语句
+    int parse(const char *sql, Statement &stmt);
+    // 根据schema生成逻辑计划，表不存在返回ENOENT
+    int plan(Statement &stmt, Plan &plan);
+    // 解析并生成计划
+    int prepare(const char *sql, Plan &plan);
+    // 按序号绑定参数，值不能再是参数
+    int bind(Plan &plan, const std::vector<Value> &values);
+    // 规范化语句文本，词法单元之间只留一个空格，去掉结尾的分号，用作计划缓存的键
+    int normalize(const char *sql, std::string &text);
+
+    // 最近一次错误
+    inline const std::string &error() const { return error_; }
+
+  private:
+    // 词法分析
+    int tokenize(const char *sql);
+
+    // 语句
+    int parseCreate(Statement &stmt);
+    int parseInsert(Statement &stmt);
+    int parseSelect(Statement &stmt);
+    int parseUpdate(Statement &stmt);
+    int parseDelete(Statement &stmt);
+    int parseWhere(Statement &stmt);
+    int parseItem(Statement &stmt);
+    int parseValue(Value &value);
+
+    // 词法单元辅助
+    inline const Token &peek() const { return tokens_[current_]; }
+    bool keyword(const char *word);          // 当前是关键字则前进
+    bool symbol(const char *sym);            // 当前是符号则前进
+    int expectKeyword(const char *word);     // 期望关键字
+    int expectSymbol(const char *sym);       // 期望符号
+    int expectIdent(std::string &ident);     // 期望标识符
+    int expectColumn(std::string &column);   // 期望列名，可以带表名
+    int fail(const std::string &message);    // 记录错误，返回EINVAL
+
+    // planner
+    int resolve(RelationInfo &info, const std::string &column, unsigned int &field);
+    int chooseAccess(RelationInfo &info, Plan &plan);
+    int planAggregate(RelationInfo &info, Statement &stmt, Plan &plan);
+    int planJoin(Statement &stmt, Plan &plan);
+    // 编码字面值，参数只记下位置
+    int literal(
+        Plan &plan,
+        const FieldInfo &field,
+        const Value &value,
+        int target,
+        size_t index,
+        std::string &out);
+    // 在FROM的表中查找列，连接时右表的列排在左表之后
+    int lookupColumn(Plan &plan, const std::string &column, unsigned int &field);
+};
+
+// 将字面值按域的类型编码成记录中的格式，类型不符或越界返回EINVAL；
+// 整数类型都是无符号的，负数也算越界
+int encodeValue(const FieldInfo &field, const Value &value, std::string &out);
+// 按域的类型比较两个编码后的值，返回<0、0、>0
+int compareValue(
+    const FieldInfo &field,
+    const unsigned char *x,
+    unsigned int xlen,
+    const unsigned char *y,
+    unsigned int ylen);
+// 判断编码后的值是否满足op
+bool matchValue(
+    const FieldInfo &field,
+    int op,
+    const unsigned char *x,
+    unsigned int xlen,
+    const std::string &value);
+
 } // namespace db
 
-#endif // __DB_SQL_H__
\ No newline at end of file
+#endif // __DB_SQL_H__
@@ -9,6 +9,9 @@
 #ifndef __DB_TABLE_H__
 #define __DB_TABLE_H__
 
+#include <string.h>
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 #include "./BPlusTree.h"
@@ -16,9 +19,85 @@
 #include "./schema.h"
 #include "./block.h"
 #include "./buffer.h"
+#include "./counter.h"
+#include "./fsm.h"
+#include "./latch.h"
 
 namespace db {
 
+// 行外字段在行内留下的指针：首个溢出块(4B)+总长度(4B)，大序
+const unsigned int OVERFLOW_POINTER = 8;
+// 超过该长度的非键字段存到行外
+const unsigned int OVERFLOW_FIELD = BLOCK_SIZE / 8;
+// 行内部分仍超过该长度时，继续把最长的字段移到行外
+const unsigned int OVERFLOW_ROW = BLOCK_SIZE / 4;
+
+// 删除后block的占用低于该值时，与后继（尾部block与前驱）合并或借记录
+const unsigned int MERGE_THRESHOLD = BLOCK_SIZE / 4;
+// 两块的占用合计不超过该值时合并成一块，否则在两块间平分
+const unsigned int MERGE_FILL = BLOCK_SIZE * 3 / 4;
+
+// 整理时目标block装到该占用为止，留出原地修改的余地
+const unsigned int COMPACT_FILL = BLOCK_SIZE * 7 / 8;
+
+// 溢出链的首个block
+inline unsigned int overflowBlock(const unsigned char *pointer)
+{
+    unsigned int blockid;
+    memcpy(&blockid, pointer, sizeof(blockid));
+    return be32toh(blockid);
+}
+// 行外字段的总长度
+inline unsigned int overflowLength(const unsigned char *pointer)
+{
+    unsigned int length;
+    memcpy(&length, pointer + sizeof(length), sizeof(length));
+    return be32toh(length);
+}
+// 位图中第i个字段是否在行外
+inline bool isOverflowed(const unsigned char *bitmap, unsigned int i)
+{
+    return (bitmap[i / 8] >> (i % 8)) & 1;
+}
+
+////
+// @brief
+// 表的统计信息
+// 打开同一张表的Table共享一份统计，计数只在内存中修改，checkpoint时才写回超块。
+//
+struct TableStat
+{
+    ShardedCounter records;    // 记录数目
+    ShardedCounter datacounts; // 数据块个数，含溢出块
+    ShardedCounter idlecounts; // 空闲块个数
+
+    // 计数器按cache line对齐，在堆上分配时也要对齐
+    static void *operator new(size_t size) { return cachelineNew(size); }
+    static void operator delete(void *ptr) { cachelineDelete(ptr); }
+};
+
+////
+// @brief
+// 在线整理的进度
+// 整理分两趟，每趟沿数据链把记录按键序紧凑地拷到新分配的block上，旧block
+// 收回。第1趟的目标block都在文件尾部，之后文件头部全部空出；第2趟从最小的
+// 空闲blockid开始依次分配，数据链因此在文件中连续，最后截掉尾部的空闲块。
+// 各批之间数据链始终完整，可以穿插前台的增删改。
+//
+struct Compaction
+{
+    int pass;                    // 第几趟，0表示没有在整理
+    unsigned int last;           // 本趟最后一个目标block，0表示还没有
+    // 整理期间收回的空闲块，映射中记为0，前台不会分配；页上仍记为空闲，
+    // 整理中断后重新打开表时照常回收
+    std::set<unsigned int> free;
+
+    Compaction()
+        : pass(0)
+        , last(0)
+    {}
+};
+
 ////
 // @brief
 // 表操作接口
@@ -35,6 +114,7 @@ class Table
         BlockIterator();
         ~BlockIterator();
         BlockIterator(const BlockIterator &other);
+        BlockIterator &operator=(const BlockIterator &other);
 
         // 前置操作
         BlockIterator &operator++();
@@ -52,35 +132,53 @@ class Table
     BPlusTree bpt;
 
   public:
-    std::string name_;   // 表名
-    RelationInfo *info_; // 表的元数据
-    unsigned int maxid_; // 最大的blockid
-    unsigned int idle_;  // 空闲链
-    unsigned int first_; // 数据链
+    std::string name_;      // 表名
+    TableId id_;            // 表的编号
+    RelationInfo *info_;    // 表的元数据
+    TableStat *stat_;       // 表的统计信息
+    FreeSpaceMap *space_;   // 空闲空间映射，打开同一张表的Table共享
+    unsigned int maxid_;    // 最大的blockid
+    unsigned int first_;    // 数据链
+    bool indexed_;          // b+树是否已初始化
+    Compaction compaction_; // 在线整理的进度
+    RWLatch latch_;         // 增删改和整理排他，扫描共享
 
   public:
     Table()
-        : info_(NULL)
+        : id_(TABLE_NONE)
+        , info_(NULL)
+        , stat_(NULL)
+        , space_(NULL)
         , maxid_(0)
-        , idle_(0)
         , first_(0)
+        , indexed_(false)
     {}
 
     // 打开一张表
     int open(const char *name);
+    // 进程内共享的表，打开同一张表的执行器都得到这一个Table，首次打开时
+    // 初始化b+树，表不存在返回NULL；从定位到修改须持有latch_的排他锁
+    static Table *shared(const char *name);
 
-    // 采用枚举的方式定位一个key在哪个block
+    // 定位一个key应在哪个block，b+树已初始化时找不大于key的最大键，
+    // 否则采用枚举的方式
     unsigned int locate(void *keybuf, unsigned int len);
-    // 定位一个block后，插入一条记录
+    // 定位一个block后，插入一条记录，键超过BPT_MAXKEY时返回EINVAL
     int insert(unsigned int blkid, std::vector<struct iovec> &iov);
+    // 删除一条记录，键不存在时返回S_FALSE
     int remove(unsigned int blkid, void *keybuf, unsigned int len);
     int update(unsigned int blkid, std::vector<struct iovec> &iov);
 
     // b+树初始化：当前table在open之后，首次需要使用到b+树搜索时，需要先调用该方法进行初始化
     // 无需二次调用：后续在table增删改时，b+树随之更新
     void BPlusTreeInit();
-    // btree搜索
+    // btree搜索，可以与插入并发，找不到返回0
     unsigned int search(void *keybuf, unsigned int len);
+    // 按主键找到记录，row直接引用block中的记录，找不到返回ENOENT
+    int view(void *keybuf, unsigned int len, RowView &row);
+
+    // 读行外字段，pointer是行内的指针，value至少有overflowLength大小
+    int fetch(const unsigned char *pointer, unsigned char *value);
 
     // 返回表上总的记录数目
     size_t recordCount();
@@ -88,16 +186,85 @@ class Table
     unsigned int dataCount();
     // 返回表上空闲块个数
     unsigned int idleCount();
+    // 将内存中的统计写回超块，空闲空间映射写回各页
+    void checkpoint();
+    // 持有latch_对所有共享的表做checkpoint，关闭时调用
+    static void checkpointAll();
+    // 超块写回文件前由Buffer调用，把内存中的统计写进超块，改写了返回true；
+    // 首次打开表时登记，持有Buffer的锁，不能借用buffer
+    static bool saveStat(BufDesp *desp);
+    // 在线整理，搬完budget个数据块后返回S_FALSE，整理完成返回S_OK，
+    // 尾部的block仍被借用、文件没有截短时返回EBUSY；
+    // 与增删改一样，调用者须持有latch_的排他锁
+    int compact(size_t budget);
 
     // block迭代器
     BlockIterator beginblock();
     BlockIterator endblock();
 
-    // 新分配一个block，返回blockid，但并没有将该block插入数据链上
-    unsigned int allocate();
+    // 新分配一个block，返回blockid，但并没有将该block插入数据链上；
+    // 优先用映射中最小的空闲块，没有才扩展文件
+    unsigned int allocate(unsigned short type = BLOCK_TYPE_DATA);
     
     // 回收一个block
     void deallocate(unsigned int blockid);
+    // 设定文件每次预分配的字节数，须是BLOCK_SIZE的倍数且不超过EXTENT_MAX，
+    // 否则返回EINVAL；从下一次预分配起生效
+    int setExtent(size_t size);
+
+  private:
+    // 加载空闲空间映射，没有映射的表逐个读block建立
+    void loadSpace(unsigned int fsm);
+    // 扩展文件得到一个新block，超出映射各页的范围时先建一页，超出已预分配
+    // 的范围时再预分配一个extent
+    unsigned int extend();
+    // 在blockid上建立映射的新页，挂到页链尾部
+    void addPage(unsigned int blockid);
+    // 映射写回各页，整理收回的空闲块在页上仍记为空闲
+    void savePages();
+    // 修改映射，空闲与否变化时随即写到页上
+    void mark(unsigned int blockid, unsigned char value);
+    // 只改页上的一项
+    void markPage(unsigned int blockid, unsigned char value);
+    // 数据块的空闲空间记到映射中
+    void note(DataBlock &data);
+    // 在blkid上插入已移出行外字段的记录，blkid满了且记录排在最后时，
+    // 映射表明后继有空间就放到后继开头，否则分裂
+    int place(
+        unsigned int blkid,
+        std::vector<struct iovec> &iov,
+        unsigned char header);
+    // 把过长的字段写到溢出链，iov中换成pointers中的指针并追加位图，
+    // header返回记录头部；行内部分仍然放不下时返回EINVAL
+    int spill(
+        std::vector<struct iovec> &iov,
+        std::string &pointers,
+        std::string &bitmap,
+        unsigned char &header);
+    // 写一条溢出链，返回首个blockid
+    unsigned int writeOverflow(const unsigned char *data, unsigned int length);
+    // 收集记录中行外字段的指针
+    void collect(Record &record, std::string &pointers);
+    // 回收pointers指向的溢出链
+    void discard(const std::string &pointers);
+    // 删除后blkid的占用过低时，与后继合并或在两块间平分，尾部block
+    // 改与前驱配对，右块移空则回收；keybuf是刚从blkid删除的键
+    void rebalance(unsigned int blkid, void *keybuf, unsigned int len);
+    // 数据链上blkid的前驱，pkey小于blkid上的所有键，没有前驱返回0
+    unsigned int
+    previous(unsigned int blkid, unsigned char *pkey, unsigned int len);
+    // 整理：把映射中的空闲块收到compaction_.free中
+    void absorbIdle();
+    // 整理：分配目标block，第2趟优先用最小的空闲块
+    unsigned int take(unsigned short type);
+    // 整理：回收旧block到compaction_.free中
+    void retire(unsigned int blockid);
+    // 整理：把一个数据块的记录搬到目标block上
+    void move(unsigned int source);
+    // 整理：搬动一条溢出链，返回新的首个blockid
+    unsigned int moveOverflow(unsigned int blockid);
+    // 整理完成：截掉尾部的空闲块，其余的在映射中标为空闲
+    int shrinkFile();
 };
 
 inline bool
@@ -1,283 +1,459 @@
-#include<db/BPlusTree.h>
-
-
-namespace db{
-
+////
+// @file BPlusTree.cc
+// @brief
+// 实现乐观锁耦合的b+树
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <string.h>
+#include <db/BPlusTree.h>
+
+namespace db {
+
+int compareKey(
+    const unsigned char *x,
+    unsigned int xlen,
+    const unsigned char *y,
+    unsigned int ylen)
+{
+    int ret = memcmp(x, y, xlen < ylen ? xlen : ylen);
+    if (ret != 0) return ret;
+    if (xlen == ylen) return 0;
+    return xlen < ylen ? -1 : 1;
+}
 
-BPlusTree::BPlusTree(){
+unsigned int
+BTreeNode::lowerBound(const unsigned char *k, unsigned int len) const
+{
+    unsigned int low = 0;
+    unsigned int high = size();
+    while (low < high) {
+        unsigned int mid = (low + high) / 2;
+        unsigned int mlen;
+        const unsigned char *mkey = key(mid, mlen);
+        if (compareKey(mkey, mlen, k, len) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
 }
 
-BPlusTree::~BPlusTree(){  
+unsigned int
+BTreeNode::upperBound(const unsigned char *k, unsigned int len) const
+{
+    unsigned int low = 0;
+    unsigned int high = size();
+    while (low < high) {
+        unsigned int mid = (low + high) / 2;
+        unsigned int mlen;
+        const unsigned char *mkey = key(mid, mlen);
+        if (compareKey(k, len, mkey, mlen) < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low;
 }
 
+void BTreeNode::putKey(unsigned int pos, const unsigned char *k, unsigned int len)
+{
+    // 键空间不够，先整理
+    if (used + len > BPT_KEYSPACE) compact();
+    memcpy(keyspace + used, k, len);
 
-void BPlusTree::insert(unsigned char* pkey, unsigned int len, unsigned int blkid) {
-    Node newNode(pkey,len);
+    // 腾出pos位置
+    for (unsigned int i = count; i > pos; --i) {
+        offsets[i] = offsets[i - 1];
+        lengths[i] = lengths[i - 1];
+    }
+    offsets[pos] = used;
+    lengths[pos] = (unsigned short) len;
+    used += (unsigned short) len;
+    live += (unsigned short) len;
+    ++count;
+}
 
-    if(root->children.empty()){//根节点的子节点信息为空，初始化根节点
-        root->children.push_back(newNode);
-        return;
+void BTreeNode::eraseKey(unsigned int pos)
+{
+    live -= lengths[pos];
+    for (unsigned int i = pos; i + 1 < count; ++i) {
+        offsets[i] = offsets[i + 1];
+        lengths[i] = lengths[i + 1];
     }
-    
-    std::pair<bool,TreeNode*> resultFind=find(root,pkey,len);
-    
-    if(!resultFind.first){//没有这个pkey才需要插入
-        if(resultFind.second->blkid==blkid){//blkid存在
-            resultFind.second->children.push_back(newNode);
-            return;
-        }
-        //blkid不存在
-        TreeNode* newLeafNode=new TreeNode(blkid);
-        newLeafNode->children.push_back(newNode);
-        insertLeafNode(newLeafNode);
+    --count;
+}
+
+void BTreeNode::compact()
+{
+    unsigned char buffer[BPT_KEYSPACE];
+    unsigned short offset = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        memcpy(buffer + offset, keyspace + offsets[i], lengths[i]);
+        offsets[i] = offset;
+        offset += lengths[i];
     }
+    memcpy(keyspace, buffer, offset);
+    used = offset;
+    live = offset;
 }
 
-void BPlusTree::insertLeafNode(TreeNode* newLeafNode) {
-    // 找到需要插入的位置，从根节点开始
-    TreeNode* current = root;
-    
-    // 用于回溯路径的栈
-    std::stack<TreeNode*> path;
-    
-    while (!current->children.empty() && current->children[0].nextNode != nullptr) {
-        path.push(current);
-        
-        // 寻找正确的子节点
-        unsigned int i = 0;
-        while (i < current->children.size() && 
-               std::memcmp(current->children[i].pkey, newLeafNode->children[0].pkey, newLeafNode->children[0].len) < 0) {
-            i++;
-        }
-        
-        if (i > 0 && std::memcmp(current->children[i - 1].pkey, newLeafNode->children[0].pkey, newLeafNode->children[0].len) == 0) {
-            i--;
+BPlusTree::BPlusTree()
+    : root_(new BTreeLeaf)
+{}
+
+BPlusTree::~BPlusTree() { destroy(root_.load()); }
+
+void BPlusTree::destroy(BTreeNode *node)
+{
+    if (!node->leaf) {
+        BTreeInner *inner = static_cast<BTreeInner *>(node);
+        for (unsigned int i = 0; i <= inner->count; ++i)
+            destroy(inner->children[i]);
+        delete inner;
+    } else
+        delete static_cast<BTreeLeaf *>(node);
+}
+
+BTreeNode *
+BPlusTree::split(BTreeNode *node, unsigned char *sep, unsigned int &seplen)
+{
+    unsigned int mid = node->count / 2;
+    unsigned int len;
+    const unsigned char *k;
+
+    if (node->leaf) {
+        // 叶子：后一半移到右兄弟，分隔键是右兄弟的第1个键
+        BTreeLeaf *leaf = static_cast<BTreeLeaf *>(node);
+        BTreeLeaf *right = new BTreeLeaf;
+        for (unsigned int i = mid; i < leaf->count; ++i) {
+            k = leaf->key(i, len);
+            right->putKey(i - mid, k, len);
+            right->blkids[i - mid] = leaf->blkids[i];
         }
-        
-        current = current->children[i].nextNode;
-    }
-    
-    // 找到当前叶子节点的位置，插入新的节点
-    unsigned int i = 0;
-    while (i < current->children.size() && 
-           std::memcmp(current->children[i].pkey, newLeafNode->children[0].pkey, newLeafNode->children[0].len) < 0) {
-        i++;
+        k = right->key(0, seplen);
+        memcpy(sep, k, seplen);
+
+        right->right = leaf->right;
+        leaf->count = (unsigned short) mid;
+        leaf->compact();
+        leaf->right = right;
+        return right;
     }
-    
-    current->children.insert(current->children.begin() + i, newLeafNode->children[0]);
-    
-    // 检查是否需要分裂叶子节点
-    if (current->children.size() > MAX_CHILDREN) {
-        TreeNode* newSibling = new TreeNode();
-        unsigned int mid = current->children.size() / 2;
-        
-        // 将后半部分移动到新节点
-        newSibling->children.assign(current->children.begin() + mid, current->children.end());
-        current->children.erase(current->children.begin() + mid, current->children.end());
-        
-        // 更新父节点的信息
-        newSibling->father = current->father;
-        if (current->father == nullptr) {
-            // 如果当前节点是根节点，创建新的根节点
-            TreeNode* newRoot = new TreeNode();
-            newRoot->children.push_back(Node(current->children[0].pkey, current->children[0].len));
-            newRoot->children[0].nextNode = current;
-            newRoot->children.push_back(Node(newSibling->children[0].pkey, newSibling->children[0].len));
-            newRoot->children[1].nextNode = newSibling;
-            current->father = newRoot;
-            newSibling->father = newRoot;
-            root = newRoot;
-        } else {
-            // 插入父节点
-            path.push(current);
-            current = current->father;
-            
-            unsigned char* midKey = newSibling->children[0].pkey;
-            insertInternalNode(current, midKey, newSibling);
-        }
+
+    // 内部节点：分隔键上移，不留在两个节点中
+    BTreeInner *inner = static_cast<BTreeInner *>(node);
+    BTreeInner *right = new BTreeInner;
+    k = inner->key(mid, seplen);
+    memcpy(sep, k, seplen);
+    for (unsigned int i = mid + 1; i < inner->count; ++i) {
+        k = inner->key(i, len);
+        right->putKey(i - mid - 1, k, len);
+        right->children[i - mid - 1] = inner->children[i];
     }
+    right->children[inner->count - mid - 1] = inner->children[inner->count];
+    inner->count = (unsigned short) mid;
+    inner->compact();
+    return right;
 }
 
-void BPlusTree::insertInternalNode(TreeNode* parent, unsigned char* pkey, TreeNode* child) {
-    unsigned int i = 0;
-    while (i < parent->children.size() && 
-           std::memcmp(parent->children[i].pkey, pkey, parent->children[i].len) < 0) {
-        i++;
-    }
-    
-    parent->children.insert(parent->children.begin() + i, Node(pkey, child->children[0].len));
-    parent->children[i].nextNode = child;
-    
-    // 检查是否需要分裂内部节点
-    if (parent->children.size() > MAX_CHILDREN) {
-        TreeNode* newSibling = new TreeNode();
-        unsigned int mid = parent->children.size() / 2;
-        
-        // 将后半部分移动到新节点
-        newSibling->children.assign(parent->children.begin() + mid, parent->children.end());
-        parent->children.erase(parent->children.begin() + mid, parent->children.end());
-        
-        // 更新父节点的信息
-        newSibling->father = parent->father;
-        if (parent->father == nullptr) {
-            // 如果当前节点是根节点，创建新的根节点
-            TreeNode* newRoot = new TreeNode();
-            newRoot->children.push_back(Node(parent->children[0].pkey, parent->children[0].len));
-            newRoot->children[0].nextNode = parent;
-            newRoot->children.push_back(Node(newSibling->children[0].pkey, newSibling->children[0].len));
-            newRoot->children[1].nextNode = newSibling;
-            parent->father = newRoot;
-            newSibling->father = newRoot;
-            root = newRoot;
-        } else {
-            // 插入父节点
-            insertInternalNode(parent->father, newSibling->children[0].pkey, newSibling);
-        }
-    }
+void BPlusTree::insertChild(
+    BTreeInner *parent,
+    const unsigned char *sep,
+    unsigned int seplen,
+    BTreeNode *child)
+{
+    unsigned int pos = parent->upperBound(sep, seplen);
+    for (unsigned int i = parent->count + 1; i > pos + 1; --i)
+        parent->children[i] = parent->children[i - 1];
+    parent->children[pos + 1] = child;
+    parent->putKey(pos, sep, seplen);
 }
 
+bool BPlusTree::insert(unsigned char *pkey, unsigned int len, unsigned int blkid)
+{
+    if (len > BPT_MAXKEY) return false;
+
+    while (true) {
+        bool restart = false;
+        BTreeNode *node = root_.load();
+        unsigned long long version = node->lock.readLock(restart);
+        if (restart || node != root_.load()) continue;
+
+        BTreeInner *parent = nullptr;
+        unsigned long long pversion = 0;
+
+        while (true) {
+            // 满节点先分裂，然后从根重新开始
+            if (node->full()) {
+                if (parent) {
+                    parent->lock.upgrade(pversion, restart);
+                    if (restart) break;
+                }
+                node->lock.upgrade(version, restart);
+                if (restart) {
+                    if (parent) parent->lock.writeUnlock();
+                    break;
+                }
+                if (!parent && node != root_.load()) {
+                    node->lock.writeUnlock();
+                    restart = true;
+                    break;
+                }
+
+                unsigned char sep[BPT_MAXKEY];
+                unsigned int seplen;
+                BTreeNode *right = split(node, sep, seplen);
+                if (parent)
+                    insertChild(parent, sep, seplen, right);
+                else {
+                    // 根分裂，树长高一层
+                    BTreeInner *root = new BTreeInner;
+                    root->children[0] = node;
+                    root->children[1] = right;
+                    root->putKey(0, sep, seplen);
+                    root_.store(root);
+                }
+                node->lock.writeUnlock();
+                if (parent) parent->lock.writeUnlock();
+                restart = true;
+                break;
+            }
 
+            if (node->leaf) break;
 
+            // 下降一层
+            if (parent) {
+                parent->lock.checkOrRestart(pversion, restart);
+                if (restart) break;
+            }
+            BTreeInner *inner = static_cast<BTreeInner *>(node);
+            parent = inner;
+            pversion = version;
+            unsigned int pos = inner->upperBound(pkey, len);
+            node = inner->children[pos > BPT_FANOUT ? BPT_FANOUT : pos];
+            inner->lock.checkOrRestart(version, restart);
+            if (restart) break;
+            version = node->lock.readLock(restart);
+            if (restart) break;
+        }
+        if (restart) continue;
+
+        // 锁定叶子
+        BTreeLeaf *leaf = static_cast<BTreeLeaf *>(node);
+        leaf->lock.upgrade(version, restart);
+        if (restart) continue;
+        if (parent) {
+            parent->lock.checkOrRestart(pversion, restart);
+            if (restart) {
+                leaf->lock.writeUnlock();
+                continue;
+            }
+        }
 
-unsigned int BPlusTree::search(unsigned char* pkey, unsigned int len){
-    return find(root,pkey,len).second->blkid;
+        unsigned int pos = leaf->lowerBound(pkey, len);
+        if (pos < leaf->count) {
+            unsigned int klen;
+            const unsigned char *k = leaf->key(pos, klen);
+            if (compareKey(k, klen, pkey, len) == 0) {
+                leaf->lock.writeUnlock();
+                return false; // 键已存在
+            }
+        }
+        for (unsigned int i = leaf->count; i > pos; --i)
+            leaf->blkids[i] = leaf->blkids[i - 1];
+        leaf->blkids[pos] = blkid;
+        leaf->putKey(pos, pkey, len);
+        leaf->lock.writeUnlock();
+        return true;
+    }
 }
 
-std::pair<bool,TreeNode*> BPlusTree::find(TreeNode* start,unsigned char* pkey, unsigned int len) { 
-    DataType::Less less;//比较器
-
-    std::vector<Node>::iterator prev;//取出节点中的一条数据
-    prev = start->children.begin();
-
-    /*
-    遍历这个节点的内容
-    1.先找到满足 pkey <= it.pkey 的位置
-    2.对于非叶子节点(nextNode不空)：
-    prev.pkey < pkey < it.pkey ：find(prev.nextNode)
-    pkey = it.pkey : find(it.nextNode)
-    3.对于叶子节点(nextNode空)：
-    prev.pkey < pkey < it.pkey ：没有这样的关键字，返回(false,start)
-    pkey = it.pkey : 要找的关键字就是当前关键字，返回(true,start)
-    */
-    for (std::vector<Node>::iterator it = start->children.begin(); it != start->children.end(); ++it) {
-        bool ret = less(it->pkey,it->len,pkey,len);
-        if(ret){//pkey > it.pkey
-            prev = it;
-            continue;
+unsigned int BPlusTree::search(unsigned char *pkey, unsigned int len)
+{
+    while (true) {
+        bool restart = false;
+        BTreeNode *node = root_.load();
+        unsigned long long version = node->lock.readLock(restart);
+        if (restart || node != root_.load()) continue;
+
+        BTreeInner *parent = nullptr;
+        unsigned long long pversion = 0;
+
+        while (!node->leaf) {
+            BTreeInner *inner = static_cast<BTreeInner *>(node);
+            unsigned int pos = inner->upperBound(pkey, len);
+            BTreeNode *child = inner->children[pos > BPT_FANOUT ? BPT_FANOUT : pos];
+            if (parent) {
+                parent->lock.checkOrRestart(pversion, restart);
+                if (restart) break;
+            }
+            inner->lock.checkOrRestart(version, restart);
+            if (restart) break;
+
+            parent = inner;
+            pversion = version;
+            node = child;
+            version = node->lock.readLock(restart);
+            if (restart) break;
+        }
+        if (restart) continue;
+        // 读到叶子的版本后再校验父节点，否则叶子可能刚分裂，键已移到右兄弟
+        if (parent) {
+            parent->lock.checkOrRestart(pversion, restart);
+            if (restart) continue;
         }
 
-
-        //pkey <= it.pkey
-        bool ret2 = less(pkey,len,it->pkey,it->len);
-        if(ret2){//pkey < it.pkey
-            if(prev->nextNode!=nullptr) {
-                return find(prev->nextNode,pkey,len);
-            }
-            return std::pair<bool,TreeNode*>(false,start); 
+        BTreeLeaf *leaf = static_cast<BTreeLeaf *>(node);
+        unsigned int pos = leaf->lowerBound(pkey, len);
+        unsigned int blkid = 0;
+        if (pos < leaf->size()) {
+            unsigned int klen;
+            const unsigned char *k = leaf->key(pos, klen);
+            if (compareKey(k, klen, pkey, len) == 0) blkid = leaf->blkids[pos];
         }
-            //(else)pkey = it.pkey
-        if(it->nextNode!=nullptr){
-            return find(it->nextNode,pkey,len);
-        };
-        return std::pair<bool,TreeNode*>(true,start);
+        leaf->lock.checkOrRestart(version, restart);
+        if (restart) continue;
+        return blkid;
     }
 }
 
+unsigned int BPlusTree::floor(unsigned char *pkey, unsigned int len)
+{
+    return nearest(pkey, len, false);
+}
 
+unsigned int BPlusTree::below(unsigned char *pkey, unsigned int len)
+{
+    return nearest(pkey, len, true);
+}
 
-
-void BPlusTree::remove(unsigned char* pkey, unsigned int len, unsigned int blkid) {
-    std::pair<bool, TreeNode*> result = find(root, pkey, len);
-    TreeNode* leafNode = result.second;
-    
-    // 找到目标节点
-    auto it = std::find_if(leafNode->children.begin(), leafNode->children.end(),
-                           [&](const Node& node) {
-                               return std::memcmp(node.pkey, pkey, len) == 0;
-                           });
-    
-    if (it != leafNode->children.end()) {
-        // 移除目标节点
-        leafNode->children.erase(it);
-        
-        // 检查是否需要合并或借用节点
-        if (leafNode->children.size() < MIN_CHILDREN) {
-            handleNodeUnderflow(leafNode);
+unsigned int
+BPlusTree::nearest(unsigned char *pkey, unsigned int len, bool strict)
+{
+    while (true) {
+        bool restart = false;
+        BTreeNode *node = root_.load();
+        unsigned long long version = node->lock.readLock(restart);
+        if (restart || node != root_.load()) continue;
+
+        BTreeInner *parent = nullptr;
+        unsigned long long pversion = 0;
+
+        while (!node->leaf) {
+            BTreeInner *inner = static_cast<BTreeInner *>(node);
+            // 严格小于时，等于分隔键的key要到左边的孩子中找
+            unsigned int pos = strict ? inner->lowerBound(pkey, len)
+                                      : inner->upperBound(pkey, len);
+            BTreeNode *child =
+                inner->children[pos > BPT_FANOUT ? BPT_FANOUT : pos];
+            if (parent) {
+                parent->lock.checkOrRestart(pversion, restart);
+                if (restart) break;
+            }
+            inner->lock.checkOrRestart(version, restart);
+            if (restart) break;
+
+            parent = inner;
+            pversion = version;
+            node = child;
+            version = node->lock.readLock(restart);
+            if (restart) break;
+        }
+        if (restart) continue;
+        // 与search相同，读到叶子的版本后再校验父节点
+        if (parent) {
+            parent->lock.checkOrRestart(pversion, restart);
+            if (restart) continue;
         }
+
+        // 叶子中最后一个不大于（严格时小于）key的键
+        BTreeLeaf *leaf = static_cast<BTreeLeaf *>(node);
+        unsigned int pos = strict ? leaf->lowerBound(pkey, len)
+                                  : leaf->upperBound(pkey, len);
+        if (pos > leaf->size()) pos = leaf->size();
+        unsigned int blkid = pos ? leaf->blkids[pos - 1] : 0;
+        leaf->lock.checkOrRestart(version, restart);
+        if (restart) continue;
+        return blkid;
     }
 }
 
-void BPlusTree::handleNodeUnderflow(TreeNode* node) {
-    // 如果是根节点，特殊处理
-    if (node == root) {
-        if (root->children.size() == 0) {
-            if (root->children[0].nextNode != nullptr) {
-                root = root->children[0].nextNode;
-                root->father = nullptr;
+BTreeLeaf *
+BPlusTree::lockLeaf(unsigned char *pkey, unsigned int len, unsigned int &pos)
+{
+    while (true) {
+        bool restart = false;
+        BTreeNode *node = root_.load();
+        unsigned long long version = node->lock.readLock(restart);
+        if (restart || node != root_.load()) continue;
+
+        BTreeInner *parent = nullptr;
+        unsigned long long pversion = 0;
+
+        while (!node->leaf) {
+            BTreeInner *inner = static_cast<BTreeInner *>(node);
+            unsigned int p = inner->upperBound(pkey, len);
+            BTreeNode *child = inner->children[p > BPT_FANOUT ? BPT_FANOUT : p];
+            if (parent) {
+                parent->lock.checkOrRestart(pversion, restart);
+                if (restart) break;
             }
+            inner->lock.checkOrRestart(version, restart);
+            if (restart) break;
+
+            parent = inner;
+            pversion = version;
+            node = child;
+            version = node->lock.readLock(restart);
+            if (restart) break;
         }
-        return;
-    }
-    
-    TreeNode* parent = node->father;
-    auto it = std::find_if(parent->children.begin(), parent->children.end(),
-                           [&](const Node& child) {
-                               return child.nextNode == node;
-                           });
-    int index = std::distance(parent->children.begin(), it);
-    
-    TreeNode* leftSibling = (index > 0) ? parent->children[index - 1].nextNode : nullptr;
-    TreeNode* rightSibling = (index < parent->children.size() - 1) ? parent->children[index + 1].nextNode : nullptr;
-    
-    if (leftSibling && leftSibling->children.size() > MIN_CHILDREN) {
-        // 从左兄弟借一个节点
-        node->children.insert(node->children.begin(), leftSibling->children.back());
-        leftSibling->children.pop_back();
-        parent->children[index].pkey = node->children[0].pkey;
-    } else if (rightSibling && rightSibling->children.size() > MIN_CHILDREN) {
-        // 从右兄弟借一个节点
-        node->children.push_back(rightSibling->children.front());
-        rightSibling->children.erase(rightSibling->children.begin());
-        parent->children[index + 1].pkey = rightSibling->children[0].pkey;
-    } else {
-        // 合并节点
-        if (leftSibling) {
-            leftSibling->children.insert(leftSibling->children.end(), node->children.begin(), node->children.end());
-            parent->children.erase(parent->children.begin() + index);
-            delete node;
-        } else if (rightSibling) {
-            node->children.insert(node->children.end(), rightSibling->children.begin(), rightSibling->children.end());
-            parent->children.erase(parent->children.begin() + index + 1);
-            delete rightSibling;
+        if (restart) continue;
+
+        // 锁定叶子后再校验父节点，与插入相同
+        BTreeLeaf *leaf = static_cast<BTreeLeaf *>(node);
+        leaf->lock.upgrade(version, restart);
+        if (restart) continue;
+        if (parent) {
+            parent->lock.checkOrRestart(pversion, restart);
+            if (restart) {
+                leaf->lock.writeUnlock();
+                continue;
+            }
         }
-        
-        if (parent->children.size() < MIN_CHILDREN) {
-            handleNodeUnderflow(parent);
+
+        pos = leaf->lowerBound(pkey, len);
+        if (pos < leaf->count) {
+            unsigned int klen;
+            const unsigned char *k = leaf->key(pos, klen);
+            if (compareKey(k, klen, pkey, len) == 0) return leaf;
         }
+        leaf->lock.writeUnlock();
+        return nullptr;
     }
 }
 
+void BPlusTree::remove(unsigned char *pkey, unsigned int len)
+{
+    unsigned int pos;
+    BTreeLeaf *leaf = lockLeaf(pkey, len, pos);
+    if (leaf == nullptr) return;
 
-
-
-void BPlusTree::update(unsigned char* pkey, unsigned int len, unsigned int blkid) {
-    std::pair<bool, TreeNode*> result = find(root, pkey, len);
-    TreeNode* leafNode = result.second;
-    
-    // 找到目标节点并更新
-    auto it = std::find_if(leafNode->children.begin(), leafNode->children.end(),
-                           [&](const Node& node) {
-                               return std::memcmp(node.pkey, pkey, len) == 0;
-                           });
-    
-    if (it != leafNode->children.end()) {
-        it->nextNode->blkid = blkid;
-    } else {
-        std::cerr << "Key not found, cannot update." << std::endl;
-    }
+    for (unsigned int i = pos; i + 1 < leaf->count; ++i)
+        leaf->blkids[i] = leaf->blkids[i + 1];
+    leaf->eraseKey(pos);
+    leaf->lock.writeUnlock();
 }
 
+void BPlusTree::update(unsigned char *pkey, unsigned int len, unsigned int blkid)
+{
+    unsigned int pos;
+    BTreeLeaf *leaf = lockLeaf(pkey, len, pos);
+    if (leaf == nullptr) return;
 
+    leaf->blkids[pos] = blkid;
+    leaf->lock.writeUnlock();
+}
 
-
-}
\ No newline at end of file
+} // namespace db
@@ -36,7 +36,8 @@ DataBlock::RecordIterator &DataBlock::RecordIterator::operator++()
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return *this;
 }
 DataBlock::RecordIterator DataBlock::RecordIterator::operator++(int)
@@ -51,7 +52,8 @@ DataBlock::RecordIterator DataBlock::RecordIterator::operator++(int)
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return tmp;
 }
 DataBlock::RecordIterator &DataBlock::RecordIterator::operator--()
@@ -65,7 +67,8 @@ DataBlock::RecordIterator &DataBlock::RecordIterator::operator--()
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return *this;
 }
 DataBlock::RecordIterator DataBlock::RecordIterator::operator--(int)
@@ -80,7 +83,8 @@ DataBlock::RecordIterator DataBlock::RecordIterator::operator--(int)
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return tmp;
 }
 Record *DataBlock::RecordIterator::operator->() { return &record; }
@@ -95,7 +99,8 @@ DataBlock::RecordIterator &DataBlock::RecordIterator::operator+=(int step)
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return *this;
 }
 DataBlock::RecordIterator &DataBlock::RecordIterator::operator-=(int step)
@@ -109,11 +114,12 @@ DataBlock::RecordIterator &DataBlock::RecordIterator::operator-=(int step)
     Slot *slots = block->getSlotsPointer();
     record.attach(
         block->buffer_ + be16toh(slots[index].offset),
-        be16toh(slots[index].length));
+        be16toh(slots[index].length),
+        block->format());
     return *this;
 }
 
-void SuperBlock::clear(unsigned short spaceid)
+void SuperBlock::clear(unsigned int spaceid)
 {
     // 清buffer
     ::memset(buffer_, 0, SUPER_SIZE);
@@ -135,6 +141,11 @@ void SuperBlock::clear(unsigned short spaceid)
     setSelf();
     // 设定空闲块，缺省从1开始
     setIdle(0);
+    // 设定空闲空间映射，首次打开表时建立
+    setFsm(0);
+    // 设定预分配，文件第一次扩展时才预分配
+    setExtent(EXTENT_SIZE / BLOCK_SIZE);
+    setReserved(0);
     // 设定记录数目
     setRecords(0);
     // 设定数据块个数
@@ -148,7 +159,7 @@ void SuperBlock::clear(unsigned short spaceid)
 }
 
 void MetaBlock::clear(
-    unsigned short spaceid,
+    unsigned int spaceid,
     unsigned int self,
     unsigned short type)
 {
@@ -178,7 +189,7 @@ void MetaBlock::clear(
     setChecksum();
 }
 
-// TODO: 如果record非full，直接分配，不考虑slot
+// 非full的记录同样占一个slot，溢出块中只有一条MID或END记录
 std::pair<unsigned char *, bool>
 MetaBlock::allocate(unsigned short space, unsigned short index)
 {
@@ -201,9 +212,11 @@ MetaBlock::allocate(unsigned short space, unsigned short index)
 
     // 如果freespace空间不够，先回收删除的记录
     unsigned short freespacesize = getFreespaceSize();
-    // freespace的空间要减去要分配的slot的空间
+    // freespace的空间要减去要分配的slot的空间，不足时直接回收，避免下溢
     if (current_trailersize < demand_trailersize)
-        freespacesize -= ALIGN_TO_SIZE(sizeof(Slot));
+        freespacesize = freespacesize > ALIGN_TO_SIZE(sizeof(Slot))
+                            ? freespacesize - ALIGN_TO_SIZE(sizeof(Slot))
+                            : 0;
     // NOTE: 这里这里没法reorder，才分配还未填充记录
     if (freespacesize < demand_space) {
         shrink();
@@ -315,7 +328,20 @@ unsigned short DataBlock::searchRecord(void *buf, size_t len)
     unsigned int key = info->key;
 
     // 调用数据类型的搜索
-    return info->fields[key].type->search(buffer_, key, buf, len);
+    return info->fields[key].type->search(
+        buffer_, key, buf, len, info->recordFormat());
+}
+
+const RecordFormat *DataBlock::format()
+{
+    return table_ ? table_->info_->recordFormat() : NULL;
+}
+
+bool DataBlock::refslots(unsigned short index, Record &record)
+{
+    if (!MetaBlock::refslots(index, record)) return false;
+    record.format_ = format();
+    return true;
 }
 
 std::pair<unsigned short, bool>
@@ -353,7 +379,8 @@ DataBlock::splitPosition(size_t space, unsigned short index)
 
 unsigned short DataBlock::requireLength(std::vector<struct iovec> &iov)
 {
-    size_t length = ALIGN_TO_SIZE(Record::size(iov)); // 对齐8B后的长度
+    // 对齐8B后的长度
+    size_t length = ALIGN_TO_SIZE(Record::size(iov, format()));
     size_t trailer =
         ALIGN_TO_SIZE((getSlots() + 1) * sizeof(Slot) + sizeof(unsigned int)) -
         ALIGN_TO_SIZE(
@@ -363,7 +390,7 @@ unsigned short DataBlock::requireLength(std::vector<struct iovec> &iov)
 }
 
 std::pair<bool, unsigned short> 
-DataBlock::insertRecord(std::vector<struct iovec> &iov)
+DataBlock::insertRecord(std::vector<struct iovec> &iov, unsigned char header)
 {
     RelationInfo *info = table_->info_;
     unsigned int key = info->key;
@@ -371,7 +398,12 @@ DataBlock::insertRecord(std::vector<struct iovec> &iov)
 
     // 先确定插入位置
     unsigned short index =
-        type->search(buffer_, key, iov[key].iov_base, iov[key].iov_len);
+        type->search(
+            buffer_,
+            key,
+            iov[key].iov_base,
+            iov[key].iov_len,
+            info->recordFormat());
 
     // 比较key
     Record record;
@@ -379,7 +411,8 @@ DataBlock::insertRecord(std::vector<struct iovec> &iov)
         Slot *slots = getSlotsPointer();
         record.attach(
             buffer_ + be16toh(slots[index].offset),
-            be16toh(slots[index].length));
+            be16toh(slots[index].length),
+            info->recordFormat());
         unsigned char *pkey;
         unsigned int len;
         record.refByIndex(&pkey, &len, key);
@@ -389,7 +422,9 @@ DataBlock::insertRecord(std::vector<struct iovec> &iov)
 
     // 如果block空间足够，插入
     size_t blen = getFreeSize(); // 该block的富余空间
-    unsigned short actlen = (unsigned short) Record::size(iov);//计算新记录所需空间
+    // 计算新记录所需空间
+    unsigned short actlen =
+        (unsigned short) Record::size(iov, info->recordFormat());
     unsigned short alignlen = ALIGN_TO_SIZE(actlen);
     unsigned short trailerlen =
         ALIGN_TO_SIZE((getSlots() + 1) * sizeof(Slot) + sizeof(unsigned int)) -
@@ -400,16 +435,17 @@ DataBlock::insertRecord(std::vector<struct iovec> &iov)
     // 分配空间
     std::pair<unsigned char *, bool> alloc_ret = allocate(actlen, index);
     // 填写记录
-    record.attach(alloc_ret.first, actlen);
-    unsigned char header = 0;
+    record.attach(alloc_ret.first, actlen, info->recordFormat());
     record.set(iov, &header);
     // 重新排序
-    if (alloc_ret.second) reorder(type, key);
+    if (alloc_ret.second) reorder(type, key, info->recordFormat());
 
     return std::pair<bool, unsigned short>(true, index);
 }
 
-std::pair<bool, unsigned short> DataBlock::updateRecord(std::vector<struct iovec> &iov)//index处删除再插入实现修改
+std::pair<bool, unsigned short> DataBlock::updateRecord(
+    std::vector<struct iovec> &iov,
+    unsigned char header) //index处删除再插入实现修改
 {
     RelationInfo *info = table_->info_;
     unsigned int key = info->key;//主键（以为标识字段）索引
@@ -417,7 +453,12 @@ std::pair<bool, unsigned short> DataBlock::updateRecord(std::vector<struct iovec
 
     // 何处修改
     unsigned short index =
-        type->search(buffer_, key, iov[key].iov_base, iov[key].iov_len);
+        type->search(
+            buffer_,
+            key,
+            iov[key].iov_base,
+            iov[key].iov_len,
+            info->recordFormat());
 
     // 寻找对应记录
     Record record;
@@ -425,7 +466,8 @@ std::pair<bool, unsigned short> DataBlock::updateRecord(std::vector<struct iovec
         Slot *slots = getSlotsPointer();
         record.attach(
             buffer_ + be16toh(slots[index].offset),
-            be16toh(slots[index].length));
+            be16toh(slots[index].length),
+            info->recordFormat());
         unsigned char *pkey;
         unsigned int len;
         record.refByIndex(&pkey, &len, key);
@@ -435,7 +477,7 @@ std::pair<bool, unsigned short> DataBlock::updateRecord(std::vector<struct iovec
 
             // 直接返回插入结果
             // 此时失败只可能是：空间不足以支持修改，给出报错，交付Table解决（分裂/新增Block）
-            return  insertRecord(iov);
+            return  insertRecord(iov, header);
         }
         // 如果key不同不可修改，则直接返回false
         return std::pair<bool, unsigned short> (false , -1);
@@ -477,7 +519,9 @@ DataBlock::RecordIterator DataBlock::beginrecord()
     if (getSlots()) {
         Slot *slots = getSlotsPointer();
         ri.record.attach(
-            buffer_ + be16toh(slots[0].offset), be16toh(slots[0].length));
+            buffer_ + be16toh(slots[0].offset),
+            be16toh(slots[0].length),
+            format());
     }
     return ri;
 }
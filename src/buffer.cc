@@ -6,14 +6,54 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
-#include <malloc.h> // windows
+#if defined(WIN32)
+#    include <malloc.h> // windows
+#else
+#    include <stdlib.h>
+#    define _aligned_malloc(size, alignment) aligned_alloc(alignment, size)
+#    define _aligned_free free
+#endif
 #include <db/buffer.h>
 #include <db/block.h>
 #include <db/file.h>
+#include <db/scheduler.h>
 
 namespace db {
+namespace {
+// block在文件中的偏移，0号block是超块
+inline unsigned long long blockOffset(unsigned int blockid)
+{
+    return blockid == 0
+               ? 0
+               : (unsigned long long) blockid * BLOCK_SIZE + SUPER_SIZE;
+}
+// 块表的键，表编号在高32位
+inline unsigned long long blockKey(TableId table, unsigned int blockid)
+{
+    return (unsigned long long) table << 32 | blockid;
+}
+// block头部的表空间与描述符不符，未初始化的block不算
+bool misplaced(BufDesp *desp)
+{
+    if (desp->spaceid == SPACE_NONE) return false;
+    Block block;
+    block.attach(desp->buffer);
+    return block.getMagic() == MAGIC_NUMBER &&
+           block.getSpaceid() != desp->spaceid;
+}
+} // namespace
+
 Buffer::~Buffer()
 {
+    // 先停IO线程，未读的block随描述符一起丢弃
+    {
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        ioStop_ = true;
+    }
+    ioReady_.notify_all();
+    for (size_t i = 0; i < io_.size(); ++i)
+        io_[i].join();
+
     if (buffer_) {
         // 释放所有lru上的描述符，TODO: 恢复？
         while (lru_.next) {
@@ -34,8 +74,7 @@ void Buffer::init(FilePool *fp, size_t size)
     filepool_ = fp;
 
     // 按照4096B对齐，以1MB为单位分配内存
-    unsigned char *buffer_ =
-        (unsigned char *) _aligned_malloc(size * 1024 * 1024, 4096);
+    buffer_ = (unsigned char *) _aligned_malloc(size * 1024 * 1024, 4096);
 
     // 初始化所有block
     BufDesp *prev = NULL;
@@ -46,7 +85,7 @@ void Buffer::init(FilePool *fp, size_t size)
         prev = idle_;
         idle_->prev = NULL;
         idle_->size = BLOCK_SIZE;
-        idle_->name = NULL;
+        idle_->table = TABLE_NONE;
         idle_->type = 0;
         ++idleCount_;
     }
@@ -74,76 +113,346 @@ void Buffer::prependLru(BufDesp *descriptor)
 {
     descriptor->next = lru_.next;
     lru_.next = descriptor;
-    if (descriptor->next) descriptor->next->prev = descriptor;
+    if (descriptor->next)
+        descriptor->next->prev = descriptor;
+    else
+        lru_.prev = descriptor; // 队列原来为空，同时也是尾
     descriptor->prev = &lru_;
 }
 
-BufDesp *Buffer::borrow(const char *table, unsigned int blockid)
+void Buffer::unlinkLru(BufDesp *desp)
 {
-    // 利用文件池打开表
+    BufDesp *prev = desp->prev;
+    prev->next = desp->next;
+    if (desp->next)
+        desp->next->prev = prev;
+    else
+        lru_.prev = prev == &lru_ ? NULL : prev;
+}
+
+void Buffer::touchLru(BufDesp *desp)
+{
+    // 将该描述符从队列中摘下，prepend到lru的头部
+    unlinkLru(desp);
+    prependLru(desp);
+}
+
+void Buffer::recycle(BlockMap::iterator it)
+{
+    BufDesp *desp = it->second;
+    unlinkLru(desp);
+    map_.erase(it);
+
+    // buffer挂回idle头部
+    BufDesp *ptr = (BufDesp *) desp->buffer;
+    ptr->next = idle_;
+    idle_ = ptr;
+    delete desp;
+}
+
+void Buffer::saveSuper(BufDesp *desp)
+{
+    // 正在读入的还不是超块的内容，写错位置的不能改写
+    if (desp->blockid != 0 || !superHook_ || (desp->type & BUFFER_LOADING) ||
+        misplaced(desp))
+        return;
+    if (superHook_(desp)) desp->type |= BUFFER_DIRTY;
+}
+
+void Buffer::setSuperHook(Hook hook)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    superHook_ = std::move(hook);
+}
+
+bool Buffer::evict()
+{
+    for (BufDesp *desp = lru_.prev; desp != NULL && desp != &lru_;
+         desp = desp->prev) {
+        if (desp->ref.load() || (desp->type & BUFFER_LOADING)) continue;
+        saveSuper(desp);
+
+        // 脏buffer先写回，写失败的留在内存；文件已删除的直接丢弃
+        // 借用时已打开文件，这里只查文件池，不经过schema
+        // 表空间不符的不能写到这个位置上，丢弃
+        if ((desp->type & BUFFER_DIRTY) && misplaced(desp)) {
+            misdirected_.fetch_add(1);
+        } else if (desp->type & BUFFER_DIRTY) {
+            File *file = filepool_->find(desp->table);
+            if (file && file->write(
+                            blockOffset(desp->blockid),
+                            (const char *) desp->buffer,
+                            BLOCK_SIZE))
+                continue;
+        }
+        recycle(map_.find(blockKey(desp->table, desp->blockid)));
+        return true;
+    }
+    return false;
+}
+
+void Buffer::discard(TableId table)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 块表是散列的，沿lru找该表的buffer
+    BufDesp *desp = lru_.next;
+    while (desp != NULL) {
+        BufDesp *next = desp->next;
+        if (desp->table == table && desp->ref.load() == 0 &&
+            !(desp->type & BUFFER_LOADING))
+            recycle(map_.find(blockKey(table, desp->blockid)));
+        desp = next;
+    }
+}
+
+void Buffer::discard(const char *table) { discard(filepool_->intern(table)); }
+
+int Buffer::truncate(TableId table, unsigned int maxid)
+{
+    // 先打开文件，不在mutex_内调用文件池
+    File *file = filepool_->open(table);
+    if (file == NULL) return ENOENT;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // 尾部的block已经回收，脏的也不写回
+        BufDesp *desp = lru_.next;
+        while (desp != NULL) {
+            BufDesp *next = desp->next;
+            if (desp->table == table && desp->blockid > maxid) {
+                if (desp->ref.load() || (desp->type & BUFFER_LOADING))
+                    return EBUSY;
+                recycle(map_.find(blockKey(table, desp->blockid)));
+            }
+            desp = next;
+        }
+    }
+    return file->truncate(blockOffset(maxid + 1));
+}
+
+int Buffer::flush(TableId table)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int ret = S_OK;
+    for (BufDesp *desp = lru_.next; desp != NULL && desp != &lru_;
+         desp = desp->next) {
+        if (table != TABLE_NONE && desp->table != table) continue;
+        saveSuper(desp);
+        // 表空间不符的留到淘汰时丢弃并计数
+        if (!(desp->type & BUFFER_DIRTY) || (desp->type & BUFFER_LOADING) ||
+            misplaced(desp))
+            continue;
+        File *file = filepool_->find(desp->table);
+        if (file == NULL) continue; // 文件已删除
+        int err = file->write(
+            blockOffset(desp->blockid),
+            (const char *) desp->buffer,
+            BLOCK_SIZE);
+        if (err == S_OK)
+            desp->type &= ~BUFFER_DIRTY;
+        else if (ret == S_OK)
+            ret = err;
+    }
+    return ret;
+}
+
+int Buffer::allocate(TableId table, unsigned int blockid, unsigned int count)
+{
+    // 预分配的block没有buffer，只改文件
     File *file = filepool_->open(table);
+    if (file == NULL) return ENOENT;
+    return file->allocate(
+        blockOffset(blockid), (unsigned long long) count * BLOCK_SIZE);
+}
 
-    // 根据表名+offset查找
-    std::pair<const char *, unsigned int> block(table, blockid);
+void Buffer::load(BufDesp *desp, File *file)
+{
+    // 从文件读数据
+    int ret = file ? file->read(
+                         blockOffset(desp->blockid),
+                         (char *) desp->buffer,
+                         BLOCK_SIZE)
+                   : S_FALSE;
+    // 读到别的表空间的block，与读取出错一样清零
+    if (ret == S_OK && misplaced(desp)) {
+        misdirected_.fetch_add(1);
+        ret = S_FALSE;
+    }
+    if (ret) memset(desp->buffer, 0, BLOCK_SIZE); // 读取出错，直接清零
+
+    // 清除读入标志，取出等待者
+    std::vector<Callback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        desp->type &= ~BUFFER_LOADING;
+        WaitMap::iterator it = waiters_.find(desp);
+        if (it != waiters_.end()) {
+            waiters.swap(it->second);
+            waiters_.erase(it);
+        }
+    }
+    loaded_.notify_all();
+
+    // 异步借用者的回调交给调度器，IO线程不执行上层的代码
+    if (waiters.empty()) return;
+    kScheduler.spawn(
+        [waiters, desp]() {
+            for (size_t i = 0; i < waiters.size(); ++i)
+                waiters[i](desp);
+        },
+        TASK_FOREGROUND);
+}
+
+void Buffer::submit(BufDesp *desp, File *file)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    // 首次异步读入时启动IO线程
+    if (io_.empty())
+        for (unsigned int i = 0; i < IO_THREADS; ++i)
+            io_.push_back(std::thread(&Buffer::serve, this));
+    reads_.push_back(Read(desp, file));
+    ioReady_.notify_one();
+}
+
+void Buffer::serve()
+{
+    std::unique_lock<std::mutex> lock(ioMutex_);
+    while (true) {
+        ioReady_.wait(lock, [this]() { return ioStop_ || !reads_.empty(); });
+        if (ioStop_) return;
+        Read read = reads_.front();
+        reads_.pop_front();
+
+        // 读文件时不持有ioMutex_，其它IO线程可以同时读
+        lock.unlock();
+        load(read.first, read.second);
+        lock.lock();
+    }
+}
+
+BufDesp *Buffer::borrow(TableId table, unsigned int blockid)
+{
+    // 利用文件池打开表，打开时可能要加载表定义，不能持有mutex_
+    unsigned int spaceid = SPACE_NONE;
+    File *file = filepool_->open(table, &spaceid);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // 根据表编号+blockid查找
+    unsigned long long block = blockKey(table, blockid);
     BlockMap::iterator it = map_.find(block);
 
+    // 其它线程正在读入，睡眠到读入完成；读入者不依赖调度器，不会死锁
+    loaded_.wait(lock, [&]() {
+        it = map_.find(block);
+        return it == map_.end() || !(it->second->type & BUFFER_LOADING);
+    });
+
     // 找到，将描述符移动到lru头部
     if (it != map_.end()) {
-        // 将该描述符从队列中摘下
-        BufDesp *prev = it->second->prev;
-        prev->next = it->second->next;
-        if (prev->next) prev->next->prev = it->second->prev;
-
-        // prepend到lru的头部
-        prependLru(it->second);
-
+        touchLru(it->second);
         // 增加引用计数
         it->second->addref();
         // 返回buffer指针
         return it->second;
     }
 
-    // TODO: 如果空闲空间不够，从lru队列上释放buffer
-    if (idle_ == NULL) {
+    // 空闲空间不够，从lru队列上淘汰buffer
+    if (idle_ == NULL && !evict()) {
         printf("OOM!!!!");
         return NULL;
     }
 
-    // 然后从idle上分配一个block
+    // 然后从idle上分配一个block，加入map
     BufDesp *descriptor = allocFromIdle();
-    descriptor->name = table;
+    descriptor->table = table;
+    descriptor->spaceid = spaceid;
     descriptor->blockid = blockid;
-    // prepend到lru的头部
-    prependLru(descriptor);
-
-    // 从文件读数据
-    unsigned long long offset =
-        blockid == 0 ? 0 : blockid * BLOCK_SIZE + SUPER_SIZE;
-    int ret = file->read(offset, (char *) descriptor->buffer, BLOCK_SIZE);
-    if (ret) memset(descriptor->buffer, 0, BLOCK_SIZE); // 读取出错，直接清零
-
-    // 将block加入map
-    BlockMap::value_type val(
-        std::pair<const char *, unsigned int>(table, blockid), descriptor);
-    map_.insert(val);
+    descriptor->type |= BUFFER_LOADING;
+    map_[block] = descriptor;
 
     // 增加引用计数
     descriptor->addref();
+
+    // 读文件时释放锁
+    lock.unlock();
+    load(descriptor, file);
     return descriptor;
 }
 
+BufDesp *Buffer::borrow(const char *table, unsigned int blockid)
+{
+    return borrow(filepool_->intern(table), blockid);
+}
+
+void Buffer::borrowAsync(
+    TableId table,
+    unsigned int blockid,
+    Callback callback)
+{
+    // 利用文件池打开表
+    unsigned int spaceid = SPACE_NONE;
+    File *file = filepool_->open(table, &spaceid);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // 根据表编号+blockid查找
+    unsigned long long block = blockKey(table, blockid);
+    BlockMap::iterator it = map_.find(block);
+
+    if (it != map_.end()) {
+        BufDesp *desp = it->second;
+        desp->addref();
+        // 正在读入，排队等待
+        if (desp->type & BUFFER_LOADING) {
+            waiters_[desp].push_back(std::move(callback));
+            return;
+        }
+        // 命中，直接回调
+        touchLru(desp);
+        lock.unlock();
+        callback(desp);
+        return;
+    }
+
+    // 空闲空间不够，从lru队列上淘汰buffer
+    if (idle_ == NULL && !evict()) {
+        lock.unlock();
+        callback(NULL);
+        return;
+    }
+
+    // 从idle上分配一个block，加入map
+    BufDesp *descriptor = allocFromIdle();
+    descriptor->table = table;
+    descriptor->spaceid = spaceid;
+    descriptor->blockid = blockid;
+    descriptor->type |= BUFFER_LOADING;
+    map_[block] = descriptor;
+    descriptor->addref();
+    waiters_[descriptor].push_back(std::move(callback));
+    lock.unlock();
+
+    // 读文件交给IO线程
+    submit(descriptor, file);
+}
+
+void Buffer::borrowAsync(
+    const char *table,
+    unsigned int blockid,
+    Callback callback)
+{
+    borrowAsync(filepool_->intern(table), blockid, std::move(callback));
+}
+
 void Buffer::writeBuf(BufDesp *desp)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
+
     // 设定dirty
     desp->type |= BUFFER_DIRTY;
-
-    // 将该描述符从队列中摘下
-    BufDesp *prev = desp->prev;
-    prev->next = desp->next;
-    prev->next->prev = desp->prev;
-
-    // prepend到lru的头部
-    prependLru(desp);
+    touchLru(desp);
 }
 
 // 全局变量
@@ -16,8 +16,9 @@ namespace db {
 namespace {
 struct CharCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -27,29 +28,27 @@ struct CharCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
-        const char *xchar = (const char *) iovrx[key].iov_base;
-        const char *ychar = (const char *) iovry[key].iov_base;
+        const char *xchar = (const char *) lx.data(key);
+        const char *ychar = (const char *) ly.data(key);
 
         // CHAR长度固定
-        size_t xsize = iovrx[key].iov_len; // 字符串长度
+        size_t xsize = lx.length(key); // 字符串长度
         return strncmp(xchar, ychar, xsize) < 0;
     }
 };
 
 struct VarCharCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -59,20 +58,17 @@ struct VarCharCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
-        const char *xchar = (const char *) iovrx[key].iov_base;
-        const char *ychar = (const char *) iovry[key].iov_base;
-        size_t xsize = iovrx[key].iov_len; // x字符串长度
-        size_t ysize = iovry[key].iov_len; // y字符串长度
+        const char *xchar = (const char *) lx.data(key);
+        const char *ychar = (const char *) ly.data(key);
+        size_t xsize = lx.length(key); // x字符串长度
+        size_t ysize = ly.length(key); // y字符串长度
 
         // 比较字符串
         int ret = strncmp(xchar, ychar, xsize);
@@ -89,8 +85,9 @@ struct VarCharCompare
 
 struct TinyIntCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -100,18 +97,15 @@ struct TinyIntCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
-        unsigned char ix = *((const unsigned char *) iovrx[key].iov_base);
-        unsigned char iy = *((const unsigned char *) iovry[key].iov_base);
+        unsigned char ix = *((const unsigned char *) lx.data(key));
+        unsigned char iy = *((const unsigned char *) ly.data(key));
 
         return ix < iy;
     }
@@ -119,8 +113,9 @@ struct TinyIntCompare
 
 struct SmallIntCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -130,20 +125,15 @@ struct SmallIntCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
-        unsigned short ix =
-            be16toh(*((const unsigned short *) iovrx[key].iov_base));
-        unsigned short iy =
-            be16toh(*((const unsigned short *) iovry[key].iov_base));
+        unsigned short ix = be16toh(*((const unsigned short *) lx.data(key)));
+        unsigned short iy = be16toh(*((const unsigned short *) ly.data(key)));
 
         return ix < iy;
     }
@@ -151,8 +141,9 @@ struct SmallIntCompare
 
 struct IntCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -162,20 +153,15 @@ struct IntCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
-        unsigned int ix =
-            be32toh(*((const unsigned int *) iovrx[key].iov_base));
-        unsigned int iy =
-            be32toh(*((const unsigned int *) iovry[key].iov_base));
+        unsigned int ix = be32toh(*((const unsigned int *) lx.data(key)));
+        unsigned int iy = be32toh(*((const unsigned int *) ly.data(key)));
 
         return ix < iy;
     }
@@ -183,8 +169,9 @@ struct IntCompare
 
 struct BigIntCompare
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -194,20 +181,17 @@ struct BigIntCompare
 
         // 引用两条记录
         Record rx, ry;
-        rx.attach(buffer + x, 8);
-        ry.attach(buffer + y, 8);
-        std::vector<struct iovec> iovrx;
-        std::vector<struct iovec> iovry;
-        unsigned char xheader;
-        unsigned char yheader;
-        rx.ref(iovrx, &xheader);
-        ry.ref(iovry, &yheader);
+        rx.attach(buffer + x, 8, format);
+        ry.attach(buffer + y, 8, format);
+        RecordLayout lx, ly;
+        lx.decode(rx);
+        ly.decode(ry);
 
         // 得到x，y
         unsigned long long ix =
-            be64toh(*((const unsigned long long *) iovrx[key].iov_base));
+            be64toh(*((const unsigned long long *) lx.data(key)));
         unsigned long long iy =
-            be64toh(*((const unsigned long long *) iovry[key].iov_base));
+            be64toh(*((const unsigned long long *) ly.data(key)));
 
         return ix < iy;
     }
@@ -215,10 +199,11 @@ struct BigIntCompare
 
 struct CharCompare2
 {
-    unsigned char *buffer; // buffer指针
-    const char *val;       // 搜索值
-    size_t size;           // val长度
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    const char *val;            // 搜索值
+    size_t size;                // val长度
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -227,26 +212,26 @@ struct CharCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x
-        const char *xchar = (const char *) iovrx[key].iov_base;
+        const char *xchar = (const char *) lx.data(key);
 
         // CHAR长度固定
-        size_t xsize = iovrx[key].iov_len; // 字符串长度
+        size_t xsize = lx.length(key); // 字符串长度
         return strncmp(xchar, val, xsize) < 0;
     }
 };
 
 struct VarCharCompare2
 {
-    unsigned char *buffer; // buffer指针
-    const char *val;       // 搜索值
-    size_t size;           // 字符串长度
-    unsigned int key;      // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    const char *val;            // 搜索值
+    size_t size;                // 字符串长度
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -255,14 +240,13 @@ struct VarCharCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x
-        const char *xchar = (const char *) iovrx[key].iov_base;
-        size_t xsize = iovrx[key].iov_len; // x字符串长度
+        const char *xchar = (const char *) lx.data(key);
+        size_t xsize = lx.length(key); // x字符串长度
 
         // 比较字符串
         int ret = strncmp(xchar, val, xsize);
@@ -279,9 +263,10 @@ struct VarCharCompare2
 
 struct TinyIntCompare2
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-    unsigned char val;     // 搜索键
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
+    unsigned char val;          // 搜索键
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -290,13 +275,12 @@ struct TinyIntCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x
-        unsigned char ix = *((const unsigned char *) iovrx[key].iov_base);
+        unsigned char ix = *((const unsigned char *) lx.data(key));
 
         return ix < val;
     }
@@ -304,9 +288,10 @@ struct TinyIntCompare2
 
 struct SmallIntCompare2
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-    unsigned short val;    // 搜索键值
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
+    unsigned short val;         // 搜索键值
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -315,14 +300,12 @@ struct SmallIntCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x
-        unsigned short ix =
-            be16toh(*((const unsigned short *) iovrx[key].iov_base));
+        unsigned short ix = be16toh(*((const unsigned short *) lx.data(key)));
 
         return ix < val;
     }
@@ -330,9 +313,10 @@ struct SmallIntCompare2
 
 struct IntCompare2
 {
-    unsigned char *buffer; // buffer指针
-    unsigned int key;      // 键的位置
-    unsigned int val;      // 搜索键值
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned int key;           // 键的位置
+    unsigned int val;           // 搜索键值
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -341,14 +325,12 @@ struct IntCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x
-        unsigned int ix =
-            be32toh(*((const unsigned int *) iovrx[key].iov_base));
+        unsigned int ix = be32toh(*((const unsigned int *) lx.data(key)));
 
         return ix < val;
     }
@@ -356,9 +338,10 @@ struct IntCompare2
 
 struct BigIntCompare2
 {
-    unsigned char *buffer;  // buffer指针
-    unsigned long long val; // 搜索键值
-    unsigned int key;       // 键的位置
+    unsigned char *buffer;      // buffer指针
+    const RecordFormat *format; // 记录格式
+    unsigned long long val;     // 搜索键值
+    unsigned int key;           // 键的位置
 
     bool operator()(const Slot &sx, const Slot &sy)
     {
@@ -367,21 +350,21 @@ struct BigIntCompare2
 
         // 引用两条记录
         Record rx;
-        rx.attach(buffer + x, 8);
-        std::vector<struct iovec> iovrx;
-        unsigned char xheader;
-        rx.ref(iovrx, &xheader);
+        rx.attach(buffer + x, 8, format);
+        RecordLayout lx;
+        lx.decode(rx);
 
         // 得到x，y
         unsigned long long ix =
-            be64toh(*((const unsigned long long *) iovrx[key].iov_base));
+            be64toh(*((const unsigned long long *) lx.data(key)));
 
         return ix < val;
     }
 };
 } // namespace
 
-static void CharSort(unsigned char *block, unsigned int key)
+static void
+CharSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -391,11 +374,13 @@ static void CharSort(unsigned char *block, unsigned int key)
     CharCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static void VarCharSort(unsigned char *block, unsigned int key)
+static void
+VarCharSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -405,11 +390,13 @@ static void VarCharSort(unsigned char *block, unsigned int key)
     VarCharCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static void TinyIntSort(unsigned char *block, unsigned int key)
+static void
+TinyIntSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -419,11 +406,13 @@ static void TinyIntSort(unsigned char *block, unsigned int key)
     TinyIntCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static void SmallIntSort(unsigned char *block, unsigned int key)
+static void
+SmallIntSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -433,11 +422,13 @@ static void SmallIntSort(unsigned char *block, unsigned int key)
     SmallIntCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static void IntSort(unsigned char *block, unsigned int key)
+static void
+IntSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -447,11 +438,13 @@ static void IntSort(unsigned char *block, unsigned int key)
     IntCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static void BigIntSort(unsigned char *block, unsigned int key)
+static void
+BigIntSort(unsigned char *block, unsigned int key, const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -461,12 +454,17 @@ static void BigIntSort(unsigned char *block, unsigned int key)
     BigIntCompare compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
 
     std::sort(slots, slots + count, compare);
 }
 
-static unsigned short
-CharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short CharSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -476,6 +474,7 @@ CharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     CharCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = (const char *) val;
     compare.size = len;
 
@@ -487,8 +486,12 @@ CharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     return (unsigned short) (low - start);
 }
 
-static unsigned short
-VarCharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short VarCharSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -498,6 +501,7 @@ VarCharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     VarCharCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = (const char *) val;
     compare.size = len;
 
@@ -509,8 +513,12 @@ VarCharSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     return (unsigned short) (low - start);
 }
 
-static unsigned short
-TinyIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short TinyIntSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -520,6 +528,7 @@ TinyIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     TinyIntCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = *(reinterpret_cast<unsigned char *>(val));
 
     // 搜索值放在compare.val中，-1只是占位
@@ -530,8 +539,12 @@ TinyIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     return (unsigned short) (low - start);
 }
 
-static unsigned short
-SmallIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short SmallIntSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -541,6 +554,7 @@ SmallIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     SmallIntCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = be16toh(*(reinterpret_cast<unsigned short *>(val)));
 
     // 搜索值放在compare.val中，-1只是占位
@@ -551,8 +565,12 @@ SmallIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     return (unsigned short) (low - start);
 }
 
-static unsigned short
-IntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short IntSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -562,6 +580,7 @@ IntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     IntCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = be32toh(*(reinterpret_cast<unsigned int *>(val)));
 
     // 搜索值放在compare.val中，-1只是占位
@@ -572,8 +591,12 @@ IntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     return (unsigned short) (low - start);
 }
 
-static unsigned short
-BigIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
+static unsigned short BigIntSearch(
+    unsigned char *block,
+    unsigned int key,
+    void *val,
+    size_t len,
+    const RecordFormat *format)
 {
     DataHeader *header = reinterpret_cast<DataHeader *>(block);
     unsigned count = be16toh(header->slots);
@@ -583,6 +606,7 @@ BigIntSearch(unsigned char *block, unsigned int key, void *val, size_t len)
     BigIntCompare2 compare;
     compare.buffer = block;
     compare.key = key;
+    compare.format = format;
     compare.val = be64toh(*(reinterpret_cast<unsigned long long *>(val)));
 
     // 搜索值放在compare.val中，-1只是占位
@@ -0,0 +1,54 @@
+////
+// @file dbserver.cc
+// @brief
+// 数据库服务器程序
+// 用法：dbserver [地址] [端口] [reactor个数]
+// 收到SIGINT或SIGTERM后关闭所有连接，统计写回超块、脏buffer写回文件后退出。
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <db/buffer.h>
+#include <db/schema.h>
+#include <db/server.h>
+#include <db/table.h>
+
+using namespace db;
+
+int main(int argc, char *argv[])
+{
+    const char *address = argc > 1 ? argv[1] : "0.0.0.0";
+    unsigned short port =
+        argc > 2 ? (unsigned short) atoi(argv[2]) : SERVER_PORT;
+    unsigned int reactors = argc > 3 ? (unsigned int) atoi(argv[3]) : 0;
+
+    dbInit();
+
+    // 先屏蔽信号，服务器的线程继承屏蔽字，由主线程sigwait
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    Server server;
+    int ret = server.start(address, port, reactors);
+    if (ret) {
+        fprintf(stderr, "dbserver: %s:%u: %s\n", address, port, strerror(ret));
+        return 1;
+    }
+    printf("dbserver: listening on %s:%u\n", address, server.port());
+    fflush(stdout);
+
+    int sig;
+    sigwait(&signals, &sig);
+    server.stop();
+    Table::checkpointAll();
+    ret = kBuffer.flush();
+    if (ret) fprintf(stderr, "dbserver: flush: %s\n", strerror(ret));
+    return ret ? 1 : 0;
+}
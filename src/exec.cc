@@ -0,0 +1,2252 @@
+////
+// @file exec.cc
+// @brief
+// 实现向量化执行器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <db/exec.h>
+#include <db/endian.h>
+#include <db/file.h>
+#include <db/scheduler.h>
+
+namespace db {
+
+namespace {
+// 整数重新编码成大序
+void encodeInteger(long long value, unsigned int length, std::string &out)
+{
+    unsigned long long v = (unsigned long long) value;
+    out.resize(length);
+    for (unsigned int i = 0; i < length; ++i) {
+        out[length - i - 1] = (char) (v & 0xff);
+        v >>= 8;
+    }
+}
+
+// 选择向量上的整数比较，比较按无符号进行
+template <typename Compare>
+size_t selectInts(
+    const long long *ints,
+    unsigned short *selection,
+    size_t count,
+    unsigned long long value,
+    Compare compare)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned short row = selection[i];
+        selection[out] = row;
+        out += compare((unsigned long long) ints[row], value) ? 1 : 0;
+    }
+    return out;
+}
+
+// 分组列在分组键中的宽度，整数8字节，字节串是4字节长度加最大长度
+size_t groupWidth(const FieldInfo &field)
+{
+    if (isIntegerField(field)) return sizeof(long long);
+    return sizeof(unsigned int) + (size_t) abs(field.length);
+}
+
+// 分组键的hash，键的宽度是8的倍数，高位用于分区
+unsigned int hashKey(const unsigned char *key, size_t width)
+{
+    unsigned long long h = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < width; i += sizeof(h)) {
+        unsigned long long w;
+        memcpy(&w, key + i, sizeof(w));
+        w *= 0xff51afd7ed558ccdULL;
+        w ^= w >> 33;
+        h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned int) (h >> 32);
+}
+
+const size_t SPILL_BUFFER = 64 * 1024;  // 溢出时的写缓冲
+const size_t PROBE_CHUNK = 256 * 1024;  // 读回probe行的缓冲
+const unsigned int PARTITION_SHIFT = 32 - AGG_PARTITION_BITS; // hash到分区
+
+// 字节串的hash
+unsigned int hashBytes(const unsigned char *data, size_t length)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i)
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned int) (h >> 32);
+}
+
+// hash连接中序列化的行：hash(4B)，总长(4B)，连接键，各列
+// 整数8字节，字节串是4字节长度加内容
+inline unsigned int rowHash(const unsigned char *row)
+{
+    unsigned int hash;
+    memcpy(&hash, row, sizeof(hash));
+    return hash;
+}
+inline unsigned int rowLength(const unsigned char *row)
+{
+    unsigned int length;
+    memcpy(&length, row + sizeof(length), sizeof(length));
+    return length;
+}
+inline size_t keyLength(const unsigned char *row, bool integer)
+{
+    if (integer) return sizeof(long long);
+    unsigned int length;
+    memcpy(&length, row + 2 * sizeof(length), sizeof(length));
+    return sizeof(length) + length;
+}
+void appendInteger(std::vector<unsigned char> &out, long long value)
+{
+    size_t at = out.size();
+    out.resize(at + sizeof(value));
+    memcpy(out.data() + at, &value, sizeof(value));
+}
+void appendBytes(
+    std::vector<unsigned char> &out,
+    const unsigned char *data,
+    unsigned int length)
+{
+    size_t at = out.size();
+    out.resize(at + sizeof(length) + length);
+    memcpy(out.data() + at, &length, sizeof(length));
+    memcpy(out.data() + at + sizeof(length), data, length);
+}
+
+// 批中的一行追加到out的offset列之后，只拷贝解码了的列
+void appendRow(Batch &out, unsigned int offset, const Batch &in, size_t row)
+{
+    for (size_t c = 0; c < in.columns.size(); ++c) {
+        const ColumnVector &column = in.columns[c];
+        ColumnVector &to = out.columns[offset + c];
+        if (column.integer) {
+            if (!column.ints.empty()) to.ints.push_back(column.ints[row]);
+        } else if (!column.data.empty()) {
+            to.data.push_back(column.data[row]);
+            to.lengths.push_back(column.lengths[row]);
+        }
+    }
+}
+
+struct Eq
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x == y;
+    }
+};
+struct Ne
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x != y;
+    }
+};
+struct Lt
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x < y;
+    }
+};
+struct Le
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x <= y;
+    }
+};
+struct Gt
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x > y;
+    }
+};
+struct Ge
+{
+    bool operator()(unsigned long long x, unsigned long long y) const
+    {
+        return x >= y;
+    }
+};
+} // namespace
+
+void Batch::clear()
+{
+    for (size_t i = 0; i < pins.size(); ++i)
+        kBuffer.releaseBuf(pins[i]);
+    pins.clear();
+    large.clear();
+    for (size_t i = 0; i < columns.size(); ++i)
+        columns[i].clear();
+    selection.clear();
+    selected = false;
+    rows = 0;
+    chunk = 0;
+    used = 0;
+}
+
+unsigned char *Batch::reserve(unsigned int length)
+{
+    // 行外字段可能超过一块，单独分配，clear时释放
+    if (length > BLOCK_SIZE) {
+        large.push_back(
+            std::unique_ptr<unsigned char[]>(new unsigned char[length]));
+        return large.back().get();
+    }
+    // arena按BLOCK_SIZE分块
+    if (chunk < arena.size() && used + length > BLOCK_SIZE) {
+        ++chunk;
+        used = 0;
+    }
+    if (chunk == arena.size())
+        arena.push_back(
+            std::unique_ptr<unsigned char[]>(new unsigned char[BLOCK_SIZE]));
+    unsigned char *out = arena[chunk].get() + used;
+    used += length;
+    return out;
+}
+
+const unsigned char *Batch::copy(const unsigned char *data, unsigned int length)
+{
+    unsigned char *out = reserve(length);
+    memcpy(out, data, length);
+    return out;
+}
+
+bool isIntegerField(const FieldInfo &field)
+{
+    const char *name = field.type->name;
+    return strcmp(name, "CHAR") != 0 && strcmp(name, "VARCHAR") != 0;
+}
+
+long long decodeInteger(const unsigned char *data, unsigned int length)
+{
+    switch (length) {
+    case 1:
+        return *data;
+    case 2: {
+        unsigned short s;
+        memcpy(&s, data, sizeof(s));
+        return be16toh(s);
+    }
+    case 4: {
+        unsigned int i;
+        memcpy(&i, data, sizeof(i));
+        return be32toh(i);
+    }
+    case 8: {
+        unsigned long long l;
+        memcpy(&l, data, sizeof(l));
+        return (long long) be64toh(l);
+    }
+    default:
+        return 0;
+    }
+}
+
+Scan::Scan(
+    Table *table,
+    const std::vector<unsigned int> &fields,
+    const Plan *plan,
+    bool copying)
+    : table_(table)
+    , needed_(table->info_->count, false)
+    , access_(ACCESS_FULL)
+    , highInclusive_(false)
+    , blkid_(0)
+    , index_(0)
+    , done_(false)
+    , stop_(0)
+    , copying_(copying)
+    , started_(false)
+    , epoch_(0)
+    , lastKey_(NULL)
+    , lastLength_(0)
+{
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (fields[i] < needed_.size()) needed_[fields[i]] = true;
+    if (plan && plan->access != ACCESS_NONE) {
+        access_ = plan->access;
+        low_ = plan->low;
+        high_ = plan->high;
+        highInclusive_ = plan->highInclusive;
+    }
+}
+
+Scan::Scan(
+    Table *table,
+    const std::vector<unsigned int> &fields,
+    std::shared_ptr<Morsels> morsels)
+    : table_(table)
+    , needed_(table->info_->count, false)
+    , access_(ACCESS_FULL)
+    , highInclusive_(false)
+    , blkid_(0)
+    , index_(0)
+    , done_(false)
+    , morsels_(morsels)
+    , stop_(0)
+    , copying_(false)
+    , started_(true)
+    , epoch_(0)
+    , lastKey_(NULL)
+    , lastLength_(0)
+{
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (fields[i] < needed_.size()) needed_[fields[i]] = true;
+}
+
+Morsels::Morsels(Table *table, unsigned int size)
+    : next_(1)
+    , maxid_(0)
+    , size_(size ? size : MORSEL_BLOCKS)
+{
+    // 从超块得到maxid
+    BufDesp *desp = kBuffer.borrow(table->id_, 0);
+    SuperBlock super;
+    super.attach(desp->buffer);
+    maxid_ = super.getMaxid();
+    super.detach();
+    kBuffer.releaseBuf(desp);
+}
+
+bool Morsels::take(unsigned int &start, unsigned int &stop)
+{
+    start = next_.fetch_add(size_);
+    if (start > maxid_) return false;
+    stop = std::min(start + size_, maxid_ + 1);
+    return true;
+}
+
+void Scan::start()
+{
+    // 点查先查b+树，再退回到枚举
+    if (access_ == ACCESS_INDEX) {
+        blkid_ = table_->search((void *) low_.data(), (unsigned int) low_.size());
+        if (blkid_ == 0)
+            blkid_ =
+                table_->locate((void *) low_.data(), (unsigned int) low_.size());
+        return;
+    }
+    // 范围扫描从下界所在block开始
+    if (access_ == ACCESS_RANGE && !low_.empty()) {
+        blkid_ =
+            table_->locate((void *) low_.data(), (unsigned int) low_.size());
+        return;
+    }
+    // 全表扫描从数据链头开始
+    BufDesp *desp = kBuffer.borrow(table_->id_, 0);
+    SuperBlock super;
+    super.attach(desp->buffer);
+    blkid_ = super.getFirst();
+    super.detach();
+    kBuffer.releaseBuf(desp);
+}
+
+void Scan::relocate()
+{
+    // 按键有序的扫描从不大于该键的block重新开始，并行扫描只在原block内调整
+    void *key = (void *) last_.data();
+    unsigned int len = (unsigned int) last_.size();
+    if (!morsels_)
+        blkid_ = table_->locate(key, len);
+    else if (index_ == 0)
+        return;
+    if (blkid_ == 0) return;
+
+    BufDesp *desp = kBuffer.borrow(table_->id_, blkid_);
+    if (desp == NULL) return;
+    DataBlock block;
+    block.setTable(table_);
+    block.attach(desp->buffer);
+    index_ = 0;
+    if (block.getMagic() == MAGIC_NUMBER &&
+        block.getType() == BLOCK_TYPE_DATA) {
+        // searchRecord返回lowerbound，跳过上一批已经输出的键
+        index_ = block.searchRecord(key, len);
+        Record record;
+        unsigned char *pkey;
+        unsigned int klen;
+        if (index_ < block.getSlots() && block.refslots(index_, record) &&
+            record.refByIndex(&pkey, &klen, table_->info_->key) &&
+            klen == len && memcmp(pkey, key, len) == 0)
+            ++index_;
+    }
+    kBuffer.releaseBuf(desp);
+}
+
+bool Scan::decode(DataBlock &block, Batch &batch)
+{
+    RelationInfo *info = table_->info_;
+    const FieldInfo &key = info->fields[info->key];
+    unsigned short slots = block.getSlots();
+
+    // 点查只解码一条记录
+    if (access_ == ACCESS_INDEX) {
+        index_ = block.searchRecord((void *) low_.data(), low_.size());
+        slots = index_ < slots ? index_ + 1 : index_;
+        done_ = true;
+    }
+
+    // 定长记录的偏移表只取一次，之后每条记录只换指针
+    RecordLayout layout;
+    for (; index_ < slots; ++index_) {
+        if (batch.rows >= BATCH_SIZE) return true;
+
+        Record record;
+        block.refslots(index_, record);
+        if (!record.isactive()) continue;
+        // 有行外字段的记录末尾多一个位图
+        bool spanning = record.isstart();
+        if (!layout.decode(record) ||
+            layout.count() != info->count + (spanning ? 1u : 0u))
+            continue;
+        unsigned int count = info->count;
+        const unsigned char *bitmap = spanning ? layout.data(count) : NULL;
+
+        // 键超过上界，范围扫描结束
+        const unsigned char *k = layout.data(info->key);
+        if (access_ == ACCESS_RANGE && !high_.empty()) {
+            int cmp = compareValue(
+                key,
+                k,
+                layout.length(info->key),
+                (const unsigned char *) high_.data(),
+                (unsigned int) high_.size());
+            if (cmp > 0 || (cmp == 0 && !highInclusive_)) {
+                done_ = true;
+                return false;
+            }
+        }
+        // 点查要求键相等
+        if (access_ == ACCESS_INDEX &&
+            compareValue(
+                key,
+                k,
+                layout.length(info->key),
+                (const unsigned char *) low_.data(),
+                (unsigned int) low_.size()) != 0)
+            return false;
+
+        for (unsigned int f = 0; f < count; ++f) {
+            if (!needed_[f]) continue;
+            ColumnVector &column = batch.columns[f];
+            const unsigned char *value = layout.data(f);
+            unsigned int length = layout.length(f);
+            if (column.integer)
+                column.ints.push_back(decodeInteger(value, length));
+            else if (bitmap && isOverflowed(bitmap, f)) {
+                // 行外字段只在投影到时才读溢出链，读到批的arena中
+                unsigned int total = overflowLength(value);
+                unsigned char *out = batch.reserve(total);
+                if (table_->fetch(value, out)) total = 0;
+                column.data.push_back(out);
+                column.lengths.push_back(total);
+            } else {
+                column.data.push_back(
+                    copying_ ? batch.copy(value, length) : value);
+                column.lengths.push_back(length);
+            }
+        }
+        ++batch.rows;
+        lastKey_ = k;
+        lastLength_ = layout.length(info->key);
+    }
+    return false;
+}
+
+bool Scan::next(Batch &batch)
+{
+    RelationInfo *info = table_->info_;
+    batch.clear();
+    batch.columns.resize(info->count);
+    for (size_t i = 0; i < info->count; ++i)
+        batch.columns[i].integer = isIntegerField(info->fields[i]);
+
+    // 本批持有共享锁，block不会被分裂、合并或回收
+    SharedGuard guard(&table_->latch_);
+    if (!started_) {
+        start();
+        started_ = true;
+    } else if (!done_ && lastKey_ && epoch_ != table_->latch_.epoch())
+        relocate();
+
+    while (!done_ && batch.rows < BATCH_SIZE) {
+        // 并行扫描，当前morsel处理完后领取下一个
+        if (morsels_ && blkid_ >= stop_ && !morsels_->take(blkid_, stop_))
+            blkid_ = 0;
+        if (blkid_ == 0) {
+            done_ = true;
+            break;
+        }
+
+        BufDesp *desp = kBuffer.borrow(table_->id_, blkid_);
+        if (desp == NULL) {
+            if (morsels_) {
+                ++blkid_;
+                continue;
+            }
+            done_ = true;
+            break;
+        }
+        DataBlock block;
+        block.setTable(table_);
+        block.attach(desp->buffer);
+
+        // 并行扫描枚举blockid，跳过空闲块等非数据块
+        if (morsels_ && (block.getMagic() != MAGIC_NUMBER ||
+                         block.getType() != BLOCK_TYPE_DATA)) {
+            kBuffer.releaseBuf(desp);
+            ++blkid_;
+            continue;
+        }
+
+        // 字节串列指向block，批释放前保持借用；归还前先取下一个blockid
+        // 和最后一条记录的键
+        size_t before = batch.rows;
+        bool more = decode(block, batch);
+        unsigned int next = morsels_ ? blkid_ + 1 : block.getNext();
+        if (batch.rows > before)
+            last_.assign((const char *) lastKey_, lastLength_);
+        if (batch.rows > before && !copying_)
+            batch.pins.push_back(desp);
+        else
+            kBuffer.releaseBuf(desp);
+        if (more) break;
+
+        // 下一个block
+        index_ = 0;
+        blkid_ = done_ ? 0 : next;
+    }
+    epoch_ = table_->latch_.epoch();
+    return batch.rows > 0;
+}
+
+Filter::Filter(
+    std::unique_ptr<Operator> child,
+    RelationInfo *info,
+    const std::vector<Predicate> &predicates)
+    : child_(std::move(child))
+    , info_(info)
+{
+    for (size_t i = 0; i < predicates.size(); ++i) {
+        const Predicate &pred = predicates[i];
+        Condition cond;
+        cond.field = pred.field;
+        cond.op = pred.op;
+        cond.integer = isIntegerField(info->fields[pred.field]);
+        cond.value = cond.integer
+                         ? decodeInteger(
+                               (const unsigned char *) pred.key.data(),
+                               (unsigned int) pred.key.size())
+                         : 0;
+        cond.key = pred.key;
+        conditions_.push_back(cond);
+    }
+}
+
+void Filter::apply(const Condition &cond, Batch &batch)
+{
+    // 还没有选择向量，先选中所有行
+    if (!batch.selected) {
+        batch.selection.resize(batch.rows);
+        for (size_t i = 0; i < batch.rows; ++i)
+            batch.selection[i] = (unsigned short) i;
+        batch.selected = true;
+    }
+
+    ColumnVector &column = batch.columns[cond.field];
+    unsigned short *selection = batch.selection.data();
+    size_t count = batch.selection.size();
+    size_t out = 0;
+
+    if (cond.integer) {
+        const long long *ints = column.ints.data();
+        unsigned long long v = (unsigned long long) cond.value;
+        switch (cond.op) {
+        case OP_EQ:
+            out = selectInts(ints, selection, count, v, Eq());
+            break;
+        case OP_NE:
+            out = selectInts(ints, selection, count, v, Ne());
+            break;
+        case OP_LT:
+            out = selectInts(ints, selection, count, v, Lt());
+            break;
+        case OP_LE:
+            out = selectInts(ints, selection, count, v, Le());
+            break;
+        case OP_GT:
+            out = selectInts(ints, selection, count, v, Gt());
+            break;
+        case OP_GE:
+            out = selectInts(ints, selection, count, v, Ge());
+            break;
+        }
+    } else {
+        const FieldInfo &field = info_->fields[cond.field];
+        for (size_t i = 0; i < count; ++i) {
+            unsigned short row = selection[i];
+            selection[out] = row;
+            out += matchValue(
+                       field,
+                       cond.op,
+                       column.data[row],
+                       column.lengths[row],
+                       cond.key)
+                       ? 1
+                       : 0;
+        }
+    }
+    batch.selection.resize(out);
+}
+
+bool Filter::next(Batch &batch)
+{
+    while (child_->next(batch)) {
+        for (size_t i = 0; i < conditions_.size() && batch.count() > 0; ++i)
+            apply(conditions_[i], batch);
+        if (batch.count() > 0) return true;
+    }
+    return false;
+}
+
+bool Project::next(Batch &batch)
+{
+    if (!child_->next(batch)) return false;
+
+    // 只出现一次的列直接交换，重复的列需要拷贝
+    std::vector<int> uses(batch.columns.size(), 0);
+    for (size_t i = 0; i < fields_.size(); ++i)
+        ++uses[fields_[i]];
+
+    std::vector<ColumnVector> out(fields_.size());
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        unsigned int f = fields_[i];
+        if (--uses[f] == 0)
+            std::swap(out[i], batch.columns[f]);
+        else
+            out[i] = batch.columns[f];
+    }
+    batch.columns.swap(out);
+    return true;
+}
+
+bool Limit::next(Batch &batch)
+{
+    if (remain_ <= 0 || !child_->next(batch)) return false;
+
+    size_t count = batch.count();
+    if ((long long) count > remain_) {
+        if (!batch.selected) {
+            batch.selection.resize(batch.rows);
+            for (size_t i = 0; i < batch.rows; ++i)
+                batch.selection[i] = (unsigned short) i;
+            batch.selected = true;
+        }
+        batch.selection.resize((size_t) remain_);
+        count = (size_t) remain_;
+    }
+    remain_ -= (long long) count;
+    return true;
+}
+
+bool Aggregate::next(Batch &batch)
+{
+    if (done_) return false;
+    done_ = true;
+
+    size_t n = aggregations_.size();
+    std::vector<long long> values(n, 0);
+    std::vector<bool> seen(n, false);
+
+    while (child_->next(batch)) {
+        size_t count = batch.count();
+        for (size_t a = 0; a < n; ++a) {
+            const Aggregation &agg = aggregations_[a];
+            if (agg.func == AGG_COUNT) {
+                values[a] += (long long) count;
+                continue;
+            }
+
+            const ColumnVector &column = batch.columns[agg.field];
+            if (!column.integer) continue;
+            const long long *ints = column.ints.data();
+            long long v = values[a];
+            bool s = seen[a];
+            for (size_t i = 0; i < count; ++i) {
+                unsigned long long x = (unsigned long long) ints[batch.row(i)];
+                if (agg.func == AGG_SUM)
+                    v += (long long) x;
+                else if (!s ||
+                         (agg.func == AGG_MIN ? x < (unsigned long long) v
+                                              : x > (unsigned long long) v))
+                    v = (long long) x;
+                s = true;
+            }
+            values[a] = v;
+            seen[a] = s;
+        }
+    }
+
+    // 输出一行
+    batch.clear();
+    batch.columns.resize(n);
+    for (size_t a = 0; a < n; ++a) {
+        batch.columns[a].integer = true;
+        batch.columns[a].ints.push_back(values[a]);
+    }
+    batch.rows = 1;
+    return true;
+}
+
+unsigned char *GroupTable::upsert(
+    const unsigned char *key,
+    unsigned int hash,
+    bool &inserted)
+{
+    // 装载因子不超过1/2
+    if (count_ * 2 >= slots_.size()) grow();
+
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot &slot = slots_[i];
+        if (slot.entry == 0) {
+            slot.hash = hash;
+            slot.entry = (unsigned int) ++count_;
+            entries_.resize(count_ * width_);
+            unsigned char *ret = entry(count_ - 1);
+            memcpy(ret, key, keyWidth_);
+            inserted = true;
+            return ret;
+        }
+        if (slot.hash == hash &&
+            memcmp(entry(slot.entry - 1), key, keyWidth_) == 0) {
+            inserted = false;
+            return entry(slot.entry - 1);
+        }
+    }
+}
+
+void GroupTable::clear()
+{
+    std::vector<Slot>().swap(slots_);
+    std::vector<unsigned char>().swap(entries_);
+    count_ = 0;
+}
+
+void GroupTable::grow()
+{
+    std::vector<Slot> slots(slots_.empty() ? 64 : slots_.size() * 2);
+    size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].entry == 0) continue;
+        size_t k = slots_[i].hash & mask;
+        while (slots[k].entry) k = (k + 1) & mask;
+        slots[k] = slots_[i];
+    }
+    slots_.swap(slots);
+}
+
+HashAggregate::HashAggregate(
+    std::vector<std::unique_ptr<Operator>> children,
+    RelationInfo *info,
+    const std::vector<unsigned int> &groups,
+    const std::vector<Aggregation> &aggregations,
+    size_t memory)
+    : children_(std::move(children))
+    , info_(info)
+    , groups_(groups)
+    , aggregations_(aggregations)
+    , memory_(memory)
+    , keyWidth_(0)
+    , built_(false)
+    , partition_(0)
+    , index_(0)
+    , spilled_(0)
+{
+    for (size_t g = 0; g < groups_.size(); ++g)
+        keyWidth_ += groupWidth(info_->fields[groups_[g]]);
+    keyWidth_ = (keyWidth_ + sizeof(long long) - 1) & ~(sizeof(long long) - 1);
+    width_ = keyWidth_ + aggregations_.size() * sizeof(long long);
+    if (width_ == 0) width_ = sizeof(long long);
+
+    locals_.resize(children_.size());
+    for (size_t w = 0; w < locals_.size(); ++w) {
+        locals_[w].partitions.assign(
+            AGG_PARTITIONS, GroupTable(keyWidth_, width_));
+        locals_[w].spills.resize(AGG_PARTITIONS);
+        locals_[w].sizes.assign(AGG_PARTITIONS, 0);
+    }
+    results_.assign(AGG_PARTITIONS, GroupTable(keyWidth_, width_));
+}
+
+HashAggregate::~HashAggregate()
+{
+    // 没有合并完的临时文件
+    for (size_t w = 0; w < locals_.size(); ++w)
+        for (size_t p = 0; p < locals_[w].spills.size(); ++p)
+            if (!locals_[w].spills[p].empty())
+                kFiles.drop(locals_[w].spills[p]);
+}
+
+void HashAggregate::consume(size_t worker)
+{
+    Local &local = locals_[worker];
+    size_t budget = memory_ / children_.size();
+    Batch batch;
+    while (children_[worker]->next(batch)) {
+        accumulate(local, batch);
+
+        size_t used = 0;
+        for (size_t p = 0; p < AGG_PARTITIONS; ++p)
+            used += local.partitions[p].memory();
+        if (used > budget) spill(local);
+    }
+}
+
+void HashAggregate::accumulate(Local &local, Batch &batch)
+{
+    std::vector<unsigned char> buffer(keyWidth_ + sizeof(long long));
+    unsigned char *key = buffer.data();
+    size_t count = batch.count();
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t row = batch.row(i);
+
+        // 拼接分组键，字节串补0到最大长度
+        memset(key, 0, keyWidth_);
+        size_t offset = 0;
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            const ColumnVector &column = batch.columns[groups_[g]];
+            size_t width = groupWidth(info_->fields[groups_[g]]);
+            if (column.integer)
+                memcpy(key + offset, &column.ints[row], sizeof(long long));
+            else {
+                unsigned int length = column.lengths[row];
+                if (length > width - sizeof(length))
+                    length = (unsigned int) (width - sizeof(length));
+                memcpy(key + offset, &length, sizeof(length));
+                memcpy(key + offset + sizeof(length), column.data[row], length);
+            }
+            offset += width;
+        }
+
+        unsigned int hash = hashKey(key, keyWidth_);
+        GroupTable &table =
+            local.partitions[hash >> (32 - AGG_PARTITION_BITS)];
+        bool inserted;
+        long long *states =
+            (long long *) (table.upsert(key, hash, inserted) + keyWidth_);
+
+        for (size_t a = 0; a < aggregations_.size(); ++a) {
+            const Aggregation &agg = aggregations_[a];
+            // MIN的初值取无符号最大值
+            if (inserted) states[a] = agg.func == AGG_MIN ? -1 : 0;
+            if (agg.func == AGG_COUNT) {
+                ++states[a];
+                continue;
+            }
+            unsigned long long x =
+                (unsigned long long) batch.columns[agg.field].ints[row];
+            unsigned long long v = (unsigned long long) states[a];
+            if (agg.func == AGG_SUM)
+                v += x;
+            else if (agg.func == AGG_MIN ? x < v : x > v)
+                v = x;
+            states[a] = (long long) v;
+        }
+    }
+}
+
+void HashAggregate::spill(Local &local)
+{
+    for (size_t p = 0; p < AGG_PARTITIONS; ++p) {
+        GroupTable &table = local.partitions[p];
+        if (table.count() == 0) continue;
+
+        // 第1次溢出时创建临时文件，创建失败则留在内存
+        if (local.spills[p].empty() &&
+            kFiles.temporary(local.spills[p]) == NULL) {
+            local.spills[p].clear();
+            continue;
+        }
+        File *file = kFiles.open(local.spills[p].c_str());
+        size_t length = table.count() * width_;
+        if (file == NULL ||
+            file->write(local.sizes[p], (const char *) table.entry(0), length))
+            continue;
+        local.sizes[p] += length;
+        table.clear();
+    }
+    spilled_.fetch_add(1);
+}
+
+void HashAggregate::combine(GroupTable &table, const unsigned char *entry)
+{
+    bool inserted;
+    unsigned char *ret =
+        table.upsert(entry, hashKey(entry, keyWidth_), inserted);
+    if (inserted) {
+        memcpy(ret + keyWidth_, entry + keyWidth_, width_ - keyWidth_);
+        return;
+    }
+
+    long long *states = (long long *) (ret + keyWidth_);
+    const long long *other = (const long long *) (entry + keyWidth_);
+    for (size_t a = 0; a < aggregations_.size(); ++a) {
+        unsigned long long x = (unsigned long long) other[a];
+        unsigned long long v = (unsigned long long) states[a];
+        switch (aggregations_[a].func) {
+        case AGG_COUNT:
+        case AGG_SUM:
+            v += x;
+            break;
+        case AGG_MIN:
+            v = std::min(v, x);
+            break;
+        case AGG_MAX:
+            v = std::max(v, x);
+            break;
+        }
+        states[a] = (long long) v;
+    }
+}
+
+void HashAggregate::merge(size_t partition)
+{
+    GroupTable &result = results_[partition];
+    std::vector<unsigned char> chunk(width_ * BATCH_SIZE);
+
+    for (size_t w = 0; w < locals_.size(); ++w) {
+        Local &local = locals_[w];
+
+        // 内存中的部分结果，第1个直接接管
+        GroupTable &table = local.partitions[partition];
+        if (result.count() == 0)
+            std::swap(result, table);
+        else
+            for (size_t i = 0; i < table.count(); ++i)
+                combine(result, table.entry(i));
+        table.clear();
+
+        // 分块读回溢出的部分结果
+        if (local.spills[partition].empty()) continue;
+        File *file = kFiles.open(local.spills[partition].c_str());
+        unsigned long long size = local.sizes[partition];
+        for (unsigned long long offset = 0; file && offset < size;) {
+            size_t length =
+                (size_t) std::min((unsigned long long) chunk.size(), size - offset);
+            if (file->read(offset, (char *) chunk.data(), length)) break;
+            for (size_t i = 0; i < length; i += width_)
+                combine(result, chunk.data() + i);
+            offset += length;
+        }
+        kFiles.drop(local.spills[partition]);
+        local.spills[partition].clear();
+    }
+}
+
+bool HashAggregate::next(Batch &batch)
+{
+    if (!built_) {
+        built_ = true;
+
+        // 每条输入一个线程，当前线程消费第0条
+        TaskGroup group;
+        for (size_t w = 1; w < children_.size(); ++w)
+            kScheduler.spawn(
+                std::bind(&HashAggregate::consume, this, w),
+                TASK_FOREGROUND,
+                &group);
+        if (!children_.empty()) consume(0);
+        kScheduler.wait(group);
+
+        // 各分区并行合并
+        TaskGroup merging;
+        for (size_t p = 1; p < AGG_PARTITIONS; ++p)
+            kScheduler.spawn(
+                std::bind(&HashAggregate::merge, this, p),
+                TASK_FOREGROUND,
+                &merging);
+        merge(0);
+        kScheduler.wait(merging);
+        locals_.clear();
+    }
+
+    batch.clear();
+    batch.columns.resize(groups_.size() + aggregations_.size());
+    for (size_t g = 0; g < groups_.size(); ++g)
+        batch.columns[g].integer = isIntegerField(info_->fields[groups_[g]]);
+    for (size_t a = 0; a < aggregations_.size(); ++a)
+        batch.columns[groups_.size() + a].integer = true;
+
+    while (partition_ < AGG_PARTITIONS && batch.rows < BATCH_SIZE) {
+        GroupTable &table = results_[partition_];
+        if (index_ >= table.count()) {
+            ++partition_;
+            index_ = 0;
+            continue;
+        }
+        const unsigned char *entry = table.entry(index_++);
+
+        // 拆开分组键
+        size_t offset = 0;
+        for (size_t g = 0; g < groups_.size(); ++g) {
+            ColumnVector &column = batch.columns[g];
+            if (column.integer) {
+                long long v;
+                memcpy(&v, entry + offset, sizeof(v));
+                column.ints.push_back(v);
+            } else {
+                unsigned int length;
+                memcpy(&length, entry + offset, sizeof(length));
+                column.data.push_back(entry + offset + sizeof(length));
+                column.lengths.push_back(length);
+            }
+            offset += groupWidth(info_->fields[groups_[g]]);
+        }
+        const long long *states = (const long long *) (entry + keyWidth_);
+        for (size_t a = 0; a < aggregations_.size(); ++a)
+            batch.columns[groups_.size() + a].ints.push_back(states[a]);
+        ++batch.rows;
+    }
+    return batch.rows > 0;
+}
+
+HashJoin::HashJoin(
+    std::unique_ptr<Operator> build,
+    std::unique_ptr<Operator> probe,
+    RelationInfo *buildInfo,
+    RelationInfo *probeInfo,
+    const std::vector<unsigned int> &buildFields,
+    const std::vector<unsigned int> &probeFields,
+    unsigned int buildKey,
+    unsigned int probeKey,
+    bool buildLeft,
+    size_t memory)
+    : columns_(buildInfo->count + probeInfo->count)
+    , memory_(memory)
+    , partitions_(AGG_PARTITIONS)
+    , built_(false)
+    , probing_(true)
+    , row_(0)
+    , partition_(-1)
+    , chunk_(PROBE_CHUNK)
+    , chunkPos_(0)
+    , chunkLen_(0)
+    , fileOffset_(0)
+    , current_(NULL)
+    , fromBatch_(false)
+    , probeRow_(0)
+    , matching_(NULL)
+    , match_(0)
+    , spilled_(0)
+{
+    children_[0] = std::move(build);
+    children_[1] = std::move(probe);
+    infos_[0] = buildInfo;
+    infos_[1] = probeInfo;
+    fields_[0] = buildFields;
+    fields_[1] = probeFields;
+    keys_[0] = buildKey;
+    keys_[1] = probeKey;
+    offsets_[0] = buildLeft ? 0 : probeInfo->count;
+    offsets_[1] = buildLeft ? buildInfo->count : 0;
+    integer_ = isIntegerField(buildInfo->fields[buildKey]);
+}
+
+HashJoin::~HashJoin()
+{
+    for (size_t p = 0; p < partitions_.size(); ++p)
+        for (int side = 0; side < 2; ++side)
+            if (!partitions_[p].files[side].empty())
+                kFiles.drop(partitions_[p].files[side]);
+}
+
+void HashJoin::serialize(
+    int side,
+    const Batch &batch,
+    size_t row,
+    bool keyOnly,
+    std::vector<unsigned char> &out)
+{
+    size_t start = out.size();
+    out.resize(start + 2 * sizeof(unsigned int));
+
+    // 连接键，字节串去掉末尾的0
+    const ColumnVector &key = batch.columns[keys_[side]];
+    if (key.integer)
+        appendInteger(out, key.ints[row]);
+    else {
+        unsigned int length = key.lengths[row];
+        while (length > 0 && key.data[row][length - 1] == 0)
+            --length;
+        appendBytes(out, key.data[row], length);
+    }
+    unsigned int hash = hashBytes(
+        out.data() + start + 2 * sizeof(unsigned int),
+        out.size() - start - 2 * sizeof(unsigned int));
+
+    // 各列
+    if (!keyOnly) {
+        for (size_t i = 0; i < fields_[side].size(); ++i) {
+            const ColumnVector &column = batch.columns[fields_[side][i]];
+            if (column.integer)
+                appendInteger(out, column.ints[row]);
+            else
+                appendBytes(out, column.data[row], column.lengths[row]);
+        }
+    }
+
+    unsigned int length = (unsigned int) (out.size() - start);
+    memcpy(out.data() + start, &hash, sizeof(hash));
+    memcpy(out.data() + start + sizeof(hash), &length, sizeof(length));
+}
+
+void HashJoin::build()
+{
+    Batch batch;
+    std::vector<unsigned char> row;
+    while (children_[0]->next(batch)) {
+        for (size_t i = 0; i < batch.count(); ++i) {
+            row.clear();
+            serialize(0, batch, batch.row(i), false, row);
+            Partition &part = partitions_[rowHash(row.data()) >> PARTITION_SHIFT];
+            if (!part.spilled) part.offsets.push_back(part.rows.size());
+            part.rows.insert(part.rows.end(), row.begin(), row.end());
+            if (part.spilled && part.rows.size() >= SPILL_BUFFER)
+                flush(part, 0);
+        }
+        spillLargest();
+    }
+
+    for (size_t p = 0; p < partitions_.size(); ++p) {
+        if (partitions_[p].spilled)
+            flush(partitions_[p], 0);
+        else
+            index(partitions_[p]);
+    }
+}
+
+void HashJoin::spillLargest()
+{
+    while (true) {
+        size_t used = 0;
+        Partition *largest = NULL;
+        for (size_t p = 0; p < partitions_.size(); ++p) {
+            Partition &part = partitions_[p];
+            if (part.spilled) continue;
+            used += part.rows.capacity() +
+                    part.offsets.capacity() * sizeof(size_t);
+            if (largest == NULL || part.rows.size() > largest->rows.size())
+                largest = &part;
+        }
+        if (used <= memory_ || largest == NULL || largest->rows.empty())
+            return;
+
+        // 写不出去就留在内存
+        flush(*largest, 0);
+        if (!largest->rows.empty()) return;
+        largest->spilled = true;
+        ++spilled_;
+        std::vector<unsigned char>().swap(largest->rows);
+        std::vector<size_t>().swap(largest->offsets);
+    }
+}
+
+void HashJoin::flush(Partition &partition, int side)
+{
+    std::vector<unsigned char> &buffer = side ? partition.probe : partition.rows;
+    if (buffer.empty()) return;
+
+    // 第1次写时创建临时文件，失败则留在缓冲
+    std::string &name = partition.files[side];
+    if (name.empty() && kFiles.temporary(name) == NULL) {
+        name.clear();
+        return;
+    }
+    File *file = kFiles.open(name.c_str());
+    if (file == NULL || file->write(
+                            partition.sizes[side],
+                            (const char *) buffer.data(),
+                            buffer.size()))
+        return;
+    partition.sizes[side] += buffer.size();
+    buffer.clear();
+}
+
+void HashJoin::index(Partition &partition)
+{
+    size_t count = partition.offsets.size();
+    size_t slots = 16;
+    while (slots < count * 2)
+        slots *= 2;
+    partition.heads.assign(slots, 0);
+    partition.nexts.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        unsigned int hash =
+            rowHash(partition.rows.data() + partition.offsets[i]);
+        unsigned int &head = partition.heads[hash & (slots - 1)];
+        partition.nexts[i] = head;
+        head = (unsigned int) (i + 1);
+    }
+}
+
+void HashJoin::load(Partition &partition)
+{
+    // 文件中的行在前，没能写出的行在后
+    std::vector<unsigned char> rows((size_t) partition.sizes[0]);
+    File *file = partition.files[0].empty()
+                     ? NULL
+                     : kFiles.open(partition.files[0].c_str());
+    if (file == NULL ||
+        file->read(0, (char *) rows.data(), (size_t) partition.sizes[0]))
+        rows.clear();
+    rows.insert(rows.end(), partition.rows.begin(), partition.rows.end());
+    partition.rows.swap(rows);
+
+    partition.offsets.clear();
+    for (size_t offset = 0; offset + 2 * sizeof(unsigned int) <=
+                            partition.rows.size();) {
+        partition.offsets.push_back(offset);
+        offset += rowLength(partition.rows.data() + offset);
+    }
+    index(partition);
+}
+
+bool HashJoin::readChunk()
+{
+    Partition &part = partitions_[partition_];
+
+    // 不完整的行移到开头
+    size_t remain = chunkLen_ - chunkPos_;
+    memmove(chunk_.data(), chunk_.data() + chunkPos_, remain);
+    chunkPos_ = 0;
+    chunkLen_ = remain;
+
+    if (fileOffset_ < part.sizes[1]) {
+        size_t length = (size_t) std::min(
+            (unsigned long long) (chunk_.size() - remain),
+            part.sizes[1] - fileOffset_);
+        File *file = kFiles.open(part.files[1].c_str());
+        if (file == NULL ||
+            file->read(fileOffset_, (char *) chunk_.data() + remain, length)) {
+            fileOffset_ = part.sizes[1];
+            return false;
+        }
+        fileOffset_ += length;
+        chunkLen_ += length;
+        return true;
+    }
+
+    // 没能写出的probe行
+    if (part.probe.empty()) return false;
+    if (chunk_.size() < remain + part.probe.size())
+        chunk_.resize(remain + part.probe.size());
+    memcpy(chunk_.data() + remain, part.probe.data(), part.probe.size());
+    chunkLen_ += part.probe.size();
+    part.probe.clear();
+    return true;
+}
+
+bool HashJoin::findMatch()
+{
+    Partition &part = *matching_;
+    size_t keylen = keyLength(current_, integer_);
+    while (match_) {
+        const unsigned char *row = part.rows.data() + part.offsets[match_ - 1];
+        if (rowHash(row) == rowHash(current_) && keyLength(row, integer_) == keylen &&
+            memcmp(
+                row + 2 * sizeof(unsigned int),
+                current_ + 2 * sizeof(unsigned int),
+                keylen) == 0)
+            return true;
+        match_ = part.nexts[match_ - 1];
+    }
+    return false;
+}
+
+bool HashJoin::advance(bool reload)
+{
+    while (true) {
+        // 逐行探测probe输入
+        if (probing_) {
+            if (row_ >= probe_.count()) {
+                if (!reload) return false;
+                if (children_[1]->next(probe_)) {
+                    row_ = 0;
+                    continue;
+                }
+
+                // probe输入结束，释放内存中的分区
+                probing_ = false;
+                probe_.clear();
+                for (size_t p = 0; p < partitions_.size(); ++p) {
+                    Partition &part = partitions_[p];
+                    if (part.spilled)
+                        flush(part, 1);
+                    else
+                        part = Partition();
+                }
+                continue;
+            }
+
+            size_t row = probe_.row(row_++);
+            scratch_.clear();
+            serialize(1, probe_, row, true, scratch_);
+            unsigned int hash = rowHash(scratch_.data());
+            Partition &part = partitions_[hash >> PARTITION_SHIFT];
+
+            // 溢出的分区，留到最后处理
+            if (part.spilled) {
+                serialize(1, probe_, row, false, part.probe);
+                if (part.probe.size() >= SPILL_BUFFER) flush(part, 1);
+                continue;
+            }
+            if (part.heads.empty()) continue;
+
+            current_ = scratch_.data();
+            fromBatch_ = true;
+            probeRow_ = row;
+            matching_ = &part;
+            match_ = part.heads[hash & (part.heads.size() - 1)];
+            if (findMatch()) return true;
+            continue;
+        }
+
+        // 溢出分区中的下一个probe行
+        if (partition_ >= (int) partitions_.size()) return false;
+        if (partition_ >= 0 &&
+            chunkPos_ + 2 * sizeof(unsigned int) <= chunkLen_ &&
+            chunkPos_ + rowLength(chunk_.data() + chunkPos_) <= chunkLen_) {
+            current_ = chunk_.data() + chunkPos_;
+            chunkPos_ += rowLength(current_);
+            Partition &part = partitions_[partition_];
+            fromBatch_ = false;
+            matching_ = &part;
+            match_ = part.heads[rowHash(current_) & (part.heads.size() - 1)];
+            if (findMatch()) return true;
+            continue;
+        }
+        if (!reload) return false;
+        if (partition_ >= 0 && readChunk()) continue;
+
+        // 当前分区处理完，装入下一个溢出分区
+        if (partition_ >= 0) {
+            Partition &part = partitions_[partition_];
+            for (int side = 0; side < 2; ++side)
+                if (!part.files[side].empty()) kFiles.drop(part.files[side]);
+            part = Partition();
+        }
+        do {
+            ++partition_;
+        } while (partition_ < (int) partitions_.size() &&
+                 !partitions_[partition_].spilled);
+        if (partition_ >= (int) partitions_.size()) return false;
+        load(partitions_[partition_]);
+        chunkPos_ = chunkLen_ = 0;
+        fileOffset_ = 0;
+    }
+}
+
+void HashJoin::deserialize(int side, const unsigned char *row, Batch &batch)
+{
+    const unsigned char *p =
+        row + 2 * sizeof(unsigned int) + keyLength(row, integer_);
+    for (size_t i = 0; i < fields_[side].size(); ++i) {
+        ColumnVector &column = batch.columns[offsets_[side] + fields_[side][i]];
+        if (column.integer) {
+            long long v;
+            memcpy(&v, p, sizeof(v));
+            column.ints.push_back(v);
+            p += sizeof(v);
+        } else {
+            unsigned int length;
+            memcpy(&length, p, sizeof(length));
+            column.data.push_back(p + sizeof(length));
+            column.lengths.push_back(length);
+            p += sizeof(length) + length;
+        }
+    }
+}
+
+void HashJoin::emit(Batch &batch)
+{
+    deserialize(
+        0,
+        matching_->rows.data() + matching_->offsets[match_ - 1],
+        batch);
+    if (fromBatch_)
+        appendRow(batch, offsets_[1], probe_, probeRow_);
+    else
+        deserialize(1, current_, batch);
+    ++batch.rows;
+}
+
+bool HashJoin::next(Batch &batch)
+{
+    if (!built_) {
+        built_ = true;
+        build();
+    }
+
+    batch.clear();
+    batch.columns.resize(columns_);
+    for (int side = 0; side < 2; ++side)
+        for (unsigned int f = 0; f < infos_[side]->count; ++f)
+            batch.columns[offsets_[side] + f].integer =
+                isIntegerField(infos_[side]->fields[f]);
+
+    // 上一批没有输出完的匹配
+    bool found = match_ != 0;
+    while (batch.rows < BATCH_SIZE) {
+        if (!found && !advance(batch.rows == 0)) break;
+        emit(batch);
+        match_ = matching_->nexts[match_ - 1];
+        found = findMatch();
+    }
+    return batch.rows > 0;
+}
+
+MergeJoin::MergeJoin(
+    std::unique_ptr<Operator> left,
+    std::unique_ptr<Operator> right,
+    RelationInfo *leftInfo,
+    RelationInfo *rightInfo,
+    unsigned int leftKey,
+    unsigned int rightKey)
+    : done_(false)
+{
+    children_[0] = std::move(left);
+    children_[1] = std::move(right);
+    infos_[0] = leftInfo;
+    infos_[1] = rightInfo;
+    keys_[0] = leftKey;
+    keys_[1] = rightKey;
+    rows_[0] = rows_[1] = 0;
+}
+
+bool MergeJoin::next(Batch &batch)
+{
+    batch.clear();
+    batch.columns.resize(infos_[0]->count + infos_[1]->count);
+    for (unsigned int f = 0; f < infos_[0]->count; ++f)
+        batch.columns[f].integer = isIntegerField(infos_[0]->fields[f]);
+    for (unsigned int f = 0; f < infos_[1]->count; ++f)
+        batch.columns[infos_[0]->count + f].integer =
+            isIntegerField(infos_[1]->fields[f]);
+
+    const FieldInfo &key = infos_[0]->fields[keys_[0]];
+    while (!done_ && batch.rows < BATCH_SIZE) {
+        // 输出引用两边的当前批，换批前先交出已有的输出
+        for (int side = 0; side < 2 && !done_; ++side) {
+            if (rows_[side] < batches_[side].count()) continue;
+            if (batch.rows > 0) return true;
+            if (!children_[side]->next(batches_[side]))
+                done_ = true;
+            else
+                rows_[side] = 0;
+        }
+        if (done_) break;
+
+        const Batch &l = batches_[0];
+        const Batch &r = batches_[1];
+        size_t x = l.row(rows_[0]);
+        size_t y = r.row(rows_[1]);
+        const ColumnVector &lk = l.columns[keys_[0]];
+        const ColumnVector &rk = r.columns[keys_[1]];
+        int cmp;
+        if (lk.integer) {
+            unsigned long long a = (unsigned long long) lk.ints[x];
+            unsigned long long b = (unsigned long long) rk.ints[y];
+            cmp = a < b ? -1 : (a > b ? 1 : 0);
+        } else
+            cmp = compareValue(
+                key,
+                lk.data[x],
+                lk.lengths[x],
+                rk.data[y],
+                rk.lengths[y]);
+
+        if (cmp < 0)
+            ++rows_[0];
+        else if (cmp > 0)
+            ++rows_[1];
+        else {
+            appendRow(batch, 0, l, x);
+            appendRow(batch, infos_[0]->count, r, y);
+            ++batch.rows;
+            ++rows_[0];
+            ++rows_[1];
+        }
+    }
+    return batch.rows > 0;
+}
+
+Sort::Sort(
+    std::vector<std::unique_ptr<Operator>> children,
+    const std::vector<bool> &integers,
+    const std::vector<unsigned int> &fields,
+    unsigned int key,
+    bool desc,
+    long long limit,
+    size_t memory)
+    : children_(std::move(children))
+    , integers_(integers)
+    , key_(key)
+    , integer_(integers[key])
+    , desc_(desc)
+    , limit_(limit)
+    , memory_(memory)
+    , locals_(children_.size())
+    , built_(false)
+    , emitted_(0)
+    , spilled_(0)
+{
+    // 排序列放在最前，便于比较
+    fields_.push_back(key);
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (std::find(fields_.begin(), fields_.end(), fields[i]) ==
+            fields_.end())
+            fields_.push_back(fields[i]);
+}
+
+Sort::~Sort()
+{
+    for (size_t r = 0; r < runs_.size(); ++r) {
+        Run &run = runs_[r];
+        if (run.pin) kBuffer.releaseBuf(run.pin);
+        if (run.file.empty()) continue;
+        kBuffer.discard(run.id);
+        kFiles.drop(run.file);
+    }
+    for (size_t w = 0; w < locals_.size(); ++w)
+        for (size_t i = 0; i < locals_[w].files.size(); ++i) {
+            kBuffer.discard(locals_[w].files[i].c_str());
+            kFiles.drop(locals_[w].files[i]);
+        }
+}
+
+void Sort::append(Local &local, const Batch &batch, size_t row)
+{
+    std::vector<unsigned char> &out = local.rows;
+    Entry entry;
+    entry.offset = out.size();
+
+    // 规范化前缀，字节串不足8字节补0，与字节序比较一致
+    const ColumnVector &key = batch.columns[key_];
+    if (key.integer)
+        entry.prefix = (unsigned long long) key.ints[row];
+    else {
+        unsigned char bytes[sizeof(long long)] = {0};
+        memcpy(
+            bytes,
+            key.data[row],
+            std::min((size_t) key.lengths[row], sizeof(bytes)));
+        memcpy(&entry.prefix, bytes, sizeof(bytes));
+        entry.prefix = be64toh(entry.prefix);
+    }
+    if (desc_) entry.prefix = ~entry.prefix;
+
+    // 总长(4B)，前缀(8B)，各列
+    out.resize(entry.offset + sizeof(unsigned int) + sizeof(entry.prefix));
+    memcpy(
+        out.data() + entry.offset + sizeof(unsigned int),
+        &entry.prefix,
+        sizeof(entry.prefix));
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        const ColumnVector &column = batch.columns[fields_[i]];
+        if (column.integer)
+            appendInteger(out, column.ints[row]);
+        else
+            appendBytes(out, column.data[row], column.lengths[row]);
+    }
+    unsigned int length = (unsigned int) (out.size() - entry.offset);
+    memcpy(out.data() + entry.offset, &length, sizeof(length));
+    local.entries.push_back(entry);
+}
+
+bool Sort::less(const unsigned char *x, const unsigned char *y) const
+{
+    const size_t header = sizeof(unsigned int) + sizeof(unsigned long long);
+    unsigned long long a, b;
+    memcpy(&a, x + sizeof(unsigned int), sizeof(a));
+    memcpy(&b, y + sizeof(unsigned int), sizeof(b));
+    if (a != b || integer_) return a < b;
+
+    // 前缀相同，比较完整的字节串，短的是长的前缀时排在前面
+    unsigned int xlen, ylen;
+    memcpy(&xlen, x + header, sizeof(xlen));
+    memcpy(&ylen, y + header, sizeof(ylen));
+    int cmp = memcmp(
+        x + header + sizeof(xlen),
+        y + header + sizeof(ylen),
+        std::min(xlen, ylen));
+    if (cmp == 0) cmp = xlen < ylen ? -1 : (xlen > ylen ? 1 : 0);
+    return desc_ ? cmp > 0 : cmp < 0;
+}
+
+void Sort::arrange(Local &local)
+{
+    const unsigned char *rows = local.rows.data();
+    auto order = [this, rows](const Entry &x, const Entry &y) {
+        if (x.prefix != y.prefix) return x.prefix < y.prefix;
+        return !integer_ && less(rows + x.offset, rows + y.offset);
+    };
+
+    // top-N只需要部分排序
+    if (limit_ >= 0 && local.entries.size() > (size_t) limit_) {
+        std::partial_sort(
+            local.entries.begin(),
+            local.entries.begin() + limit_,
+            local.entries.end(),
+            order);
+        local.entries.resize((size_t) limit_);
+    } else
+        std::sort(local.entries.begin(), local.entries.end(), order);
+}
+
+void Sort::truncate(Local &local)
+{
+    const unsigned char *rows = local.rows.data();
+    auto order = [this, rows](const Entry &x, const Entry &y) {
+        if (x.prefix != y.prefix) return x.prefix < y.prefix;
+        return !integer_ && less(rows + x.offset, rows + y.offset);
+    };
+    std::nth_element(
+        local.entries.begin(),
+        local.entries.begin() + limit_,
+        local.entries.end(),
+        order);
+    local.entries.resize((size_t) limit_);
+
+    // 留下的行搬到新缓冲
+    std::vector<unsigned char> kept;
+    for (size_t i = 0; i < local.entries.size(); ++i) {
+        const unsigned char *row = rows + local.entries[i].offset;
+        unsigned int length;
+        memcpy(&length, row, sizeof(length));
+        local.entries[i].offset = kept.size();
+        kept.insert(kept.end(), row, row + length);
+    }
+    local.rows.swap(kept);
+}
+
+void Sort::spill(Local &local)
+{
+    arrange(local);
+    std::string name;
+    if (kFiles.temporary(name) == NULL) return;
+    TableId id = kFiles.intern(name.c_str());
+
+    // 逐block借用buffer顺序写入，文件中还没有的block借用时清零
+    unsigned long long size = 0;
+    BufDesp *desp = NULL;
+    bool failed = false;
+    for (size_t i = 0; i < local.entries.size() && !failed; ++i) {
+        const unsigned char *row = local.rows.data() + local.entries[i].offset;
+        unsigned int length;
+        memcpy(&length, row, sizeof(length));
+
+        // 行可以跨block
+        for (unsigned int done = 0; done < length;) {
+            if (desp == NULL) {
+                desp =
+                    kBuffer.borrow(id, (unsigned int) (size / BLOCK_SIZE));
+                if (desp == NULL) {
+                    failed = true;
+                    break;
+                }
+            }
+            size_t at = (size_t) (size % BLOCK_SIZE);
+            size_t n = std::min(BLOCK_SIZE - at, (size_t) (length - done));
+            memcpy(desp->buffer + at, row + done, n);
+            done += (unsigned int) n;
+            size += n;
+            if (size % BLOCK_SIZE == 0) {
+                kBuffer.writeBuf(desp);
+                kBuffer.releaseBuf(desp);
+                desp = NULL;
+            }
+        }
+    }
+    if (desp) {
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+    }
+
+    // 写不出去就留在内存
+    if (failed) {
+        kBuffer.discard(id);
+        kFiles.drop(name);
+        return;
+    }
+    local.files.push_back(name);
+    local.sizes.push_back(size);
+    local.rows.clear();
+    local.entries.clear();
+    spilled_.fetch_add(1);
+}
+
+void Sort::consume(size_t worker)
+{
+    Local &local = locals_[worker];
+    size_t budget = memory_ / children_.size();
+    Batch batch;
+    while (children_[worker]->next(batch)) {
+        for (size_t i = 0; i < batch.count(); ++i)
+            append(local, batch, batch.row(i));
+
+        if (limit_ >= 0 &&
+            local.entries.size() >= 2 * (size_t) limit_ + BATCH_SIZE)
+            truncate(local);
+        if (local.rows.size() + local.entries.size() * sizeof(Entry) > budget)
+            spill(local);
+    }
+    arrange(local);
+}
+
+bool Sort::read(Run &run, unsigned char *out, size_t length)
+{
+    while (length > 0) {
+        unsigned int blockid = (unsigned int) (run.offset / BLOCK_SIZE);
+        if (run.pin == NULL || run.pin->blockid != blockid) {
+            if (run.pin) kBuffer.releaseBuf(run.pin);
+            run.pin = kBuffer.borrow(run.id, blockid);
+            if (run.pin == NULL) return false;
+        }
+        size_t at = (size_t) (run.offset % BLOCK_SIZE);
+        size_t n = std::min(BLOCK_SIZE - at, length);
+        memcpy(out, run.pin->buffer + at, n);
+        out += n;
+        length -= n;
+        run.offset += n;
+    }
+    return true;
+}
+
+void Sort::fetch(Run &run)
+{
+    run.current = NULL;
+    if (run.local) {
+        if (run.index < run.local->entries.size())
+            run.current = run.local->rows.data() +
+                          run.local->entries[run.index++].offset;
+        return;
+    }
+
+    // 文件run，先读总长再读整行
+    unsigned int length;
+    if (run.offset + sizeof(length) <= run.size &&
+        read(run, (unsigned char *) &length, sizeof(length)) &&
+        length >= sizeof(length) &&
+        run.offset - sizeof(length) + length <= run.size) {
+        run.row.resize(length);
+        memcpy(run.row.data(), &length, sizeof(length));
+        if (read(run, run.row.data() + sizeof(length), length - sizeof(length)))
+            run.current = run.row.data();
+    }
+    if (run.current) return;
+
+    // 读完，删除临时文件
+    if (run.pin) kBuffer.releaseBuf(run.pin);
+    run.pin = NULL;
+    kBuffer.discard(run.id);
+    kFiles.drop(run.file);
+    run.file.clear();
+}
+
+void Sort::replay(int run)
+{
+    // 叶子run + runs_.size()的父节点开始，节点上留败者，胜者继续向上
+    int winner = run;
+    for (size_t t = (run + runs_.size()) / 2; t > 0; t /= 2) {
+        int loser = tree_[t];
+        // -1是初始化用的哨兵，排在所有行前面；结束的run排在最后
+        bool beats;
+        if (loser < 0 || winner < 0)
+            beats = loser < 0;
+        else if (runs_[loser].current == NULL || runs_[winner].current == NULL)
+            beats = runs_[winner].current == NULL &&
+                    runs_[loser].current != NULL;
+        else
+            beats = less(runs_[loser].current, runs_[winner].current);
+        if (beats) std::swap(tree_[t], winner);
+    }
+    tree_[0] = winner;
+}
+
+void Sort::deserialize(const unsigned char *row, Batch &batch)
+{
+    const unsigned char *p =
+        row + sizeof(unsigned int) + sizeof(unsigned long long);
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        ColumnVector &column = batch.columns[fields_[i]];
+        if (column.integer) {
+            long long v;
+            memcpy(&v, p, sizeof(v));
+            column.ints.push_back(v);
+            p += sizeof(v);
+        } else {
+            unsigned int length;
+            memcpy(&length, p, sizeof(length));
+            column.data.push_back(p + sizeof(length));
+            column.lengths.push_back(length);
+            p += sizeof(length) + length;
+        }
+    }
+}
+
+bool Sort::next(Batch &batch)
+{
+    if (!built_) {
+        built_ = true;
+
+        // 每条输入一个线程生成run，当前线程消费第0条
+        TaskGroup group;
+        for (size_t w = 1; w < children_.size(); ++w)
+            kScheduler.spawn(
+                std::bind(&Sort::consume, this, w), TASK_FOREGROUND, &group);
+        if (!children_.empty()) consume(0);
+        kScheduler.wait(group);
+
+        // 各线程的文件run和内存中的run
+        for (size_t w = 0; w < locals_.size(); ++w) {
+            Local &local = locals_[w];
+            for (size_t i = 0; i < local.files.size(); ++i) {
+                runs_.push_back(Run());
+                runs_.back().file = local.files[i];
+                runs_.back().id = kFiles.intern(local.files[i].c_str());
+                runs_.back().size = local.sizes[i];
+            }
+            local.files.clear();
+            if (local.entries.empty()) continue;
+            runs_.push_back(Run());
+            runs_.back().local = &local;
+        }
+
+        // 败者树先填满哨兵，再逐个放入各run
+        tree_.assign(runs_.size(), -1);
+        for (size_t r = 0; r < runs_.size(); ++r)
+            fetch(runs_[r]);
+        for (int r = (int) runs_.size() - 1; r >= 0; --r)
+            replay(r);
+    }
+
+    batch.clear();
+    batch.columns.resize(integers_.size());
+    for (size_t c = 0; c < integers_.size(); ++c)
+        batch.columns[c].integer = integers_[c];
+
+    // 先把一批行拷到output_，再解码，文件run的当前行在fetch后失效
+    output_.clear();
+    std::vector<size_t> starts;
+    while (!tree_.empty() && starts.size() < BATCH_SIZE &&
+           (limit_ < 0 || emitted_ < limit_)) {
+        int winner = tree_[0];
+        Run &run = runs_[winner];
+        if (run.current == NULL) break;
+        unsigned int length;
+        memcpy(&length, run.current, sizeof(length));
+        starts.push_back(output_.size());
+        output_.insert(output_.end(), run.current, run.current + length);
+        ++emitted_;
+        fetch(run);
+        replay(winner);
+    }
+    for (size_t i = 0; i < starts.size(); ++i) {
+        deserialize(output_.data() + starts[i], batch);
+        ++batch.rows;
+    }
+    return batch.rows > 0;
+}
+
+Executor::~Executor()
+{
+    // 会话结束时把打开过的表的统计写回超块
+    for (std::map<std::string, Table *>::iterator it = tables_.begin();
+         it != tables_.end();
+         ++it) {
+        std::lock_guard<RWLatch> guard(it->second->latch_);
+        it->second->checkpoint();
+    }
+}
+
+Table *Executor::open(const std::string &name)
+{
+    std::map<std::string, Table *>::iterator it = tables_.find(name);
+    if (it != tables_.end()) return it->second;
+
+    Table *table = Table::shared(name.c_str());
+    if (table == NULL) return NULL;
+    tables_[name] = table;
+    return table;
+}
+
+int Executor::build(
+    Plan &plan,
+    std::unique_ptr<Operator> &root,
+    bool copying)
+{
+    Table *table = open(plan.table);
+    if (table == NULL) return ENOENT;
+    bool sorting = plan.orderField >= 0 && !plan.sorted;
+
+    // 只解码用到的列，有聚集时投影指向聚集的输出
+    std::vector<unsigned int> fields;
+    if (!plan.groupBy.empty() || !plan.aggregates.empty()) {
+        fields = plan.groupBy;
+        for (size_t i = 0; i < plan.aggregates.size(); ++i)
+            if (plan.aggregates[i].field >= 0)
+                fields.push_back((unsigned int) plan.aggregates[i].field);
+    } else {
+        fields = plan.projection;
+        if (sorting) fields.push_back((unsigned int) plan.orderField);
+    }
+    std::vector<unsigned int> carried = fields; // 排序时带上的列
+
+    std::vector<std::unique_ptr<Operator>> children;
+    RelationInfo *info = table->info_;
+    if (plan.join != JOIN_NONE) {
+        int ret = join(plan, fields, root, copying);
+        if (ret) return ret;
+        children.push_back(std::move(root));
+        info = &plan.joined;
+    } else {
+        for (size_t i = 0; i < plan.filters.size(); ++i)
+            fields.push_back(plan.filters[i].field);
+
+        // 分组聚集和排序的全表扫描每个线程一条流水线，共享一个block分配器
+        size_t workers = 1;
+        std::shared_ptr<Morsels> morsels;
+        if ((!plan.groupBy.empty() || sorting) &&
+            plan.access == ACCESS_FULL) {
+            morsels.reset(new Morsels(table));
+            workers = kScheduler.workers() + 1;
+        }
+        for (size_t w = 0; w < workers; ++w) {
+            std::unique_ptr<Operator> child(
+                morsels ? new Scan(table, fields, morsels)
+                        : new Scan(table, fields, &plan, copying));
+            if (!plan.filters.empty())
+                child.reset(new Filter(std::move(child), info, plan.filters));
+            children.push_back(std::move(child));
+        }
+    }
+
+    // 排序列在分组时是聚集输出中的下标
+    std::vector<bool> integers;
+    if (!plan.groupBy.empty()) {
+        root.reset(new HashAggregate(
+            std::move(children), info, plan.groupBy, plan.aggregates));
+        if (sorting) {
+            carried.clear();
+            for (size_t g = 0; g < plan.groupBy.size(); ++g)
+                integers.push_back(isIntegerField(info->fields[plan.groupBy[g]]));
+            integers.resize(plan.groupBy.size() + plan.aggregates.size(), true);
+            for (unsigned int c = 0; c < integers.size(); ++c)
+                carried.push_back(c);
+            children.clear();
+            children.push_back(std::move(root));
+        }
+    } else if (!sorting) {
+        root = std::move(children[0]);
+        if (!plan.aggregates.empty())
+            root.reset(new Aggregate(std::move(root), plan.aggregates));
+    } else {
+        for (unsigned int f = 0; f < info->count; ++f)
+            integers.push_back(isIntegerField(info->fields[f]));
+    }
+    if (sorting)
+        root.reset(new Sort(
+            std::move(children),
+            integers,
+            carried,
+            (unsigned int) plan.orderField,
+            plan.desc,
+            plan.limit));
+    if (plan.limit >= 0) root.reset(new Limit(std::move(root), plan.limit));
+    root.reset(new Project(std::move(root), plan.projection));
+    return S_OK;
+}
+
+int Executor::join(
+    Plan &plan,
+    const std::vector<unsigned int> &fields,
+    std::unique_ptr<Operator> &root,
+    bool copying)
+{
+    Table *tables[2] = {open(plan.table), open(plan.right)};
+    if (tables[0] == NULL || tables[1] == NULL) return ENOENT;
+    unsigned int count = tables[0]->info_->count;
+    unsigned int keys[2] = {plan.leftKey, plan.rightKey};
+    std::vector<Predicate> *filters[2] = {&plan.filters, &plan.rightFilters};
+
+    // 按左右拆开用到的列，加上连接列和各自条件中的列
+    std::vector<unsigned int> sides[2];
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i] < count)
+            sides[0].push_back(fields[i]);
+        else
+            sides[1].push_back(fields[i] - count);
+    }
+    std::unique_ptr<Operator> inputs[2];
+    for (int s = 0; s < 2; ++s) {
+        sides[s].push_back(keys[s]);
+        for (size_t i = 0; i < filters[s]->size(); ++i)
+            sides[s].push_back((*filters[s])[i].field);
+        std::sort(sides[s].begin(), sides[s].end());
+        sides[s].erase(
+            std::unique(sides[s].begin(), sides[s].end()), sides[s].end());
+
+        // 左表按计划的访问路径，右表全表扫描
+        inputs[s].reset(
+            new Scan(tables[s], sides[s], s ? NULL : &plan, copying));
+        if (!filters[s]->empty())
+            inputs[s].reset(new Filter(
+                std::move(inputs[s]), tables[s]->info_, *filters[s]));
+    }
+
+    if (plan.join == JOIN_MERGE)
+        root.reset(new MergeJoin(
+            std::move(inputs[0]),
+            std::move(inputs[1]),
+            tables[0]->info_,
+            tables[1]->info_,
+            keys[0],
+            keys[1]));
+    else {
+        int b = plan.buildLeft ? 0 : 1;
+        root.reset(new HashJoin(
+            std::move(inputs[b]),
+            std::move(inputs[1 - b]),
+            tables[b]->info_,
+            tables[1 - b]->info_,
+            sides[b],
+            sides[1 - b],
+            keys[b],
+            keys[1 - b],
+            plan.buildLeft));
+    }
+    return S_OK;
+}
+
+int Executor::insert(Plan &plan)
+{
+    Table *table = open(plan.table);
+    if (table == NULL) return ENOENT;
+
+    std::vector<struct iovec> iov(plan.row.size());
+    for (size_t i = 0; i < plan.row.size(); ++i) {
+        iov[i].iov_base = (void *) plan.row[i].data();
+        iov[i].iov_len = plan.row[i].size();
+    }
+    // 定位和插入之间block不能被其它会话分裂
+    std::lock_guard<RWLatch> guard(table->latch_);
+    unsigned int key = table->info_->key;
+    unsigned int blkid =
+        table->locate(iov[key].iov_base, (unsigned int) iov[key].iov_len);
+    return table->insert(blkid, iov);
+}
+
+int Executor::remove(Plan &plan, size_t &affected)
+{
+    Table *table = open(plan.table);
+    if (table == NULL) return ENOENT;
+    RelationInfo *info = table->info_;
+    const FieldInfo &field = info->fields[info->key];
+    std::lock_guard<RWLatch> guard(table->latch_);
+
+    // 先收集要删除的键，再逐个删除
+    std::vector<std::string> keys;
+    {
+        std::vector<unsigned int> fields(1, info->key);
+        std::unique_ptr<Operator> root(new Scan(table, fields, &plan));
+        if (!plan.filters.empty())
+            root.reset(new Filter(std::move(root), info, plan.filters));
+        Batch batch;
+        while (root->next(batch)) {
+            const ColumnVector &column = batch.columns[info->key];
+            for (size_t i = 0; i < batch.count(); ++i) {
+                size_t row = batch.row(i);
+                std::string key;
+                if (column.integer)
+                    encodeInteger(
+                        column.ints[row], (unsigned int) field.length, key);
+                else
+                    key.assign(
+                        (const char *) column.data[row], column.lengths[row]);
+                keys.push_back(key);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        void *k = (void *) keys[i].data();
+        unsigned int len = (unsigned int) keys[i].size();
+        unsigned int blkid = table->search(k, len);
+        if (blkid == 0) blkid = table->locate(k, len);
+        if (table->remove(blkid, k, len) == S_OK) ++affected;
+    }
+    return S_OK;
+}
+
+int Executor::update(Plan &plan, size_t &affected)
+{
+    Table *table = open(plan.table);
+    if (table == NULL) return ENOENT;
+    RelationInfo *info = table->info_;
+    std::lock_guard<RWLatch> guard(table->latch_);
+
+    // 先收集修改后的记录，再逐条写回
+    std::vector<std::vector<std::string> > rows;
+    {
+        std::vector<unsigned int> fields;
+        for (unsigned int f = 0; f < info->count; ++f)
+            fields.push_back(f);
+        std::unique_ptr<Operator> root(new Scan(table, fields, &plan));
+        if (!plan.filters.empty())
+            root.reset(new Filter(std::move(root), info, plan.filters));
+        Batch batch;
+        while (root->next(batch)) {
+            for (size_t i = 0; i < batch.count(); ++i) {
+                size_t row = batch.row(i);
+                std::vector<std::string> values(info->count);
+                for (unsigned int f = 0; f < info->count; ++f) {
+                    const ColumnVector &column = batch.columns[f];
+                    if (column.integer)
+                        encodeInteger(
+                            column.ints[row],
+                            (unsigned int) info->fields[f].length,
+                            values[f]);
+                    else
+                        values[f].assign(
+                            (const char *) column.data[row],
+                            column.lengths[row]);
+                }
+                for (size_t s = 0; s < plan.sets.size(); ++s)
+                    values[plan.sets[s].field] = plan.sets[s].data;
+                rows.push_back(values);
+            }
+        }
+    }
+
+    unsigned int key = info->key;
+    for (size_t r = 0; r < rows.size(); ++r) {
+        std::vector<struct iovec> iov(info->count);
+        for (unsigned int f = 0; f < info->count; ++f) {
+            iov[f].iov_base = (void *) rows[r][f].data();
+            iov[f].iov_len = rows[r][f].size();
+        }
+        unsigned int blkid = table->search(
+            iov[key].iov_base, (unsigned int) iov[key].iov_len);
+        if (blkid == 0)
+            blkid = table->locate(
+                iov[key].iov_base, (unsigned int) iov[key].iov_len);
+        if (table->update(blkid, iov) == S_OK) ++affected;
+    }
+    return S_OK;
+}
+
+int Executor::execute(Plan &plan, const Visitor &visitor, size_t *affected)
+{
+    size_t count = 0;
+    int ret = S_OK;
+
+    switch (plan.kind) {
+    case STMT_CREATE:
+        ret = kSchema.create(plan.table.c_str(), plan.create);
+        break;
+    case STMT_INSERT:
+        ret = insert(plan);
+        if (ret == S_OK) count = 1;
+        break;
+    case STMT_DELETE:
+        ret = remove(plan, count);
+        break;
+    case STMT_UPDATE:
+        ret = update(plan, count);
+        break;
+    case STMT_SELECT: {
+        // 整条语句持有各表的共享锁，不拷贝的批可以一直指向block
+        Table *left = open(plan.table);
+        Table *right = plan.join != JOIN_NONE ? open(plan.right) : NULL;
+        SharedGuard lguard(left ? &left->latch_ : NULL);
+        SharedGuard rguard(right ? &right->latch_ : NULL);
+        std::unique_ptr<Operator> root;
+        ret = build(plan, root);
+        if (ret) break;
+        Batch batch;
+        while (root->next(batch)) {
+            count += batch.count();
+            if (visitor) visitor(batch);
+        }
+        break;
+    }
+    default:
+        ret = EINVAL;
+    }
+
+    if (affected) *affected = count;
+    return ret;
+}
+
+int Executor::open(Plan &plan, Cursor &cursor, size_t *affected)
+{
+    cursor.close();
+    cursor.rows_ = 0;
+    if (plan.kind != STMT_SELECT) return execute(plan, Visitor(), affected);
+
+    // 算子引用计划中的元数据，计划随游标保存
+    if (affected) *affected = 0;
+    cursor.plan_ = plan;
+    int ret = build(cursor.plan_, cursor.root_, true);
+    if (ret) {
+        cursor.root_.reset();
+        return ret;
+    }
+    cursor.tables_[0] = open(plan.table);
+    cursor.tables_[1] = plan.join != JOIN_NONE ? open(plan.right) : NULL;
+    return S_OK;
+}
+
+bool Cursor::next()
+{
+    // 取一批时持有各表的共享锁，分组和排序一次读完输入，不与增删改交错
+    SharedGuard lguard(tables_[0] ? &tables_[0]->latch_ : NULL);
+    SharedGuard rguard(tables_[1] ? &tables_[1]->latch_ : NULL);
+    while (root_) {
+        if (!root_->next(batch_)) {
+            close();
+            break;
+        }
+        if (batch_.count() == 0) continue;
+        rows_ += batch_.count();
+        return true;
+    }
+    return false;
+}
+
+void Cursor::close()
+{
+    // 先归还批借用的block，再析构算子
+    batch_.clear();
+    root_.reset();
+    tables_[0] = tables_[1] = NULL;
+}
+
+} // namespace db
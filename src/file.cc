@@ -6,11 +6,20 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
+#include <stdio.h>
+#if !defined(WIN32)
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <string.h>
+#    include <unistd.h>
+#    include <sys/stat.h>
+#endif
 #include <db/file.h>
 #include <db/schema.h>
 
 namespace db {
 
+#if defined(WIN32)
 int File::open(const char *path)
 {
     // https://docs.microsoft.com/zh-cn/windows/win32/api/fileapi/nf-fileapi-createfilea
@@ -71,6 +80,34 @@ int File::write(unsigned long long offset, const char *buffer, size_t length)
     // TODO: len == length??
 }
 
+int File::truncate(unsigned long long len)
+{
+    // https://docs.microsoft.com/zh-cn/windows/win32/api/fileapi/nf-fileapi-setendoffile
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG) len;
+    if (!::SetFilePointerEx(handle_, size, NULL, FILE_BEGIN) ||
+        !::SetEndOfFile(handle_))
+        return ::GetLastError();
+    return S_OK;
+}
+
+int File::allocate(unsigned long long offset, unsigned long long length)
+{
+    // https://docs.microsoft.com/zh-cn/windows/win32/api/fileapi/nf-fileapi-setfileinformationbyhandle
+    unsigned long long len;
+    int ret = this->length(len);
+    if (ret) return ret;
+    if (len >= offset + length) return S_OK;
+
+    // 先保留磁盘空间，再移动文件尾
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG) (offset + length);
+    if (!::SetFileInformationByHandle(
+            handle_, FileAllocationInfo, &info, sizeof(info)))
+        return ::GetLastError();
+    return truncate(offset + length);
+}
+
 int File::remove(const char *path)
 {
     // TODO: DeleteFile
@@ -92,28 +129,158 @@ int File::length(unsigned long long &len)
     }
 }
 
+#else
+// posix上用pread/pwrite，不移动文件指针，多线程可并发读写
+
+int File::open(const char *path)
+{
+    handle_ = ::open(path, O_RDWR | O_CREAT, 0644);
+    return handle_ == INVALID_HANDLE_VALUE ? errno : S_OK;
+}
+
+void File::close()
+{
+    if (handle_ != INVALID_HANDLE_VALUE) {
+        ::close(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+    }
+}
+
+int File::read(unsigned long long offset, char *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t ret = ::pread(
+            handle_, buffer + done, length - done, (off_t) (offset + done));
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (ret == 0) break; // 读过文件尾
+        done += (size_t) ret;
+    }
+    // 与ReadFile一致，文件尾之后的部分按0处理
+    if (done < length) memset(buffer + done, 0, length - done);
+    return S_OK;
+}
+
+int File::write(unsigned long long offset, const char *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t ret = ::pwrite(
+            handle_, buffer + done, length - done, (off_t) (offset + done));
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        done += (size_t) ret;
+    }
+    return S_OK;
+}
+
+int File::truncate(unsigned long long len)
+{
+    return ::ftruncate(handle_, (off_t) len) ? errno : S_OK;
+}
+
+int File::allocate(unsigned long long offset, unsigned long long length)
+{
+#    if defined(__linux__)
+    // 一次分配连续的extent，文件系统不支持时退回到延长文件
+    if (::fallocate(handle_, 0, (off_t) offset, (off_t) length) == 0)
+        return S_OK;
+    if (errno != EOPNOTSUPP) return errno;
+#    endif
+    unsigned long long len;
+    int ret = this->length(len);
+    if (ret) return ret;
+    return len < offset + length ? truncate(offset + length) : S_OK;
+}
+
+int File::remove(const char *path)
+{
+    return ::unlink(path) ? errno : S_OK;
+}
+
+int File::length(unsigned long long &len)
+{
+    struct stat st;
+    if (::fstat(handle_, &st)) return errno;
+    len = (unsigned long long) st.st_size;
+    return S_OK;
+}
+#endif
+
 void FilePool ::init(Schema *schema) { schema_ = schema; }
 
-File *FilePool::open(const char *table)
+File *FilePool::find(TableId table, unsigned int *spaceid)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (table >= files_.size() || !files_[table].file) return NULL;
+    if (spaceid) *spaceid = files_[table].spaceid;
+    return files_[table].file.get();
+}
+
+File *FilePool::open(TableId table, unsigned int *spaceid)
 {
     // 先查询表是否打开
-    std::map<const char *, File>::iterator it = map_.find(table);
-    // 找到，直接返回
-    if (it != map_.end()) return &it->second;
+    File *opened = find(table, spaceid);
+    if (opened) return opened;
 
-    // 未找到，先查schema得到路径
+    // 未找到，先查schema得到路径，lookup可能加载表定义，不能持有mutex_
     std::pair<Schema::TableSpace::iterator, bool> bret = schema_->lookup(table);
     if (!bret.second) return NULL; // 表不存在
 
     // 打开表文件
-    File file;
-    int ret = file.open(bret.first->second.path.c_str());
+    std::unique_ptr<File> file(new File);
+    int ret = file->open(bret.first->second.path.c_str());
     if (ret) return NULL; // 文件打开失败
 
-    // 在map中增加项
-    map_[table] = file;
-    file.handle_ = INVALID_HANDLE_VALUE; // 防止析构函数动作
-    return &map_[table];
+    // 加入files_，其它线程先打开了则用它的
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (table >= files_.size()) files_.resize(table + 1);
+    Entry &entry = files_[table];
+    if (!entry.file) {
+        entry.file = std::move(file);
+        entry.spaceid = bret.first->second.spaceid;
+    }
+    if (spaceid) *spaceid = entry.spaceid;
+    return entry.file.get();
+}
+
+File *FilePool::open(const char *table) { return open(intern(table)); }
+
+TableId FilePool::intern(const char *table) { return schema_->intern(table); }
+
+File *FilePool::temporary(std::string &name)
+{
+    // 临时文件放在当前目录，以"_tmp"开头，与表文件区分
+    char buf[32];
+    TableId id;
+    std::lock_guard<std::mutex> guard(mutex_);
+    do {
+        snprintf(buf, sizeof(buf), "_tmp%u.tmp", temporaries_++);
+        id = schema_->intern(buf);
+    } while (id < files_.size() && files_[id].file);
+    name = buf;
+
+    // 删除残留的同名文件
+    File::remove(buf);
+    std::unique_ptr<File> file(new File);
+    if (file->open(buf)) return NULL;
+    if (id >= files_.size()) files_.resize(id + 1);
+    files_[id].file = std::move(file);
+    files_[id].spaceid = SPACE_NONE;
+    return files_[id].file.get();
+}
+
+void FilePool::drop(const std::string &name)
+{
+    TableId id = schema_->intern(name.c_str());
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (id < files_.size()) files_[id].file.reset(); // 析构时关闭
+    File::remove(name.c_str());
 }
 
 // 全局文件池
@@ -0,0 +1,80 @@
+////
+// @file fsm.cc
+// @brief
+// 空闲空间映射
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <string.h>
+#include <algorithm>
+#include <db/fsm.h>
+
+namespace db {
+
+void FreeSpaceMap::resize(size_t count)
+{
+    map_.resize(count, 0);
+    idles_.resize((count + FSM_ENTRIES - 1) / FSM_ENTRIES, 0);
+
+    // 截断时最后一页重新计数
+    if (!idles_.empty()) {
+        size_t last = idles_.size() - 1;
+        idles_[last] = (unsigned int) std::count(
+            map_.begin() + last * FSM_ENTRIES, map_.end(), FSM_IDLE);
+    }
+}
+
+void FreeSpaceMap::set(unsigned int blockid, unsigned char value)
+{
+    if (blockid >= map_.size()) resize(blockid + 1);
+
+    unsigned char &entry = map_[blockid];
+    if (entry == FSM_IDLE) --idles_[blockid / FSM_ENTRIES];
+    if (value == FSM_IDLE) ++idles_[blockid / FSM_ENTRIES];
+    entry = value;
+}
+
+unsigned int FreeSpaceMap::findIdle(unsigned int start) const
+{
+    // 先按摘要跳过没有空闲块的页，再在页内查找
+    for (size_t index = start / FSM_ENTRIES; index < idles_.size(); ++index) {
+        if (idles_[index] == 0) continue;
+        size_t begin = std::max<size_t>(index * FSM_ENTRIES, start);
+        size_t end = std::min<size_t>((index + 1) * FSM_ENTRIES, map_.size());
+        if (begin >= end) continue;
+        const void *found = memchr(&map_[begin], FSM_IDLE, end - begin);
+        if (found)
+            return (unsigned int) ((const unsigned char *) found - &map_[0]);
+    }
+    return 0;
+}
+
+size_t FreeSpaceMap::idles() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < idles_.size(); ++i)
+        total += idles_[i];
+    return total;
+}
+
+void FreeSpaceMap::store(size_t index, unsigned char *data) const
+{
+    size_t begin = index * FSM_ENTRIES;
+    size_t length = 0;
+    if (begin < map_.size())
+        length = std::min<size_t>(FSM_ENTRIES, map_.size() - begin);
+    if (length) memcpy(data, &map_[begin], length);
+    memset(data + length, 0, FSM_ENTRIES - length);
+}
+
+void FreeSpaceMap::load(size_t index, const unsigned char *data)
+{
+    size_t begin = index * FSM_ENTRIES;
+    if (map_.size() < begin + FSM_ENTRIES) resize(begin + FSM_ENTRIES);
+    memcpy(&map_[begin], data, FSM_ENTRIES);
+    idles_[index] = (unsigned int) std::count(
+        map_.begin() + begin, map_.begin() + begin + FSM_ENTRIES, FSM_IDLE);
+}
+
+} // namespace db
@@ -7,8 +7,102 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include <db/integer.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define INTEGER_SSE2
+#endif
 
 namespace db {
+
+namespace {
+#if defined(INTEGER_SSE2)
+// 最低位1的位置，mask不为0
+inline unsigned int lowest(unsigned int mask)
+{
+#    if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int) index;
+#    else
+    return (unsigned int) __builtin_ctz(mask);
+#    endif
+}
+
+// 8个16位整数扩展成64位，写到out
+inline void widen16(__m128i v, unsigned long long *out)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi16(v, zero);
+    __m128i hi = _mm_unpackhi_epi16(v, zero);
+    _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi32(lo, zero));
+    _mm_storeu_si128((__m128i *) (out + 2), _mm_unpackhi_epi32(lo, zero));
+    _mm_storeu_si128((__m128i *) (out + 4), _mm_unpacklo_epi32(hi, zero));
+    _mm_storeu_si128((__m128i *) (out + 6), _mm_unpackhi_epi32(hi, zero));
+}
+
+// 从p开始有多少个连续的1字节整数，解码到values，最多16个
+// p后至少有16字节，values后至少有16个空位
+inline size_t decodeOnes(
+    const unsigned char *p,
+    unsigned long long *values,
+    bool zero,
+    bool *stop)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i z = _mm_setzero_si128();
+    // 高2位为00的字节
+    unsigned int ones = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_and_si128(v, _mm_set1_epi8((char) 0xC0)), z));
+    size_t count = ones == 0xFFFF ? 16 : lowest(~ones & 0xFFFF);
+    if (count == 0) return 0;
+    if (zero) {
+        unsigned int zeros =
+            (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, z));
+        zeros &= (1u << count) - 1;
+        if (zeros) {
+            count = lowest(zeros) + 1;
+            *stop = true;
+        }
+    }
+    widen16(_mm_unpacklo_epi8(v, z), values);
+    widen16(_mm_unpackhi_epi8(v, z), values + 8);
+    return count;
+}
+
+// 从p开始有多少个连续的2字节整数，解码到values，最多8个
+// p后至少有16字节，values后至少有8个空位
+inline size_t decodeTwos(
+    const unsigned char *p,
+    unsigned long long *values,
+    bool zero,
+    bool *stop)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    // 每个16位整数的首字节在低地址，高2位应为01
+    __m128i first = _mm_and_si128(v, _mm_set1_epi16(0x00C0));
+    unsigned int twos = (unsigned int) _mm_movemask_epi8(
+        _mm_cmpeq_epi16(first, _mm_set1_epi16(0x0040)));
+    size_t count = twos == 0xFFFF ? 8 : lowest(~twos & 0xFFFF) / 2;
+    if (count == 0) return 0;
+
+    // 交换字节得到主机序，再去掉长度位
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_and_si128(v, _mm_set1_epi16(0x3FFF));
+    if (zero) {
+        unsigned int zeros = (unsigned int) _mm_movemask_epi8(
+            _mm_cmpeq_epi16(v, _mm_setzero_si128()));
+        zeros &= (1u << (count * 2)) - 1;
+        if (zeros) {
+            count = lowest(zeros) / 2 + 1;
+            *stop = true;
+        }
+    }
+    widen16(v, values);
+    return count;
+}
+#endif
+} // namespace
+
 // 编码
 bool Integer::encode(char *buf, size_t len) const
 {
@@ -77,4 +171,69 @@ bool Integer::decode(char *buf, size_t len)
         return false;
     }
 }
+
+size_t Integer::encodeBatch(
+    const unsigned long long *values,
+    size_t count,
+    char *buf,
+    size_t len)
+{
+    size_t offset = 0;
+    Integer it;
+    for (size_t i = 0; i < count; ++i) {
+        // 偏移数组中多是1字节的整数
+        if (values[i] <= 0x3F && offset < len) {
+            buf[offset++] = (char) values[i];
+            continue;
+        }
+        it.set(values[i]);
+        int size = it.size();
+        if (size < 0 || !it.encode(buf + offset, len - offset)) return 0;
+        offset += size;
+    }
+    return offset;
+}
+
+size_t Integer::decodeBatch(
+    const char *buf,
+    size_t len,
+    unsigned long long *values,
+    size_t max,
+    size_t *used,
+    bool zero)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+    size_t offset = 0;
+    size_t count = 0;
+    bool stop = false;
+    Integer it;
+
+    while (count < max && !stop) {
+#if defined(INTEGER_SSE2)
+        // 剩余空间足够时先试连续的1字节和2字节整数
+        if (len - offset >= 16 && max - count >= 16) {
+            size_t n = decodeOnes(p + offset, values + count, zero, &stop);
+            if (n) {
+                offset += n;
+                count += n;
+                continue;
+            }
+            n = decodeTwos(p + offset, values + count, zero, &stop);
+            if (n) {
+                offset += n * 2;
+                count += n;
+                continue;
+            }
+        }
+#endif
+        if (offset >= len) break;
+        if (!it.decode((char *) p + offset, len - offset)) return 0;
+        values[count++] = it.get();
+        offset += (size_t) 1 << (p[offset] >> 6); // 长度由首字节决定
+        if (zero && it.get() == 0) stop = true;
+    }
+    if (zero && !stop) return 0; // 没有找到结尾的0
+    *used = offset;
+    return count;
+}
 } // namespace db
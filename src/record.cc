@@ -12,8 +12,36 @@ namespace db {
 
 // TODO: 加上log
 
-size_t Record::size(std::vector<struct iovec> &iov)
+bool RecordFormat::init(const std::vector<unsigned int> &widths, size_t max)
 {
+    offsets.clear();
+    if (widths.empty()) return false;
+
+    size_t offset = Record::HEADER_SIZE;
+    for (size_t i = 0; i < widths.size(); ++i) {
+        if (widths[i] == 0 || offset + widths[i] > max) {
+            offsets.clear();
+            return false;
+        }
+        offsets.push_back((unsigned short) offset);
+        offset += widths[i];
+    }
+    offsets.push_back((unsigned short) offset);
+    return true;
+}
+
+bool RecordFormat::match(const std::vector<struct iovec> &iov) const
+{
+    if (iov.size() != count()) return false;
+    for (size_t i = 0; i < iov.size(); ++i)
+        if (iov[i].iov_len != width(i)) return false;
+    return true;
+}
+
+size_t Record::size(std::vector<struct iovec> &iov, const RecordFormat *format)
+{
+    if (format) return format->length();
+
     size_t iovoff = 0; // 字段偏移量，第0个字段的偏移量为0
     size_t total = 0;  // 整个记录长度
     Integer it;
@@ -34,6 +62,7 @@ size_t Record::size(std::vector<struct iovec> &iov)
 
 size_t Record::startOfoffsets()
 {
+    if (format_) return HEADER_SIZE; // 定长记录没有偏移数组
     Integer it;
     it.decode((char *) buffer_ + 1, length_ - 1);
     return it.size() + 1;
@@ -41,6 +70,7 @@ size_t Record::startOfoffsets()
 
 size_t Record::startOfFields()
 {
+    if (format_) return HEADER_SIZE;
     size_t offset = 1;
 
     // 总长度所占大小
@@ -69,6 +99,8 @@ size_t Record::startOfFields()
 
 bool Record::set(std::vector<struct iovec> &iov, const unsigned char *header)
 {
+    if (format_) return setFixed(iov, header);
+
     // 偏移量
     unsigned int offset = 1;
 
@@ -89,12 +121,18 @@ bool Record::set(std::vector<struct iovec> &iov, const unsigned char *header)
     size_t len = 0;
     for (size_t i = 0; i < iov.size(); ++i)
         len += iov[i].iov_len; // 计算总长
-    // 逆序输出
-    for (size_t i = iov.size(); i > 0; --i) {
-        len -= iov[i - 1].iov_len;
-        it.set(len);
-        it.encode((char *) buffer_ + offset, length_);
-        offset += (unsigned int) it.size();
+    // 逆序输出，每次批量编码一段
+    unsigned long long values[64];
+    for (size_t i = iov.size(); i > 0;) {
+        size_t count = 0;
+        for (; i > 0 && count < 64; --i) {
+            len -= iov[i - 1].iov_len;
+            values[count++] = len;
+        }
+        size_t bytes = Integer::encodeBatch(
+            values, count, (char *) buffer_ + offset, length_ - offset);
+        if (bytes == 0) return false;
+        offset += (unsigned int) bytes;
     }
 
     // 顺序输出各字段
@@ -107,22 +145,22 @@ bool Record::set(std::vector<struct iovec> &iov, const unsigned char *header)
     length_ =
         (unsigned short) (total + ALIGN_SIZE - 1) / ALIGN_SIZE * ALIGN_SIZE;
 
-    // 输出padding
-    if (total < length_)
-        for (size_t i = 0; i < length_ - total; ++i)
-            this->buffer_[length_ - i] = 0;
+    // 输出padding，不能越过对齐后的长度
+    if (total < length_) memset(buffer_ + total, 0, length_ - total);
 
     return true;
 }
 
 size_t Record::length()
 {
+    if (format_) return format_->length();
     Integer it;
     return it.decode((char *) buffer_ + 1, length_) ? it.value_ : 0;
 }
 
 size_t Record::fields()
 {
+    if (format_) return format_->count();
     unsigned short offset = 1; // 含头部字段
 
     // 计算总长度的字节数
@@ -153,177 +191,52 @@ size_t Record::fields()
 
 bool Record::get(std::vector<struct iovec> &iov, unsigned char *header)
 {
-    size_t offset = 1; // 偏移量
-
     // 拷贝header
     if (header == NULL) return false;
     ::memcpy(header, buffer_, HEADER_SIZE);
 
-    // 总长
-    Integer it;
-    bool ret = it.decode((char *) buffer_ + 1, length_);
-    if (!ret) return false;
-    size_t length = it.get(); // 记录总长度
-    offset += it.size();
-
-    // 枚举所有字段长度
-    size_t index = 0;
-    std::vector<size_t> vec(iov.size()); // 存放各字段长度
-    while (true) {
-        if (offset >= length_) return false;
-        ret = it.decode((char *) buffer_ + offset, length_ - offset);
-        if (!ret) return false;
-
-        vec[index] = it.get(); // 临时存放偏移量，注意是逆序
-        if (++index > iov.size()) return false;
-
-        // 找到尾部
-        offset += it.size();
-        if (it.value_ == 0) break;
-    }
-    if (index != iov.size()) return false; // 字段数目不对
+    RecordLayout layout;
+    if (!layout.decode(*this) || layout.count() != iov.size()) return false;
 
-    // 逆序，先交换
-    for (size_t i = 0; i < iov.size() / 2; ++i) {
-        size_t tmp = vec[i];
-        vec[i] = vec[iov.size() - i - 1];
-        vec[iov.size() - i - 1] = tmp;
-    }
-    // check长度
-    for (size_t i = 0; i < iov.size() - 1; ++i) {
-        vec[i] = vec[i + 1] - vec[i];
-        if (vec[i] > iov[i].iov_len)
-            return false; // 要求iov长度足够
-        else
-            iov[i].iov_len = vec[i];
-    }
-
-    // 最后一个字段长度
-    vec[iov.size() - 1] = length - vec[iov.size() - 1] - offset;
-    if (vec[iov.size() - 1] > iov[iov.size() - 1].iov_len)
-        return false;
-    else
-        iov[iov.size() - 1].iov_len = vec[iov.size() - 1];
+    // 要求iov长度足够
+    for (size_t i = 0; i < iov.size(); ++i)
+        if (layout.length(i) > iov[i].iov_len) return false;
 
     // 拷贝字段
     for (size_t i = 0; i < iov.size(); ++i) {
-        ::memcpy(iov[i].iov_base, buffer_ + offset, iov[i].iov_len);
-        offset += iov[i].iov_len;
+        iov[i].iov_len = layout.length(i);
+        ::memcpy(iov[i].iov_base, layout.data(i), iov[i].iov_len);
     }
-
     return true;
 }
 
 bool Record::ref(std::vector<struct iovec> &iov, unsigned char *header)
 {
-    size_t offset = 1; // 偏移量
-
     // 拷贝header
     if (header == NULL) return false;
     ::memcpy(header, buffer_, HEADER_SIZE);
 
-    // 总长
-    Integer it;
-    bool ret = it.decode((char *) buffer_ + 1, length_);
-    if (!ret) return false;
-    size_t length = it.get();                         // 记录总长度
-    length_ = (unsigned short) ALIGN_TO_SIZE(length); // 调整总长
-    offset += it.size();
-
-    // 枚举所有字段长度
-    size_t index = 0;
-    std::vector<size_t> vec; // 存放各字段长度
-    while (true) {
-        if (offset >= length_) return false;
-        ret = it.decode((char *) buffer_ + offset, length_ - offset);
-        if (!ret) return false;
-
-        vec.push_back(it.get()); // 临时存放偏移量，注意是逆序
-        ++index;
-
-        // 找到尾部
-        offset += it.size();
-        if (it.value_ == 0) break;
-    }
-    iov.resize(index); // 调整iov的大小
-
-    // 逆序，先交换
-    for (size_t i = 0; i < iov.size() / 2; ++i) {
-        size_t tmp = vec[i];
-        vec[i] = vec[iov.size() - i - 1];
-        vec[iov.size() - i - 1] = tmp;
-    }
-
-    // check长度
-    for (size_t i = 0; i < iov.size() - 1; ++i) {
-        vec[i] = vec[i + 1] - vec[i];
-        iov[i].iov_len = vec[i];
-    }
-    // 最后一个字段长度
-    vec[iov.size() - 1] = length - vec[iov.size() - 1] - offset;
-    iov[iov.size() - 1].iov_len = vec[iov.size() - 1];
+    RecordLayout layout;
+    if (!layout.decode(*this)) return false;
+    length_ = (unsigned short) ALIGN_TO_SIZE(layout.total()); // 调整总长
 
     // 引用各字段
+    iov.resize(layout.count());
     for (size_t i = 0; i < iov.size(); ++i) {
-        iov[i].iov_base = (void *) (buffer_ + offset);
-        offset += iov[i].iov_len;
+        iov[i].iov_base = (void *) layout.data(i);
+        iov[i].iov_len = layout.length(i);
     }
-
     return true;
 }
 
 bool Record::getByIndex(char *buffer, unsigned int *len, unsigned int idx)
 {
-    size_t offset = 1; // 偏移量
+    RecordLayout layout;
+    if (!layout.decode(*this) || idx >= layout.count()) return false;
+    if (*len < layout.length(idx)) return false;
 
-    // 总长
-    Integer it;
-    bool ret = it.decode((char *) buffer_ + 1, length_);
-    if (!ret) return false;
-    size_t length = it.get(); // 记录总长度
-    offset += it.size();
-
-    // 枚举所有字段长度
-    size_t index = 0;
-    std::vector<size_t> vec; // 存放各字段长度
-    while (true) {
-        if (offset >= length_) return false;
-        ret = it.decode((char *) buffer_ + offset, length_ - offset);
-        if (!ret) return false;
-
-        vec.push_back(it.get()); // 临时存放偏移量，注意是逆序
-        ++index;
-
-        // 找到尾部
-        offset += it.size();
-        if (it.value_ == 0) break;
-    }
-    if (idx >= index) return false;
-
-    // 逆序，先交换
-    for (int i = 0; i < index / 2; ++i) {
-        size_t tmp = vec[i];
-        vec[i] = vec[index - i - 1];
-        vec[index - i - 1] = tmp;
-    }
-
-    // 计算长度
-    std::vector<size_t> lvec; // 存放各字段长度
-    for (int i = 0; i < index - 1; ++i) {
-        lvec.push_back(vec[i + 1] - vec[i]);
-        if (i == idx) {
-            if (*len < lvec[idx]) return false;
-            *len = (unsigned int) lvec[idx];
-            memcpy(buffer, buffer_ + offset + vec[idx], lvec[idx]);
-            return true;
-        }
-    }
-
-    // 最后一个字段长度
-    lvec.push_back(length - vec[index - 1] - offset);
-    if (*len < lvec[idx]) return false;
-    *len = (unsigned int) lvec[idx];
-    memcpy(buffer, buffer_ + offset + vec[idx], lvec[idx]);
+    *len = layout.length(idx);
+    memcpy(buffer, layout.data(idx), *len);
     return true;
 }
 
@@ -332,55 +245,124 @@ bool Record::refByIndex(
     unsigned int *len,
     unsigned int idx)
 {
-    size_t offset = 1; // 偏移量
+    RecordLayout layout;
+    if (!layout.decode(*this) || idx >= layout.count()) return false;
+
+    *len = layout.length(idx);
+    *buffer = layout.data(idx);
+    return true;
+}
+
+bool RecordLayout::decode(const Record &record)
+{
+    // 定长记录的偏移与记录无关，格式不变时沿用上次的偏移表
+    if (record.format_) {
+        if (record.format_ != format_) {
+            count_ = (unsigned int) record.format_->count();
+            if (count_ > RECORD_MAX_FIELDS) {
+                clear();
+                return false;
+            }
+            for (unsigned int i = 0; i <= count_; ++i)
+                offsets_[i] = record.format_->offsets[i];
+            format_ = record.format_;
+        }
+        buffer_ = record.buffer_;
+        return true;
+    }
+    format_ = NULL;
+    count_ = 0;
+    buffer_ = record.buffer_;
 
     // 总长
     Integer it;
-    bool ret = it.decode((char *) buffer_ + 1, length_);
-    if (!ret) return false;
-    size_t length = it.get(); // 记录总长度
-    offset += it.size();
+    if (!it.decode((char *) buffer_ + 1, record.length_)) return false;
+    size_t total = (size_t) it.get();
+    size_t offset = 1 + it.size();
+    if (total > (unsigned short) -1) return false;
+
+    // 偏移数组是逆序的，最后一项是第0个字段的偏移0，一次解码整个数组
+    if (offset >= total) return false;
+    unsigned long long values[RECORD_MAX_FIELDS];
+    size_t used;
+    size_t count = Integer::decodeBatch(
+        (char *) buffer_ + offset,
+        total - offset,
+        values,
+        RECORD_MAX_FIELDS,
+        &used,
+        true);
+    if (count == 0) return false;
+    offset += used;
+
+    // 逆序放入偏移表，改为从Header开始，末项是记录结束处
+    for (size_t i = 0; i < count; ++i)
+        offsets_[i] = (unsigned short) (values[count - i - 1] + offset);
+    offsets_[count] = (unsigned short) total;
+    if (offsets_[count - 1] > total) return false;
+    count_ = (unsigned int) count;
+    return true;
+}
 
-    // 枚举所有字段长度
-    size_t index = 0;
-    std::vector<size_t> vec; // 存放各字段长度
-    while (true) {
-        if (offset >= length_) return false;
-        ret = it.decode((char *) buffer_ + offset, length_ - offset);
-        if (!ret) return false;
+bool Record::setFixed(
+    std::vector<struct iovec> &iov,
+    const unsigned char *header)
+{
+    // 各字段的长度必须与格式一致
+    size_t total = format_->length();
+    if ((size_t) length_ < total || !format_->match(iov)) return false;
 
-        vec.push_back(it.get()); // 临时存放偏移量，注意是逆序
-        ++index;
+    // 输出头部和各字段
+    memcpy(buffer_, header, HEADER_SIZE);
+    for (size_t i = 0; i < iov.size(); ++i)
+        memcpy(buffer_ + format_->offset(i), iov[i].iov_base, iov[i].iov_len);
 
-        // 找到尾部
-        offset += it.size();
-        if (it.value_ == 0) break;
-    }
-    if (idx >= index) return false;
+    // 对齐后的长度，padding在分配的空间内才清零
+    size_t aligned = ALIGN_TO_SIZE(total);
+    if (aligned <= length_) memset(buffer_ + total, 0, aligned - total);
+    length_ = (unsigned short) aligned;
+    return true;
+}
 
-    // 逆序，先交换
-    for (int i = 0; i < index / 2; ++i) {
-        size_t tmp = vec[i];
-        vec[i] = vec[index - i - 1];
-        vec[index - i - 1] = tmp;
-    }
+RowView::RowView(const RowView &other)
+    : desp_(other.desp_)
+    , header_(other.header_)
+    , layout_(other.layout_)
+{
+    if (desp_) desp_->addref();
+}
 
-    // 计算长度
-    std::vector<size_t> lvec; // 存放各字段长度
-    for (int i = 0; i < index - 1; ++i) {
-        lvec.push_back(vec[i + 1] - vec[i]);
-        if (i == idx) {
-            *len = (unsigned int) lvec[idx];
-            *buffer = buffer_ + offset + vec[idx];
-            return true;
-        }
-    }
+RowView &RowView::operator=(const RowView &other)
+{
+    if (this == &other) return *this;
+    if (other.desp_) other.desp_->addref();
+    release();
+    desp_ = other.desp_;
+    header_ = other.header_;
+    layout_ = other.layout_;
+    return *this;
+}
 
-    // 最后一个字段长度
-    lvec.push_back(length - vec[index - 1] - offset);
-    *len = (unsigned int) lvec[idx];
-    *buffer = buffer_ + offset + vec[idx];
+bool RowView::attach(BufDesp *desp, Record &record)
+{
+    release();
+    if (desp == NULL || !layout_.decode(record)) {
+        layout_.clear();
+        return false;
+    }
+    header_ = *record.buffer_;
+    desp->addref();
+    desp_ = desp;
     return true;
 }
 
+void RowView::release()
+{
+    if (desp_) {
+        desp_->relref();
+        desp_ = NULL;
+    }
+    layout_.clear();
+}
+
 } // namespace db
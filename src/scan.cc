@@ -0,0 +1,109 @@
+////
+// @file scan.cc
+// @brief
+// 实现并行表扫描
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <db/scan.h>
+#include <db/table.h>
+#include <db/buffer.h>
+#include <db/counter.h>
+#include <db/scheduler.h>
+
+namespace db {
+
+namespace {
+// 一个工作线程负责的blockid区间[next, end)
+// 所有者和窃取者都通过next上的fetch_add领取morsel，不需要加锁
+struct Range
+{
+    std::atomic<unsigned int> next;
+    unsigned int end;
+    char pad[CACHELINE_SIZE - sizeof(std::atomic<unsigned int>) - sizeof(int)];
+};
+} // namespace
+
+ParallelScan::ParallelScan(
+    Table *table,
+    unsigned int workers,
+    unsigned int morsel)
+    : table_(table)
+    , workers_(workers)
+    , morsel_(morsel ? morsel : MORSEL_BLOCKS)
+{
+    // 缺省用满调度器的所有线程，加上当前线程
+    if (workers_ == 0) {
+        kScheduler.init();
+        workers_ = kScheduler.workers() + 1;
+    }
+}
+
+size_t ParallelScan::run(const Visitor &visitor)
+{
+    TableId table = table_->id_;
+
+    // 从超块得到maxid
+    BufDesp *bd = kBuffer.borrow(table, 0);
+    SuperBlock super;
+    super.attach(bd->buffer);
+    unsigned int maxid = super.getMaxid();
+    super.detach();
+    kBuffer.releaseBuf(bd);
+    if (maxid == 0) return 0;
+
+    // 将[1, maxid]均分给各个线程
+    std::vector<Range> ranges(workers_);
+    unsigned int per = (maxid + workers_ - 1) / workers_;
+    for (unsigned int i = 0; i < workers_; ++i) {
+        unsigned int start = std::min(1 + i * per, maxid + 1);
+        ranges[i].next.store(start);
+        ranges[i].end = std::min(start + per, maxid + 1);
+    }
+
+    std::atomic<size_t> scanned(0);
+    auto work = [&](unsigned int worker) {
+        size_t count = 0;
+        // 先处理自己的区间，再依次窃取其它线程的区间
+        for (unsigned int k = 0; k < workers_; ++k) {
+            Range &range = ranges[(worker + k) % workers_];
+            while (true) {
+                unsigned int start = range.next.fetch_add(morsel_);
+                if (start >= range.end) break;
+                unsigned int stop = std::min(start + morsel_, range.end);
+
+                for (unsigned int id = start; id < stop; ++id) {
+                    BufDesp *desp = kBuffer.borrow(table, id);
+                    if (desp == NULL) continue;
+                    DataBlock block;
+                    block.setTable(table_);
+                    block.attach(desp->buffer);
+                    // 跳过空闲块、溢出块等
+                    if (block.getMagic() == MAGIC_NUMBER &&
+                        block.getType() == BLOCK_TYPE_DATA) {
+                        visitor(worker, block);
+                        ++count;
+                    }
+                    block.detach();
+                    kBuffer.releaseBuf(desp);
+                }
+            }
+        }
+        scanned.fetch_add(count);
+    };
+
+    // 其它worker作为前台任务提交给调度器，当前线程作为0号worker
+    TaskGroup group;
+    for (unsigned int i = 1; i < workers_; ++i)
+        kScheduler.spawn(std::bind(work, i), TASK_FOREGROUND, &group);
+    work(0);
+    kScheduler.wait(group);
+
+    return scanned.load();
+}
+
+} // namespace db
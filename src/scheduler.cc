@@ -0,0 +1,172 @@
+////
+// @file scheduler.cc
+// @brief
+// 实现任务调度器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <chrono>
+#include <db/scheduler.h>
+
+namespace db {
+
+namespace {
+thread_local int kWorkerIndex = -1;              // 当前线程编号
+thread_local Scheduler *kWorkerScheduler = NULL; // 当前线程所属调度器
+} // namespace
+
+void Scheduler::init(unsigned int threads)
+{
+    std::call_once(once_, [this, threads]() {
+        unsigned int count = threads;
+        if (count == 0) count = std::thread::hardware_concurrency();
+        if (count == 0) count = 1;
+
+        // 先创建所有队列，再启动线程，线程启动后就可能窃取任务
+        for (unsigned int i = 0; i < count; ++i)
+            workers_.push_back(new Worker);
+        for (unsigned int i = 0; i < count; ++i)
+            workers_[i]->thread = std::thread(&Scheduler::loop, this, (int) i);
+    });
+}
+
+void Scheduler::shutdown()
+{
+    if (workers_.empty() || stop_.load()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stop_.store(true);
+    }
+    sleep_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        if (workers_[i]->thread.joinable()) workers_[i]->thread.join();
+        delete workers_[i];
+    }
+    workers_.clear();
+}
+
+int Scheduler::current()
+{
+    return kWorkerScheduler ? kWorkerIndex : -1;
+}
+
+void Scheduler::spawn(Task task, int priority, TaskGroup *group)
+{
+    init();
+    if (priority < 0 || priority >= TASK_PRIORITIES) priority = TASK_FOREGROUND;
+
+    // 调度器已经停止，直接执行
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    if (group) group->add();
+
+    // 工作线程放入自己的队列，外部线程轮转放入
+    int index = kWorkerScheduler == this ? kWorkerIndex : -1;
+    if (index < 0) index = (int) (round_.fetch_add(1) % workers_.size());
+
+    Worker *worker = workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        Entry entry;
+        entry.task = std::move(task);
+        entry.group = group;
+        worker->queues[priority].push_back(std::move(entry));
+    }
+    queued_.fetch_add(1);
+
+    // 唤醒一个睡眠的线程
+    { std::lock_guard<std::mutex> lock(sleepMutex_); }
+    sleep_.notify_one();
+}
+
+bool Scheduler::take(int index, Entry &entry)
+{
+    size_t count = workers_.size();
+    if (count == 0 || queued_.load() == 0) return false;
+
+    for (int priority = 0; priority < TASK_PRIORITIES; ++priority) {
+        // 自己的队列，从尾部取
+        if (index >= 0) {
+            Worker *self = workers_[index];
+            std::lock_guard<std::mutex> lock(self->mutex);
+            std::deque<Entry> &queue = self->queues[priority];
+            if (!queue.empty()) {
+                entry = std::move(queue.back());
+                queue.pop_back();
+                queued_.fetch_sub(1);
+                return true;
+            }
+        }
+
+        // 从其它线程的头部窃取
+        size_t start = index >= 0 ? (size_t) index + 1 : 0;
+        for (size_t k = 0; k < count; ++k) {
+            size_t victim = (start + k) % count;
+            if ((int) victim == index) continue;
+            Worker *other = workers_[victim];
+            std::lock_guard<std::mutex> lock(other->mutex);
+            std::deque<Entry> &queue = other->queues[priority];
+            if (!queue.empty()) {
+                entry = std::move(queue.front());
+                queue.pop_front();
+                queued_.fetch_sub(1);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Scheduler::run(Entry &entry)
+{
+    entry.task();
+    if (entry.group) entry.group->done();
+}
+
+void Scheduler::loop(int index)
+{
+    kWorkerIndex = index;
+    kWorkerScheduler = this;
+
+    while (!stop_.load()) {
+        Entry entry;
+        if (take(index, entry)) {
+            run(entry);
+            continue;
+        }
+
+        // 没有任务，睡眠直到有新任务
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        while (queued_.load() == 0 && !stop_.load())
+            sleep_.wait(lock);
+    }
+}
+
+bool Scheduler::yield()
+{
+    Entry entry;
+    int index = kWorkerScheduler == this ? kWorkerIndex : -1;
+    if (take(index, entry)) {
+        run(entry);
+        return true;
+    }
+    std::this_thread::yield();
+    return false;
+}
+
+void Scheduler::wait(TaskGroup &group)
+{
+    while (!group.finished()) {
+        if (!yield())
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+// 全局调度器
+Scheduler kScheduler;
+
+} // namespace db
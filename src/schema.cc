@@ -6,16 +6,35 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include <stdlib.h>
+#include <algorithm>
 #include <db/schema.h>
 #include <db/block.h>
 #include <db/endian.h>
 #include <db/record.h>
 #include <db/file.h>
 #include <db/buffer.h>
+#include <db/scheduler.h>
 
 namespace db {
 
 const char *Schema::META_FILE = "_meta.db";
+const TableId Schema::META_ID;
+
+namespace {
+// 按各字段的长度生成定长格式，有不定长的字段时返回false
+bool fixedFormat(RelationInfo &info)
+{
+    std::vector<unsigned int> widths;
+    for (size_t i = 0; i < info.fields.size(); ++i) {
+        const FieldInfo &field = info.fields[i];
+        if (field.type == NULL || field.type->size < 0 || field.length <= 0)
+            return false;
+        widths.push_back((unsigned int) field.length);
+    }
+    // 一条记录最多占半个block，与变长记录分裂的前提一致
+    return info.format.init(widths, BLOCK_SIZE / 2);
+}
+} // namespace
 
 void Schema::init(Buffer *buffer)
 {
@@ -23,7 +42,7 @@ void Schema::init(Buffer *buffer)
     buffer_ = buffer;
     // 加入meta
     RelationInfo kMetaInfo(META_FILE);
-    tablespace_[META_FILE] = kMetaInfo;
+    tablespace_[META_ID] = kMetaInfo;
     // 打开meta
     open();
 }
@@ -32,7 +51,7 @@ void Schema::open()
 {
     // 读取超块
     SuperBlock super;
-    BufDesp *desp = buffer_->borrow(META_FILE, 0);
+    BufDesp *desp = buffer_->borrow(META_ID, 0);
     super.attach(desp->buffer);
 
     // meta未初始化，初始化超块
@@ -52,45 +71,132 @@ void Schema::open()
     super.detach(); // 分离超块指针
     desp->relref(); // 释放超块
 
-    // 读第1个meta块
+    // 沿meta链扫描，只取出表名，记下记录的位置
+    std::lock_guard<std::mutex> guard(meta_);
+    std::vector<std::pair<std::string, Location>> catalog;
+    blocks_ = 0;
+    maxspace_ = SPACE_LEGACY;
+    unsigned int blockid = first_;
+    while (blockid) {
+        MetaBlock block;
+        desp = buffer_->borrow(META_ID, blockid);
+        block.attach(desp->buffer);
+        // 新建的meta.db，第1个meta块还未写过，写下去以免被换出后丢失
+        if (block.getMagic() != MAGIC_NUMBER) {
+            block.clear(0, blockid, BLOCK_TYPE_META);
+            buffer_->writeBuf(desp);
+        }
+
+        unsigned short count = block.getSlots();
+        Slot *slots = block.getSlotsPointer();
+        for (unsigned short i = 0; i < count; ++i) {
+            Record record;
+            unsigned char *rb = desp->buffer + be16toh(slots[i].offset);
+            record.attach(rb, BLOCK_SIZE);
+            RecordLayout layout;
+            if (!layout.decode(record)) continue;
+
+            // 顺便取出表空间id，新表的id接着分配
+            unsigned short fields;
+            ::memcpy(&fields, layout.data(2), sizeof(fields));
+            size_t at = 7 + be16toh(fields) * 4;
+            if (at < layout.count() && layout.length(at) == sizeof(int)) {
+                unsigned int spaceid;
+                ::memcpy(&spaceid, layout.data(at), sizeof(spaceid));
+                maxspace_ = std::max(maxspace_, be32toh(spaceid));
+            }
+
+            Location loc;
+            loc.blockid = blockid;
+            loc.slot = i;
+            catalog.push_back(std::make_pair(
+                std::string((const char *) layout.data(0)), loc));
+        }
+
+        last_ = blockid;
+        ++blocks_;
+        blockid = block.getNext();
+        block.detach(); // 分离meta块指针
+        desp->relref(); // 释放meta块
+    }
+
+    // 表名一次性intern，重复open时已加载的表不再登记
+    std::lock_guard<std::mutex> lock(mutex_);
+    catalog_.clear();
+    for (size_t i = 0; i < catalog.size(); ++i) {
+        TableId id = assign(catalog[i].first);
+        if (tablespace_.find(id) == tablespace_.end())
+            catalog_[id] = catalog[i].second;
+    }
+}
+
+void Schema::load(const Location &loc, RelationInfo &info)
+{
     MetaBlock block;
-    desp = buffer_->borrow(META_FILE, first_);
+    BufDesp *desp = buffer_->borrow(META_ID, loc.blockid);
     block.attach(desp->buffer);
-    if (block.getMagic() != MAGIC_NUMBER)
-        block.clear(0, first_, BLOCK_TYPE_META);
-
-    // 枚举所有slots，加载tablespace_
-    unsigned short count = block.getSlots();
     Slot *slots = block.getSlotsPointer();
-    for (unsigned short i = 0; i < count; ++i) {
-        RelationInfo info;
 
-        // 得到记录
-        Record record;
-        unsigned char *rb = desp->buffer + be16toh(slots[i].offset);
-        record.attach(rb, BLOCK_SIZE);
+    // 得到记录
+    Record record;
+    unsigned char *rb = desp->buffer + be16toh(slots[loc.slot].offset);
+    record.attach(rb, BLOCK_SIZE);
 
-        // 先分配iovec
-        size_t fields = record.fields();
-        std::vector<struct iovec> iov(fields);
-        unsigned char header;
+    // 先分配iovec，再从记录得到iovec
+    std::vector<struct iovec> iov(record.fields());
+    unsigned char header;
+    record.ref(iov, &header);
+    std::string table;
+    retrieveInfo(table, info, iov); // 填充info
+    // 定长表重新算出记录格式，算不出来的按变长处理
+    if (info.type == RELATION_FIXED && !fixedFormat(info))
+        info.type = RELATION_VARIABLE;
+
+    block.detach(); // 分离meta块指针
+    desp->relref(); // 释放meta块
+}
 
-        // 从记录得到iovec
-        record.ref(iov, &header);
-        std::string table;
-        retrieveInfo(table, info, iov); // 填充info
+void Schema::extend()
+{
+    // 新块接在maxid之后
+    unsigned int blockid = ++maxid_;
+    MetaBlock block;
+    BufDesp *desp = buffer_->borrow(META_ID, blockid);
+    block.attach(desp->buffer);
+    block.clear(0, blockid, BLOCK_TYPE_META);
+    block.setChecksum();
+    buffer_->writeBuf(desp);
+    block.detach();
+    desp->relref();
 
-        // 插入tablespace
-        tablespace_.insert(std::pair<std::string, RelationInfo>(table, info));
-    }
+    // 超块记下新的maxid
+    SuperBlock super;
+    desp = buffer_->borrow(META_ID, 0);
+    super.attach(desp->buffer);
+    super.setMaxid(maxid_);
+    super.setChecksum();
+    buffer_->writeBuf(desp);
+    super.detach();
+    desp->relref();
 
-    block.detach(); // 分离超块指针
-    desp->relref(); // 释放超块
+    // 最后挂到链尾
+    desp = buffer_->borrow(META_ID, last_);
+    block.attach(desp->buffer);
+    block.setNext(blockid);
+    block.setChecksum();
+    buffer_->writeBuf(desp);
+    block.detach();
+    desp->relref();
+
+    last_ = blockid;
+    ++blocks_;
 }
 
 int Schema::create(const char *table, RelationInfo &info)
 {
     if ((size_t) info.count != info.fields.size()) return EINVAL;
+    // meta记录要能被RecordLayout解码
+    if ((unsigned int) info.iovSize() > RECORD_MAX_FIELDS) return EINVAL;
 
     // 先将info转化iov
     int total = info.iovSize();
@@ -99,30 +205,50 @@ int Schema::create(const char *table, RelationInfo &info)
     // NOTE: 强制修改路径名
     info.path = table;
     info.path += ".dat";
+    // 所有字段都定长时采用定长记录
+    info.type = fixedFormat(info) ? RELATION_FIXED : RELATION_VARIABLE;
+
+    // create串行执行，meta链只在这里增长
+    std::lock_guard<std::mutex> guard(meta_);
+    TableId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = assign(table);
+        if (tablespace_.count(id) || catalog_.count(id)) return EEXIST;
+    }
+    // 分配表空间id
+    if (maxspace_ == SPACE_NONE - 1) return EINVAL;
+    info.spaceid = maxspace_ + 1;
 
     // 初始化iov
     initIov(table, info, iov);
 
-    // 在表空间中添加
-    std::string t(table);
-    std::pair<TableSpace::iterator, bool> pret =
-        tablespace_.insert(std::pair<std::string, RelationInfo>(t, info));
-    if (!pret.second) return EEXIST;
-
-    // 读1个meta块
+    // 在meta链的最后一块分配，满了就接上一块
+    unsigned short length = (unsigned short) Record::size(iov);
     MetaBlock meta;
-    BufDesp *desp = buffer_->borrow(META_FILE, first_);
+    BufDesp *desp = buffer_->borrow(META_ID, last_);
     meta.attach(desp->buffer);
-    unsigned short length = (unsigned short) Record::size(iov);
-    std::pair<unsigned char *, bool> alloc_ret = meta.allocate(length, 0);
+    std::pair<unsigned char *, bool> alloc_ret =
+        meta.allocate(length, meta.getSlots());
     if (alloc_ret.first == NULL) {
-        // TODO: 再分配一个block
+        meta.detach();
+        desp->relref();
+        extend();
+        desp = buffer_->borrow(META_ID, last_);
+        meta.attach(desp->buffer);
+        alloc_ret = meta.allocate(length, meta.getSlots());
+        if (alloc_ret.first == NULL) {
+            // 空块也放不下
+            meta.detach();
+            desp->relref();
+            return EINVAL;
+        }
     }
 
     // 将关系信息写入buf，这里不需要排序，因为有tablespace_
     Record record;
     record.attach(alloc_ret.first, length);
-    unsigned char header;
+    unsigned char header = 0;
     htobe(iov);
     record.set(iov, &header);
     betoh(iov);
@@ -135,12 +261,21 @@ int Schema::create(const char *table, RelationInfo &info)
     meta.detach();           // 分离超块指针
     desp->relref();          // 释放超块
 
+    // 写入meta后才算分配了表空间id
+    maxspace_ = info.spaceid;
+
+    // 在表空间中添加
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tablespace_.insert(TableSpace::value_type(id, info));
+    }
+    version_.fetch_add(1);
+
     // 创建新表的超块
     SuperBlock super;
     desp = buffer_->borrow(table, 0);
     super.attach(desp->buffer);
-    // TODO: spaceid
-    super.clear(1);
+    super.clear(info.spaceid);
     super.setFirst(1);
     super.setMaxid(1);
     super.setChecksum();
@@ -152,7 +287,7 @@ int Schema::create(const char *table, RelationInfo &info)
     DataBlock data;
     desp = buffer_->borrow(table, 1);
     data.attach(desp->buffer);
-    data.clear(1, 1, BLOCK_TYPE_DATA);
+    data.clear(info.spaceid, 1, BLOCK_TYPE_DATA);
     buffer_->writeBuf(desp); // 写meta块
     data.detach();           // 分离超块指针
     desp->relref();          // 释放超块
@@ -160,12 +295,86 @@ int Schema::create(const char *table, RelationInfo &info)
     return S_OK;
 }
 
+std::pair<Schema::TableSpace::iterator, bool> Schema::lookup(TableId table)
+{
+    Location loc;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TableSpace::iterator it = tablespace_.find(table);
+        if (it != tablespace_.end())
+            return std::pair<TableSpace::iterator, bool>(it, true);
+        Catalog::iterator cit = catalog_.find(table);
+        if (cit == catalog_.end())
+            return std::pair<TableSpace::iterator, bool>(it, false);
+        loc = cit->second;
+    }
+
+    // borrow会经FilePool回到lookup，解码时不能持有mutex_
+    RelationInfo info;
+    load(loc, info);
+
+    // 并发加载同一张表时，后到的丢弃自己的结果
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::pair<TableSpace::iterator, bool> ret =
+        tablespace_.insert(TableSpace::value_type(table, info));
+    catalog_.erase(table);
+    return std::pair<TableSpace::iterator, bool>(ret.first, true);
+}
+
 std::pair<Schema::TableSpace::iterator, bool> Schema::lookup(const char *table)
 {
-    std::string t(table);
-    TableSpace::iterator it = tablespace_.find(t);
-    bool ret = it != tablespace_.end();
-    return std::pair<TableSpace::iterator, bool>(it, ret);
+    TableId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<std::string, TableId>::iterator it =
+            ids_.find(table);
+        // 没有intern过的名字不可能是表
+        if (it == ids_.end())
+            return std::pair<TableSpace::iterator, bool>(
+                tablespace_.end(), false);
+        id = it->second;
+    }
+    return lookup(id);
+}
+
+TableId Schema::intern(const char *table)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return assign(table);
+}
+
+const std::string &Schema::name(TableId table)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_[table];
+}
+
+TableId Schema::assign(const std::string &table)
+{
+    std::unordered_map<std::string, TableId>::iterator it = ids_.find(table);
+    if (it != ids_.end()) return it->second;
+    TableId id = (TableId) names_.size();
+    names_.push_back(table);
+    ids_[table] = id;
+    return id;
+}
+
+size_t Schema::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tablespace_.size() + catalog_.size();
+}
+
+size_t Schema::loaded()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tablespace_.size();
+}
+
+size_t Schema::blocks()
+{
+    std::lock_guard<std::mutex> lock(meta_);
+    return blocks_;
 }
 
 void Schema::initIov(
@@ -210,6 +419,9 @@ void Schema::initIov(
         iov[7 + i * 4 + 3].iov_base = (void *) info.fields[i].type->name;
         iov[7 + i * 4 + 3].iov_len = strlen(info.fields[i].type->name) + 1;
     }
+    // 表空间id
+    iov[7 + info.count * 4].iov_base = &info.spaceid;
+    iov[7 + info.count * 4].iov_len = sizeof(unsigned int);
 }
 void Schema::betoh(std::vector<struct iovec> &iov)
 {
@@ -239,6 +451,9 @@ void Schema::betoh(std::vector<struct iovec> &iov)
         l = (unsigned long long *) iov[7 + i * 4 + 2].iov_base;
         *l = be64toh(*l);
     }
+    // 表空间id
+    i = (unsigned int *) iov[7 + count * 4].iov_base;
+    *i = be32toh(*i);
 }
 void Schema::htobe(std::vector<struct iovec> &iov)
 {
@@ -268,6 +483,9 @@ void Schema::htobe(std::vector<struct iovec> &iov)
         l = (unsigned long long *) iov[7 + i * 4 + 2].iov_base;
         *l = htobe64(*l);
     }
+    // 表空间id
+    i = (unsigned int *) iov[7 + count * 4].iov_base;
+    *i = htobe32(*i);
 }
 
 void Schema::retrieveInfo(
@@ -317,6 +535,13 @@ void Schema::retrieveInfo(
 
         info.fields.push_back(field);
     }
+
+    // 表空间id，老版本的记录没有
+    info.spaceid = SPACE_LEGACY;
+    if (iov.size() > 7 + count * 4) {
+        ::memcpy(&info.spaceid, iov[7 + count * 4].iov_base, sizeof(int));
+        info.spaceid = be32toh(info.spaceid);
+    }
 }
 
 void dbInit(size_t bufsize)
@@ -327,6 +552,7 @@ void dbInit(size_t bufsize)
         kBuffer.init(&kFiles, bufsize);
         kFiles.init(&kSchema);
         kSchema.init(&kBuffer);
+        kScheduler.init();
     }
 }
 
@@ -0,0 +1,701 @@
+////
+// @file server.cc
+// @brief
+// 实现网络服务器和客户端
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#if defined(__linux__)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <db/server.h>
+
+namespace db {
+namespace {
+const size_t RECEIVE_SIZE = 64 * 1024; // 一次recv的缓冲大小
+
+inline void putU16(std::string &out, unsigned int value)
+{
+    out.push_back((char) (value >> 8));
+    out.push_back((char) value);
+}
+inline void putU32(std::string &out, unsigned int value)
+{
+    putU16(out, value >> 16);
+    putU16(out, value & 0xffff);
+}
+inline void putU64(std::string &out, unsigned long long value)
+{
+    putU32(out, (unsigned int) (value >> 32));
+    putU32(out, (unsigned int) value);
+}
+inline unsigned int getU16(const unsigned char *p)
+{
+    return ((unsigned int) p[0] << 8) | p[1];
+}
+inline unsigned int getU32(const unsigned char *p)
+{
+    return (getU16(p) << 16) | getU16(p + 2);
+}
+inline unsigned long long getU64(const unsigned char *p)
+{
+    return ((unsigned long long) getU32(p) << 32) | getU32(p + 4);
+}
+
+// 开始一帧，返回帧在out中的位置，长度由endFrame回填
+inline size_t beginFrame(std::string &out, unsigned char type)
+{
+    size_t start = out.size();
+    putU32(out, 0);
+    out.push_back((char) type);
+    return start;
+}
+inline void endFrame(std::string &out, size_t start)
+{
+    unsigned int length = (unsigned int) (out.size() - start - 4);
+    for (int i = 0; i < 4; ++i)
+        out[start + i] = (char) (length >> (24 - 8 * i));
+}
+
+// 编码一个值
+void putValue(std::string &out, const Value &value)
+{
+    if (value.string) {
+        out.push_back((char) VALUE_BYTES);
+        putU32(out, (unsigned int) value.text.size());
+        out.append(value.text);
+    } else {
+        out.push_back((char) VALUE_INTEGER);
+        putU64(out, (unsigned long long) value.number);
+    }
+}
+// 解码一个值，offset前进，越界返回false
+bool getValue(
+    const unsigned char *payload,
+    size_t length,
+    size_t &offset,
+    Value &value)
+{
+    if (offset >= length) return false;
+    unsigned char tag = payload[offset++];
+    if (tag == VALUE_INTEGER) {
+        if (length - offset < 8) return false;
+        value.string = false;
+        value.number = (long long) getU64(payload + offset);
+        offset += 8;
+        return true;
+    } else if (tag == VALUE_BYTES) {
+        if (length - offset < 4) return false;
+        size_t size = getU32(payload + offset);
+        offset += 4;
+        if (length - offset < size) return false;
+        value.string = true;
+        value.text.assign((const char *) payload + offset, size);
+        offset += size;
+        return true;
+    }
+    return false;
+}
+
+// 一批结果编码成ROWS帧，字节串去掉CHAR补齐的尾部0
+void putRows(std::string &out, Batch &batch)
+{
+    size_t count = batch.count();
+    if (count == 0) return;
+    size_t start = beginFrame(out, MSG_ROWS);
+    putU16(out, (unsigned int) count);
+    putU16(out, (unsigned int) batch.columns.size());
+    for (size_t i = 0; i < count; ++i) {
+        size_t row = batch.row(i);
+        for (size_t c = 0; c < batch.columns.size(); ++c) {
+            const ColumnVector &column = batch.columns[c];
+            if (column.integer) {
+                out.push_back((char) VALUE_INTEGER);
+                putU64(out, (unsigned long long) column.ints[row]);
+            } else {
+                const unsigned char *data = column.data[row];
+                unsigned int length = column.lengths[row];
+                while (length > 0 && data[length - 1] == 0)
+                    --length;
+                out.push_back((char) VALUE_BYTES);
+                putU32(out, length);
+                out.append((const char *) data, length);
+            }
+        }
+    }
+    endFrame(out, start);
+}
+
+// 唤醒eventfd上等待的线程
+inline void notify(int fd)
+{
+    unsigned long long one = 1;
+    ssize_t ret = ::write(fd, &one, sizeof(one));
+    (void) ret;
+}
+// 读空eventfd
+inline void drain(int fd)
+{
+    unsigned long long value;
+    ssize_t ret = ::read(fd, &value, sizeof(value));
+    (void) ret;
+}
+inline void closeFd(int &fd)
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+// 把fd登记到epoll上，data是fd本身
+inline int watch(int epoll, int fd, unsigned int events, int op)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    return ::epoll_ctl(epoll, op, fd, &event) ? errno : S_OK;
+}
+} // namespace
+
+int Server::start(
+    const char *address,
+    unsigned short port,
+    unsigned int reactors)
+{
+    if (running_) return EEXIST;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address, &addr.sin_addr) != 1) return EINVAL;
+
+    // 监听socket
+    listen_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_ < 0) return errno;
+    int on = 1;
+    ::setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    socklen_t len = sizeof(addr);
+    if (::bind(listen_, (struct sockaddr *) &addr, sizeof(addr)) ||
+        ::listen(listen_, SERVER_BACKLOG) ||
+        ::getsockname(listen_, (struct sockaddr *) &addr, &len)) {
+        int ret = errno;
+        stop();
+        return ret;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    // accept线程的epoll等待监听socket和唤醒
+    int ret = S_OK;
+    epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeup_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || wakeup_ < 0)
+        ret = errno;
+    else if (!(ret = watch(epoll_, listen_, EPOLLIN, EPOLL_CTL_ADD)))
+        ret = watch(epoll_, wakeup_, EPOLLIN, EPOLL_CTL_ADD);
+
+    // 各reactor的epoll
+    if (reactors == 0) reactors = std::thread::hardware_concurrency();
+    if (reactors == 0) reactors = 1;
+    for (unsigned int i = 0; ret == S_OK && i < reactors; ++i) {
+        std::unique_ptr<Reactor> reactor(new Reactor);
+        reactor->epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        reactor->wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactor->epoll < 0 || reactor->wakeup < 0)
+            ret = errno;
+        else
+            ret = watch(
+                reactor->epoll, reactor->wakeup, EPOLLIN, EPOLL_CTL_ADD);
+        reactors_.push_back(std::move(reactor));
+    }
+    if (ret) {
+        stop();
+        return ret;
+    }
+
+    running_ = true;
+    for (size_t i = 0; i < reactors_.size(); ++i) {
+        Reactor *reactor = reactors_[i].get();
+        reactor->thread = std::thread([this, reactor] {
+            reactorLoop(*reactor);
+        });
+    }
+    acceptor_ = std::thread([this] { acceptLoop(); });
+    return S_OK;
+}
+
+void Server::stop()
+{
+    // 唤醒所有线程，等它们看到running_为false后退出
+    if (running_.exchange(false)) {
+        notify(wakeup_);
+        for (size_t i = 0; i < reactors_.size(); ++i)
+            notify(reactors_[i]->wakeup);
+        acceptor_.join();
+        for (size_t i = 0; i < reactors_.size(); ++i)
+            reactors_[i]->thread.join();
+    }
+
+    for (size_t i = 0; i < reactors_.size(); ++i) {
+        Reactor &reactor = *reactors_[i];
+        while (!reactor.connections.empty())
+            drop(reactor, reactor.connections.begin()->first);
+        for (size_t j = 0; j < reactor.pending.size(); ++j)
+            ::close(reactor.pending[j]);
+        closeFd(reactor.epoll);
+        closeFd(reactor.wakeup);
+    }
+    reactors_.clear();
+    closeFd(listen_);
+    closeFd(epoll_);
+    closeFd(wakeup_);
+}
+
+void Server::acceptLoop()
+{
+    struct epoll_event events[2];
+    size_t next = 0; // 下一个连接分给的reactor
+    while (running_) {
+        int count = ::epoll_wait(epoll_, events, 2, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.fd == wakeup_) {
+                drain(wakeup_);
+                continue;
+            }
+            // 接受所有排队的连接
+            while (true) {
+                int fd = ::accept4(
+                    listen_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) break;
+                int on = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+                Reactor &reactor = *reactors_[next++ % reactors_.size()];
+                {
+                    std::lock_guard<std::mutex> lock(reactor.mutex);
+                    reactor.pending.push_back(fd);
+                }
+                notify(reactor.wakeup);
+                ++accepted_;
+            }
+        }
+    }
+}
+
+void Server::reactorLoop(Reactor &reactor)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    while (running_) {
+        int count = ::epoll_wait(reactor.epoll, events, SERVER_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == reactor.wakeup) {
+                drain(fd);
+                adopt(reactor);
+                continue;
+            }
+            std::map<int, std::unique_ptr<Connection>>::iterator it =
+                reactor.connections.find(fd);
+            if (it == reactor.connections.end()) continue;
+            Connection &conn = *it->second;
+
+            // 先发积压的响应，再读新的请求
+            bool ok = true;
+            if (events[i].events & EPOLLOUT) ok = flush(conn);
+            if (ok && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                ok = receive(conn);
+            if (ok) {
+                process(conn);
+                ok = flush(conn) && rearm(reactor, conn);
+            }
+            if (!ok) drop(reactor, fd);
+        }
+    }
+}
+
+void Server::adopt(Reactor &reactor)
+{
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+        fds.swap(reactor.pending);
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (watch(reactor.epoll, fds[i], EPOLLIN, EPOLL_CTL_ADD)) {
+            ::close(fds[i]);
+            continue;
+        }
+        std::unique_ptr<Connection> conn(new Connection);
+        conn->fd = fds[i];
+        conn->events = EPOLLIN;
+        reactor.connections[fds[i]] = std::move(conn);
+    }
+}
+
+bool Server::receive(Connection &conn)
+{
+    char buffer[RECEIVE_SIZE];
+    while (true) {
+        ssize_t ret = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (ret > 0) {
+            conn.in.append(buffer, (size_t) ret);
+            if ((size_t) ret < sizeof(buffer)) return true;
+        } else if (ret == 0)
+            return false; // 对方关闭
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        else if (errno != EINTR)
+            return false;
+    }
+}
+
+void Server::process(Connection &conn)
+{
+    // 先把暂停的结果返回完，再处理后面的请求
+    if (conn.cursor.active()) {
+        stream(conn);
+        if (conn.cursor.active()) return;
+    }
+
+    size_t offset = 0;
+    while (!conn.closing && conn.in.size() - offset >= 4) {
+        // 未发出的响应太多，等客户读走再处理后面的请求
+        if (conn.out.size() - conn.sent >= SERVER_PENDING) {
+            ++paused_;
+            break;
+        }
+
+        const unsigned char *frame =
+            (const unsigned char *) conn.in.data() + offset;
+        size_t length = getU32(frame);
+        if (length == 0 || length > FRAME_MAX) {
+            // 帧长不对，无法再同步，回一个错误后关闭
+            size_t start = beginFrame(conn.out, MSG_ERROR);
+            putU32(conn.out, EPROTO);
+            conn.out.append("malformed frame");
+            endFrame(conn.out, start);
+            conn.closing = true;
+            break;
+        }
+        if (conn.in.size() - offset - 4 < length) break; // 帧还没收全
+
+        dispatch(conn, frame[4], frame + FRAME_HEADER, length - 1);
+        offset += 4 + length;
+        if (conn.cursor.active()) break; // 结果没返回完
+    }
+    conn.in.erase(0, offset);
+}
+
+void Server::stream(Connection &conn)
+{
+    while (conn.out.size() - conn.sent < SERVER_PENDING) {
+        if (!conn.cursor.next()) {
+            size_t start = beginFrame(conn.out, MSG_DONE);
+            putU64(conn.out, conn.cursor.rows());
+            endFrame(conn.out, start);
+            return;
+        }
+        // 积累多了先发一部分
+        putRows(conn.out, conn.cursor.batch());
+        if (conn.out.size() - conn.sent >= SERVER_FLUSH) flush(conn);
+    }
+    ++paused_; // 游标停在原处，积压发出后继续
+}
+
+void Server::dispatch(
+    Connection &conn,
+    unsigned char type,
+    const unsigned char *payload,
+    size_t length)
+{
+    int ret = EINVAL;
+    size_t affected = 0;
+    const char *message = NULL; // 会话之外的错误
+    switch (type) {
+    case MSG_QUERY: {
+        std::string sql((const char *) payload, length);
+        ret = conn.session.open(sql.c_str(), conn.cursor, &affected);
+        break;
+    }
+    case MSG_PREPARE: {
+        std::string sql((const char *) payload, length);
+        unsigned int id;
+        ret = conn.session.prepare(sql.c_str(), id);
+        if (ret == S_OK) {
+            size_t start = beginFrame(conn.out, MSG_PREPARED);
+            putU32(conn.out, id);
+            putU16(conn.out, (unsigned int) conn.session.params(id));
+            endFrame(conn.out, start);
+            return;
+        }
+        break;
+    }
+    case MSG_EXECUTE: {
+        std::vector<Value> params;
+        size_t offset = 6;
+        bool ok = length >= offset;
+        if (ok) params.resize(getU16(payload + 4));
+        for (size_t i = 0; ok && i < params.size(); ++i)
+            ok = getValue(payload, length, offset, params[i]);
+        if (ok && offset == length)
+            ret = conn.session.open(
+                getU32(payload), params, conn.cursor, &affected);
+        else
+            message = "malformed parameters";
+        break;
+    }
+    case MSG_CLOSE:
+        if (length == 4) {
+            ret = conn.session.close(getU32(payload));
+            if (ret) message = "unknown statement";
+        } else
+            message = "malformed request";
+        break;
+    default:
+        ret = ENOTSUP;
+        message = "unknown request";
+        break;
+    }
+
+    // SELECT的结果从游标拉取，DONE在取完后发
+    if (ret == S_OK && conn.cursor.active()) {
+        stream(conn);
+        return;
+    }
+
+    size_t start;
+    if (ret == S_OK) {
+        start = beginFrame(conn.out, MSG_DONE);
+        putU64(conn.out, affected);
+    } else {
+        start = beginFrame(conn.out, MSG_ERROR);
+        putU32(conn.out, (unsigned int) ret);
+        conn.out.append(message ? message : conn.session.error());
+    }
+    endFrame(conn.out, start);
+}
+
+bool Server::flush(Connection &conn)
+{
+    while (conn.sent < conn.out.size()) {
+        ssize_t ret = ::send(
+            conn.fd,
+            conn.out.data() + conn.sent,
+            conn.out.size() - conn.sent,
+            MSG_NOSIGNAL);
+        if (ret > 0)
+            conn.sent += (size_t) ret;
+        else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else if (ret < 0 && errno == EINTR)
+            continue;
+        else
+            return false;
+    }
+
+    // 回收已发送的部分
+    if (conn.sent == conn.out.size()) {
+        conn.out.clear();
+        conn.sent = 0;
+    } else if (conn.sent >= SERVER_FLUSH) {
+        conn.out.erase(0, conn.sent);
+        conn.sent = 0;
+    }
+    return true;
+}
+
+bool Server::rearm(Reactor &reactor, Connection &conn)
+{
+    size_t pending = conn.out.size() - conn.sent;
+    if (conn.closing && pending == 0) return false;
+
+    // 有积压时等EPOLLOUT，积压太多或要关闭时不再读请求
+    unsigned int events = 0;
+    if (!conn.closing && pending < SERVER_PENDING) events |= EPOLLIN;
+    if (pending > 0) events |= EPOLLOUT;
+    if (events == conn.events) return true;
+    conn.events = events;
+    return watch(reactor.epoll, conn.fd, events, EPOLL_CTL_MOD) == S_OK;
+}
+
+void Server::drop(Reactor &reactor, int fd)
+{
+    ::epoll_ctl(reactor.epoll, EPOLL_CTL_DEL, fd, NULL);
+    ::close(fd);
+    reactor.connections.erase(fd);
+}
+
+int Client::connect(const char *address, unsigned short port)
+{
+    close();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address, &addr.sin_addr) != 1) return EINVAL;
+
+    fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return errno;
+    if (::connect(fd_, (struct sockaddr *) &addr, sizeof(addr))) {
+        int ret = errno;
+        close();
+        return ret;
+    }
+    int on = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return S_OK;
+}
+
+void Client::close()
+{
+    closeFd(fd_);
+    out_.clear();
+    in_.clear();
+}
+
+void Client::query(const char *sql)
+{
+    size_t start = beginFrame(out_, MSG_QUERY);
+    out_.append(sql);
+    endFrame(out_, start);
+}
+
+void Client::prepare(const char *sql)
+{
+    size_t start = beginFrame(out_, MSG_PREPARE);
+    out_.append(sql);
+    endFrame(out_, start);
+}
+
+void Client::execute(unsigned int id, const std::vector<Value> &params)
+{
+    size_t start = beginFrame(out_, MSG_EXECUTE);
+    putU32(out_, id);
+    putU16(out_, (unsigned int) params.size());
+    for (size_t i = 0; i < params.size(); ++i)
+        putValue(out_, params[i]);
+    endFrame(out_, start);
+}
+
+void Client::closeStatement(unsigned int id)
+{
+    size_t start = beginFrame(out_, MSG_CLOSE);
+    putU32(out_, id);
+    endFrame(out_, start);
+}
+
+int Client::flush()
+{
+    size_t sent = 0;
+    while (sent < out_.size()) {
+        ssize_t ret = ::send(
+            fd_, out_.data() + sent, out_.size() - sent, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) return ret < 0 ? errno : ECONNRESET;
+        sent += (size_t) ret;
+    }
+    out_.clear();
+    return S_OK;
+}
+
+int Client::receive(Response &response)
+{
+    // 读到一个完整的帧
+    while (in_.size() < 4 ||
+           in_.size() - 4 < getU32((const unsigned char *) in_.data())) {
+        char buffer[RECEIVE_SIZE];
+        ssize_t ret = ::recv(fd_, buffer, sizeof(buffer), 0);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) return ret < 0 ? errno : ECONNRESET;
+        in_.append(buffer, (size_t) ret);
+    }
+
+    const unsigned char *frame = (const unsigned char *) in_.data();
+    size_t length = getU32(frame);
+    if (length == 0) return EPROTO;
+    const unsigned char *payload = frame + FRAME_HEADER;
+    size_t size = length - 1;
+    response.type = frame[4];
+
+    int ret = S_OK;
+    switch (response.type) {
+    case MSG_ROWS: {
+        if (size < 4) {
+            ret = EPROTO;
+            break;
+        }
+        size_t count = getU16(payload);
+        size_t columns = getU16(payload + 2);
+        size_t offset = 4;
+        for (size_t i = 0; ret == S_OK && i < count; ++i) {
+            std::vector<Value> row(columns);
+            for (size_t c = 0; c < columns; ++c)
+                if (!getValue(payload, size, offset, row[c])) {
+                    ret = EPROTO;
+                    break;
+                }
+            response.rows.push_back(row);
+        }
+        break;
+    }
+    case MSG_DONE:
+        if (size == 8)
+            response.affected = (long long) getU64(payload);
+        else
+            ret = EPROTO;
+        break;
+    case MSG_PREPARED:
+        if (size == 6) {
+            response.id = getU32(payload);
+            response.params = getU16(payload + 4);
+        } else
+            ret = EPROTO;
+        break;
+    case MSG_ERROR:
+        if (size >= 4) {
+            response.code = (int) getU32(payload);
+            response.error.assign((const char *) payload + 4, size - 4);
+        } else
+            ret = EPROTO;
+        break;
+    default:
+        ret = EPROTO;
+        break;
+    }
+    in_.erase(0, 4 + length);
+    return ret;
+}
+
+int Client::result(Response &response)
+{
+    response = Response();
+    while (true) {
+        int ret = receive(response);
+        if (ret) return ret;
+        if (response.type != MSG_ROWS) return S_OK;
+    }
+}
+
+} // namespace db
+
+#endif // __linux__
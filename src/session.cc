@@ -0,0 +1,252 @@
+////
+// @file session.cc
+// @brief
+// 实现客户会话和计划缓存
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <db/session.h>
+
+namespace db {
+
+std::shared_ptr<const Plan>
+PlanCache::find(const std::string &text, unsigned long long version)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 目录变了，缓存的计划全部失效
+    if (version != version_) {
+        if (version < version_) return std::shared_ptr<const Plan>();
+        map_.clear();
+        lru_.clear();
+        version_ = version;
+    }
+
+    std::map<std::string, Item>::iterator it = map_.find(text);
+    if (it == map_.end()) {
+        ++misses_;
+        return std::shared_ptr<const Plan>();
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second.position);
+    return it->second.plan;
+}
+
+void PlanCache::insert(
+    const std::string &text,
+    unsigned long long version,
+    const std::shared_ptr<const Plan> &plan)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (version < version_) return;
+    if (version > version_) {
+        map_.clear();
+        lru_.clear();
+        version_ = version;
+    }
+
+    std::map<std::string, Item>::iterator it = map_.find(text);
+    if (it != map_.end()) {
+        it->second.plan = plan;
+        lru_.splice(lru_.begin(), lru_, it->second.position);
+        return;
+    }
+
+    // 满了淘汰最久没用的
+    if (map_.size() >= capacity_ && !lru_.empty()) {
+        map_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(text);
+    Item &item = map_[text];
+    item.plan = plan;
+    item.position = lru_.begin();
+}
+
+void PlanCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_.clear();
+    lru_.clear();
+}
+
+size_t PlanCache::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return map_.size();
+}
+
+size_t PlanCache::hits()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+size_t PlanCache::misses()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+PlanCache kPlans;
+
+int Session::lookup(
+    const std::string &text,
+    std::shared_ptr<const Plan> &plan,
+    unsigned long long &version)
+{
+    // 先取版本再生成计划，期间目录变化时计划按旧版本缓存，随即失效
+    version = kSchema.version();
+    plan = kPlans.find(text, version);
+    if (plan) return S_OK;
+
+    std::shared_ptr<Plan> fresh(new Plan);
+    int ret = sql_.prepare(text.c_str(), *fresh);
+    if (ret) {
+        error_ = sql_.error();
+        return ret;
+    }
+    // CREATE执行后目录就变了，不缓存
+    if (fresh->kind != STMT_CREATE) kPlans.insert(text, version, fresh);
+    plan = fresh;
+    return S_OK;
+}
+
+int Session::run(Plan &plan, const Visitor &visitor, size_t *affected)
+{
+    int ret = executor_.execute(plan, visitor, affected);
+    if (ret && error_.empty()) error_ = "execution failed";
+    return ret;
+}
+
+int Session::start(Plan &plan, Cursor &cursor, size_t *affected)
+{
+    int ret = executor_.open(plan, cursor, affected);
+    if (ret && error_.empty()) error_ = "execution failed";
+    return ret;
+}
+
+int Session::prepare(const char *sql, unsigned int &id)
+{
+    error_.clear();
+    Prepared stmt;
+    int ret = sql_.normalize(sql, stmt.text);
+    if (ret) {
+        error_ = sql_.error();
+        return ret;
+    }
+    if ((ret = lookup(stmt.text, stmt.plan, stmt.version))) return ret;
+
+    // 重用关闭的编号
+    for (id = 0; id < statements_.size(); ++id)
+        if (!statements_[id].plan) break;
+    if (id == statements_.size()) statements_.push_back(Prepared());
+    statements_[id] = stmt;
+    return S_OK;
+}
+
+int Session::bound(
+    unsigned int id,
+    const std::vector<Value> &params,
+    Plan &plan)
+{
+    error_.clear();
+    if (id >= statements_.size() || !statements_[id].plan) {
+        error_ = "unknown statement";
+        return ENOENT;
+    }
+
+    // 目录变化后重新生成计划
+    Prepared &stmt = statements_[id];
+    if (stmt.version != kSchema.version()) {
+        int ret = lookup(stmt.text, stmt.plan, stmt.version);
+        if (ret) return ret;
+    }
+
+    plan = *stmt.plan;
+    int ret = sql_.bind(plan, params);
+    if (ret) error_ = sql_.error();
+    return ret;
+}
+
+int Session::parsed(const char *sql, Plan &plan)
+{
+    error_.clear();
+    std::string text;
+    int ret = sql_.normalize(sql, text);
+    if (ret) {
+        error_ = sql_.error();
+        return ret;
+    }
+
+    std::shared_ptr<const Plan> cached;
+    unsigned long long version;
+    if ((ret = lookup(text, cached, version))) return ret;
+    if (!cached->params.empty()) {
+        error_ = "missing parameters";
+        return EINVAL;
+    }
+    plan = *cached;
+    return S_OK;
+}
+
+int Session::execute(
+    unsigned int id,
+    const std::vector<Value> &params,
+    const Visitor &visitor,
+    size_t *affected)
+{
+    Plan plan;
+    int ret = bound(id, params, plan);
+    if (ret) return ret;
+    return run(plan, visitor, affected);
+}
+
+int Session::execute(
+    const char *sql,
+    const Visitor &visitor,
+    size_t *affected)
+{
+    Plan plan;
+    int ret = parsed(sql, plan);
+    if (ret) return ret;
+    return run(plan, visitor, affected);
+}
+
+int Session::open(
+    unsigned int id,
+    const std::vector<Value> &params,
+    Cursor &cursor,
+    size_t *affected)
+{
+    cursor.close();
+    Plan plan;
+    int ret = bound(id, params, plan);
+    if (ret) return ret;
+    return start(plan, cursor, affected);
+}
+
+int Session::open(const char *sql, Cursor &cursor, size_t *affected)
+{
+    cursor.close();
+    Plan plan;
+    int ret = parsed(sql, plan);
+    if (ret) return ret;
+    return start(plan, cursor, affected);
+}
+
+int Session::close(unsigned int id)
+{
+    if (id >= statements_.size() || !statements_[id].plan) return ENOENT;
+    statements_[id] = Prepared();
+    return S_OK;
+}
+
+size_t Session::params(unsigned int id) const
+{
+    if (id >= statements_.size() || !statements_[id].plan) return 0;
+    return statements_[id].plan->params.size();
+}
+
+} // namespace db
@@ -0,0 +1,1076 @@
+////
+// @file sql.cc
+// @brief
+// 实现SQL解析和planner
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <db/sql.h>
+#include <db/table.h>
+#include <db/endian.h>
+
+namespace db {
+
+namespace {
+// 大小写无关比较
+bool equalsIgnoreCase(const std::string &x, const char *y)
+{
+    size_t i = 0;
+    for (; i < x.size() && y[i]; ++i)
+        if (toupper((unsigned char) x[i]) != toupper((unsigned char) y[i]))
+            return false;
+    return i == x.size() && y[i] == 0;
+}
+
+std::string toUpper(const std::string &s)
+{
+    std::string ret(s);
+    for (size_t i = 0; i < ret.size(); ++i)
+        ret[i] = (char) toupper((unsigned char) ret[i]);
+    return ret;
+}
+
+// 是否字节串类型
+bool isBytes(const FieldInfo &field)
+{
+    const char *name = field.type->name;
+    return strcmp(name, "CHAR") == 0 || strcmp(name, "VARCHAR") == 0;
+}
+
+// 按名字查找域
+bool findField(
+    const RelationInfo &info,
+    const std::string &name,
+    unsigned int &field)
+{
+    for (size_t i = 0; i < info.fields.size(); ++i)
+        if (info.fields[i].name == name) {
+            field = (unsigned int) i;
+            return true;
+        }
+    return false;
+}
+
+// 表的记录数，来自超块中的统计
+size_t countRecords(const std::string &name)
+{
+    Table table;
+    if (table.open(name.c_str())) return 0;
+    return table.recordCount();
+}
+
+// 双字符符号
+const char *kSymbols2[] = {"<=", ">=", "<>", "!=", NULL};
+// 单字符符号
+const char *kSymbols1 = "(),;*=<>-.?";
+} // namespace
+
+int SQL::tokenize(const char *sql)
+{
+    tokens_.clear();
+    current_ = 0;
+
+    size_t i = 0;
+    while (sql[i]) {
+        unsigned char c = (unsigned char) sql[i];
+        if (isspace(c)) {
+            ++i;
+            continue;
+        }
+
+        Token token;
+        token.pos = i;
+        if (isalpha(c) || c == '_') {
+            // 标识符或关键字
+            size_t start = i;
+            while (isalnum((unsigned char) sql[i]) || sql[i] == '_')
+                ++i;
+            token.type = TOKEN_IDENT;
+            token.text.assign(sql + start, i - start);
+        } else if (isdigit(c)) {
+            // 整数
+            size_t start = i;
+            while (isdigit((unsigned char) sql[i]))
+                ++i;
+            token.type = TOKEN_NUMBER;
+            token.text.assign(sql + start, i - start);
+        } else if (c == '\'') {
+            // 字符串，''转义一个引号
+            ++i;
+            token.type = TOKEN_STRING;
+            while (true) {
+                if (sql[i] == 0) {
+                    error_ = "unterminated string";
+                    return EINVAL;
+                }
+                if (sql[i] == '\'') {
+                    if (sql[i + 1] != '\'') break;
+                    ++i;
+                }
+                token.text.push_back(sql[i++]);
+            }
+            ++i;
+        } else {
+            // 符号
+            token.type = TOKEN_SYMBOL;
+            for (int k = 0; kSymbols2[k]; ++k)
+                if (sql[i] == kSymbols2[k][0] && sql[i + 1] == kSymbols2[k][1])
+                    token.text = kSymbols2[k];
+            if (token.text.empty() && strchr(kSymbols1, c))
+                token.text.assign(1, (char) c);
+            if (token.text.empty()) {
+                error_ = "unexpected character '";
+                error_.push_back((char) c);
+                error_ += "'";
+                return EINVAL;
+            }
+            i += token.text.size();
+        }
+        tokens_.push_back(token);
+    }
+
+    Token end;
+    end.pos = i;
+    tokens_.push_back(end);
+    return S_OK;
+}
+
+bool SQL::keyword(const char *word)
+{
+    const Token &token = peek();
+    if (token.type != TOKEN_IDENT || !equalsIgnoreCase(token.text, word))
+        return false;
+    ++current_;
+    return true;
+}
+
+bool SQL::symbol(const char *sym)
+{
+    const Token &token = peek();
+    if (token.type != TOKEN_SYMBOL || token.text != sym) return false;
+    ++current_;
+    return true;
+}
+
+int SQL::fail(const std::string &message)
+{
+    const Token &token = peek();
+    error_ = message;
+    if (token.type == TOKEN_END)
+        error_ += " at end";
+    else
+        error_ += " near '" + token.text + "'";
+    return EINVAL;
+}
+
+int SQL::expectKeyword(const char *word)
+{
+    if (keyword(word)) return S_OK;
+    return fail(std::string("expect ") + word);
+}
+
+int SQL::expectSymbol(const char *sym)
+{
+    if (symbol(sym)) return S_OK;
+    return fail(std::string("expect '") + sym + "'");
+}
+
+int SQL::expectIdent(std::string &ident)
+{
+    const Token &token = peek();
+    if (token.type != TOKEN_IDENT) return fail("expect identifier");
+    ident = token.text;
+    ++current_;
+    return S_OK;
+}
+
+int SQL::expectColumn(std::string &column)
+{
+    int ret = expectIdent(column);
+    if (ret || !symbol(".")) return ret;
+
+    // 表名.列名
+    std::string name;
+    if ((ret = expectIdent(name))) return ret;
+    column += "." + name;
+    return S_OK;
+}
+
+int SQL::parseValue(Value &value)
+{
+    // 参数按出现的顺序编号
+    if (symbol("?")) {
+        value.param = (int) params_++;
+        return S_OK;
+    }
+
+    bool negative = symbol("-");
+    const Token &token = peek();
+    if (token.type == TOKEN_NUMBER) {
+        value.string = false;
+        value.number = strtoll(token.text.c_str(), NULL, 10);
+        if (negative) value.number = -value.number;
+        ++current_;
+        return S_OK;
+    }
+    if (token.type == TOKEN_STRING && !negative) {
+        value.string = true;
+        value.text = token.text;
+        ++current_;
+        return S_OK;
+    }
+    return fail("expect literal");
+}
+
+int SQL::parse(const char *sql, Statement &stmt)
+{
+    error_.clear();
+    stmt = Statement();
+    params_ = 0;
+    int ret = tokenize(sql);
+    if (ret) return ret;
+
+    if (keyword("CREATE"))
+        ret = parseCreate(stmt);
+    else if (keyword("INSERT"))
+        ret = parseInsert(stmt);
+    else if (keyword("SELECT"))
+        ret = parseSelect(stmt);
+    else if (keyword("UPDATE"))
+        ret = parseUpdate(stmt);
+    else if (keyword("DELETE"))
+        ret = parseDelete(stmt);
+    else
+        return fail("unknown statement");
+    if (ret) return ret;
+
+    // 允许结尾的分号
+    symbol(";");
+    if (peek().type != TOKEN_END) return fail("unexpected token");
+    stmt.params = params_;
+    return S_OK;
+}
+
+int SQL::parseCreate(Statement &stmt)
+{
+    stmt.kind = STMT_CREATE;
+    int ret = expectKeyword("TABLE");
+    if (ret) return ret;
+    if ((ret = expectIdent(stmt.table))) return ret;
+    if ((ret = expectSymbol("("))) return ret;
+
+    do {
+        // 表级主键 PRIMARY KEY (col)
+        if (keyword("PRIMARY")) {
+            std::string column;
+            if ((ret = expectKeyword("KEY"))) return ret;
+            if ((ret = expectSymbol("("))) return ret;
+            if ((ret = expectIdent(column))) return ret;
+            if ((ret = expectSymbol(")"))) return ret;
+
+            size_t i = 0;
+            for (; i < stmt.defs.size(); ++i)
+                if (stmt.defs[i].name == column) break;
+            if (i == stmt.defs.size()) return fail("unknown primary key");
+            stmt.defs[i].primary = true;
+            continue;
+        }
+
+        ColumnDef def;
+        if ((ret = expectIdent(def.name))) return ret;
+        std::string type;
+        if ((ret = expectIdent(type))) return ret;
+        def.type = toUpper(type);
+        if (symbol("(")) {
+            const Token &token = peek();
+            if (token.type != TOKEN_NUMBER) return fail("expect length");
+            def.length = strtoll(token.text.c_str(), NULL, 10);
+            ++current_;
+            if ((ret = expectSymbol(")"))) return ret;
+        }
+        if (keyword("PRIMARY")) {
+            if ((ret = expectKeyword("KEY"))) return ret;
+            def.primary = true;
+        }
+        stmt.defs.push_back(def);
+    } while (symbol(","));
+
+    return expectSymbol(")");
+}
+
+int SQL::parseInsert(Statement &stmt)
+{
+    stmt.kind = STMT_INSERT;
+    int ret = expectKeyword("INTO");
+    if (ret) return ret;
+    if ((ret = expectIdent(stmt.table))) return ret;
+
+    // 可选的列名
+    if (symbol("(")) {
+        do {
+            std::string column;
+            if ((ret = expectIdent(column))) return ret;
+            stmt.columns.push_back(column);
+        } while (symbol(","));
+        if ((ret = expectSymbol(")"))) return ret;
+    }
+
+    if ((ret = expectKeyword("VALUES"))) return ret;
+    if ((ret = expectSymbol("("))) return ret;
+    do {
+        Value value;
+        if ((ret = parseValue(value))) return ret;
+        stmt.values.push_back(value);
+    } while (symbol(","));
+    return expectSymbol(")");
+}
+
+int SQL::parseWhere(Statement &stmt)
+{
+    if (!keyword("WHERE")) return S_OK;
+
+    do {
+        Predicate pred;
+        int ret = expectColumn(pred.column);
+        if (ret) return ret;
+
+        if (symbol("="))
+            pred.op = OP_EQ;
+        else if (symbol("!=") || symbol("<>"))
+            pred.op = OP_NE;
+        else if (symbol("<="))
+            pred.op = OP_LE;
+        else if (symbol(">="))
+            pred.op = OP_GE;
+        else if (symbol("<"))
+            pred.op = OP_LT;
+        else if (symbol(">"))
+            pred.op = OP_GT;
+        else
+            return fail("expect comparison");
+
+        if ((ret = parseValue(pred.value))) return ret;
+        stmt.where.push_back(pred);
+    } while (keyword("AND"));
+    return S_OK;
+}
+
+int SQL::parseItem(Statement &stmt)
+{
+    static const char *names[] = {"COUNT", "SUM", "MIN", "MAX", NULL};
+    int ret;
+
+    // 聚集函数名后面紧跟括号
+    const Token &token = peek();
+    if (token.type == TOKEN_IDENT && tokens_[current_ + 1].type == TOKEN_SYMBOL &&
+        tokens_[current_ + 1].text == "(") {
+        AggregateCall call;
+        int func = 0;
+        for (; names[func]; ++func)
+            if (equalsIgnoreCase(token.text, names[func])) break;
+        if (names[func] == NULL) return fail("unknown function");
+        call.func = func;
+        call.position = stmt.columns.size() + stmt.aggregates.size();
+        current_ += 2;
+
+        if (!(func == AGG_COUNT && symbol("*")))
+            if ((ret = expectColumn(call.column))) return ret;
+        if ((ret = expectSymbol(")"))) return ret;
+        stmt.aggregates.push_back(call);
+        return S_OK;
+    }
+
+    std::string column;
+    if ((ret = expectColumn(column))) return ret;
+    stmt.columns.push_back(column);
+    return S_OK;
+}
+
+int SQL::parseSelect(Statement &stmt)
+{
+    stmt.kind = STMT_SELECT;
+    int ret;
+
+    // 投影
+    if (!symbol("*")) {
+        do {
+            if ((ret = parseItem(stmt))) return ret;
+        } while (symbol(","));
+    }
+
+    if ((ret = expectKeyword("FROM"))) return ret;
+    if ((ret = expectIdent(stmt.table))) return ret;
+
+    // 连接
+    bool inner = keyword("INNER");
+    if (keyword("JOIN")) {
+        if ((ret = expectIdent(stmt.join))) return ret;
+        if ((ret = expectKeyword("ON"))) return ret;
+        if ((ret = expectColumn(stmt.on[0]))) return ret;
+        if ((ret = expectSymbol("="))) return ret;
+        if ((ret = expectColumn(stmt.on[1]))) return ret;
+    } else if (inner)
+        return fail("expect JOIN");
+
+    if ((ret = parseWhere(stmt))) return ret;
+
+    if (keyword("GROUP")) {
+        if ((ret = expectKeyword("BY"))) return ret;
+        do {
+            std::string column;
+            if ((ret = expectColumn(column))) return ret;
+            stmt.groupBy.push_back(column);
+        } while (symbol(","));
+    }
+
+    if (keyword("ORDER")) {
+        if ((ret = expectKeyword("BY"))) return ret;
+        if ((ret = expectColumn(stmt.orderBy))) return ret;
+        if (keyword("DESC"))
+            stmt.desc = true;
+        else
+            keyword("ASC");
+    }
+
+    if (keyword("LIMIT")) {
+        const Token &token = peek();
+        if (token.type != TOKEN_NUMBER) return fail("expect limit");
+        stmt.limit = strtoll(token.text.c_str(), NULL, 10);
+        ++current_;
+    }
+    return S_OK;
+}
+
+int SQL::parseUpdate(Statement &stmt)
+{
+    stmt.kind = STMT_UPDATE;
+    int ret = expectIdent(stmt.table);
+    if (ret) return ret;
+    if ((ret = expectKeyword("SET"))) return ret;
+
+    do {
+        Assignment set;
+        if ((ret = expectIdent(set.column))) return ret;
+        if ((ret = expectSymbol("="))) return ret;
+        if ((ret = parseValue(set.value))) return ret;
+        stmt.sets.push_back(set);
+    } while (symbol(","));
+
+    return parseWhere(stmt);
+}
+
+int SQL::parseDelete(Statement &stmt)
+{
+    stmt.kind = STMT_DELETE;
+    int ret = expectKeyword("FROM");
+    if (ret) return ret;
+    if ((ret = expectIdent(stmt.table))) return ret;
+    return parseWhere(stmt);
+}
+
+int encodeValue(const FieldInfo &field, const Value &value, std::string &out)
+{
+    const char *name = field.type->name;
+
+    // 字符串类型
+    if (strcmp(name, "CHAR") == 0 || strcmp(name, "VARCHAR") == 0) {
+        if (!value.string) return EINVAL;
+        long long max = field.length < 0 ? -field.length : field.length;
+        if ((long long) value.text.size() > max) return EINVAL;
+        out = value.text;
+        // CHAR定长，补0
+        if (field.length > 0) out.resize((size_t) field.length, '\0');
+        return S_OK;
+    }
+
+    // 整数类型，按大序存放；存储层按无符号比较，负数当作越界
+    if (value.string) return EINVAL;
+    long long v = value.number;
+    if (v < 0) return EINVAL;
+    if (strcmp(name, "TINYINT") == 0) {
+        if (v > 255) return EINVAL;
+        out.assign(1, (char) (unsigned char) v);
+    } else if (strcmp(name, "SMALLINT") == 0) {
+        if (v > 65535) return EINVAL;
+        unsigned short s = htobe16((unsigned short) v);
+        out.assign((const char *) &s, sizeof(s));
+    } else if (strcmp(name, "INT") == 0) {
+        if (v > 4294967295LL) return EINVAL;
+        unsigned int i = htobe32((unsigned int) v);
+        out.assign((const char *) &i, sizeof(i));
+    } else if (strcmp(name, "BIGINT") == 0) {
+        unsigned long long l = htobe64((unsigned long long) v);
+        out.assign((const char *) &l, sizeof(l));
+    } else
+        return EINVAL;
+    return S_OK;
+}
+
+int compareValue(
+    const FieldInfo &field,
+    const unsigned char *x,
+    unsigned int xlen,
+    const unsigned char *y,
+    unsigned int ylen)
+{
+    DataType::Less less = field.type->less;
+    unsigned char *px = const_cast<unsigned char *>(x);
+    unsigned char *py = const_cast<unsigned char *>(y);
+    if (less(px, xlen, py, ylen)) return -1;
+    if (less(py, ylen, px, xlen)) return 1;
+    return 0;
+}
+
+bool matchValue(
+    const FieldInfo &field,
+    int op,
+    const unsigned char *x,
+    unsigned int xlen,
+    const std::string &value)
+{
+    int ret = compareValue(
+        field,
+        x,
+        xlen,
+        (const unsigned char *) value.data(),
+        (unsigned int) value.size());
+    switch (op) {
+    case OP_EQ:
+        return ret == 0;
+    case OP_NE:
+        return ret != 0;
+    case OP_LT:
+        return ret < 0;
+    case OP_LE:
+        return ret <= 0;
+    case OP_GT:
+        return ret > 0;
+    case OP_GE:
+        return ret >= 0;
+    default:
+        return false;
+    }
+}
+
+int SQL::resolve(
+    RelationInfo &info,
+    const std::string &column,
+    unsigned int &field)
+{
+    for (size_t i = 0; i < info.fields.size(); ++i)
+        if (info.fields[i].name == column) {
+            field = (unsigned int) i;
+            return S_OK;
+        }
+    error_ = "unknown column '" + column + "'";
+    return EINVAL;
+}
+
+int SQL::lookupColumn(
+    Plan &plan,
+    const std::string &column,
+    unsigned int &field)
+{
+    // 拆开表名
+    std::string table, name(column);
+    size_t dot = column.find('.');
+    if (dot != std::string::npos) {
+        table = column.substr(0, dot);
+        name = column.substr(dot + 1);
+    }
+    bool left = table.empty() || table == plan.table;
+    bool right =
+        plan.join != JOIN_NONE && (table.empty() || table == plan.right);
+    if (!left && !right) {
+        error_ = "unknown table '" + table + "'";
+        return EINVAL;
+    }
+
+    unsigned int x = 0, y = 0;
+    left = left && findField(*plan.info, name, x);
+    right = right && findField(*plan.rightInfo, name, y);
+    if (left && right) {
+        error_ = "ambiguous column '" + column + "'";
+        return EINVAL;
+    }
+    if (!left && !right) {
+        error_ = "unknown column '" + column + "'";
+        return EINVAL;
+    }
+    field = left ? x : (unsigned int) plan.info->fields.size() + y;
+    return S_OK;
+}
+
+int SQL::planJoin(Statement &stmt, Plan &plan)
+{
+    std::pair<Schema::TableSpace::iterator, bool> bret =
+        kSchema.lookup(stmt.join.c_str());
+    if (!bret.second) {
+        error_ = "unknown table '" + stmt.join + "'";
+        return ENOENT;
+    }
+    if (stmt.join == stmt.table) {
+        error_ = "self join is not supported";
+        return EINVAL;
+    }
+    RelationInfo &left = *plan.info;
+    RelationInfo &right = bret.first->second;
+    plan.join = JOIN_HASH;
+    plan.right = stmt.join;
+    plan.rightInfo = &right;
+
+    // 连接的输出，左表的域在前
+    plan.joined.fields = left.fields;
+    plan.joined.fields.insert(
+        plan.joined.fields.end(), right.fields.begin(), right.fields.end());
+    plan.joined.count = (unsigned short) plan.joined.fields.size();
+    plan.joined.key = left.key;
+
+    // ON的两列分属两张表
+    unsigned int x, y;
+    int ret;
+    if ((ret = lookupColumn(plan, stmt.on[0], x))) return ret;
+    if ((ret = lookupColumn(plan, stmt.on[1], y))) return ret;
+    if (x > y) std::swap(x, y);
+    if (y < left.fields.size() || x >= left.fields.size()) {
+        error_ = "join condition must compare the two tables";
+        return EINVAL;
+    }
+    plan.leftKey = x;
+    plan.rightKey = y - (unsigned int) left.fields.size();
+    const FieldInfo &lf = left.fields[plan.leftKey];
+    const FieldInfo &rf = right.fields[plan.rightKey];
+    if (isBytes(lf) != isBytes(rf)) {
+        error_ = "join columns of different types";
+        return EINVAL;
+    }
+
+    // 两边都按同类型的主键连接，数据链的顺序就是连接列的顺序，归并即可
+    if (plan.leftKey == left.key && plan.rightKey == right.key &&
+        lf.type == rf.type && lf.length == rf.length)
+        plan.join = JOIN_MERGE;
+    // hash连接用行数少的表建hash表
+    plan.buildLeft = countRecords(plan.table) <= countRecords(plan.right);
+    return S_OK;
+}
+
+int SQL::chooseAccess(RelationInfo &info, Plan &plan)
+{
+    const FieldInfo &key = info.fields[info.key];
+    plan.access = ACCESS_FULL;
+
+    for (size_t i = 0; i < plan.filters.size(); ++i) {
+        const Predicate &pred = plan.filters[i];
+        if (pred.field != info.key) continue;
+        // 还没有绑定的参数
+        if (pred.value.param >= 0 && pred.key.empty()) continue;
+
+        // 键上的等值条件，点查
+        if (pred.op == OP_EQ) {
+            plan.access = ACCESS_INDEX;
+            plan.low = plan.high = pred.key;
+            plan.lowInclusive = plan.highInclusive = true;
+            return S_OK;
+        }
+
+        // 键上的范围条件，收紧上下界
+        const unsigned char *k = (const unsigned char *) pred.key.data();
+        unsigned int klen = (unsigned int) pred.key.size();
+        if (pred.op == OP_GT || pred.op == OP_GE) {
+            int cmp = plan.low.empty() ? 1
+                                       : compareValue(
+                                             key,
+                                             k,
+                                             klen,
+                                             (const unsigned char *) plan.low.data(),
+                                             (unsigned int) plan.low.size());
+            if (cmp > 0 || (cmp == 0 && pred.op == OP_GT)) {
+                plan.low = pred.key;
+                plan.lowInclusive = pred.op == OP_GE;
+            }
+            plan.access = ACCESS_RANGE;
+        } else if (pred.op == OP_LT || pred.op == OP_LE) {
+            int cmp = plan.high.empty() ? -1
+                                        : compareValue(
+                                              key,
+                                              k,
+                                              klen,
+                                              (const unsigned char *) plan.high.data(),
+                                              (unsigned int) plan.high.size());
+            if (cmp < 0 || (cmp == 0 && pred.op == OP_LT)) {
+                plan.high = pred.key;
+                plan.highInclusive = pred.op == OP_LE;
+            }
+            plan.access = ACCESS_RANGE;
+        }
+    }
+    return S_OK;
+}
+
+int SQL::plan(Statement &stmt, Plan &plan)
+{
+    plan = Plan();
+    plan.kind = stmt.kind;
+    plan.table = stmt.table;
+    plan.params.resize(stmt.params);
+    int ret;
+
+    // CREATE只生成关系，不需要查schema
+    if (stmt.kind == STMT_CREATE) {
+        RelationInfo &rel = plan.create;
+        bool primary = false;
+        for (size_t i = 0; i < stmt.defs.size(); ++i) {
+            const ColumnDef &def = stmt.defs[i];
+            FieldInfo field;
+            field.name = def.name;
+            field.index = i;
+            field.type = findDataType(def.type.c_str());
+            if (field.type == NULL) {
+                error_ = "unknown type '" + def.type + "'";
+                return EINVAL;
+            }
+            // 定长类型取类型大小，CHAR(n)为n，VARCHAR(n)为-n
+            if (field.type->size > 0 && field.type->size != 65535)
+                field.length = field.type->size;
+            else if (def.length <= 0) {
+                error_ = "missing length of '" + def.name + "'";
+                return EINVAL;
+            } else
+                field.length =
+                    field.type->size < 0 ? -def.length : def.length;
+
+            if (def.primary) {
+                if (primary) {
+                    error_ = "multiple primary keys";
+                    return EINVAL;
+                }
+                primary = true;
+                rel.key = (unsigned int) i;
+            }
+            rel.fields.push_back(field);
+        }
+        rel.count = (unsigned short) rel.fields.size();
+        return S_OK;
+    }
+
+    // 查找表
+    std::pair<Schema::TableSpace::iterator, bool> bret =
+        kSchema.lookup(stmt.table.c_str());
+    if (!bret.second) {
+        error_ = "unknown table '" + stmt.table + "'";
+        return ENOENT;
+    }
+    RelationInfo &info = bret.first->second;
+    plan.info = &info;
+
+    // INSERT，按域的顺序编码
+    if (stmt.kind == STMT_INSERT) {
+        std::vector<unsigned int> fields;
+        if (stmt.columns.empty()) {
+            for (unsigned int i = 0; i < info.fields.size(); ++i)
+                fields.push_back(i);
+        } else {
+            for (size_t i = 0; i < stmt.columns.size(); ++i) {
+                unsigned int field;
+                if ((ret = resolve(info, stmt.columns[i], field))) return ret;
+                fields.push_back(field);
+            }
+        }
+        // 不支持NULL，所有列都要有值
+        if (fields.size() != info.fields.size() ||
+            stmt.values.size() != fields.size()) {
+            error_ = "column count mismatch";
+            return EINVAL;
+        }
+
+        plan.row.resize(info.fields.size());
+        std::vector<bool> seen(info.fields.size(), false);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (seen[fields[i]]) {
+                error_ = "duplicate column '" + info.fields[fields[i]].name + "'";
+                return EINVAL;
+            }
+            seen[fields[i]] = true;
+            ret = literal(
+                plan,
+                info.fields[fields[i]],
+                stmt.values[i],
+                PARAM_ROW,
+                fields[i],
+                plan.row[fields[i]]);
+            if (ret) {
+                error_ = "bad value for '" + info.fields[fields[i]].name + "'";
+                return ret;
+            }
+        }
+        return S_OK;
+    }
+
+    // 连接
+    if (stmt.kind == STMT_SELECT && !stmt.join.empty())
+        if ((ret = planJoin(stmt, plan))) return ret;
+
+    // WHERE，编码字面值，右表上的条件单独存放
+    for (size_t i = 0; i < stmt.where.size(); ++i) {
+        Predicate pred = stmt.where[i];
+        if ((ret = lookupColumn(plan, pred.column, pred.field))) return ret;
+        RelationInfo *rel = &info;
+        std::vector<Predicate> *filters = &plan.filters;
+        if (pred.field >= info.fields.size()) {
+            pred.field -= (unsigned int) info.fields.size();
+            rel = plan.rightInfo;
+            filters = &plan.rightFilters;
+        }
+        ret = literal(
+            plan,
+            rel->fields[pred.field],
+            pred.value,
+            filters == &plan.filters ? PARAM_FILTER : PARAM_RIGHT,
+            filters->size(),
+            pred.key);
+        if (ret) {
+            error_ = "bad value for '" + pred.column + "'";
+            return ret;
+        }
+        filters->push_back(pred);
+    }
+    if ((ret = chooseAccess(info, plan))) return ret;
+
+    // UPDATE，不允许修改键
+    for (size_t i = 0; i < stmt.sets.size(); ++i) {
+        Assignment set = stmt.sets[i];
+        if ((ret = resolve(info, set.column, set.field))) return ret;
+        if (set.field == info.key) {
+            error_ = "cannot update primary key";
+            return EINVAL;
+        }
+        ret = literal(
+            plan,
+            info.fields[set.field],
+            set.value,
+            PARAM_SET,
+            plan.sets.size(),
+            set.data);
+        if (ret) {
+            error_ = "bad value for '" + set.column + "'";
+            return ret;
+        }
+        plan.sets.push_back(set);
+    }
+
+    // 连接时输出的是joined
+    RelationInfo &scope = plan.join == JOIN_NONE ? info : plan.joined;
+
+    // 聚集和分组
+    if (stmt.kind == STMT_SELECT &&
+        (!stmt.aggregates.empty() || !stmt.groupBy.empty()))
+        return planAggregate(scope, stmt, plan);
+
+    // 投影
+    if (stmt.kind == STMT_SELECT) {
+        if (stmt.columns.empty()) {
+            for (unsigned int i = 0; i < scope.fields.size(); ++i)
+                plan.projection.push_back(i);
+        } else {
+            for (size_t i = 0; i < stmt.columns.size(); ++i) {
+                unsigned int field;
+                if ((ret = lookupColumn(plan, stmt.columns[i], field)))
+                    return ret;
+                plan.projection.push_back(field);
+            }
+        }
+    }
+
+    // 排序，数据链按键有序，键上的升序不需要再排序；
+    // 归并连接的输出按两边的连接列有序
+    if (!stmt.orderBy.empty()) {
+        unsigned int field;
+        if ((ret = lookupColumn(plan, stmt.orderBy, field))) return ret;
+        plan.orderField = (int) field;
+        plan.desc = stmt.desc;
+        if (plan.join == JOIN_NONE)
+            plan.sorted = field == info.key && !stmt.desc;
+        else
+            plan.sorted = plan.join == JOIN_MERGE && !stmt.desc &&
+                          (field == plan.leftKey ||
+                           field == info.fields.size() + plan.rightKey);
+    }
+    plan.limit = stmt.limit;
+    return S_OK;
+}
+
+int SQL::planAggregate(RelationInfo &info, Statement &stmt, Plan &plan)
+{
+    int ret;
+
+    // 分组列
+    for (size_t i = 0; i < stmt.groupBy.size(); ++i) {
+        unsigned int field;
+        if ((ret = lookupColumn(plan, stmt.groupBy[i], field))) return ret;
+        plan.groupBy.push_back(field);
+    }
+
+    // 聚集，SUM/MIN/MAX只支持整数列
+    for (size_t i = 0; i < stmt.aggregates.size(); ++i) {
+        const AggregateCall &call = stmt.aggregates[i];
+        Aggregation agg(call.func);
+        if (!call.column.empty()) {
+            unsigned int field;
+            if ((ret = lookupColumn(plan, call.column, field))) return ret;
+            if (call.func != AGG_COUNT && isBytes(info.fields[field])) {
+                error_ = "cannot aggregate '" + call.column + "'";
+                return EINVAL;
+            }
+            agg.field = (int) field;
+        }
+        plan.aggregates.push_back(agg);
+    }
+
+    // 投影，普通列必须是分组列，SELECT *输出所有分组列和聚集
+    size_t total = stmt.columns.size() + stmt.aggregates.size();
+    if (total == 0) total = plan.groupBy.size() + plan.aggregates.size();
+    size_t column = 0, aggregate = 0;
+    for (size_t pos = 0; pos < total; ++pos) {
+        if (stmt.columns.empty() && stmt.aggregates.empty()) {
+            plan.projection.push_back((unsigned int) pos);
+            continue;
+        }
+        if (aggregate < stmt.aggregates.size() &&
+            stmt.aggregates[aggregate].position == pos) {
+            plan.projection.push_back(
+                (unsigned int) (plan.groupBy.size() + aggregate++));
+            continue;
+        }
+        unsigned int field;
+        const std::string &name = stmt.columns[column++];
+        if ((ret = lookupColumn(plan, name, field))) return ret;
+        size_t g = 0;
+        while (g < plan.groupBy.size() && plan.groupBy[g] != field)
+            ++g;
+        if (g == plan.groupBy.size()) {
+            error_ = "'" + name + "' is not in GROUP BY";
+            return EINVAL;
+        }
+        plan.projection.push_back((unsigned int) g);
+    }
+
+    // 排序列必须是分组列，下标指向聚集的输出
+    if (!stmt.orderBy.empty()) {
+        unsigned int field;
+        if ((ret = lookupColumn(plan, stmt.orderBy, field))) return ret;
+        size_t g = 0;
+        while (g < plan.groupBy.size() && plan.groupBy[g] != field)
+            ++g;
+        if (g == plan.groupBy.size()) {
+            error_ = "'" + stmt.orderBy + "' is not in GROUP BY";
+            return EINVAL;
+        }
+        plan.orderField = (int) g;
+        plan.desc = stmt.desc;
+    }
+    plan.limit = stmt.limit;
+    return S_OK;
+}
+
+int SQL::literal(
+    Plan &plan,
+    const FieldInfo &field,
+    const Value &value,
+    int target,
+    size_t index,
+    std::string &out)
+{
+    if (value.param < 0) return encodeValue(field, value, out);
+    Parameter &param = plan.params[value.param];
+    param.target = target;
+    param.index = index;
+    param.field = &field;
+    return S_OK;
+}
+
+int SQL::bind(Plan &plan, const std::vector<Value> &values)
+{
+    error_.clear();
+    if (values.size() != plan.params.size()) {
+        error_ = "parameter count mismatch";
+        return EINVAL;
+    }
+
+    bool access = false;
+    for (size_t i = 0; i < values.size(); ++i) {
+        const Parameter &param = plan.params[i];
+        std::string *out;
+        switch (param.target) {
+        case PARAM_ROW:
+            out = &plan.row[param.index];
+            break;
+        case PARAM_FILTER:
+            out = &plan.filters[param.index].key;
+            access = true;
+            break;
+        case PARAM_RIGHT:
+            out = &plan.rightFilters[param.index].key;
+            break;
+        default:
+            out = &plan.sets[param.index].data;
+        }
+        if (values[i].param >= 0 || encodeValue(*param.field, values[i], *out)) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%u", (unsigned int) i + 1);
+            error_ = std::string("bad value for parameter ") + buf;
+            return EINVAL;
+        }
+    }
+
+    // 左表条件中的参数可能改变访问路径
+    if (!access) return S_OK;
+    plan.low.clear();
+    plan.high.clear();
+    plan.lowInclusive = plan.highInclusive = false;
+    return chooseAccess(*plan.info, plan);
+}
+
+int SQL::normalize(const char *sql, std::string &text)
+{
+    error_.clear();
+    int ret = tokenize(sql);
+    if (ret) return ret;
+
+    text.clear();
+    size_t count = tokens_.size() - 1;
+    if (count > 0 && tokens_[count - 1].type == TOKEN_SYMBOL &&
+        tokens_[count - 1].text == ";")
+        --count;
+    for (size_t i = 0; i < count; ++i) {
+        const Token &token = tokens_[i];
+        if (i > 0) text.push_back(' ');
+        if (token.type != TOKEN_STRING) {
+            text += token.text;
+            continue;
+        }
+        // 字符串重新加上引号
+        text.push_back('\'');
+        for (size_t k = 0; k < token.text.size(); ++k) {
+            if (token.text[k] == '\'') text.push_back('\'');
+            text.push_back(token.text[k]);
+        }
+        text.push_back('\'');
+    }
+    return S_OK;
+}
+
+int SQL::prepare(const char *sql, Plan &plan)
+{
+    Statement stmt;
+    int ret = parse(sql, stmt);
+    if (ret) return ret;
+    return this->plan(stmt, plan);
+}
+
+} // namespace db
@@ -6,12 +6,41 @@
 // @author niexw
 // @email niexiaowen@uestc.edu.cn
 //
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <db/table.h>
 
-
-
 namespace db {
 
+namespace {
+std::mutex kStatMutex; // 保护kStats
+std::unordered_map<TableId, std::unique_ptr<TableStat>> kStats; // 统计信息
+std::once_flag kHookOnce; // 只登记一次超块钩子
+std::mutex kSpaceMutex;                            // 保护kSpaces
+std::unordered_map<TableId, FreeSpaceMap> kSpaces; // 表编号 --> 空闲空间映射
+std::mutex kExtendMutex; // 串行化各表的文件扩展
+std::mutex kTableMutex; // 保护kTables
+std::unordered_map<TableId, std::unique_ptr<Table>> kTables; // 共享的表
+
+// 获取表的统计信息，首次获取时从超块加载
+TableStat *acquireStat(TableId table, SuperBlock &super)
+{
+    std::lock_guard<std::mutex> lock(kStatMutex);
+    std::unordered_map<TableId, std::unique_ptr<TableStat>>::iterator it =
+        kStats.find(table);
+    if (it != kStats.end()) return it->second.get();
+
+    TableStat *stat = new TableStat;
+    stat->records.reset(super.getRecords());
+    stat->datacounts.reset(super.getDataCounts());
+    stat->idlecounts.reset(super.getIdleCounts());
+    kStats[table].reset(stat);
+    return stat;
+}
+} // namespace
+
 Table::BlockIterator::BlockIterator()
     : bufdesp(nullptr)
 {}
@@ -25,6 +54,16 @@ Table::BlockIterator::BlockIterator(const BlockIterator &other)
 {
     if (bufdesp) bufdesp->addref();
 }
+Table::BlockIterator &
+Table::BlockIterator::operator=(const BlockIterator &other)
+{
+    // 先加后减，自赋值时不会提前释放
+    if (other.bufdesp) other.bufdesp->addref();
+    if (bufdesp) kBuffer.releaseBuf(bufdesp);
+    block = other.block;
+    bufdesp = other.bufdesp;
+    return *this;
+}
 
 // 前置操作
 Table::BlockIterator &Table::BlockIterator::operator++()
@@ -33,10 +72,12 @@ Table::BlockIterator &Table::BlockIterator::operator++()
     unsigned int blockid = block.getNext();
     kBuffer.releaseBuf(bufdesp);
     if (blockid) {
-        bufdesp = kBuffer.borrow(block.table_->name_.c_str(), blockid);
+        bufdesp = kBuffer.borrow(block.table_->id_, blockid);
         block.attach(bufdesp->buffer);
-    } else
+    } else {
         block.buffer_ = nullptr;
+        bufdesp = nullptr; // 已释放，析构时不再释放
+    }
     return *this;
 }
 // 后置操作
@@ -47,10 +88,12 @@ Table::BlockIterator Table::BlockIterator::operator++(int)
     unsigned int blockid = block.getNext();
     kBuffer.releaseBuf(bufdesp);
     if (blockid) {
-        bufdesp = kBuffer.borrow(block.table_->name_.c_str(), blockid);
+        bufdesp = kBuffer.borrow(block.table_->id_, blockid);
         block.attach(bufdesp->buffer);
-    } else
+    } else {
         block.buffer_ = nullptr;
+        bufdesp = nullptr; // 已释放，析构时不再释放
+    }
     return tmp;
 }
 // 数据块指针
@@ -58,118 +101,293 @@ DataBlock *Table::BlockIterator::operator->() { return &block; }
 void Table::BlockIterator::release()
 {
     bufdesp->relref();
+    bufdesp = nullptr;
     block.detach();
 }
 
 int Table::open(const char *name)
 {
-    // 查找table
-    std::pair<Schema::TableSpace::iterator, bool> bret = kSchema.lookup(name);
+    // 查找table，表名只在这里intern一次
+    TableId id = kSchema.intern(name);
+    std::pair<Schema::TableSpace::iterator, bool> bret = kSchema.lookup(id);
     if (!bret.second) return EEXIST; // 表不存在
 
     // 填充结构
     name_ = name;
+    id_ = id;
     info_ = &bret.first->second;
 
+    // 淘汰或刷盘写回超块时带上内存中的统计
+    std::call_once(kHookOnce, []() { kBuffer.setSuperHook(saveStat); });
+
     // 加载超块
     SuperBlock super;
-    BufDesp *desp = kBuffer.borrow(name, 0);
+    BufDesp *desp = kBuffer.borrow(id_, 0);
     super.attach(desp->buffer);
 
     // 获取元数据
     maxid_ = super.getMaxid();
-    idle_ = super.getIdle();
     first_ = super.getFirst();
+    stat_ = acquireStat(id_, super);
+    unsigned int fsm = super.getFsm();
 
     // 释放超块
     super.detach();
     desp->relref();
+
+    // 空闲空间映射，首次打开时加载，加载时可能扩展文件
+    std::lock_guard<std::mutex> lock(kSpaceMutex);
+    std::pair<std::unordered_map<TableId, FreeSpaceMap>::iterator, bool> ret =
+        kSpaces.insert(std::make_pair(id_, FreeSpaceMap()));
+    space_ = &ret.first->second;
+    if (ret.second) loadSpace(fsm);
     return S_OK;
 }
 
-unsigned int Table::allocate()
+Table *Table::shared(const char *name)
 {
-    // 空闲链上有block
+    TableId id = kSchema.intern(name);
+    std::lock_guard<std::mutex> lock(kTableMutex);
+    std::unordered_map<TableId, std::unique_ptr<Table>>::iterator it =
+        kTables.find(id);
+    if (it != kTables.end()) return it->second.get();
+
+    // 各会话共用maxid_、数据链和b+树，分配block和分裂才不会冲突
+    std::unique_ptr<Table> table(new Table);
+    if (table->open(name) != S_OK) return NULL;
+    table->BPlusTreeInit();
+    Table *ret = table.get();
+    kTables[id] = std::move(table);
+    return ret;
+}
+
+unsigned int Table::allocate(unsigned short type)
+{
+    // 映射中有空闲块就用最小的，不用读空闲块
+    unsigned int blockid = space_->findIdle();
+    if (blockid)
+        stat_->idlecounts.sub(1);
+    else
+        blockid = extend();
+    stat_->datacounts.add(1);
+
+    // 初始化block
     DataBlock data;
-    SuperBlock super;
-    BufDesp *desp;
+    BufDesp *desp = kBuffer.borrow(id_, blockid);
+    data.attach(desp->buffer);
+    data.clear(info_->spaceid, blockid, type);
+    kBuffer.writeBuf(desp);
+    mark(
+        blockid,
+        type == BLOCK_TYPE_DATA ? FreeSpaceMap::encode(data.getFreeSize())
+                                : 0);
+    data.detach();
+    desp->relref();
 
-    if (idle_) {
-        // 读idle块，获得下一个空闲块
-        desp = kBuffer.borrow(name_.c_str(), idle_);
-        data.attach(desp->buffer);
-        unsigned int next = data.getNext();
-        data.detach();
-        desp->relref();
+    return blockid;
+}
 
-        // 读超块，设定空闲块
-        desp = kBuffer.borrow(name_.c_str(), 0);
-        super.attach(desp->buffer);
-        super.setIdle(next);
-        super.setIdleCounts(super.getIdleCounts() - 1);
-        super.setDataCounts(super.getDataCounts() + 1);
-        super.setChecksum();
-        super.detach();
-        kBuffer.writeBuf(desp);
-        desp->relref();
+void Table::deallocate(unsigned int blockid)
+{
+    // 只改block类型，空闲与否由映射记录
+    DataBlock data;
+    BufDesp *desp = kBuffer.borrow(id_, blockid);
+    data.attach(desp->buffer);
+    data.setType(BLOCK_TYPE_IDLE);
+    data.setNext(0);
+    data.setChecksum();
+    data.detach();
+    kBuffer.writeBuf(desp);
+    desp->relref();
 
-        unsigned int current = idle_;
-        idle_ = next;
+    mark(blockid, FSM_IDLE);
+    stat_->idlecounts.add(1);
+    stat_->datacounts.sub(1);
+}
 
-        desp = kBuffer.borrow(name_.c_str(), current);
-        data.attach(desp->buffer);
-        data.clear(1, current, BLOCK_TYPE_DATA);
-        desp->relref();
+void Table::loadSpace(unsigned int fsm)
+{
+    // 沿页链读入
+    if (fsm) {
+        for (size_t index = 0; fsm; ++index) {
+            MetaBlock block;
+            BufDesp *desp = kBuffer.borrow(id_, fsm);
+            block.attach(desp->buffer);
+            space_->addPage(fsm);
+            space_->load(index, block.buffer_ + sizeof(MetaHeader));
+            fsm = block.getNext();
+            block.detach();
+            kBuffer.releaseBuf(desp);
+        }
+        space_->resize(maxid_ + 1);
+        return;
+    }
 
-        return current;
+    // 没有映射的表逐个读block建立，旧的空闲链上的block类型都是空闲
+    space_->resize(maxid_ + 1);
+    for (unsigned int blockid = 1; blockid <= maxid_; ++blockid) {
+        DataBlock data;
+        BufDesp *desp = kBuffer.borrow(id_, blockid);
+        data.attach(desp->buffer);
+        unsigned short type = data.getType();
+        if (type == BLOCK_TYPE_IDLE)
+            space_->set(blockid, FSM_IDLE);
+        else if (type == BLOCK_TYPE_DATA)
+            space_->set(blockid, FreeSpaceMap::encode(data.getFreeSize()));
+        data.detach();
+        kBuffer.releaseBuf(desp);
     }
+    // 各页放在文件尾部
+    while (space_->pages() * FSM_ENTRIES <= maxid_)
+        addPage(++maxid_);
+    space_->resize(maxid_ + 1);
+    savePages();
 
-    // 没有空闲块
-    ++maxid_;
-    // 读超块，设定空闲块
-    desp = kBuffer.borrow(name_.c_str(), 0);
+    SuperBlock super;
+    BufDesp *desp = kBuffer.borrow(id_, 0);
     super.attach(desp->buffer);
     super.setMaxid(maxid_);
-    super.setDataCounts(super.getDataCounts() + 1);
+    super.setIdle(0);
     super.setChecksum();
     super.detach();
     kBuffer.writeBuf(desp);
-    desp->relref();
-    // 初始化数据块
-    desp = kBuffer.borrow(name_.c_str(), maxid_);
-    data.attach(desp->buffer);
-    data.clear(1, maxid_, BLOCK_TYPE_DATA);
-    desp->relref();
-
-    return maxid_;
+    kBuffer.releaseBuf(desp);
 }
 
-void Table::deallocate(unsigned int blockid)
+unsigned int Table::extend()
 {
-    // 读idle块，获得下一个空闲块
-    DataBlock data;
-    BufDesp *desp = kBuffer.borrow(name_.c_str(), blockid);
-    data.attach(desp->buffer);
-    data.setNext(idle_);
-    data.setChecksum();
-    data.detach();
+    // 以超块中的maxid为准，打开同一张表的其它Table可能已经扩展过；
+    // 持有kExtendMutex，两次扩展不会预分配重叠的extent、分出同一个block
+    std::lock_guard<std::mutex> lock(kExtendMutex);
+    SuperBlock super;
+    BufDesp *desp = kBuffer.borrow(id_, 0);
+    super.attach(desp->buffer);
+    maxid_ = std::max(maxid_, super.getMaxid());
+
+    unsigned int first = maxid_ + 1; // 本次新增的第1个block
+    unsigned int blockid = ++maxid_;
+    if (blockid >= space_->pages() * FSM_ENTRIES) {
+        addPage(blockid);
+        blockid = ++maxid_;
+    }
+    space_->resize(maxid_ + 1);
+    super.setMaxid(maxid_);
+
+    // 超出已预分配的范围时，连同新增的页一次预分配一个extent，预分配
+    // 失败不影响使用，下次扩展时再试
+    unsigned int reserved = super.getReserved();
+    if (maxid_ > reserved) {
+        unsigned int extent = super.getExtent();
+        if (extent == 0) extent = EXTENT_SIZE / BLOCK_SIZE;
+        unsigned int start = std::max(reserved + 1, first);
+        if (kBuffer.allocate(id_, start, maxid_ - start + extent) == S_OK)
+            super.setReserved(maxid_ + extent - 1);
+    }
+    super.setChecksum();
+    super.detach();
     kBuffer.writeBuf(desp);
-    desp->relref();
+    kBuffer.releaseBuf(desp);
+    return blockid;
+}
+
+int Table::setExtent(size_t size)
+{
+    if (size < BLOCK_SIZE || size > EXTENT_MAX || size % BLOCK_SIZE)
+        return EINVAL;
 
-    // 读超块，设定空闲块
     SuperBlock super;
-    desp = kBuffer.borrow(name_.c_str(), 0);
+    BufDesp *desp = kBuffer.borrow(id_, 0);
     super.attach(desp->buffer);
-    super.setIdle(blockid);
-    super.setIdleCounts(super.getIdleCounts() + 1);
-    super.setDataCounts(super.getDataCounts() - 1);
+    super.setExtent((unsigned int) (size / BLOCK_SIZE));
     super.setChecksum();
     super.detach();
     kBuffer.writeBuf(desp);
-    desp->relref();
+    kBuffer.releaseBuf(desp);
+    return S_OK;
+}
 
-    // 设定自己
-    idle_ = blockid;
+void Table::addPage(unsigned int blockid)
+{
+    size_t index = space_->pages();
+    space_->addPage(blockid);
+    space_->set(blockid, 0);
+
+    MetaBlock block;
+    BufDesp *desp = kBuffer.borrow(id_, blockid);
+    block.attach(desp->buffer);
+    block.clear(info_->spaceid, blockid, BLOCK_TYPE_FSM);
+    space_->store(index, block.buffer_ + sizeof(MetaHeader));
+    block.setChecksum();
+    block.detach();
+    kBuffer.writeBuf(desp);
+    kBuffer.releaseBuf(desp);
+
+    // 首页挂在超块上，其余的挂在前一页后面
+    if (index == 0) {
+        SuperBlock super;
+        desp = kBuffer.borrow(id_, 0);
+        super.attach(desp->buffer);
+        super.setFsm(blockid);
+        super.setChecksum();
+        super.detach();
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+    } else {
+        desp = kBuffer.borrow(id_, space_->page(index - 1));
+        block.attach(desp->buffer);
+        block.setNext(blockid);
+        block.setChecksum();
+        block.detach();
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+    }
+}
+
+void Table::savePages()
+{
+    for (size_t index = 0; index < space_->pages(); ++index) {
+        MetaBlock block;
+        BufDesp *desp = kBuffer.borrow(id_, space_->page(index));
+        block.attach(desp->buffer);
+        space_->store(index, block.buffer_ + sizeof(MetaHeader));
+        // 整理收回的空闲块还没有复用，页上记为空闲
+        unsigned int begin = (unsigned int) (index * FSM_ENTRIES);
+        std::set<unsigned int>::iterator it =
+            compaction_.free.lower_bound(begin);
+        for (; it != compaction_.free.end() && *it < begin + FSM_ENTRIES; ++it)
+            block.buffer_[sizeof(MetaHeader) + *it - begin] = FSM_IDLE;
+        block.setChecksum();
+        block.detach();
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+    }
+}
+
+void Table::mark(unsigned int blockid, unsigned char value)
+{
+    bool idle = space_->get(blockid) == FSM_IDLE;
+    space_->set(blockid, value);
+    if (idle == (value == FSM_IDLE)) return;
+
+    // 分配依赖空闲与否，不能等到checkpoint
+    markPage(blockid, value);
+}
+
+void Table::markPage(unsigned int blockid, unsigned char value)
+{
+    MetaBlock block;
+    BufDesp *desp = kBuffer.borrow(id_, space_->page(blockid / FSM_ENTRIES));
+    block.attach(desp->buffer);
+    block.buffer_[sizeof(MetaHeader) + blockid % FSM_ENTRIES] = value;
+    block.setChecksum();
+    block.detach();
+    kBuffer.writeBuf(desp);
+    kBuffer.releaseBuf(desp);
+}
+
+void Table::note(DataBlock &data)
+{
+    mark(data.getSelf(), FreeSpaceMap::encode(data.getFreeSize()));
 }
 
 Table::BlockIterator Table::beginblock()
@@ -179,13 +397,13 @@ Table::BlockIterator Table::beginblock()
     bi.block.table_ = this;
 
     // 获取第1个blockid
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    BufDesp *bd = kBuffer.borrow(id_, 0);
     SuperBlock super;
     super.attach(bd->buffer);
     unsigned int blockid = super.getFirst();
     kBuffer.releaseBuf(bd);
 
-    bi.bufdesp = kBuffer.borrow(name_.c_str(), blockid);
+    bi.bufdesp = kBuffer.borrow(id_, blockid);
     bi.block.attach(bi.bufdesp->buffer);
     return bi;
 }
@@ -199,14 +417,20 @@ Table::BlockIterator Table::endblock()
 
 unsigned int Table::locate(void *keybuf, unsigned int len)
 {
+    // 不大于key的最大键所在的block，找不到时退回到枚举
+    if (indexed_) {
+        unsigned int blkid = bpt.floor((unsigned char *) keybuf, len);
+        if (blkid) return blkid;
+    }
+
     unsigned int key = info_->key;
     DataType *type = info_->fields[key].type;
 
     BlockIterator prev = beginblock();
     for (BlockIterator bi = beginblock(); bi != endblock(); ++bi) {
-        // 获取第1个记录
+        // 获取第1个记录，跳过空block
         Record record;
-        bi->refslots(0, record);
+        if (!bi->refslots(0, record)) continue;
 
         // 与参数比较
         unsigned char *pkey;
@@ -230,25 +454,45 @@ unsigned int Table::locate(void *keybuf, unsigned int len)
 
 int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
 {
+    // b+树放不下的键插进block后按键就找不到了，先拒绝
+    if (iov[info_->key].iov_len > BPT_MAXKEY) return EINVAL;
+
+    // 定长表的字段长度必须与格式一致
+    const RecordFormat *format = info_->recordFormat();
+    if (format && !format->match(iov)) return EINVAL;
+
+    // 过长的字段先移到行外，插入失败时回收
+    std::vector<struct iovec> row(iov);
+    std::string pointers, bitmap;
+    unsigned char header;
+    int ret = spill(row, pointers, bitmap, header);
+    if (ret) return ret;
+    ret = place(blkid, row, header);
+    if (ret) discard(pointers);
+    return ret;
+}
+
+int Table::place(
+    unsigned int blkid,
+    std::vector<struct iovec> &iov,
+    unsigned char header)
+{
+    const RecordFormat *format = info_->recordFormat();
     DataBlock data;
-    SuperBlock super;
     data.setTable(this);
 
     // 从buffer中借用
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
+    BufDesp *bd = kBuffer.borrow(id_, blkid);
     data.attach(bd->buffer);
 
     // 尝试插入
-    std::pair<bool, unsigned short> ret = data.insertRecord(iov);
+    std::pair<bool, unsigned short> ret = data.insertRecord(iov, header);
 
     // 处理插入结果
     if (ret.first) {
+        note(data);
         kBuffer.releaseBuf(bd); // 释放buffer
-        // 修改表头统计
-        bd = kBuffer.borrow(name_.c_str(), 0);
-        super.attach(bd->buffer);
-        super.setRecords(super.getRecords() + 1);
-        bd->relref();
+        stat_->records.add(1);  // 修改表统计
 
         //更新bpt
         unsigned int key=info_->key;
@@ -262,43 +506,73 @@ int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
         return EEXIST;          // key已经存在
     }
 
-    //(false,index)，空间不足引起的插入失败，分裂block以提供空间
+    //(false,index)，空间不足引起的插入失败
+    // 记录排在最后，映射表明后继有空间时放到后继开头，不必分裂
+    unsigned int key = info_->key;
+    unsigned int successor = data.getNext();
+    size_t length =
+        ALIGN_TO_SIZE(Record::size(iov, format)) + 2 * sizeof(Slot);
+    if (ret.second == data.getSlots() && successor &&
+        space_->room(successor, length)) {
+        DataBlock next;
+        next.setTable(this);
+        BufDesp *bd2 = kBuffer.borrow(id_, successor);
+        next.attach(bd2->buffer);
+        std::pair<bool, unsigned short> ret2 = next.insertRecord(iov, header);
+        if (ret2.first) note(next);
+        kBuffer.releaseBuf(bd2);
+        if (ret2.first) {
+            kBuffer.releaseBuf(bd);
+            stat_->records.add(1);
+            bpt.insert(
+                (unsigned char *) iov[key].iov_base,
+                iov[key].iov_len,
+                successor);
+            return S_OK;
+        }
+        // 映射中的空闲空间只是提示，放不下仍然分裂
+    }
+
     // 分裂block
     unsigned short insert_position = ret.second;
     std::pair<unsigned short, bool> split_position =
-        data.splitPosition(Record::size(iov), insert_position);
+        data.splitPosition(Record::size(iov, format), insert_position);
 
     // 先分配一个block
     DataBlock next;
     next.setTable(this);
-    blkid = allocate();
-    BufDesp *bd2 = kBuffer.borrow(name_.c_str(), blkid);
+    unsigned int nextid = allocate();
+    BufDesp *bd2 = kBuffer.borrow(id_, nextid);
     next.attach(bd2->buffer);
 
-    // 移动记录到新的block上
+    // 移动记录到新的block上，同时修改bpt中这些键所在的block
     while (data.getSlots() > split_position.first) {
         Record record;
         data.refslots(split_position.first, record);
         next.copyRecord(record);
+        unsigned char *pkey;
+        unsigned int klen;
+        record.refByIndex(&pkey, &klen, key);
+        bpt.update(pkey, klen, nextid);
         data.deallocate(split_position.first);
     }
     // 插入新记录，不需要再重排顺序
     if (split_position.second)
-        data.insertRecord(iov);
-    else
-        next.insertRecord(iov);
+        data.insertRecord(iov, header);
+    else {
+        next.insertRecord(iov, header);
+        blkid = nextid;
+    }
     // 维持数据链
     next.setNext(data.getNext());
     data.setNext(next.getSelf());
+    note(data);
+    note(next);
     bd2->relref();
-
-    bd = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(bd->buffer);
-    super.setRecords(super.getRecords() + 1);
-    bd->relref();
+    kBuffer.releaseBuf(bd);
+    stat_->records.add(1); // 修改表统计
 
     //更新bpt
-    unsigned int key=info_->key;
     bpt.insert((unsigned char*)iov[key].iov_base,iov[key].iov_len,blkid);
 
     return S_OK;
@@ -307,105 +581,697 @@ int Table::insert(unsigned int blkid, std::vector<struct iovec> &iov)
 int Table::remove(unsigned int blkid, void* keybuf, unsigned int len) 
 {
     DataBlock data;
-    SuperBlock super;
     data.setTable(this);
 
     // 从buffer中借用block
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
+    BufDesp *bd = kBuffer.borrow(id_, blkid);
     data.attach(bd->buffer);
     
-    //删除了block中的对应record
-    unsigned int index = data.searchRecord(keybuf,len);
+    // searchRecord返回lowerbound，键不相等说明记录不存在，不修改统计
+    unsigned short index = data.searchRecord(keybuf, len);
+    Record record;
+    unsigned char *pkey;
+    unsigned int klen;
+    if (index >= data.getSlots() || !data.refslots(index, record) ||
+        !record.refByIndex(&pkey, &klen, info_->key) || klen != len ||
+        memcmp(pkey, keybuf, len) != 0) {
+        kBuffer.releaseBuf(bd);
+        return S_FALSE;
+    }
+    // 行外字段的溢出链随记录一起回收
+    std::string pointers;
+    collect(record, pointers);
     data.deallocate(index);
+    note(data);
 
     kBuffer.releaseBuf(bd); // 释放buffer
-    // 修改表头统计
-    bd = kBuffer.borrow(name_.c_str(), 0);
-    super.attach(bd->buffer);
-    super.setRecords(super.getRecords() - 1);
-    bd->relref();
+    stat_->records.sub(1);  // 修改表统计
+    discard(pointers);
 
     //更新bpt
-    bpt.remove((unsigned char*)keybuf,len,blkid);
+    bpt.remove((unsigned char *) keybuf, len);
 
+    // 占用过低时与后继合并，尾部block与前驱合并
+    rebalance(blkid, keybuf, len);
     return S_OK;
 }
 
+unsigned int
+Table::previous(unsigned int blkid, unsigned char *pkey, unsigned int len)
+{
+    // 小于key的最大键在前驱上，b+树的结果要核对数据链
+    if (indexed_) {
+        unsigned int previd = bpt.below(pkey, len);
+        if (previd && previd != blkid) {
+            DataBlock prev;
+            prev.setTable(this);
+            BufDesp *bd = kBuffer.borrow(id_, previd);
+            prev.attach(bd->buffer);
+            bool linked = prev.getNext() == blkid;
+            kBuffer.releaseBuf(bd);
+            if (linked) return previd;
+        }
+    }
+    // 找不到时沿数据链枚举
+    for (BlockIterator bi = beginblock(); bi != endblock(); ++bi)
+        if (bi->getNext() == blkid) return bi->getSelf();
+    return 0;
+}
+
+void Table::rebalance(unsigned int blkid, void *keybuf, unsigned int len)
+{
+    DataBlock data;
+    data.setTable(this);
+    BufDesp *bd = kBuffer.borrow(id_, blkid);
+    data.attach(bd->buffer);
+    unsigned int nextid = data.getNext();
+    if (data.getUsedSize() >= MERGE_THRESHOLD) {
+        kBuffer.releaseBuf(bd);
+        return;
+    }
+    // 尾部block没有后继，改与前驱配对；用本块和被删键中较小的找前驱
+    unsigned int leftid = blkid, rightid = nextid;
+    if (nextid == 0) {
+        unsigned char *pkey = (unsigned char *) keybuf;
+        unsigned int klen = len;
+        Record record;
+        unsigned char *first;
+        unsigned int flen;
+        if (data.refslots(0, record) &&
+            record.refByIndex(&first, &flen, info_->key) &&
+            info_->fields[info_->key].type->less(first, flen, pkey, klen)) {
+            pkey = first;
+            klen = flen;
+        }
+        leftid = previous(blkid, pkey, klen);
+        rightid = blkid;
+    }
+    kBuffer.releaseBuf(bd);
+    if (leftid == 0) return; // 只剩一块
+
+    DataBlock left;
+    left.setTable(this);
+    BufDesp *lbd = kBuffer.borrow(id_, leftid);
+    left.attach(lbd->buffer);
+    DataBlock right;
+    right.setTable(this);
+    BufDesp *rbd = kBuffer.borrow(id_, rightid);
+    right.attach(rbd->buffer);
+
+    // 合计放得下就全部移到左块，否则从较满的一块移到两块大致相等
+    bool merging = left.getUsedSize() + right.getUsedSize() <= MERGE_FILL;
+    unsigned int key = info_->key;
+    if (merging || left.getUsedSize() < right.getUsedSize()) {
+        // 右块的记录都大于左块的，按序追加到左块，移动的键改指左块
+        left.shrink();
+        while (right.getSlots() > 0) {
+            if (!merging && left.getUsedSize() >= right.getUsedSize()) break;
+            Record record;
+            right.refslots(0, record);
+            if (!left.copyRecord(record)) break;
+            unsigned char *pkey;
+            unsigned int klen;
+            record.refByIndex(&pkey, &klen, key);
+            bpt.update(pkey, klen, leftid);
+            right.deallocate(0);
+        }
+        // shrink按偏移排列了slots[]，重新按键排序
+        left.reorder(info_->fields[key].type, key, info_->recordFormat());
+    } else {
+        // 左块较满，从末尾把记录移到右块
+        right.shrink();
+        while (left.getSlots() > 0 &&
+               right.getUsedSize() < left.getUsedSize()) {
+            Record record;
+            left.refslots(left.getSlots() - 1, record);
+            if (!right.copyRecord(record)) break;
+            unsigned char *pkey;
+            unsigned int klen;
+            record.refByIndex(&pkey, &klen, key);
+            bpt.update(pkey, klen, rightid);
+            left.deallocate(left.getSlots() - 1);
+        }
+        right.reorder(info_->fields[key].type, key, info_->recordFormat());
+    }
+
+    // 右块移空则从数据链上摘下并回收
+    bool empty = right.getSlots() == 0;
+    if (empty) left.setNext(right.getNext());
+    // 整理中的最后一个目标block被吸收，进度退到左块
+    if (empty && compaction_.last == rightid) compaction_.last = leftid;
+    note(left);
+    if (!empty) note(right);
+    left.setChecksum();
+    kBuffer.writeBuf(lbd);
+    kBuffer.releaseBuf(lbd);
+    right.setChecksum();
+    kBuffer.writeBuf(rbd);
+    kBuffer.releaseBuf(rbd);
+    if (empty) deallocate(rightid);
+}
+
 int Table::update(unsigned int blkid, std::vector<struct iovec>& iov) 
 {
+    const RecordFormat *format = info_->recordFormat();
+    if (format && !format->match(iov)) return EINVAL;
+
+    // 新记录过长的字段移到行外
+    std::vector<struct iovec> row(iov);
+    std::string pointers, bitmap;
+    unsigned char header;
+    int ret = spill(row, pointers, bitmap, header);
+    if (ret) return ret;
+
     DataBlock data;
-    SuperBlock super;
     data.setTable(this);
 
     // 从buffer中借用
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
+    BufDesp *bd = kBuffer.borrow(id_, blkid);
     data.attach(bd->buffer);
 
+    // 旧记录的溢出链，修改成功后回收
+    unsigned int key = info_->key;
+    std::string old;
+    unsigned short index =
+        data.searchRecord(iov[key].iov_base, iov[key].iov_len);
+    Record record;
+    if (index < data.getSlots() && data.refslots(index, record))
+        collect(record, old);
+
     // 尝试修改，结果存入updateResult
-    std::pair<bool, unsigned short> updateResult = data.updateRecord(iov);
+    std::pair<bool, unsigned short> updateResult =
+        data.updateRecord(row, header);
+    note(data);
+    kBuffer.releaseBuf(bd); // 释放buffer
 
     // 修改成功
     if (updateResult.first) 
     {
-        kBuffer.releaseBuf(bd); // 释放buffer
-        // 修改表头统计
-        bd = kBuffer.borrow(name_.c_str(), 0);
-        super.attach(bd->buffer);
-        super.setRecords(super.getRecords());
-        bd->relref();
-
         //更新bpt
-        unsigned int key=info_->key;
         bpt.update((unsigned char*)iov[key].iov_base,iov[key].iov_len,blkid);
-
+        discard(old);
         return S_OK; 
     }
 
     // 存在这个record，但是修改失败
-    if(updateResult.second!=-1){
-        insert(blkid,iov);
-
-        //更新bpt
-        unsigned int key=info_->key;
-        bpt.update((unsigned char*)iov[key].iov_base,iov[key].iov_len,blkid);
-
+    if(updateResult.second!=(unsigned short)-1){
+        // 旧记录已删除，place可能把新记录放到别的block，由它重新插入bpt；
+        // place会把记录数加1，先减去删掉的旧记录
+        bpt.remove((unsigned char *) iov[key].iov_base, iov[key].iov_len);
+        stat_->records.sub(1);
+        place(blkid, row, header);
+        discard(old);
         return S_OK;
     }
 
     // 不存在这个record，直接返回失败
+    discard(pointers);
     return S_FALSE; 
 }
 
-size_t Table::recordCount()
+int Table::spill(
+    std::vector<struct iovec> &iov,
+    std::string &pointers,
+    std::string &bitmap,
+    unsigned char &header)
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
-    SuperBlock super;
-    super.attach(bd->buffer);
-    size_t count = super.getRecords();
+    header = RECORD_FULL_ALL;
+    // 定长表的记录不超过半个block，不移出
+    if (info_->recordFormat()) return S_OK;
+
+    // 先挑出过长的非键字段
+    size_t count = iov.size();
+    std::vector<bool> out(count, false);
+    size_t moved = 0;
+    size_t inlined = 0; // 行内字段的总长
+    for (size_t i = 0; i < count; ++i) {
+        if (i != info_->key && iov[i].iov_len > OVERFLOW_FIELD) {
+            out[i] = true;
+            ++moved;
+        } else
+            inlined += iov[i].iov_len;
+    }
+    // 行内部分仍然过长，继续移出最长的字段
+    size_t overhead = Record::HEADER_SIZE + 4 + (count + 1) * 2 + count / 8 + 1;
+    while (inlined + moved * OVERFLOW_POINTER + overhead > OVERFLOW_ROW) {
+        size_t longest = count;
+        for (size_t i = 0; i < count; ++i)
+            if (i != info_->key && !out[i] &&
+                iov[i].iov_len > OVERFLOW_POINTER &&
+                (longest == count || iov[i].iov_len > iov[longest].iov_len))
+                longest = i;
+        if (longest == count) break;
+        out[longest] = true;
+        inlined -= iov[longest].iov_len;
+        ++moved;
+    }
+    if (moved == 0) {
+        // 没有可移出的字段，记录必须放得进半个block
+        if (Record::size(iov) > BLOCK_SIZE / 2) return EINVAL;
+        return S_OK;
+    }
+    if (inlined + moved * OVERFLOW_POINTER + overhead > BLOCK_SIZE / 2)
+        return EINVAL;
+
+    // 写溢出链，字段换成指针，末尾追加位图
+    pointers.resize(moved * OVERFLOW_POINTER);
+    bitmap.assign((count + 7) / 8, '\0');
+    size_t at = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!out[i]) continue;
+        unsigned int length = (unsigned int) iov[i].iov_len;
+        unsigned int blockid = htobe32(writeOverflow(
+            (const unsigned char *) iov[i].iov_base, length));
+        length = htobe32(length);
+        char *pointer = &pointers[at];
+        memcpy(pointer, &blockid, sizeof(blockid));
+        memcpy(pointer + sizeof(blockid), &length, sizeof(length));
+        iov[i].iov_base = pointer;
+        iov[i].iov_len = OVERFLOW_POINTER;
+        bitmap[i / 8] |= (char) (1 << (i % 8));
+        at += OVERFLOW_POINTER;
+    }
+    struct iovec tail;
+    tail.iov_base = &bitmap[0];
+    tail.iov_len = bitmap.size();
+    iov.push_back(tail);
+    header = RECORD_FULL_START;
+    return S_OK;
+}
+
+unsigned int
+Table::writeOverflow(const unsigned char *data, unsigned int length)
+{
+    // 每块一个分片，先分配下一块再写当前块的next
+    unsigned int first = allocate(BLOCK_TYPE_OVERFLOW);
+    unsigned int current = first;
+    for (unsigned int done = 0; done < length;) {
+        unsigned int size = std::min(length - done, OVERFLOW_CHUNK);
+        bool last = done + size == length;
+        unsigned int next = last ? 0 : allocate(BLOCK_TYPE_OVERFLOW);
+
+        BufDesp *desp = kBuffer.borrow(id_, current);
+        MetaBlock block;
+        block.attach(desp->buffer);
+        std::vector<struct iovec> iov(1);
+        iov[0].iov_base = (void *) (data + done);
+        iov[0].iov_len = size;
+        unsigned short actlen = (unsigned short) Record::size(iov);
+        Record record;
+        record.attach(block.allocate(actlen, 0).first, actlen);
+        unsigned char header = last ? RECORD_FULL_END : RECORD_FULL_MID;
+        record.set(iov, &header);
+        block.setNext(next);
+        block.setChecksum();
+        block.detach();
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+
+        done += size;
+        current = next;
+    }
+    return first;
+}
+
+int Table::fetch(const unsigned char *pointer, unsigned char *value)
+{
+    unsigned int blockid = overflowBlock(pointer);
+    unsigned int length = overflowLength(pointer);
+    unsigned int done = 0;
+    while (blockid) {
+        BufDesp *desp = kBuffer.borrow(id_, blockid);
+        if (desp == NULL) return EIO;
+        MetaBlock block;
+        block.attach(desp->buffer);
+
+        // 每个溢出块只有一条MID或END记录
+        Record record;
+        unsigned char *data;
+        unsigned int len;
+        if (block.getType() != BLOCK_TYPE_OVERFLOW ||
+            !block.refslots(0, record) || record.isfull() ||
+            record.isstart() || !record.refByIndex(&data, &len, 0) ||
+            done + len > length) {
+            kBuffer.releaseBuf(desp);
+            return EINVAL;
+        }
+        memcpy(value + done, data, len);
+        done += len;
+        blockid = record.isend() ? 0 : block.getNext();
+        kBuffer.releaseBuf(desp);
+    }
+    return done == length ? S_OK : EINVAL;
+}
+
+void Table::collect(Record &record, std::string &pointers)
+{
+    if (!record.isactive() || !record.isstart()) return;
+    RecordLayout layout;
+    if (!layout.decode(record) || layout.count() != info_->count + 1u)
+        return;
+    const unsigned char *bitmap = layout.data(info_->count);
+    for (unsigned int f = 0; f < info_->count; ++f)
+        if (isOverflowed(bitmap, f) && layout.length(f) == OVERFLOW_POINTER)
+            pointers.append((const char *) layout.data(f), OVERFLOW_POINTER);
+}
+
+void Table::discard(const std::string &pointers)
+{
+    for (size_t at = 0; at < pointers.size(); at += OVERFLOW_POINTER) {
+        unsigned int blockid =
+            overflowBlock((const unsigned char *) pointers.data() + at);
+        while (blockid) {
+            BufDesp *desp = kBuffer.borrow(id_, blockid);
+            if (desp == NULL) break;
+            MetaBlock block;
+            block.attach(desp->buffer);
+            Record record;
+            bool overflow = block.getType() == BLOCK_TYPE_OVERFLOW &&
+                            block.refslots(0, record);
+            unsigned int next =
+                overflow && !record.isend() ? block.getNext() : 0;
+            kBuffer.releaseBuf(desp);
+            if (!overflow) break;
+            deallocate(blockid);
+            blockid = next;
+        }
+    }
+}
+
+int Table::compact(size_t budget)
+{
+    // 前台释放的block先收过来，前台分配只能扩展文件，不会占用整理的区域
+    absorbIdle();
+    if (compaction_.pass == 0) {
+        compaction_.pass = 1;
+        compaction_.last = 0;
+    }
+
+    for (size_t moved = 0; moved < budget;) {
+        // 源block是最后一个目标block的后继，本趟开始时是数据链头
+        unsigned int source;
+        if (compaction_.last) {
+            DataBlock data;
+            BufDesp *desp = kBuffer.borrow(id_, compaction_.last);
+            data.attach(desp->buffer);
+            source = data.getNext();
+            kBuffer.releaseBuf(desp);
+        } else {
+            SuperBlock super;
+            BufDesp *desp = kBuffer.borrow(id_, 0);
+            super.attach(desp->buffer);
+            source = super.getFirst();
+            kBuffer.releaseBuf(desp);
+        }
+
+        // 本趟结束
+        if (source == 0) {
+            if (compaction_.pass == 1) {
+                compaction_.pass = 2;
+                compaction_.last = 0;
+                continue;
+            }
+            compaction_.pass = 0;
+            compaction_.last = 0;
+            return shrinkFile();
+        }
+        move(source);
+        ++moved;
+    }
+    return S_FALSE;
+}
+
+void Table::absorbIdle()
+{
+    // 收过来的block只在映射中记为0，前台不会再分配；页上不变，仍是空闲
+    for (unsigned int blockid = space_->findIdle(); blockid;
+         blockid = space_->findIdle(blockid + 1)) {
+        compaction_.free.insert(blockid);
+        space_->set(blockid, 0);
+    }
+}
+
+unsigned int Table::take(unsigned short type)
+{
+    // 第1趟扩展文件，第2趟从最小的空闲块开始
+    if (compaction_.pass != 2 || compaction_.free.empty())
+        return allocate(type);
+
+    unsigned int blockid = *compaction_.free.begin();
+    compaction_.free.erase(compaction_.free.begin());
+    stat_->idlecounts.sub(1);
+    stat_->datacounts.add(1);
+
+    DataBlock data;
+    BufDesp *desp = kBuffer.borrow(id_, blockid);
+    data.attach(desp->buffer);
+    data.clear(info_->spaceid, blockid, type);
+    kBuffer.writeBuf(desp);
+    // 映射中原本记为0，页上的空闲要另外改掉
+    unsigned char value =
+        type == BLOCK_TYPE_DATA ? FreeSpaceMap::encode(data.getFreeSize()) : 0;
+    space_->set(blockid, value);
+    markPage(blockid, value);
+    kBuffer.releaseBuf(desp);
+    return blockid;
+}
+
+void Table::retire(unsigned int blockid)
+{
+    DataBlock data;
+    BufDesp *desp = kBuffer.borrow(id_, blockid);
+    data.attach(desp->buffer);
+    data.setType(BLOCK_TYPE_IDLE);
+    data.setNext(0);
+    data.setChecksum();
+    data.detach();
+    kBuffer.writeBuf(desp);
+    kBuffer.releaseBuf(desp);
+
+    // 映射中记为0，页上记为空闲，整理中断时不会丢掉这个block
+    compaction_.free.insert(blockid);
+    space_->set(blockid, 0);
+    markPage(blockid, FSM_IDLE);
+    stat_->idlecounts.add(1);
+    stat_->datacounts.sub(1);
+}
+
+void Table::move(unsigned int source)
+{
+    // 本趟的第一个目标block成为数据链头
+    if (compaction_.last == 0) {
+        unsigned int blockid = take(BLOCK_TYPE_DATA);
+        SuperBlock super;
+        BufDesp *desp = kBuffer.borrow(id_, 0);
+        super.attach(desp->buffer);
+        super.setFirst(blockid);
+        super.setChecksum();
+        super.detach();
+        kBuffer.writeBuf(desp);
+        kBuffer.releaseBuf(desp);
+        first_ = blockid;
+        compaction_.last = blockid;
+    }
+
+    DataBlock from;
+    from.setTable(this);
+    BufDesp *bd = kBuffer.borrow(id_, source);
+    from.attach(bd->buffer);
+    DataBlock to;
+    to.setTable(this);
+    BufDesp *bd2 = kBuffer.borrow(id_, compaction_.last);
+    to.attach(bd2->buffer);
+
+    // 源block的记录按键序追加到目标block，装满了另起一块
+    unsigned int key = info_->key;
+    for (unsigned short i = 0; i < from.getSlots(); ++i) {
+        Record record;
+        from.refslots(i, record);
+        bool fits = to.getUsedSize() + record.allocLength() + sizeof(Slot) <=
+                    COMPACT_FILL;
+        if (!fits || !to.copyRecord(record)) {
+            unsigned int blockid = take(BLOCK_TYPE_DATA);
+            to.setNext(blockid);
+            to.setChecksum();
+            note(to);
+            kBuffer.writeBuf(bd2);
+            kBuffer.releaseBuf(bd2);
+            bd2 = kBuffer.borrow(id_, blockid);
+            to.attach(bd2->buffer);
+            compaction_.last = blockid;
+            to.copyRecord(record);
+        }
+
+        // 行外字段的溢出链跟着记录一起搬，改写拷贝中的指针
+        Record copy;
+        to.refslots(to.getSlots() - 1, copy);
+        RecordLayout layout;
+        if (copy.isstart() && layout.decode(copy) &&
+            layout.count() == info_->count + 1u) {
+            const unsigned char *bitmap = layout.data(info_->count);
+            for (unsigned int f = 0; f < info_->count; ++f) {
+                if (!isOverflowed(bitmap, f)) continue;
+                unsigned int blockid =
+                    htobe32(moveOverflow(overflowBlock(layout.data(f))));
+                memcpy(layout.data(f), &blockid, sizeof(blockid));
+            }
+        }
+
+        unsigned char *pkey;
+        unsigned int klen;
+        copy.refByIndex(&pkey, &klen, key);
+        bpt.update(pkey, klen, compaction_.last);
+    }
+
+    // 目标接上源的后继，源block收回
+    to.setNext(from.getNext());
+    to.setChecksum();
+    note(to);
+    kBuffer.writeBuf(bd2);
+    kBuffer.releaseBuf(bd2);
     kBuffer.releaseBuf(bd);
-    return count;
+    retire(source);
 }
 
-unsigned int Table::dataCount()
+unsigned int Table::moveOverflow(unsigned int blockid)
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    unsigned int first = 0;
+    BufDesp *prev = NULL;
+    while (blockid) {
+        BufDesp *from = kBuffer.borrow(id_, blockid);
+        MetaBlock block;
+        block.attach(from->buffer);
+        if (block.getType() != BLOCK_TYPE_OVERFLOW) {
+            kBuffer.releaseBuf(from);
+            break;
+        }
+        unsigned int next = block.getNext();
+
+        // 整块拷过去，只改self
+        unsigned int target = take(BLOCK_TYPE_OVERFLOW);
+        BufDesp *to = kBuffer.borrow(id_, target);
+        memcpy(to->buffer, from->buffer, BLOCK_SIZE);
+        block.attach(to->buffer);
+        block.setSelf(target);
+        kBuffer.releaseBuf(from);
+        retire(blockid);
+
+        // 前一块指向新的block
+        if (prev) {
+            block.attach(prev->buffer);
+            block.setNext(target);
+            block.setChecksum();
+            kBuffer.writeBuf(prev);
+            kBuffer.releaseBuf(prev);
+        } else
+            first = target;
+        prev = to;
+        blockid = next;
+    }
+    if (prev) {
+        MetaBlock block;
+        block.attach(prev->buffer);
+        block.setChecksum();
+        kBuffer.writeBuf(prev);
+        kBuffer.releaseBuf(prev);
+    }
+    return first ? first : blockid;
+}
+
+int Table::shrinkFile()
+{
+    // 尾部的空闲块直接截掉
+    std::set<unsigned int> &free = compaction_.free;
+    while (maxid_ > 0 && free.erase(maxid_)) {
+        --maxid_;
+        stat_->idlecounts.sub(1);
+    }
+
+    // 其余的在映射中标为空闲，分配时先用最小的
+    space_->resize(maxid_ + 1);
+    for (std::set<unsigned int>::iterator it = free.begin(); it != free.end();
+         ++it)
+        space_->set(*it, FSM_IDLE);
+    free.clear();
+    savePages();
+
     SuperBlock super;
-    super.attach(bd->buffer);
-    unsigned int count = super.getDataCounts();
-    kBuffer.releaseBuf(bd);
-    return count;
+    BufDesp *desp = kBuffer.borrow(id_, 0);
+    super.attach(desp->buffer);
+    super.setMaxid(maxid_);
+    super.setReserved(maxid_); // 预分配的部分一并截掉
+    super.setChecksum();
+    super.detach();
+    kBuffer.writeBuf(desp);
+    kBuffer.releaseBuf(desp);
+    return kBuffer.truncate(id_, maxid_);
+}
+
+size_t Table::recordCount() { return (size_t) stat_->records.load(); }
+
+unsigned int Table::dataCount()
+{
+    return (unsigned int) stat_->datacounts.load();
 }
 
 unsigned int Table::idleCount()
 {
-    BufDesp *bd = kBuffer.borrow(name_.c_str(), 0);
+    return (unsigned int) stat_->idlecounts.load();
+}
+
+void Table::checkpoint()
+{
+    savePages();
+
+    BufDesp *bd = kBuffer.borrow(id_, 0);
     SuperBlock super;
     super.attach(bd->buffer);
-    unsigned int count = super.getIdleCounts();
+    super.setRecords(stat_->records.load());
+    super.setDataCounts((unsigned int) stat_->datacounts.load());
+    super.setIdleCounts((unsigned int) stat_->idlecounts.load());
+    super.setChecksum();
+    super.detach();
+    kBuffer.writeBuf(bd);
     kBuffer.releaseBuf(bd);
-    return count;
 }
 
+bool Table::saveStat(BufDesp *desp)
+{
+    std::lock_guard<std::mutex> lock(kStatMutex);
+    std::unordered_map<TableId, std::unique_ptr<TableStat>>::iterator it =
+        kStats.find(desp->table);
+    if (it == kStats.end()) return false;
+
+    SuperBlock super;
+    super.attach(desp->buffer);
+    long long records = it->second->records.load();
+    unsigned int datacounts = (unsigned int) it->second->datacounts.load();
+    unsigned int idlecounts = (unsigned int) it->second->idlecounts.load();
+    bool changed = super.getMagic() == MAGIC_NUMBER &&
+                   (super.getRecords() != records ||
+                    super.getDataCounts() != datacounts ||
+                    super.getIdleCounts() != idlecounts);
+    if (changed) {
+        super.setRecords(records);
+        super.setDataCounts(datacounts);
+        super.setIdleCounts(idlecounts);
+        super.setChecksum();
+    }
+    super.detach();
+    return changed;
+}
+
+void Table::checkpointAll()
+{
+    std::lock_guard<std::mutex> lock(kTableMutex);
+    for (std::unordered_map<TableId, std::unique_ptr<Table>>::iterator it =
+             kTables.begin();
+         it != kTables.end();
+         ++it) {
+        std::lock_guard<RWLatch> guard(it->second->latch_);
+        it->second->checkpoint();
+    }
+}
 
 void Table::BPlusTreeInit() { 
     //逐个block，遍历每一条record
@@ -422,12 +1288,13 @@ void Table::BPlusTreeInit() {
             //确定pkey,len
             unsigned int len;
             unsigned char *pkey;
-            record.refByIndex(&pkey, &len, index);
+            record.refByIndex(&pkey, &len, info_->key);
             
             //插入到bpt中
             bpt.insert(pkey,len,blkid);
         }
     }
+    indexed_ = true;
 }
 
 unsigned int Table::search(void* keybuf, unsigned int len) {
@@ -435,5 +1302,37 @@ unsigned int Table::search(void* keybuf, unsigned int len) {
     
     return bpt.search((unsigned char *) keybuf,len);
 }
+
+int Table::view(void *keybuf, unsigned int len, RowView &row)
+{
+    row.release();
+
+    // b+树上没有时再枚举
+    unsigned int blkid = search(keybuf, len);
+    if (blkid == 0) blkid = locate(keybuf, len);
+    if (blkid == 0) return ENOENT;
+
+    DataBlock data;
+    data.setTable(this);
+    BufDesp *bd = kBuffer.borrow(id_, blkid);
+    data.attach(bd->buffer);
+
+    // 找到第一个不小于key的记录，再排除不等的情况
+    unsigned int key = info_->key;
+    DataType *type = info_->fields[key].type;
+    unsigned short index = data.searchRecord(keybuf, len);
+    Record record;
+    int ret = ENOENT;
+    if (index < data.getSlots() && data.refslots(index, record)) {
+        unsigned char *pkey;
+        unsigned int klen;
+        record.refByIndex(&pkey, &klen, key);
+        if (!type->less((unsigned char *) keybuf, len, pkey, klen) &&
+            record.isactive() && row.attach(bd, record))
+            ret = S_OK;
+    }
+    kBuffer.releaseBuf(bd); // row有自己的引用
+    return ret;
+}
     
 } // namespace db
\ No newline at end of file
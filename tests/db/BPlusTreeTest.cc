@@ -0,0 +1,187 @@
+////
+// @file BPlusTreeTest.cc
+// @brief
+// 测试b+树
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <db/BPlusTree.h>
+#include <db/endian.h>
+using namespace db;
+
+TEST_CASE("db/BPlusTree.h")
+{
+    SECTION("compare")
+    {
+        unsigned char x[] = {1, 2, 3};
+        unsigned char y[] = {1, 2, 4};
+        REQUIRE(compareKey(x, 3, y, 3) < 0);
+        REQUIRE(compareKey(y, 3, x, 3) > 0);
+        REQUIRE(compareKey(x, 2, x, 3) < 0);
+        REQUIRE(compareKey(x, 3, x, 3) == 0);
+    }
+
+    SECTION("insert")
+    {
+        BPlusTree tree;
+        for (unsigned int i = 1; i <= 10000; ++i) {
+            unsigned long long key = htobe64(i * 7 % 10007);
+            REQUIRE(tree.insert((unsigned char *) &key, sizeof(key), i));
+        }
+        // 重复插入失败
+        unsigned long long key = htobe64(7);
+        REQUIRE(!tree.insert((unsigned char *) &key, sizeof(key), 1));
+
+        for (unsigned int i = 1; i <= 10000; ++i) {
+            key = htobe64(i * 7 % 10007);
+            REQUIRE(tree.search((unsigned char *) &key, sizeof(key)) == i);
+        }
+        key = htobe64(20000);
+        REQUIRE(tree.search((unsigned char *) &key, sizeof(key)) == 0);
+    }
+
+    SECTION("update")
+    {
+        BPlusTree tree;
+        for (unsigned int i = 0; i < 1000; ++i) {
+            unsigned int key = htobe32(i);
+            tree.insert((unsigned char *) &key, sizeof(key), 1);
+        }
+        for (unsigned int i = 0; i < 1000; i += 2) {
+            unsigned int key = htobe32(i);
+            tree.update((unsigned char *) &key, sizeof(key), 2);
+        }
+        for (unsigned int i = 0; i < 1000; i += 3) {
+            unsigned int key = htobe32(i);
+            tree.remove((unsigned char *) &key, sizeof(key));
+        }
+        for (unsigned int i = 0; i < 1000; ++i) {
+            unsigned int key = htobe32(i);
+            unsigned int blkid = tree.search((unsigned char *) &key, sizeof(key));
+            if (i % 3 == 0)
+                REQUIRE(blkid == 0);
+            else
+                REQUIRE(blkid == (i % 2 == 0 ? 2u : 1u));
+        }
+    }
+
+    SECTION("below")
+    {
+        // 偶数键，跨越多个叶子
+        BPlusTree tree;
+        for (unsigned int i = 0; i < 2000; i += 2) {
+            unsigned int key = htobe32(i);
+            tree.insert((unsigned char *) &key, sizeof(key), i + 1);
+        }
+        for (unsigned int i = 0; i < 2000; ++i) {
+            unsigned int key = htobe32(i);
+            unsigned int floor = i - i % 2 + 1;
+            unsigned int below = i % 2 ? floor : floor - 2;
+            REQUIRE(tree.floor((unsigned char *) &key, sizeof(key)) == floor);
+            if (i == 0)
+                REQUIRE(tree.below((unsigned char *) &key, sizeof(key)) == 0);
+            else
+                REQUIRE(
+                    tree.below((unsigned char *) &key, sizeof(key)) == below);
+        }
+    }
+
+    SECTION("varchar")
+    {
+        BPlusTree tree;
+        char key[64];
+        for (unsigned int i = 0; i < 5000; ++i) {
+            int len = snprintf(key, sizeof(key), "key-%u-%0*u", i, i % 40, i);
+            REQUIRE(tree.insert((unsigned char *) key, len, i + 1));
+        }
+        for (unsigned int i = 0; i < 5000; ++i) {
+            int len = snprintf(key, sizeof(key), "key-%u-%0*u", i, i % 40, i);
+            REQUIRE(tree.search((unsigned char *) key, len) == i + 1);
+        }
+    }
+
+    SECTION("concurrent")
+    {
+        // 写线程插入的同时，读线程查找已插入的键
+        BPlusTree tree;
+        const unsigned int total = 100000;
+        const unsigned int writers = 4;
+        std::atomic<unsigned int> inserted(0);
+        std::atomic<int> errors(0);
+        std::vector<std::thread> threads;
+
+        for (unsigned int w = 0; w < writers; ++w)
+            threads.push_back(std::thread([&, w]() {
+                for (unsigned int i = w; i < total; i += writers) {
+                    unsigned long long key = htobe64(i);
+                    tree.insert((unsigned char *) &key, sizeof(key), i + 1);
+                    if (w == 0) inserted.store(i, std::memory_order_release);
+                }
+            }));
+        for (unsigned int r = 0; r < 4; ++r)
+            threads.push_back(std::thread([&]() {
+                for (int n = 0; n < 100000; ++n) {
+                    unsigned int limit = inserted.load(std::memory_order_acquire);
+                    unsigned int i = (unsigned int) (n * 2654435761u) % (limit + 1);
+                    i -= i % writers; // 只查写线程0已插入的键
+                    if (i > limit) continue;
+                    unsigned long long key = htobe64(i);
+                    if (tree.search((unsigned char *) &key, sizeof(key)) != i + 1)
+                        ++errors;
+                }
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        REQUIRE(errors.load() == 0);
+
+        for (unsigned int i = 0; i < total; ++i) {
+            unsigned long long key = htobe64(i);
+            REQUIRE(tree.search((unsigned char *) &key, sizeof(key)) == i + 1);
+        }
+    }
+
+    SECTION("split")
+    {
+        // 写线程按键序往各个叶子中插入新键，叶子依次分裂，已有的键移到右
+        // 兄弟；读线程查找写线程前方刚要分裂的叶子中已有的键，都应该找到
+        BPlusTree tree;
+        const unsigned int total = 100000;
+        for (unsigned int i = 0; i < total; ++i) {
+            unsigned int key = htobe32(i * 4);
+            tree.insert((unsigned char *) &key, sizeof(key), i + 1);
+        }
+        std::atomic<unsigned int> progress(0);
+        std::atomic<bool> done(false);
+        std::atomic<int> errors(0);
+        std::vector<std::thread> threads;
+        threads.push_back(std::thread([&]() {
+            for (unsigned int i = 0; i < total; ++i) {
+                for (unsigned int j = 1; j < 4; ++j) {
+                    unsigned int key = htobe32(i * 4 + j);
+                    tree.insert((unsigned char *) &key, sizeof(key), 1);
+                }
+                progress.store(i, std::memory_order_release);
+            }
+            done.store(true);
+        }));
+        for (unsigned int r = 0; r < 8; ++r)
+            threads.push_back(std::thread([&, r]() {
+                for (unsigned int n = r; !done.load(); ++n) {
+                    unsigned int i = progress.load() + 1 + n % 16;
+                    if (i >= total) continue;
+                    unsigned int key = htobe32(i * 4);
+                    if (tree.search((unsigned char *) &key, sizeof(key)) !=
+                        i + 1)
+                        ++errors;
+                }
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        REQUIRE(errors.load() == 0);
+    }
+}
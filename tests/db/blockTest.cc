@@ -23,7 +23,8 @@ TEST_CASE("db/block.h")
         REQUIRE(sizeof(Trailer) % 8 == 0);
         REQUIRE(
             sizeof(SuperHeader) ==
-            sizeof(CommonHeader) + sizeof(TimeStamp) + 9 * sizeof(int));
+            sizeof(CommonHeader) + sizeof(TimeStamp) + sizeof(long long) +
+                9 * sizeof(int));
         REQUIRE(sizeof(SuperHeader) % 8 == 0);
         REQUIRE(sizeof(IdleHeader) == sizeof(CommonHeader) + sizeof(int));
         REQUIRE(sizeof(IdleHeader) % 8 == 0);
@@ -308,7 +309,7 @@ TEST_CASE("db/block.h")
         type->htobe(&id);
         iov[0].iov_base = &id;
         iov[0].iov_len = 8;
-        iov[1].iov_base = "John Carter ";
+        iov[1].iov_base = (void *) "John Carter ";
         iov[1].iov_len = 12;
         const char *addr = "(323) 238-0693"
                            "909 - 1/2 E 49th St"
@@ -339,7 +340,7 @@ TEST_CASE("db/block.h")
         type->htobe(&id);
         iov[0].iov_base = &id;
         iov[0].iov_len = 8;
-        iov[1].iov_base = "Joi Biden    ";
+        iov[1].iov_base = (void *) "Joi Biden    ";
         iov[1].iov_len = 12;
         const char *addr2 = "(323) 751-1875"
                             "7609 Mckinley Ave"
@@ -421,7 +422,7 @@ TEST_CASE("db/block.h")
         type->htobe(&id);
         iov[0].iov_base = &id;
         iov[0].iov_len = 8;
-        iov[1].iov_base = "John Carter ";
+        iov[1].iov_base = (void *) "John Carter ";
         iov[1].iov_len = 12;
         const char *addr = "(323) 238-0693"
                            "909 - 1/2 E 49th St"
@@ -447,7 +448,7 @@ TEST_CASE("db/block.h")
         type->htobe(&id);
         iov[0].iov_base = &id;
         iov[0].iov_len = 8;
-        iov[1].iov_base = "Joi Biden    ";
+        iov[1].iov_base = (void *) "Joi Biden    ";
         iov[1].iov_len = 12;
         const char *addr2 = "(323) 751-1875"
                             "7609 Mckinley Ave"
@@ -475,13 +476,13 @@ TEST_CASE("db/block.h")
 
         // 搜索
         id = htobe64(3);
-        unsigned short ret = type->search(buffer, 0, &id, sizeof(id));
+        unsigned short ret = type->search(buffer, 0, &id, sizeof(id), NULL);
         REQUIRE(ret == 0);
         id = htobe64(12);
-        ret = type->search(buffer, 0, &id, sizeof(id));
+        ret = type->search(buffer, 0, &id, sizeof(id), NULL);
         REQUIRE(ret == 1);
         id = htobe64(2);
-        ret = type->search(buffer, 0, &id, sizeof(id));
+        ret = type->search(buffer, 0, &id, sizeof(id), NULL);
         REQUIRE(ret == 0);
     }
 
@@ -549,7 +550,7 @@ TEST_CASE("db/block.h")
         REQUIRE(record.length() == Record::size(iov));
         REQUIRE(record.fields() == 3);
         long long xid;
-        unsigned int len;
+        unsigned int len = sizeof(xid);
         record.getByIndex((char *) &xid, &len, 0);
         REQUIRE(len == 8);
         type->betoh(&xid);
@@ -584,6 +585,7 @@ TEST_CASE("db/block.h")
             data.buffer_ + be16toh(slots[0].offset), be16toh(slots[0].length));
         REQUIRE(record.length() == Record::size(iov));
         REQUIRE(record.fields() == 3);
+        len = sizeof(xid);
         record.getByIndex((char *) &xid, &len, 0);
         REQUIRE(len == 8);
         type->betoh(&xid);
@@ -617,6 +619,7 @@ TEST_CASE("db/block.h")
             data.buffer_ + be16toh(slots[2].offset), be16toh(slots[2].length));
         REQUIRE(record.length() == Record::size(iov));
         REQUIRE(record.fields() == 3);
+        len = sizeof(xid);
         record.getByIndex((char *) &xid, &len, 0);
         REQUIRE(len == 8);
         type->betoh(&xid);
@@ -650,6 +653,7 @@ TEST_CASE("db/block.h")
             data.buffer_ + be16toh(slots[1].offset), be16toh(slots[1].length));
         REQUIRE(record.length() == Record::size(iov));
         REQUIRE(record.fields() == 3);
+        len = sizeof(xid);
         record.getByIndex((char *) &xid, &len, 0);
         REQUIRE(len == 8);
         type->betoh(&xid);
@@ -768,14 +772,17 @@ TEST_CASE("db/block.h")
         iov[2].iov_base = (void *) addr;
         iov[2].iov_len = 128;
         std::pair<bool, unsigned short> ha = data.insertRecord(iov);
+        REQUIRE(ha.first);
+        REQUIRE(ha.second == 3);
+
+        // 修改第5条记录的phone
+        memset(phone, 0, sizeof(phone));
+        strcpy(phone, "46558");
+        bool ret = data.updateRecord(iov).first;
+        REQUIRE(ret);
+
         // 写入，释放
         kBuffer.writeBuf(bd);
         kBuffer.releaseBuf(bd);
-
-
-        iov[1].iov_base = "46558";
-
-        bool ret = data.updateRecord(iov);
-        REQUIRE(ret);
     }
 }
\ No newline at end of file
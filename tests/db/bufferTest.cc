@@ -7,9 +7,14 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include <string.h>
+#include <atomic>
+#include <vector>
 #include <db/buffer.h>
+#include <db/scheduler.h>
 #include <db/file.h>
 #include <db/block.h>
+#include <db/schema.h>
 using namespace db;
 
 TEST_CASE("db/buffer.h")
@@ -25,5 +30,227 @@ TEST_CASE("db/buffer.h")
         REQUIRE(bd->ref.load() == 1);
         kBuffer.releaseBuf(bd);
         REQUIRE(bd->ref.load() == 0);
+
+        // 按表名和按编号借到同一个buffer
+        char name[16];
+        strcpy(name, Schema::META_FILE);
+        BufDesp *byname = kBuffer.borrow(name, 0);
+        BufDesp *byid = kBuffer.borrow(Schema::META_ID, 0);
+        REQUIRE(byname == bd);
+        REQUIRE(byid == bd);
+        REQUIRE(bd->table == Schema::META_ID);
+        kBuffer.releaseBuf(byname);
+        kBuffer.releaseBuf(byid);
+    }
+
+    SECTION("async")
+    {
+        // 命中时直接在当前线程回调
+        BufDesp *bd = kBuffer.borrow(Schema::META_FILE, 0);
+        BufDesp *hit = NULL;
+        kBuffer.borrowAsync(
+            Schema::META_FILE, 0, [&hit](BufDesp *desp) { hit = desp; });
+        REQUIRE(hit == bd);
+        REQUIRE(bd->ref.load() == 2);
+        kBuffer.releaseBuf(hit);
+        kBuffer.releaseBuf(bd);
+
+        // 未命中时并发发起多个请求，同一block只读一次
+        const int count = 64;
+        std::atomic<int> done(0);
+        BufDesp *results[count] = {};
+        for (int i = 0; i < count; ++i)
+            kBuffer.borrowAsync(
+                Schema::META_FILE,
+                1000 + i % 8,
+                [&done, &results, i](BufDesp *desp) {
+                    results[i] = desp;
+                    done.fetch_add(1);
+                });
+        while (done.load() < count)
+            kScheduler.yield();
+
+        for (int i = 0; i < count; ++i) {
+            REQUIRE(results[i]);
+            REQUIRE(results[i] == results[i % 8]);
+            REQUIRE(results[i]->blockid == (unsigned int) (1000 + i % 8));
+            REQUIRE((results[i]->type & kBuffer.BUFFER_LOADING) == 0);
+        }
+        for (int i = 0; i < 8; ++i) {
+            REQUIRE(results[i]->ref.load() == count / 8);
+            REQUIRE(kBuffer.borrow(Schema::META_FILE, 1000 + i) == results[i]);
+            kBuffer.releaseBuf(results[i]);
+        }
+        for (int i = 0; i < count; ++i)
+            kBuffer.releaseBuf(results[i]);
+
+        // IO线程读入时同步借用同一block，睡眠到读完，拿到同一个buffer
+        std::atomic<BufDesp *> async(NULL);
+        kBuffer.borrowAsync(
+            Schema::META_FILE, 2000, [&async](BufDesp *desp) {
+                async.store(desp);
+            });
+        BufDesp *sync = kBuffer.borrow(Schema::META_FILE, 2000);
+        REQUIRE(sync);
+        REQUIRE((sync->type & kBuffer.BUFFER_LOADING) == 0);
+        while (async.load() == NULL)
+            kScheduler.yield();
+        REQUIRE(async.load() == sync);
+        REQUIRE(sync->ref.load() == 2);
+        kBuffer.releaseBuf(sync);
+        kBuffer.releaseBuf(sync);
+    }
+
+    SECTION("evict")
+    {
+        // 1MB的buffer，写满后从lru尾部淘汰，脏block写回文件
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        const unsigned int blocks = 1024 * 1024 / BLOCK_SIZE;
+        std::string name;
+        REQUIRE(kFiles.temporary(name));
+        for (unsigned int i = 0; i < blocks * 2; ++i) {
+            BufDesp *bd = buffer.borrow(name.c_str(), i);
+            REQUIRE(bd);
+            memset(bd->buffer, (int) i + 1, BLOCK_SIZE);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        for (unsigned int i = 0; i < blocks * 2; ++i) {
+            BufDesp *bd = buffer.borrow(name.c_str(), i);
+            REQUIRE(bd);
+            REQUIRE(bd->buffer[0] == (unsigned char) (i + 1));
+            REQUIRE(bd->buffer[BLOCK_SIZE - 1] == (unsigned char) (i + 1));
+            buffer.releaseBuf(bd);
+        }
+
+        // 全部借出时不能淘汰
+        std::vector<BufDesp *> pins;
+        for (unsigned int i = 0; i < blocks; ++i) {
+            pins.push_back(buffer.borrow(name.c_str(), i));
+            REQUIRE(pins.back());
+        }
+        REQUIRE(buffer.borrow(name.c_str(), blocks) == NULL);
+        for (unsigned int i = 0; i < blocks; ++i)
+            buffer.releaseBuf(pins[i]);
+
+        // 丢弃后重新从文件读入
+        buffer.discard(name.c_str());
+        BufDesp *bd = buffer.borrow(name.c_str(), 1);
+        REQUIRE(bd);
+        REQUIRE(bd->buffer[0] == 2);
+        buffer.releaseBuf(bd);
+        buffer.discard(name.c_str());
+        kFiles.drop(name);
+    }
+
+    SECTION("flush")
+    {
+        // 脏buffer写回文件
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        std::string name;
+        REQUIRE(kFiles.temporary(name));
+        for (unsigned int i = 0; i < 4; ++i) {
+            BufDesp *bd = buffer.borrow(name.c_str(), i);
+            REQUIRE(bd);
+            memset(bd->buffer, (int) i + 1, BLOCK_SIZE);
+            buffer.writeBuf(bd);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.flush() == S_OK);
+        File *file = kFiles.open(name.c_str());
+        REQUIRE(file);
+        std::vector<char> raw(BLOCK_SIZE);
+        unsigned long long offset = 3ULL * BLOCK_SIZE + SUPER_SIZE;
+        REQUIRE(file->read(offset, raw.data(), BLOCK_SIZE) == S_OK);
+        REQUIRE(raw[0] == 4);
+        REQUIRE(raw[BLOCK_SIZE - 1] == 4);
+
+        // 给定表时只写回这张表的脏buffer
+        std::string other;
+        REQUIRE(kFiles.temporary(other));
+        BufDesp *bd = buffer.borrow(other.c_str(), 0);
+        REQUIRE(bd);
+        memset(bd->buffer, 9, BLOCK_SIZE);
+        buffer.writeBuf(bd);
+        buffer.releaseBuf(bd);
+        REQUIRE(buffer.flush(kFiles.intern(name.c_str())) == S_OK);
+        unsigned long long length;
+        REQUIRE(kFiles.open(other.c_str())->length(length) == S_OK);
+        REQUIRE(length == 0);
+        REQUIRE(buffer.flush() == S_OK);
+        REQUIRE(kFiles.open(other.c_str())->length(length) == S_OK);
+        REQUIRE(length == BLOCK_SIZE);
+
+        buffer.discard(name.c_str());
+        buffer.discard(other.c_str());
+        kFiles.drop(name);
+        kFiles.drop(other);
+    }
+
+    SECTION("spaceid")
+    {
+        RelationInfo relation;
+        FieldInfo field;
+        field.name = "id";
+        field.length = 8;
+        field.type = findDataType("BIGINT");
+        relation.fields.push_back(field);
+        relation.count = 1;
+        int ret = kSchema.create("bufferspace", relation);
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        unsigned int spaceid =
+            kSchema.lookup("bufferspace").first->second.spaceid;
+
+        Buffer buffer;
+        buffer.init(&kFiles, 1);
+        const unsigned int blocks = 1024 * 1024 / BLOCK_SIZE;
+        BufDesp *bd = buffer.borrow("bufferspace", 1);
+        REQUIRE(bd->spaceid == spaceid);
+        buffer.releaseBuf(bd);
+
+        // 文件里的block盖的是别的表空间，读入时清零
+        std::vector<unsigned char> raw(BLOCK_SIZE);
+        DataBlock data;
+        data.attach(raw.data());
+        data.clear(spaceid + 1, 2, BLOCK_TYPE_DATA);
+        data.detach();
+        File *file = kFiles.open("bufferspace");
+        REQUIRE(file);
+        REQUIRE(
+            file->write(
+                2ULL * BLOCK_SIZE + SUPER_SIZE,
+                (const char *) raw.data(),
+                BLOCK_SIZE) == S_OK);
+        bd = buffer.borrow("bufferspace", 2);
+        REQUIRE(buffer.misdirected() == 1);
+        data.attach(bd->buffer);
+        REQUIRE(data.getMagic() != MAGIC_NUMBER);
+        data.detach();
+        buffer.releaseBuf(bd);
+
+        // 内存中的block盖错了表空间，淘汰时不写回
+        bd = buffer.borrow("bufferspace", 3);
+        data.attach(bd->buffer);
+        data.clear(spaceid + 1, 3, BLOCK_TYPE_DATA);
+        data.detach();
+        buffer.writeBuf(bd);
+        buffer.releaseBuf(bd);
+        std::string name;
+        REQUIRE(kFiles.temporary(name));
+        for (unsigned int i = 0; i < blocks; ++i) {
+            bd = buffer.borrow(name.c_str(), i);
+            REQUIRE(bd);
+            buffer.releaseBuf(bd);
+        }
+        REQUIRE(buffer.misdirected() == 2);
+        bd = buffer.borrow("bufferspace", 3);
+        data.attach(bd->buffer);
+        REQUIRE(data.getMagic() != MAGIC_NUMBER);
+        data.detach();
+        buffer.releaseBuf(bd);
+        buffer.discard(name.c_str());
+        kFiles.drop(name);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+////
+// @file counterTest.cc
+// @brief
+// 测试分片计数器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <db/counter.h>
+using namespace db;
+
+TEST_CASE("db/counter.h")
+{
+    SECTION("single")
+    {
+        ShardedCounter counter;
+        REQUIRE(counter.load() == 0);
+        counter.add(5);
+        counter.sub(2);
+        REQUIRE(counter.load() == 3);
+        counter.reset(10);
+        REQUIRE(counter.load() == 10);
+    }
+
+    SECTION("align")
+    {
+        // 每个分片独占一个cache line，堆上分配的也对齐
+        REQUIRE(alignof(ShardedCounter) == CACHELINE_SIZE);
+        REQUIRE(sizeof(ShardedCounter) == COUNTER_SHARDS * CACHELINE_SIZE);
+        for (size_t size = 1; size < 256; size += 37) {
+            void *ptr = cachelineNew(size);
+            REQUIRE((uintptr_t) ptr % CACHELINE_SIZE == 0);
+            memset(ptr, 0, size);
+            cachelineDelete(ptr);
+        }
+    }
+
+    SECTION("threads")
+    {
+        ShardedCounter counter;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 8; ++i)
+            threads.push_back(std::thread([&counter]() {
+                for (int j = 0; j < 10000; ++j)
+                    counter.add(1);
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        REQUIRE(counter.load() == 80000);
+    }
+}
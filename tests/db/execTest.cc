@@ -0,0 +1,1387 @@
+////
+// @file execTest.cc
+// @brief
+// 测试向量化执行器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <db/exec.h>
+using namespace db;
+
+namespace {
+// 执行一条语句，返回影响或输出的行数
+size_t run(
+    Executor &exec,
+    const char *text,
+    const Executor::Visitor &visitor = Executor::Visitor())
+{
+    SQL sql;
+    Plan plan;
+    REQUIRE(sql.prepare(text, plan) == S_OK);
+    size_t affected = 0;
+    REQUIRE(exec.execute(plan, visitor, &affected) == S_OK);
+    return affected;
+}
+} // namespace
+
+TEST_CASE("db/exec.h")
+{
+    SECTION("decode")
+    {
+        unsigned char buf[8] = {0, 0, 0, 0, 0, 0, 1, 2};
+        REQUIRE(decodeInteger(buf + 7, 1) == 2);
+        REQUIRE(decodeInteger(buf + 6, 2) == 258);
+        REQUIRE(decodeInteger(buf + 4, 4) == 258);
+        REQUIRE(decodeInteger(buf, 8) == 258);
+
+        // 无符号，高位为1时零扩展
+        unsigned char high[4] = {0xff, 0xff, 0xff, 0xfe};
+        REQUIRE(decodeInteger(high, 1) == 255);
+        REQUIRE(decodeInteger(high, 2) == 65535);
+        REQUIRE(decodeInteger(high, 4) == 4294967294LL);
+    }
+
+    SECTION("select")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE exectest (id INT PRIMARY KEY, grp TINYINT, "
+                "name VARCHAR(32))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM exectest");
+
+        // 乱序插入，跨越多个block和多个批
+        const int total = 3000;
+        char text[128];
+        for (int i = 0; i < total; ++i) {
+            int id = (i * 7919) % total;
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO exectest VALUES (%d, %d, 'name%d')",
+                id,
+                id % 10,
+                id);
+            REQUIRE(run(exec, text) == 1);
+        }
+
+        // 全表扫描，按键有序
+        long long last = -1;
+        bool ordered = true;
+        size_t rows = run(exec, "SELECT id FROM exectest", [&](Batch &batch) {
+            REQUIRE(batch.columns.size() == 1);
+            REQUIRE(batch.count() <= BATCH_SIZE);
+            for (size_t i = 0; i < batch.count(); ++i) {
+                long long id = batch.columns[0].ints[batch.row(i)];
+                if (id <= last) ordered = false;
+                last = id;
+            }
+        });
+        REQUIRE(rows == (size_t) total);
+        REQUIRE(ordered);
+
+        // 非键过滤
+        REQUIRE(run(exec, "SELECT * FROM exectest WHERE grp = 3") == 300);
+        REQUIRE(
+            run(exec, "SELECT * FROM exectest WHERE grp >= 3 AND grp < 5") ==
+            600);
+        REQUIRE(
+            run(exec, "SELECT id FROM exectest WHERE name = 'name42'") == 1);
+
+        // 范围扫描
+        REQUIRE(sql.prepare(
+                    "SELECT id FROM exectest WHERE id >= 100 AND id < 2100",
+                    plan) == S_OK);
+        REQUIRE(plan.access == ACCESS_RANGE);
+        size_t count = 0;
+        REQUIRE(exec.execute(plan, Executor::Visitor(), &count) == S_OK);
+        REQUIRE(count == 2000);
+
+        // 点查，投影
+        std::string name;
+        rows = run(
+            exec,
+            "SELECT name, grp FROM exectest WHERE id = 1234",
+            [&](Batch &batch) {
+                size_t row = batch.row(0);
+                name.assign(
+                    (const char *) batch.columns[0].data[row],
+                    batch.columns[0].lengths[row]);
+                REQUIRE(batch.columns[1].ints[row] == 4);
+            });
+        REQUIRE(rows == 1);
+        REQUIRE(name == "name1234");
+        REQUIRE(run(exec, "SELECT * FROM exectest WHERE id = 5000") == 0);
+
+        // LIMIT
+        REQUIRE(run(exec, "SELECT id FROM exectest LIMIT 1500") == 1500);
+        REQUIRE(
+            run(exec, "SELECT id FROM exectest WHERE grp = 1 LIMIT 7") == 7);
+
+        // 修改，删除
+        REQUIRE(
+            run(exec, "UPDATE exectest SET name = 'x' WHERE grp = 9") == 300);
+        REQUIRE(run(exec, "SELECT id FROM exectest WHERE name = 'x'") == 300);
+        REQUIRE(run(exec, "DELETE FROM exectest WHERE id >= 2500") == 500);
+        REQUIRE(run(exec, "SELECT id FROM exectest") == 2500);
+
+        // 不分组的聚集
+        Table *table = exec.open("exectest");
+        REQUIRE(table);
+        std::vector<unsigned int> fields;
+        fields.push_back(0);
+        fields.push_back(1);
+        std::vector<Aggregation> aggs;
+        aggs.push_back(Aggregation(AGG_COUNT));
+        aggs.push_back(Aggregation(AGG_SUM, 0));
+        aggs.push_back(Aggregation(AGG_MIN, 0));
+        aggs.push_back(Aggregation(AGG_MAX, 1));
+        std::unique_ptr<Operator> root(new Scan(table, fields));
+        root.reset(new Aggregate(std::move(root), aggs));
+        Batch batch;
+        REQUIRE(root->next(batch));
+        REQUIRE(batch.rows == 1);
+        REQUIRE(batch.columns[0].ints[0] == 2500);
+        REQUIRE(batch.columns[1].ints[0] == 2499LL * 2500 / 2);
+        REQUIRE(batch.columns[2].ints[0] == 0);
+        REQUIRE(batch.columns[3].ints[0] == 9);
+        REQUIRE(!root->next(batch));
+    }
+
+    SECTION("longkey")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE longkeytest (k VARCHAR(2000) PRIMARY KEY, v INT)",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM longkeytest");
+        Table *table = exec.open("longkeytest");
+        REQUIRE(table);
+        long long records = table->recordCount();
+
+        // b+树放得下的最长键可以插入，也能按键找到
+        std::string key(BPT_MAXKEY, 'k');
+        std::string text = "INSERT INTO longkeytest VALUES ('" + key + "', 1)";
+        REQUIRE(run(exec, text.c_str()) == 1);
+        text = "SELECT v FROM longkeytest WHERE k = '" + key + "'";
+        REQUIRE(run(exec, text.c_str()) == 1);
+
+        // 再长的键b+树放不下，不能插进block
+        key.append("k");
+        text = "INSERT INTO longkeytest VALUES ('" + key + "', 2)";
+        REQUIRE(sql.prepare(text.c_str(), plan) == S_OK);
+        REQUIRE(exec.execute(plan, Executor::Visitor()) == EINVAL);
+        REQUIRE(table->recordCount() == records + 1);
+        REQUIRE(run(exec, "SELECT v FROM longkeytest") == 1);
+    }
+
+    SECTION("unsigned")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE unsignedtest (id INT PRIMARY KEY, small TINYINT)",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM unsignedtest");
+
+        // 整数都是无符号的，负数字面值越界，插入和条件中都不接受
+        REQUIRE(
+            sql.prepare("INSERT INTO unsignedtest VALUES (-1, 0)", plan) ==
+            EINVAL);
+        REQUIRE(
+            sql.prepare("INSERT INTO unsignedtest VALUES (1, -1)", plan) ==
+            EINVAL);
+        REQUIRE(
+            sql.prepare("SELECT id FROM unsignedtest WHERE id > -1", plan) ==
+            EINVAL);
+        REQUIRE(run(exec, "SELECT id FROM unsignedtest") == 0);
+
+        // 高位为1的值原样读回，并排在较小的值后面
+        REQUIRE(
+            run(exec, "INSERT INTO unsignedtest VALUES (4294967295, 255)") ==
+            1);
+        REQUIRE(
+            run(exec, "INSERT INTO unsignedtest VALUES (2147483648, 128)") ==
+            1);
+        REQUIRE(run(exec, "INSERT INTO unsignedtest VALUES (7, 1)") == 1);
+        std::vector<long long> ids, smalls;
+        run(exec,
+            "SELECT id, small FROM unsignedtest ORDER BY small DESC",
+            [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    ids.push_back(batch.columns[0].ints[batch.row(i)]);
+                    smalls.push_back(batch.columns[1].ints[batch.row(i)]);
+                }
+            });
+        REQUIRE(ids.size() == 3);
+        REQUIRE(ids[0] == 4294967295LL);
+        REQUIRE(ids[1] == 2147483648LL);
+        REQUIRE(ids[2] == 7);
+        REQUIRE(smalls[0] == 255);
+        REQUIRE(smalls[1] == 128);
+        REQUIRE(smalls[2] == 1);
+
+        // 过滤和聚集都按无符号比较
+        REQUIRE(
+            run(exec, "SELECT id FROM unsignedtest WHERE small > 127") == 2);
+        REQUIRE(
+            run(exec,
+                "SELECT id FROM unsignedtest WHERE id >= 2147483648") == 2);
+        REQUIRE(
+            run(exec, "SELECT id FROM unsignedtest WHERE small < 128") == 1);
+        long long least = 0, most = 0;
+        run(exec,
+            "SELECT MIN(small), MAX(id) FROM unsignedtest",
+            [&](Batch &batch) {
+                least = batch.columns[0].ints[batch.row(0)];
+                most = batch.columns[1].ints[batch.row(0)];
+            });
+        REQUIRE(least == 1);
+        REQUIRE(most == 4294967295LL);
+        most = 0;
+        run(exec,
+            "SELECT small, MAX(id) FROM unsignedtest GROUP BY small",
+            [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i)
+                    most = std::max(most, batch.columns[1].ints[batch.row(i)]);
+            });
+        REQUIRE(most == 4294967295LL);
+    }
+
+    SECTION("relocate")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE relocatetest (id INT PRIMARY KEY, "
+                "name VARCHAR(64))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM relocatetest");
+        char text[128];
+        for (int i = 0; i < 600; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO relocatetest VALUES (%d, 'n%d')",
+                i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+
+        // 变长字段变长后本块放不下，记录移到别处，记录数不变
+        Table *table = exec.open("relocatetest");
+        REQUIRE(table);
+        long long records = table->recordCount();
+        REQUIRE(
+            run(exec,
+                "UPDATE relocatetest SET name = "
+                "'abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuv'") ==
+            600);
+        REQUIRE(table->recordCount() == records);
+        REQUIRE(run(exec, "SELECT id FROM relocatetest") == 600);
+
+        // 删除不存在的键不改统计
+        unsigned int key = htobe32(1000);
+        unsigned int blkid = table->locate(&key, sizeof(key));
+        REQUIRE(table->remove(blkid, &key, sizeof(key)) == S_FALSE);
+        REQUIRE(table->recordCount() == records);
+    }
+
+    SECTION("group")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+
+        // 接着select中的数据，id在[0, 2500)，name = 'x'的是grp = 9的行
+        std::vector<long long> counts(10, 0), sums(10, 0), maxs(10, 0);
+        size_t groups = run(
+            exec,
+            "SELECT COUNT(*), grp, SUM(id), MAX(id) FROM exectest GROUP BY grp",
+            [&](Batch &batch) {
+                REQUIRE(batch.columns.size() == 4);
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    size_t row = batch.row(i);
+                    long long grp = batch.columns[1].ints[row];
+                    REQUIRE((grp >= 0 && grp < 10));
+                    counts[grp] += batch.columns[0].ints[row];
+                    sums[grp] += batch.columns[2].ints[row];
+                    maxs[grp] = batch.columns[3].ints[row];
+                }
+            });
+        REQUIRE(groups == 10);
+        for (int g = 0; g < 10; ++g) {
+            REQUIRE(counts[g] == 250);
+            REQUIRE(sums[g] == 250LL * g + 10LL * 249 * 250 / 2);
+            REQUIRE(maxs[g] == 2490 + g);
+        }
+
+        // 字节串分组，带过滤和LIMIT
+        REQUIRE(
+            run(exec,
+                "SELECT name, COUNT(*) FROM exectest WHERE id < 1000 GROUP BY "
+                "name") == 901);
+        REQUIRE(
+            run(exec, "SELECT name FROM exectest GROUP BY name LIMIT 5") == 5);
+        size_t x = 0;
+        run(exec,
+            "SELECT name, MIN(id) FROM exectest WHERE id >= 1000 AND grp = 9 "
+            "GROUP BY name",
+            [&](Batch &batch) {
+                REQUIRE(batch.count() == 1);
+                size_t row = batch.row(0);
+                REQUIRE(batch.columns[0].lengths[row] == 1);
+                REQUIRE(batch.columns[0].data[row][0] == 'x');
+                REQUIRE(batch.columns[1].ints[row] == 1009);
+                ++x;
+            });
+        REQUIRE(x == 1);
+
+        // 内存不够时溢出到临时文件，结果不变
+        Table *table = exec.open("exectest");
+        REQUIRE(table);
+        std::vector<unsigned int> fields;
+        fields.push_back(0);
+        std::shared_ptr<Morsels> morsels(new Morsels(table, 1));
+        std::vector<std::unique_ptr<Operator>> children;
+        for (int w = 0; w < 3; ++w)
+            children.push_back(
+                std::unique_ptr<Operator>(new Scan(table, fields, morsels)));
+        std::vector<unsigned int> keys(1, 0);
+        std::vector<Aggregation> aggs(1, Aggregation(AGG_COUNT));
+        HashAggregate agg(
+            std::move(children), table->info_, keys, aggs, 3 * 4096);
+        Batch batch;
+        size_t total = 0;
+        std::vector<bool> seen(2500, false);
+        while (agg.next(batch)) {
+            for (size_t i = 0; i < batch.count(); ++i) {
+                long long id = batch.columns[0].ints[i];
+                REQUIRE((id >= 0 && id < 2500));
+                REQUIRE(!seen[id]);
+                seen[id] = true;
+                REQUIRE(batch.columns[1].ints[i] == 1);
+                ++total;
+            }
+        }
+        REQUIRE(total == 2500);
+        REQUIRE(agg.spilled() > 0);
+    }
+
+    SECTION("join")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        const char *creates[] = {
+            "CREATE TABLE execorder (oid INT PRIMARY KEY, cust INT, amount "
+            "INT)",
+            "CREATE TABLE execcust (cid INT PRIMARY KEY, cname VARCHAR(16))"};
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(sql.prepare(creates[i], plan) == S_OK);
+            int ret = exec.execute(plan, Executor::Visitor());
+            REQUIRE((ret == S_OK || ret == EEXIST));
+        }
+        run(exec, "DELETE FROM execorder");
+        run(exec, "DELETE FROM execcust");
+        // 订单表都是定长字段，与变长的客户表连接
+        REQUIRE(kSchema.lookup("execorder").first->second.recordFormat());
+        REQUIRE(!kSchema.lookup("execcust").first->second.recordFormat());
+
+        // 200个客户，3000个订单，cust >= 200的订单没有客户
+        char text[128];
+        for (int i = 0; i < 200; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO execcust VALUES (%d, 'c%d')",
+                i,
+                i);
+            run(exec, text);
+        }
+        for (int i = 0; i < 3000; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO execorder VALUES (%d, %d, %d)",
+                i,
+                i % 250,
+                i);
+            run(exec, text);
+        }
+
+        // hash连接，客户表小，用来建hash表
+        REQUIRE(
+            sql.prepare(
+                "SELECT oid, cname FROM execorder JOIN execcust ON cust = cid",
+                plan) == S_OK);
+        REQUIRE(plan.join == JOIN_HASH);
+        REQUIRE(!plan.buildLeft);
+        size_t rows = 0;
+        bool matched = true;
+        REQUIRE(exec.execute(plan, [&](Batch &batch) {
+            for (size_t i = 0; i < batch.count(); ++i) {
+                size_t row = batch.row(i);
+                snprintf(
+                    text,
+                    sizeof(text),
+                    "c%lld",
+                    batch.columns[0].ints[row] % 250);
+                std::string cname(
+                    (const char *) batch.columns[1].data[row],
+                    batch.columns[1].lengths[row]);
+                if (cname != text) matched = false;
+                ++rows;
+            }
+        }) == S_OK);
+        REQUIRE(rows == 2400);
+        REQUIRE(matched);
+
+        // 两边的条件和连接之后的聚集
+        long long count = 0, sum = 0;
+        run(exec,
+            "SELECT COUNT(*), SUM(amount) FROM execorder JOIN execcust ON "
+            "execorder.cust = execcust.cid WHERE cid < 10 AND oid >= 500",
+            [&](Batch &batch) {
+                count = batch.columns[0].ints[0];
+                sum = batch.columns[1].ints[0];
+            });
+        long long expect = 0;
+        for (int i = 500; i < 3000; ++i)
+            if (i % 250 < 10) expect += i;
+        REQUIRE(count == 100);
+        REQUIRE(sum == expect);
+        REQUIRE(
+            run(exec,
+                "SELECT cname, COUNT(*) FROM execorder JOIN execcust ON cust "
+                "= cid GROUP BY cname") == 200);
+
+        // 按主键连接用归并连接，输出按键有序
+        REQUIRE(
+            sql.prepare(
+                "SELECT oid, cname FROM execorder JOIN execcust ON oid = cid "
+                "ORDER BY oid",
+                plan) == S_OK);
+        REQUIRE(plan.join == JOIN_MERGE);
+        long long last = -1;
+        bool ordered = true;
+        rows = 0;
+        REQUIRE(exec.execute(plan, [&](Batch &batch) {
+            for (size_t i = 0; i < batch.count(); ++i) {
+                long long oid = batch.columns[0].ints[batch.row(i)];
+                if (oid <= last) ordered = false;
+                last = oid;
+                ++rows;
+            }
+        }) == S_OK);
+        REQUIRE(rows == 200);
+        REQUIRE(ordered);
+
+        // build端超过内存上限时溢出
+        Table *orders = exec.open("execorder");
+        Table *custs = exec.open("execcust");
+        std::vector<unsigned int> of, cf;
+        of.push_back(0);
+        of.push_back(1);
+        cf.push_back(0);
+        cf.push_back(1);
+        HashJoin join(
+            std::unique_ptr<Operator>(new Scan(orders, of)),
+            std::unique_ptr<Operator>(new Scan(custs, cf)),
+            orders->info_,
+            custs->info_,
+            of,
+            cf,
+            1,
+            0,
+            true,
+            16 * 1024);
+        Batch batch;
+        rows = 0;
+        matched = true;
+        while (join.next(batch)) {
+            for (size_t i = 0; i < batch.count(); ++i) {
+                if (batch.columns[1].ints[i] != batch.columns[3].ints[i])
+                    matched = false;
+                ++rows;
+            }
+        }
+        REQUIRE(rows == 2400);
+        REQUIRE(matched);
+        REQUIRE(join.spilled() > 0);
+    }
+
+    SECTION("sort")
+    {
+        Executor exec;
+
+        // 接着select中的数据，按非键的字节串列排序
+        std::string last;
+        bool ordered = true;
+        size_t rows = run(
+            exec,
+            "SELECT id, name FROM exectest ORDER BY name",
+            [&](Batch &batch) {
+                REQUIRE(batch.columns.size() == 2);
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    size_t row = batch.row(i);
+                    std::string name(
+                        (const char *) batch.columns[1].data[row],
+                        batch.columns[1].lengths[row]);
+                    if (name < last) ordered = false;
+                    last = name;
+                }
+            });
+        REQUIRE(rows == 2500);
+        REQUIRE(ordered);
+        REQUIRE(last == "x");
+
+        // 键上的降序，top-N
+        long long expect = 2499;
+        rows = run(
+            exec, "SELECT id FROM exectest ORDER BY id DESC", [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i)
+                    if (batch.columns[0].ints[batch.row(i)] != expect--)
+                        ordered = false;
+            });
+        REQUIRE(rows == 2500);
+        REQUIRE(ordered);
+        rows = run(
+            exec,
+            "SELECT grp FROM exectest ORDER BY grp DESC LIMIT 25",
+            [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i)
+                    if (batch.columns[0].ints[batch.row(i)] != 9)
+                        ordered = false;
+            });
+        REQUIRE(rows == 25);
+        REQUIRE(ordered);
+
+        // 分组的结果按分组列排序
+        expect = 9;
+        rows = run(
+            exec,
+            "SELECT grp, COUNT(*) FROM exectest GROUP BY grp ORDER BY grp DESC",
+            [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    size_t row = batch.row(i);
+                    if (batch.columns[0].ints[row] != expect--) ordered = false;
+                    if (batch.columns[1].ints[row] != 250) ordered = false;
+                }
+            });
+        REQUIRE(rows == 10);
+        REQUIRE(ordered);
+
+        // 连接的结果排序，execorder和execcust来自join
+        last.clear();
+        rows = run(
+            exec,
+            "SELECT cname, oid FROM execorder JOIN execcust ON cust = cid "
+            "ORDER BY cname LIMIT 30",
+            [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    size_t row = batch.row(i);
+                    std::string cname(
+                        (const char *) batch.columns[0].data[row],
+                        batch.columns[0].lengths[row]);
+                    if (cname < last) ordered = false;
+                    last = cname;
+                }
+            });
+        REQUIRE(rows == 30);
+        REQUIRE(ordered);
+        REQUIRE(last == "c10");
+
+        // 内存不够时生成多个run，经buffer写入临时文件再归并
+        Table *table = exec.open("exectest");
+        REQUIRE(table);
+        std::vector<unsigned int> fields;
+        fields.push_back(0);
+        fields.push_back(2);
+        std::vector<bool> integers;
+        for (unsigned int f = 0; f < table->info_->count; ++f)
+            integers.push_back(isIntegerField(table->info_->fields[f]));
+        for (int pass = 0; pass < 2; ++pass) {
+            long long limit = pass ? 100 : -1;
+            std::shared_ptr<Morsels> morsels(new Morsels(table, 1));
+            std::vector<std::unique_ptr<Operator>> children;
+            for (int w = 0; w < 3; ++w)
+                children.push_back(
+                    std::unique_ptr<Operator>(new Scan(table, fields, morsels)));
+            Sort sort(
+                std::move(children), integers, fields, 2, true, limit, 3 * 8192);
+            Batch batch;
+            std::vector<bool> seen(2500, false);
+            last = "\xff";
+            rows = 0;
+            while (sort.next(batch)) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    long long id = batch.columns[0].ints[i];
+                    REQUIRE((id >= 0 && id < 2500));
+                    REQUIRE(!seen[id]);
+                    seen[id] = true;
+                    std::string name(
+                        (const char *) batch.columns[2].data[i],
+                        batch.columns[2].lengths[i]);
+                    if (name > last) ordered = false;
+                    last = name;
+                    ++rows;
+                }
+            }
+            REQUIRE(rows == (pass ? 100 : 2500));
+            REQUIRE(ordered);
+            REQUIRE(sort.spilled() > 1);
+        }
+    }
+
+    SECTION("cursor")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        Cursor cursor;
+
+        // 接着select中的数据，整批拉取，批不借用block
+        REQUIRE(sql.prepare("SELECT id, name FROM exectest", plan) == S_OK);
+        REQUIRE(exec.open(plan, cursor) == S_OK);
+        REQUIRE(cursor.active());
+        REQUIRE(cursor.next());
+        REQUIRE(cursor.batch().count() == BATCH_SIZE);
+        REQUIRE(cursor.batch().pins.empty());
+
+        // 暂停期间执行别的语句
+        REQUIRE(run(exec, "SELECT id FROM exectest WHERE grp = 3") == 250);
+
+        long long expect = 0;
+        char text[32];
+        bool matched = true;
+        do {
+            Batch &batch = cursor.batch();
+            REQUIRE(batch.pins.empty());
+            if (cursor.rows() < 2500) REQUIRE(batch.count() == BATCH_SIZE);
+            for (size_t i = 0; i < batch.count(); ++i) {
+                size_t row = batch.row(i);
+                long long id = batch.columns[0].ints[row];
+                std::string name(
+                    (const char *) batch.columns[1].data[row],
+                    batch.columns[1].lengths[row]);
+                snprintf(text, sizeof(text), "name%lld", id);
+                if (id != expect++ || (name != text && name != "x"))
+                    matched = false;
+            }
+        } while (cursor.next());
+        REQUIRE(matched);
+        REQUIRE(expect == 2500);
+        REQUIRE(cursor.rows() == 2500);
+        REQUIRE(!cursor.active());
+        REQUIRE(!cursor.next());
+
+        // 提前关闭
+        REQUIRE(
+            sql.prepare("SELECT name FROM exectest WHERE id >= 100", plan) ==
+            S_OK);
+        REQUIRE(exec.open(plan, cursor) == S_OK);
+        REQUIRE(cursor.next());
+        REQUIRE(cursor.rows() > 0);
+        REQUIRE(cursor.rows() <= BATCH_SIZE);
+        cursor.close();
+        REQUIRE(!cursor.active());
+
+        // 排序和分组的结果同样可以拉取
+        REQUIRE(
+            sql.prepare(
+                "SELECT grp, COUNT(*) FROM exectest GROUP BY grp ORDER BY grp",
+                plan) == S_OK);
+        REQUIRE(exec.open(plan, cursor) == S_OK);
+        size_t groups = 0;
+        while (cursor.next())
+            groups += cursor.batch().count();
+        REQUIRE(groups == 10);
+
+        // 其它语句直接执行，不打开游标
+        size_t affected = 0;
+        REQUIRE(
+            sql.prepare(
+                "UPDATE exectest SET grp = 3 WHERE id = 7", plan) == S_OK);
+        REQUIRE(exec.open(plan, cursor, &affected) == S_OK);
+        REQUIRE(affected == 1);
+        REQUIRE(!cursor.active());
+    }
+
+    SECTION("writers")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE writertest (id INT PRIMARY KEY, pad CHAR(200))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM writertest");
+
+        // 偶数键是不动的记录，增删只用奇数键
+        const int total = 6000;
+        char text[128];
+        for (int i = 0; i < total; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO writertest VALUES (%d, 'w%d')",
+                i * 2,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+
+        // 游标停在原处时，插入让当前和后面的block分裂，删除让后面的合并回收
+        Cursor cursor;
+        REQUIRE(sql.prepare("SELECT id, pad FROM writertest", plan) == S_OK);
+        REQUIRE(exec.open(plan, cursor) == S_OK);
+        REQUIRE(cursor.next());
+        std::vector<long long> ids;
+        Batch *batch = &cursor.batch();
+        for (size_t i = 0; i < batch->count(); ++i)
+            ids.push_back(batch->columns[0].ints[batch->row(i)]);
+        long long last = ids.back();
+        Table *table = exec.open("writertest");
+        unsigned int blocks = table->dataCount();
+        for (long long id = last - 301; id < last + 3000; id += 2) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO writertest VALUES (%lld, 'o')",
+                id);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table->dataCount() > blocks);
+        for (long long id = last + 1; id < last + 3000; id += 2) {
+            snprintf(
+                text,
+                sizeof(text),
+                "DELETE FROM writertest WHERE id = %lld",
+                id);
+            REQUIRE(run(exec, text) == 1);
+        }
+
+        // 拉取的同时另一个线程不停地增删
+        std::atomic<bool> stop(false);
+        std::atomic<int> errors(0);
+        std::thread writer([&]() {
+            Executor local;
+            SQL parser;
+            Plan statement;
+            char buf[128];
+            for (int n = 0; !stop.load(); n = (n + 1) % total) {
+                snprintf(
+                    buf,
+                    sizeof(buf),
+                    "INSERT INTO writertest VALUES (%d, 'o')",
+                    n * 2 + 1);
+                // 前面留下的奇数键已经存在
+                int ret = parser.prepare(buf, statement);
+                if (ret == S_OK)
+                    ret = local.execute(statement, Executor::Visitor());
+                if (ret != S_OK && ret != EEXIST) ++errors;
+                snprintf(
+                    buf,
+                    sizeof(buf),
+                    "DELETE FROM writertest WHERE id = %d",
+                    (n + total - 30) % total * 2 + 1);
+                if (parser.prepare(buf, statement) ||
+                    local.execute(statement, Executor::Visitor()))
+                    ++errors;
+            }
+        });
+        while (cursor.next()) {
+            batch = &cursor.batch();
+            REQUIRE(batch->pins.empty());
+            for (size_t i = 0; i < batch->count(); ++i)
+                ids.push_back(batch->columns[0].ints[batch->row(i)]);
+            std::this_thread::yield();
+        }
+
+        // 排序的游标在第1批中读完输入，并行扫描不与增删交错
+        REQUIRE(
+            sql.prepare("SELECT id FROM writertest ORDER BY pad", plan) ==
+            S_OK);
+        REQUIRE(exec.open(plan, cursor) == S_OK);
+        int sorted = 0;
+        while (cursor.next()) {
+            batch = &cursor.batch();
+            for (size_t i = 0; i < batch->count(); ++i)
+                if (batch->columns[0].ints[batch->row(i)] % 2 == 0) ++sorted;
+        }
+        REQUIRE(sorted == total);
+        stop.store(true);
+        writer.join();
+        REQUIRE(errors.load() == 0);
+
+        // 按键严格递增，不动的记录都恰好读到一次
+        bool ordered = true;
+        int evens = 0;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i && ids[i] <= ids[i - 1]) ordered = false;
+            if (ids[i] % 2 == 0) ++evens;
+        }
+        REQUIRE(ordered);
+        REQUIRE(evens == total);
+        run(exec, "DELETE FROM writertest");
+    }
+
+    SECTION("view")
+    {
+        // 按主键点查，直接引用block中的记录
+        Table table;
+        REQUIRE(table.open("exectest") == S_OK);
+        RowView row;
+        unsigned int id = htobe32(1234);
+        REQUIRE(table.view(&id, sizeof(id), row) == S_OK);
+        REQUIRE(row.valid());
+        REQUIRE(row.isactive());
+        REQUIRE(row.count() == 3);
+        REQUIRE(row.length(0) == sizeof(id));
+        REQUIRE(memcmp(row.data(0), &id, sizeof(id)) == 0);
+        std::string name((const char *) row.data(2), row.length(2));
+        REQUIRE((name == "name1234" || name == "x"));
+
+        // 持有期间可以再查，之前的视图不受影响
+        RowView other;
+        unsigned int id2 = htobe32(7);
+        REQUIRE(table.view(&id2, sizeof(id2), other) == S_OK);
+        REQUIRE(memcmp(other.data(0), &id2, sizeof(id2)) == 0);
+        REQUIRE(memcmp(row.data(0), &id, sizeof(id)) == 0);
+
+        // 不存在的键
+        unsigned int missing = htobe32(100000);
+        REQUIRE(table.view(&missing, sizeof(missing), row) == ENOENT);
+        REQUIRE(!row.valid());
+    }
+
+    SECTION("overflow")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE overflowtest (id INT PRIMARY KEY, grp TINYINT, "
+                "body VARCHAR(65536))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM overflowtest");
+
+        char text[128];
+        for (int i = 2; i <= 50; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO overflowtest VALUES (%d, %d, 'small')",
+                i,
+                i % 3);
+            REQUIRE(run(exec, text) == 1);
+        }
+        Table table;
+        REQUIRE(table.open("overflowtest") == S_OK);
+        unsigned int blocks = table.dataCount();
+
+        // 大字段超过一个block，存成三块的溢出链
+        std::string big(40000, 'a');
+        for (size_t i = 0; i < big.size(); ++i)
+            big[i] = (char) ('a' + i % 26);
+        std::string insert =
+            "INSERT INTO overflowtest VALUES (1, 1, '" + big + "')";
+        REQUIRE(run(exec, insert.c_str()) == 1);
+        REQUIRE(table.dataCount() == blocks + 3);
+
+        // 行内只留指针和位图
+        RowView row;
+        unsigned int id = htobe32(1);
+        REQUIRE(table.view(&id, sizeof(id), row) == S_OK);
+        REQUIRE(row.spanning());
+        REQUIRE(row.count() == 3);
+        REQUIRE(!row.overflowed(0));
+        REQUIRE(row.overflowed(2));
+        REQUIRE(row.length(2) == OVERFLOW_POINTER);
+        REQUIRE(overflowLength(row.data(2)) == big.size());
+        std::string value(overflowLength(row.data(2)), '\0');
+        REQUIRE(table.fetch(row.data(2), (unsigned char *) &value[0]) == S_OK);
+        REQUIRE(value == big);
+
+        // 溢出链损坏时，不投影大字段的扫描不受影响
+        BufDesp *desp = kBuffer.borrow(table.id_, overflowBlock(row.data(2)));
+        MetaBlock block;
+        block.attach(desp->buffer);
+        block.setType(BLOCK_TYPE_IDLE);
+        REQUIRE(run(exec, "SELECT id, grp FROM overflowtest") == 50);
+        size_t length = 1;
+        run(exec, "SELECT body FROM overflowtest WHERE id = 1", [&](Batch &b) {
+            length = b.columns[0].lengths[b.row(0)];
+        });
+        REQUIRE(length == 0);
+        block.setType(BLOCK_TYPE_OVERFLOW);
+        block.detach();
+        kBuffer.releaseBuf(desp);
+        row.release();
+
+        std::string body;
+        run(exec, "SELECT body FROM overflowtest WHERE id = 1", [&](Batch &b) {
+            const ColumnVector &column = b.columns[0];
+            size_t r = b.row(0);
+            body.assign((const char *) column.data[r], column.lengths[r]);
+        });
+        REQUIRE(body == big);
+
+        // 改成短值和删除时溢出链都被回收
+        REQUIRE(
+            run(exec, "UPDATE overflowtest SET grp = 2 WHERE id = 1") == 1);
+        REQUIRE(table.dataCount() == blocks + 3);
+        REQUIRE(
+            run(exec, "UPDATE overflowtest SET body = 'x' WHERE id = 1") == 1);
+        REQUIRE(table.dataCount() == blocks);
+        REQUIRE(table.view(&id, sizeof(id), row) == S_OK);
+        REQUIRE(!row.spanning());
+        REQUIRE(row.length(2) == 1);
+        row.release();
+        REQUIRE(run(exec, "DELETE FROM overflowtest WHERE id = 1") == 1);
+        REQUIRE(run(exec, insert.c_str()) == 1);
+        REQUIRE(run(exec, "DELETE FROM overflowtest WHERE id = 1") == 1);
+        REQUIRE(table.dataCount() == blocks);
+        REQUIRE(run(exec, "SELECT id FROM overflowtest") == 49);
+    }
+
+    SECTION("merge")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE mergetest (id INT PRIMARY KEY, pad CHAR(200))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM mergetest");
+
+        char text[128];
+        for (int i = 0; i < 2000; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO mergetest VALUES (%d, 'm%d')",
+                i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        Table table;
+        REQUIRE(table.open("mergetest") == S_OK);
+        unsigned int blocks = table.dataCount();
+        unsigned int idles = table.idleCount();
+        REQUIRE(blocks > 20);
+
+        // 删掉中间的九成，稀疏的block与后继合并后回收
+        REQUIRE(
+            run(exec,
+                "DELETE FROM mergetest WHERE id >= 100 AND id < 1900") ==
+            1800);
+        REQUIRE(table.dataCount() * 4 < blocks);
+        REQUIRE(table.idleCount() == idles + blocks - table.dataCount());
+        unsigned int freed = table.idleCount();
+
+        // 剩下的记录有序，点查仍然找得到
+        long long last = -1;
+        bool ordered = true;
+        REQUIRE(
+            run(exec, "SELECT id FROM mergetest", [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    long long id = batch.columns[0].ints[batch.row(i)];
+                    if (id <= last) ordered = false;
+                    last = id;
+                }
+            }) == 200);
+        REQUIRE(ordered);
+        REQUIRE(run(exec, "SELECT pad FROM mergetest WHERE id = 1950") == 1);
+        REQUIRE(run(exec, "SELECT pad FROM mergetest WHERE id = 50") == 1);
+
+        // 再插入时先用空闲块
+        for (int i = 100; i < 1000; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO mergetest VALUES (%d, 'n%d')",
+                i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table.idleCount() < freed);
+        REQUIRE(run(exec, "SELECT id FROM mergetest WHERE id >= 0") == 1100);
+
+        // 从尾部逐条删除，尾部block没有后继，与前驱合并或从前驱借记录
+        blocks = table.dataCount();
+        for (int i = 1999; i >= 600; --i) {
+            if (i == 1899) i = 999;
+            snprintf(
+                text, sizeof(text), "DELETE FROM mergetest WHERE id = %d", i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table.dataCount() < blocks);
+        unsigned int tail = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi)
+            tail = bi->getUsedSize();
+        REQUIRE(tail >= MERGE_THRESHOLD);
+        REQUIRE(run(exec, "SELECT id FROM mergetest WHERE id >= 0") == 600);
+    }
+
+    SECTION("compact")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE compacttest (id INT PRIMARY KEY, pad CHAR(200), "
+                "body VARCHAR(40000))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM compacttest");
+
+        // 乱序插入，删掉一部分再插入，数据链在文件中来回跳
+        char text[128];
+        for (int i = 0; i < 3000; ++i) {
+            int id = (i * 7919) % 3000;
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO compacttest VALUES (%d, 'c%d', 'b')",
+                id,
+                id);
+            REQUIRE(run(exec, text) == 1);
+        }
+        run(exec, "DELETE FROM compacttest WHERE id >= 500 AND id < 2000");
+        for (int i = 500; i < 1000; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO compacttest VALUES (%d, 'd%d', 'b')",
+                i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        std::string big(20000, 'z');
+        std::string insert =
+            "INSERT INTO compacttest VALUES (5000, 'big', '" + big + "')";
+        REQUIRE(run(exec, insert.c_str()) == 1);
+
+        // 分批整理，批之间穿插前台的修改
+        Table *table = exec.open("compacttest");
+        REQUIRE(table != NULL);
+        int batches = 0;
+        size_t held = 0;
+        while (true) {
+            {
+                std::lock_guard<RWLatch> guard(table->latch_);
+                ret = table->compact(4);
+            }
+            if (ret != S_FALSE) break;
+            // 此时崩溃，从页上读回的映射中整理收回的block仍是空闲
+            FreeSpaceMap stored;
+            for (size_t i = 0; i < table->space_->pages(); ++i) {
+                BufDesp *desp =
+                    kBuffer.borrow(table->id_, table->space_->page(i));
+                stored.load(i, desp->buffer + sizeof(MetaHeader));
+                kBuffer.releaseBuf(desp);
+            }
+            held += table->compaction_.free.size();
+            REQUIRE(
+                stored.idles() ==
+                table->space_->idles() + table->compaction_.free.size());
+            snprintf(
+                text,
+                sizeof(text),
+                "UPDATE compacttest SET pad = 'u%d' WHERE id = %d",
+                batches,
+                batches * 3);
+            REQUIRE(run(exec, text) == 1);
+            ++batches;
+        }
+        REQUIRE(ret == S_OK);
+        REQUIRE(batches > 2);
+        REQUIRE(held > 0);
+
+        // 数据链按blockid递增，空闲块都截掉了
+        unsigned int last = 0;
+        unsigned int count = 0;
+        bool ascending = true;
+        for (Table::BlockIterator bi = table->beginblock();
+             bi != table->endblock();
+             ++bi) {
+            if (bi->getSelf() <= last) ascending = false;
+            last = bi->getSelf();
+            ++count;
+        }
+        REQUIRE(ascending);
+        REQUIRE(table->space_->idles() == 0);
+        REQUIRE(count + 2 + table->space_->pages() == table->maxid_);
+        unsigned long long length;
+        REQUIRE(kFiles.open(table->id_)->length(length) == S_OK);
+        REQUIRE(length == (table->maxid_ + 1ull) * BLOCK_SIZE + SUPER_SIZE);
+
+        // 记录和溢出链都还在，点查走b+树
+        REQUIRE(run(exec, "SELECT id FROM compacttest") == 2001);
+        REQUIRE(run(exec, "SELECT pad FROM compacttest WHERE id = 2999") == 1);
+        std::string pad;
+        run(exec, "SELECT pad FROM compacttest WHERE id = 3", [&](Batch &b) {
+            const ColumnVector &column = b.columns[0];
+            pad.assign((const char *) column.data[b.row(0)]);
+        });
+        REQUIRE(pad == "u1");
+        std::string body;
+        run(exec,
+            "SELECT body FROM compacttest WHERE id = 5000",
+            [&](Batch &b) {
+                const ColumnVector &column = b.columns[0];
+                size_t r = b.row(0);
+                body.assign((const char *) column.data[r], column.lengths[r]);
+            });
+        REQUIRE(body == big);
+    }
+
+    SECTION("fsm")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE fsmtest (id INT PRIMARY KEY, pad CHAR(200))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM fsmtest");
+
+        // 顺序插入，分裂后除最后一块都只有一半
+        char text[128];
+        for (int i = 0; i < 300; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO fsmtest VALUES (%d, 'f%d')",
+                i * 100,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        Table *table = exec.open("fsmtest");
+        REQUIRE(table != NULL);
+        unsigned int blocks = table->dataCount();
+        int last;
+        {
+            Table::BlockIterator bi = table->beginblock();
+            Record record;
+            REQUIRE(bi->refslots(bi->getSlots() - 1, record));
+            unsigned char *pkey;
+            unsigned int klen;
+            REQUIRE(record.refByIndex(&pkey, &klen, 0));
+            unsigned int key;
+            memcpy(&key, pkey, sizeof(key));
+            last = (int) be32toh(key);
+        }
+
+        // 都插在第1块末尾，第1块满了以后放到后继开头，不必分裂
+        for (int i = 1; i <= 60; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO fsmtest VALUES (%d, 'g%d')",
+                last + i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table->dataCount() == blocks);
+        long long previous = -1;
+        bool ordered = true;
+        REQUIRE(
+            run(exec, "SELECT id FROM fsmtest", [&](Batch &batch) {
+                for (size_t i = 0; i < batch.count(); ++i) {
+                    long long id = batch.columns[0].ints[batch.row(i)];
+                    if (id <= previous) ordered = false;
+                    previous = id;
+                }
+            }) == 360);
+        REQUIRE(ordered);
+        snprintf(
+            text,
+            sizeof(text),
+            "SELECT pad FROM fsmtest WHERE id = %d",
+            last + 60);
+        REQUIRE(run(exec, text) == 1);
+
+        // 合并回收的block记在映射中，再分配时先用最小的
+        REQUIRE(
+            run(exec, "DELETE FROM fsmtest WHERE id >= 10000 AND id < 25000") ==
+            150);
+        unsigned int idle = table->space_->findIdle();
+        REQUIRE(idle != 0);
+        for (int i = 0; i < 100; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO fsmtest VALUES (%d, 'h%d')",
+                40000 + i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table->space_->get(idle) != FSM_IDLE);
+        REQUIRE(run(exec, "SELECT id FROM fsmtest WHERE id >= 40000") == 100);
+    }
+
+    SECTION("checkpoint")
+    {
+        {
+            Executor exec;
+            SQL sql;
+            Plan plan;
+            REQUIRE(
+                sql.prepare(
+                    "CREATE TABLE ckpttest (id INT PRIMARY KEY, pad CHAR(200))",
+                    plan) == S_OK);
+            int ret = exec.execute(plan, Executor::Visitor());
+            REQUIRE((ret == S_OK || ret == EEXIST));
+            run(exec, "DELETE FROM ckpttest");
+            char text[128];
+            for (int i = 0; i < 300; ++i) {
+                snprintf(
+                    text,
+                    sizeof(text),
+                    "INSERT INTO ckpttest VALUES (%d, 'c%d')",
+                    i,
+                    i);
+                REQUIRE(run(exec, text) == 1);
+            }
+        }
+
+        // 执行器析构时统计写回超块，刷盘后文件中的超块与内存一致；
+        // 只刷这张表，其它表和目录不落盘，重复运行时不受影响
+        Table *table = Table::shared("ckpttest");
+        REQUIRE(table != NULL);
+        REQUIRE(table->recordCount() == 300);
+        REQUIRE(kBuffer.flush(table->id_) == S_OK);
+        std::vector<char> raw(SUPER_SIZE);
+        REQUIRE(
+            kFiles.open(table->id_)->read(0, raw.data(), SUPER_SIZE) == S_OK);
+        SuperBlock super;
+        super.attach((unsigned char *) raw.data());
+        REQUIRE(super.getRecords() == 300);
+        REQUIRE(super.getDataCounts() == table->dataCount());
+        REQUIRE(super.getIdleCounts() == table->idleCount());
+        super.detach();
+
+        // 没有checkpoint，超块写回时也带上内存中的统计
+        Executor exec;
+        REQUIRE(run(exec, "INSERT INTO ckpttest VALUES (300, 'c300')") == 1);
+        REQUIRE(kBuffer.flush(table->id_) == S_OK);
+        REQUIRE(
+            kFiles.open(table->id_)->read(0, raw.data(), SUPER_SIZE) == S_OK);
+        super.attach((unsigned char *) raw.data());
+        REQUIRE(super.getRecords() == 301);
+        super.detach();
+    }
+
+    SECTION("extent")
+    {
+        Executor exec;
+        SQL sql;
+        Plan plan;
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE extenttest (id INT PRIMARY KEY, pad CHAR(200))",
+                plan) == S_OK);
+        int ret = exec.execute(plan, Executor::Visitor());
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        run(exec, "DELETE FROM extenttest");
+
+        Table *table = exec.open("extenttest");
+        REQUIRE(table != NULL);
+        REQUIRE(table->setExtent(BLOCK_SIZE * 4 + 1) == EINVAL);
+        REQUIRE(table->setExtent(EXTENT_MAX + BLOCK_SIZE) == EINVAL);
+        REQUIRE(table->setExtent(BLOCK_SIZE * 4) == S_OK);
+
+        // 插到文件扩展到已预分配的范围之外为止
+        unsigned int reserved;
+        {
+            SuperBlock super;
+            BufDesp *desp = kBuffer.borrow(table->id_, 0);
+            super.attach(desp->buffer);
+            reserved = std::max(super.getReserved(), table->maxid_);
+            super.detach();
+            kBuffer.releaseBuf(desp);
+        }
+        char text[128];
+        for (int i = 0; i < 5000 && table->maxid_ <= reserved; ++i) {
+            snprintf(
+                text,
+                sizeof(text),
+                "INSERT INTO extenttest VALUES (%d, 'e%d')",
+                i,
+                i);
+            REQUIRE(run(exec, text) == 1);
+        }
+        REQUIRE(table->maxid_ == reserved + 1);
+
+        // 一次预分配4个block，之后的3个block不再扩展文件
+        SuperBlock super;
+        BufDesp *desp = kBuffer.borrow(table->id_, 0);
+        super.attach(desp->buffer);
+        REQUIRE(super.getExtent() == 4);
+        REQUIRE(super.getReserved() == table->maxid_ + 3);
+        super.detach();
+        kBuffer.releaseBuf(desp);
+        unsigned long long length;
+        REQUIRE(kFiles.open(table->id_)->length(length) == S_OK);
+        REQUIRE(length >= (table->maxid_ + 4ull) * BLOCK_SIZE + SUPER_SIZE);
+
+        // 另一个Table的maxid_停在打开时，扩展时以超块为准，不会分出同一个block
+        Table other;
+        REQUIRE(other.open("extenttest") == S_OK);
+        std::vector<unsigned int> taken;
+        while (table->space_->idles())
+            taken.push_back(table->allocate());
+        unsigned int a = table->allocate();
+        unsigned int b = other.allocate();
+        REQUIRE(a == table->maxid_);
+        REQUIRE(b == a + 1);
+        REQUIRE(other.maxid_ == b);
+        taken.push_back(a);
+        taken.push_back(b);
+        for (size_t i = 0; i < taken.size(); ++i)
+            table->deallocate(taken[i]);
+    }
+}
@@ -72,6 +72,31 @@ TEST_CASE("db/file.h")
         file.close();
     }
 
+    SECTION("allocate")
+    {
+        File file;
+        file.open("table.db");
+
+        // 预分配延长文件，原有内容不变，新增部分读出为0
+        REQUIRE(file.allocate(4096, 8192) == S_OK);
+        unsigned long long len = 0;
+        REQUIRE(file.length(len) == S_OK);
+        REQUIRE(len == 4096 + 8192);
+        char buffer[20];
+        REQUIRE(file.read(0, buffer, strlen(hello)) == S_OK);
+        REQUIRE(strncmp(buffer, hello, strlen(hello)) == 0);
+        REQUIRE(file.read(8000, buffer, sizeof(buffer)) == S_OK);
+        REQUIRE(buffer[0] == 0);
+        REQUIRE(buffer[sizeof(buffer) - 1] == 0);
+
+        // 已有的范围不缩短文件
+        REQUIRE(file.allocate(0, 100) == S_OK);
+        REQUIRE(file.length(len) == S_OK);
+        REQUIRE(len == 4096 + 8192);
+
+        file.close();
+    }
+
     SECTION("remove")
     {
         int ret = File::remove("table.db");
@@ -82,5 +107,10 @@ TEST_CASE("db/file.h")
     {
         File *meta = kFiles.open(Schema::META_FILE);
         REQUIRE(meta);
+        // 不同指针的同名表打开的是同一个文件
+        std::string name(Schema::META_FILE);
+        REQUIRE(kFiles.open(name.c_str()) == meta);
+        REQUIRE(kFiles.open(Schema::META_ID) == meta);
+        REQUIRE(kFiles.find(Schema::META_ID) == meta);
     }
 }
\ No newline at end of file
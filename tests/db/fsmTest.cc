@@ -0,0 +1,78 @@
+////
+// @file fsmTest.cc
+// @brief
+// 测试空闲空间映射
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <vector>
+#include <db/fsm.h>
+using namespace db;
+
+TEST_CASE("db/fsm.h")
+{
+    SECTION("idle")
+    {
+        FreeSpaceMap map;
+        map.resize(100);
+        REQUIRE(map.findIdle() == 0);
+        REQUIRE(map.idles() == 0);
+
+        // 总是先找到最小的空闲块
+        map.set(70, FSM_IDLE);
+        map.set(30, FSM_IDLE);
+        REQUIRE(map.findIdle() == 30);
+        REQUIRE(map.findIdle(31) == 70);
+        REQUIRE(map.findIdle(71) == 0);
+        REQUIRE(map.idles() == 2);
+        map.set(30, 5);
+        REQUIRE(map.findIdle() == 70);
+        REQUIRE(map.idles() == 1);
+
+        // 截掉尾部的空闲块
+        map.resize(50);
+        REQUIRE(map.findIdle() == 0);
+        REQUIRE(map.idles() == 0);
+        REQUIRE(map.get(70) == 0);
+    }
+
+    SECTION("pages")
+    {
+        // 跨页时按摘要跳过没有空闲块的页
+        FreeSpaceMap map;
+        map.set(FSM_ENTRIES * 2 + 9, FSM_IDLE);
+        REQUIRE(map.size() == FSM_ENTRIES * 2 + 10);
+        REQUIRE(map.findIdle() == FSM_ENTRIES * 2 + 9);
+        map.set(FSM_ENTRIES + 1, FSM_IDLE);
+        REQUIRE(map.findIdle() == FSM_ENTRIES + 1);
+        REQUIRE(map.findIdle(FSM_ENTRIES + 2) == FSM_ENTRIES * 2 + 9);
+
+        // 写出再读入
+        std::vector<unsigned char> page(FSM_ENTRIES);
+        FreeSpaceMap copy;
+        for (size_t i = 0; i < 3; ++i) {
+            map.store(i, &page[0]);
+            copy.load(i, &page[0]);
+        }
+        copy.resize(map.size());
+        REQUIRE(copy.idles() == 2);
+        REQUIRE(copy.findIdle() == FSM_ENTRIES + 1);
+        REQUIRE(copy.get(FSM_ENTRIES * 2 + 9) == FSM_IDLE);
+    }
+
+    SECTION("room")
+    {
+        FreeSpaceMap map;
+        map.set(1, FreeSpaceMap::encode(FSM_UNIT * 3 + 1));
+        REQUIRE(map.get(1) == 3);
+        REQUIRE(map.room(1, FSM_UNIT * 3));
+        REQUIRE(!map.room(1, FSM_UNIT * 3 + 1));
+        // 空闲块和超出范围的block都放不下
+        map.set(2, FSM_IDLE);
+        REQUIRE(!map.room(2, 1));
+        REQUIRE(!map.room(100, 1));
+        REQUIRE(FreeSpaceMap::encode(BLOCK_SIZE * 2) == FSM_IDLE - 1);
+    }
+}
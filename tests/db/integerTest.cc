@@ -7,6 +7,7 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include <vector>
 #include <db/integer.h>
 using namespace db;
 
@@ -93,4 +94,71 @@ TEST_CASE("db/integer.h")
         REQUIRE(it.decode((char *) &x4, 8));
         REQUIRE(it.get() == 0x40000000);
     }
+
+    SECTION("batch")
+    {
+        // 各种长度混合，含连续的1字节和2字节整数
+        std::vector<unsigned long long> values;
+        for (unsigned long long i = 0; i < 40; ++i)
+            values.push_back(i + 1);
+        for (unsigned long long i = 0; i < 20; ++i)
+            values.push_back(0x100 + i * 0x1F3);
+        values.push_back(0x4000);
+        values.push_back(0x40000000);
+        values.push_back(0x3F);
+        for (unsigned long long i = 0; i < 10; ++i)
+            values.push_back(0x3FFF - i);
+        values.push_back(0);
+
+        char buf[512];
+        size_t bytes = Integer::encodeBatch(
+            values.data(), values.size(), buf, sizeof(buf));
+        size_t expect = 0;
+        Integer it;
+        for (size_t i = 0; i < values.size(); ++i) {
+            it.set(values[i]);
+            expect += it.size();
+        }
+        REQUIRE(bytes == expect);
+        REQUIRE(
+            Integer::encodeBatch(values.data(), values.size(), buf, 8) == 0);
+
+        // 整串解码，与逐个解码一致
+        std::vector<unsigned long long> out(values.size() + 16);
+        size_t used = 0;
+        size_t count = Integer::decodeBatch(
+            buf, bytes, out.data(), out.size(), &used);
+        REQUIRE(count == values.size());
+        REQUIRE(used == bytes);
+        bool matched = true;
+        for (size_t i = 0; i < values.size(); ++i)
+            if (out[i] != values[i]) matched = false;
+        REQUIRE(matched);
+
+        // 解码到第一个0为止，后面的字节不管
+        buf[bytes] = 5;
+        count = Integer::decodeBatch(
+            buf, bytes + 1, out.data(), out.size(), &used, true);
+        REQUIRE(count == values.size());
+        REQUIRE(used == bytes);
+        // 1字节整数中间的0
+        char ones[32];
+        for (int i = 0; i < 32; ++i)
+            ones[i] = (char) (i == 20 ? 0 : i + 1);
+        count = Integer::decodeBatch(
+            ones, sizeof(ones), out.data(), out.size(), &used, true);
+        REQUIRE(count == 21);
+        REQUIRE(used == 21);
+        REQUIRE(out[19] == 20);
+        REQUIRE(out[20] == 0);
+        // 没有0或者max不够
+        REQUIRE(
+            Integer::decodeBatch(
+                buf, 40, out.data(), out.size(), &used, true) == 0);
+        REQUIRE(Integer::decodeBatch(buf, bytes, out.data(), 10, &used) == 10);
+        REQUIRE(used == 10);
+
+        // 截断的整数
+        REQUIRE(Integer::decodeBatch(buf, 41, out.data(), 64, &used) == 0);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+////
+// @file latchTest.cc
+// @brief
+// 测试读写latch
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <db/latch.h>
+using namespace db;
+
+TEST_CASE("db/latch.h")
+{
+    SECTION("nested")
+    {
+        // 写者自己可以再加共享锁，释放排他锁时epoch加1
+        RWLatch latch;
+        REQUIRE(latch.epoch() == 0);
+        latch.lock();
+        {
+            SharedGuard guard(&latch);
+            SharedGuard again(&latch);
+        }
+        latch.unlock();
+        REQUIRE(latch.epoch() == 1);
+
+        // 读者可以重复加共享锁，共享锁不改epoch
+        latch.lock_shared();
+        latch.lock_shared();
+        latch.unlock_shared();
+        latch.unlock_shared();
+        REQUIRE(latch.epoch() == 1);
+        SharedGuard none(NULL);
+    }
+
+    SECTION("exclusive")
+    {
+        // 写者之间、写者与读者之间互斥
+        RWLatch latch;
+        long long value = 0;
+        std::atomic<int> errors(0);
+        std::vector<std::thread> threads;
+        for (int w = 0; w < 4; ++w)
+            threads.push_back(std::thread([&]() {
+                for (int i = 0; i < 2000; ++i) {
+                    std::lock_guard<RWLatch> guard(latch);
+                    long long v = value;
+                    value = v + 1;
+                }
+            }));
+        for (int r = 0; r < 4; ++r)
+            threads.push_back(std::thread([&]() {
+                for (int i = 0; i < 2000; ++i) {
+                    SharedGuard guard(&latch);
+                    long long v = value;
+                    std::this_thread::yield();
+                    if (value != v) ++errors;
+                }
+            }));
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        REQUIRE(value == 8000);
+        REQUIRE(errors.load() == 0);
+        REQUIRE(latch.epoch() == 8000);
+    }
+
+    SECTION("waiting")
+    {
+        // 有写者在等待时，持有共享锁的线程仍能再加，不会死锁
+        RWLatch latch;
+        latch.lock_shared();
+        std::atomic<bool> written(false);
+        std::thread writer([&]() {
+            std::lock_guard<RWLatch> guard(latch);
+            written.store(true);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        latch.lock_shared();
+        REQUIRE(!written.load());
+        latch.unlock_shared();
+        latch.unlock_shared();
+        writer.join();
+        REQUIRE(written.load());
+    }
+}
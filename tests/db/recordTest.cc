@@ -134,5 +134,179 @@ TEST_CASE("db/record.h")
         REQUIRE(bret);
         REQUIRE(memcmp(pb, &length, sizeof(length)) == 0);
         REQUIRE(l == 8);
+
+        // RowView引用记录时借用block
+        BufDesp desp;
+        desp.buffer = buffer;
+        desp.blockid = 3;
+        RowView row;
+        REQUIRE(!row.valid());
+        REQUIRE(row.attach(&desp, record));
+        REQUIRE(desp.ref == 1);
+        REQUIRE(row.valid());
+        REQUIRE(row.blockid() == 3);
+        REQUIRE(row.header() == header);
+        REQUIRE(row.count() == 4);
+        REQUIRE(row.data(0) == (const unsigned char *) iov3[0].iov_base);
+        REQUIRE(row.length(2) == strlen(hello) + 1);
+        REQUIRE(memcmp(row.data(3), &length, row.length(3)) == 0);
+        {
+            RowView copy(row);
+            REQUIRE(desp.ref == 2);
+            REQUIRE(copy.data(1) == row.data(1));
+            copy = copy;
+            REQUIRE(desp.ref == 2);
+        }
+        REQUIRE(desp.ref == 1);
+        row.release();
+        REQUIRE(desp.ref == 0);
+        REQUIRE(!row.valid());
+        REQUIRE(row.count() == 0);
+    }
+
+    SECTION("fixed")
+    {
+        // 定长格式：int 4B，char(10)，bigint 8B
+        std::vector<unsigned int> widths;
+        widths.push_back(4);
+        widths.push_back(10);
+        widths.push_back(8);
+        RecordFormat format;
+        REQUIRE(!format.init(widths, 16));
+        REQUIRE(format.init(widths, 64));
+        REQUIRE(format.length() == 23);
+
+        unsigned int id = 7;
+        char name[10] = "fixed";
+        unsigned long long big = 0x0102030405060708ULL;
+        std::vector<struct iovec> iov(3);
+        iov[0].iov_base = &id;
+        iov[0].iov_len = sizeof(id);
+        iov[1].iov_base = name;
+        iov[1].iov_len = sizeof(name);
+        iov[2].iov_base = &big;
+        iov[2].iov_len = sizeof(big);
+        REQUIRE(format.match(iov));
+        REQUIRE(Record::size(iov, &format) == 23);
+        REQUIRE(Record::size(iov) > 23); // 变长记录多出总长度和偏移数组
+
+        // 没有总长度和偏移数组，字段紧跟头部
+        unsigned char buffer[32];
+        Record record;
+        record.attach(buffer, 24, &format);
+        unsigned char header = 0;
+        REQUIRE(record.set(iov, &header));
+        REQUIRE(record.length_ == 24);
+        REQUIRE(record.length() == 23);
+        REQUIRE(record.fields() == 3);
+        REQUIRE(record.startOfFields() == 1);
+        REQUIRE(memcmp(buffer + 1, &id, sizeof(id)) == 0);
+        REQUIRE(memcmp(buffer + 5, name, sizeof(name)) == 0);
+        REQUIRE(memcmp(buffer + 15, &big, sizeof(big)) == 0);
+
+        // ref/refByIndex直接按格式定位
+        std::vector<struct iovec> iov2;
+        unsigned char header2;
+        REQUIRE(record.ref(iov2, &header2));
+        REQUIRE(iov2.size() == 3);
+        REQUIRE(iov2[1].iov_base == buffer + 5);
+        REQUIRE(iov2[1].iov_len == 10);
+        unsigned char *pb;
+        unsigned int l;
+        REQUIRE(record.refByIndex(&pb, &l, 2));
+        REQUIRE(pb == buffer + 15);
+        REQUIRE(l == 8);
+        REQUIRE(!record.refByIndex(&pb, &l, 3));
+
+        // get/getByIndex
+        unsigned long long big2 = 0;
+        l = 4;
+        REQUIRE(!record.getByIndex((char *) &big2, &l, 2)); // 空间不够
+        l = 8;
+        REQUIRE(record.getByIndex((char *) &big2, &l, 2));
+        REQUIRE(big2 == big);
+        unsigned int id2;
+        char name2[16];
+        iov2[0].iov_base = &id2;
+        iov2[0].iov_len = sizeof(id2);
+        iov2[1].iov_base = name2;
+        iov2[1].iov_len = sizeof(name2);
+        iov2[2].iov_base = &big2;
+        iov2[2].iov_len = sizeof(big2);
+        REQUIRE(record.get(iov2, &header2));
+        REQUIRE(id2 == id);
+        REQUIRE(iov2[1].iov_len == 10);
+        REQUIRE(strcmp(name2, "fixed") == 0);
+
+        // 长度与格式不符的不能写入
+        iov[1].iov_len = 5;
+        REQUIRE(!format.match(iov));
+        record.attach(buffer, 24, &format);
+        REQUIRE(!record.set(iov, &header));
+    }
+
+    SECTION("layout")
+    {
+        // 变长记录：3个字段，中间一个为空
+        const char *name = "layout";
+        unsigned int id = 42;
+        std::vector<struct iovec> iov(3);
+        iov[0].iov_base = &id;
+        iov[0].iov_len = sizeof(id);
+        iov[1].iov_base = (void *) name;
+        iov[1].iov_len = 0;
+        iov[2].iov_base = (void *) name;
+        iov[2].iov_len = strlen(name);
+        unsigned char buffer[64];
+        Record record;
+        record.attach(buffer, sizeof(buffer));
+        unsigned char header = 0;
+        REQUIRE(record.set(iov, &header));
+
+        RecordLayout layout;
+        REQUIRE(layout.decode(record));
+        REQUIRE(layout.count() == 3);
+        REQUIRE(layout.total() == Record::size(iov));
+        REQUIRE(layout.offset(0) == record.startOfFields());
+        REQUIRE(layout.length(0) == sizeof(id));
+        REQUIRE(memcmp(layout.data(0), &id, sizeof(id)) == 0);
+        REQUIRE(layout.length(1) == 0);
+        REQUIRE(layout.data(1) == layout.data(0) + sizeof(id));
+        REQUIRE(layout.length(2) == strlen(name));
+        REQUIRE(memcmp(layout.data(2), name, strlen(name)) == 0);
+
+        // 定长记录沿用偏移表，只换记录
+        std::vector<unsigned int> widths(2, 4);
+        RecordFormat format;
+        REQUIRE(format.init(widths, 64));
+        unsigned char fixed[2][16];
+        Record r0, r1;
+        r0.attach(fixed[0], 16, &format);
+        r1.attach(fixed[1], 16, &format);
+        REQUIRE(layout.decode(r0));
+        REQUIRE(layout.count() == 2);
+        REQUIRE(layout.data(1) == fixed[0] + 5);
+        REQUIRE(layout.decode(r1));
+        REQUIRE(layout.data(1) == fixed[1] + 5);
+        REQUIRE(layout.total() == 9);
+
+        // 再解码变长记录
+        REQUIRE(layout.decode(record));
+        REQUIRE(layout.count() == 3);
+        REQUIRE(layout.data(0) == buffer + record.startOfFields());
+
+        // 超过RECORD_MAX_FIELDS的记录不能解码
+        std::vector<struct iovec> many(RECORD_MAX_FIELDS + 1);
+        for (size_t i = 0; i < many.size(); ++i) {
+            many[i].iov_base = &id;
+            many[i].iov_len = 1;
+        }
+        std::vector<unsigned char> big(Record::size(many) + ALIGN_SIZE);
+        record.attach(big.data(), (unsigned short) big.size());
+        REQUIRE(record.set(many, &header));
+        REQUIRE(!layout.decode(record));
+        unsigned char *pb;
+        unsigned int l;
+        REQUIRE(!record.refByIndex(&pb, &l, 0));
     }
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+////
+// @file scanTest.cc
+// @brief
+// 测试并行扫描
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <vector>
+#include <db/scan.h>
+#include <db/table.h>
+using namespace db;
+
+TEST_CASE("db/scan.h")
+{
+    SECTION("run")
+    {
+        // NOTE: tableTest.cc中插入记录
+        Table table;
+        REQUIRE(table.open("table") == S_OK);
+
+        // 顺序扫描
+        size_t records = 0;
+        size_t blocks = 0;
+        for (Table::BlockIterator bi = table.beginblock();
+             bi != table.endblock();
+             ++bi, ++blocks)
+            records += bi->getSlots();
+
+        // 并行扫描，每个线程独立计数
+        ParallelScan scan(&table, 4, 1);
+        std::vector<size_t> counts(scan.workers() * 8, 0);
+        size_t scanned = scan.run([&](unsigned int worker, DataBlock &block) {
+            for (DataBlock::RecordIterator ri = block.beginrecord();
+                 ri != block.endrecord();
+                 ++ri)
+                ++counts[worker * 8];
+        });
+        REQUIRE(scanned == blocks);
+
+        size_t total = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+            total += counts[i];
+        REQUIRE(total == records);
+    }
+}
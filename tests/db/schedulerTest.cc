@@ -0,0 +1,115 @@
+////
+// @file schedulerTest.cc
+// @brief
+// 测试任务调度器
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <db/scheduler.h>
+using namespace db;
+
+TEST_CASE("db/scheduler.h")
+{
+    SECTION("spawn")
+    {
+        Scheduler scheduler;
+        scheduler.init(4);
+        REQUIRE(scheduler.workers() == 4);
+        REQUIRE(Scheduler::current() == -1);
+
+        std::atomic<int> sum(0);
+        TaskGroup group;
+        for (int i = 1; i <= 1000; ++i)
+            scheduler.spawn([&sum, i]() { sum.fetch_add(i); }, TASK_FOREGROUND, &group);
+        scheduler.wait(group);
+        REQUIRE(group.finished());
+        REQUIRE(sum.load() == 500500);
+    }
+
+    SECTION("nested")
+    {
+        Scheduler scheduler;
+        scheduler.init(4);
+
+        // 任务内再提交任务，并在工作线程上等待
+        std::atomic<int> count(0);
+        TaskGroup outer;
+        for (int i = 0; i < 8; ++i)
+            scheduler.spawn(
+                [&scheduler, &count]() {
+                    TaskGroup inner;
+                    for (int j = 0; j < 100; ++j)
+                        scheduler.spawn(
+                            [&count]() { count.fetch_add(1); },
+                            TASK_FOREGROUND,
+                            &inner);
+                    scheduler.wait(inner);
+                },
+                TASK_FOREGROUND,
+                &outer);
+        scheduler.wait(outer);
+        REQUIRE(count.load() == 800);
+    }
+
+    SECTION("priority")
+    {
+        Scheduler scheduler;
+        scheduler.init(1);
+
+        // 唯一的工作线程被阻塞时排队，放行后高优先级先执行
+        std::atomic<bool> started(false);
+        std::atomic<bool> gate(false);
+        TaskGroup group;
+        scheduler.spawn(
+            [&started, &gate]() {
+                started.store(true);
+                while (!gate.load())
+                    std::this_thread::yield();
+            },
+            TASK_FOREGROUND,
+            &group);
+        while (!started.load())
+            std::this_thread::yield();
+
+        std::vector<int> order;
+        std::mutex mutex;
+        int priorities[] = {TASK_PREFETCH, TASK_FLUSH, TASK_FOREGROUND};
+        for (int i = 0; i < 3; ++i) {
+            int p = priorities[i];
+            scheduler.spawn(
+                [&order, &mutex, p]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    order.push_back(p);
+                },
+                p,
+                &group);
+        }
+        gate.store(true);
+        // 等待线程也会取任务，所以只等待，不帮忙
+        while (!group.finished())
+            std::this_thread::yield();
+        REQUIRE(order.size() == 3);
+        REQUIRE(order[0] == TASK_FOREGROUND);
+        REQUIRE(order[1] == TASK_FLUSH);
+        REQUIRE(order[2] == TASK_PREFETCH);
+    }
+
+    SECTION("shutdown")
+    {
+        Scheduler scheduler;
+        scheduler.init(2);
+        scheduler.shutdown();
+        REQUIRE(scheduler.workers() == 0);
+
+        // 停止后提交的任务直接执行
+        int value = 0;
+        scheduler.spawn([&value]() { value = 1; });
+        REQUIRE(value == 1);
+    }
+}
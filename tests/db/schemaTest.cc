@@ -6,7 +6,10 @@
 // @email niexiaowen@uestc.edu.cn
 //
 #include "../catch.hpp"
+#include <stdio.h>
 #include <db/schema.h>
+#include <db/buffer.h>
+#include <db/block.h>
 using namespace db;
 
 TEST_CASE("db/schema.h")
@@ -41,7 +44,7 @@ TEST_CASE("db/schema.h")
         relation.key = 0;
 
         int total = relation.iovSize();
-        REQUIRE(total == 3 * 4 + 7);
+        REQUIRE(total == 3 * 4 + 8);
 
         Schema schema;
         std::vector<struct iovec> iov(total);
@@ -69,6 +72,10 @@ TEST_CASE("db/schema.h")
         REQUIRE(iov[4].iov_len == 4);
         unsigned int key = *((unsigned int *) iov[4].iov_base);
         REQUIRE(key == 0);
+
+        // 表空间id在最后
+        REQUIRE(iov[total - 1].iov_len == 4);
+        REQUIRE(iov[total - 1].iov_base == &relation.spaceid);
     }
 
     SECTION("create")
@@ -108,5 +115,127 @@ TEST_CASE("db/schema.h")
         REQUIRE(bret.second);
         REQUIRE(bret.first->second.count == 3);
         REQUIRE(strcmp(bret.first->second.fields[0].name.c_str(), "id") == 0);
+        // 有VARCHAR，采用变长记录
+        REQUIRE(bret.first->second.type == RELATION_VARIABLE);
+        REQUIRE(bret.first->second.recordFormat() == NULL);
+
+        // 分配了表空间id，盖在超块和第1个数据块上
+        unsigned int spaceid = bret.first->second.spaceid;
+        REQUIRE(spaceid > SPACE_LEGACY);
+        REQUIRE(relation.spaceid == spaceid);
+        SuperBlock super;
+        BufDesp *desp = kBuffer.borrow("table", 0);
+        super.attach(desp->buffer);
+        REQUIRE(super.getSpaceid() == spaceid);
+        super.detach();
+        kBuffer.releaseBuf(desp);
+        DataBlock data;
+        desp = kBuffer.borrow("table", 1);
+        data.attach(desp->buffer);
+        REQUIRE(data.getSpaceid() == spaceid);
+        data.detach();
+        kBuffer.releaseBuf(desp);
+    }
+
+    SECTION("format")
+    {
+        // id bigint, phone char(20), age int，都定长
+        RelationInfo relation;
+        FieldInfo field;
+        field.name = "id";
+        field.length = 8;
+        field.type = findDataType("BIGINT");
+        relation.fields.push_back(field);
+        field.name = "phone";
+        field.index = 1;
+        field.length = 20;
+        field.type = findDataType("CHAR");
+        relation.fields.push_back(field);
+        field.name = "age";
+        field.index = 2;
+        field.length = 4;
+        field.type = findDataType("INT");
+        relation.fields.push_back(field);
+        relation.count = 3;
+
+        int ret = kSchema.create("fixedtable", relation);
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        std::pair<Schema::TableSpace::iterator, bool> bret =
+            kSchema.lookup("fixedtable");
+        REQUIRE(bret.second);
+        RelationInfo &info = bret.first->second;
+        REQUIRE(info.type == RELATION_FIXED);
+        const RecordFormat *format = info.recordFormat();
+        REQUIRE(format != NULL);
+        REQUIRE(format->count() == 3);
+        REQUIRE(format->offset(0) == 1);
+        REQUIRE(format->offset(1) == 9);
+        REQUIRE(format->offset(2) == 29);
+        REQUIRE(format->width(1) == 20);
+        REQUIRE(format->length() == 33);
+        // 每张表的表空间id不同
+        REQUIRE(info.spaceid > SPACE_LEGACY);
+        REQUIRE(info.spaceid != kSchema.lookup("table").first->second.spaceid);
+    }
+
+    SECTION("catalog")
+    {
+        // 建足够多的表，一个meta块放不下
+        char name[32];
+        for (int i = 0; i < 400; ++i) {
+            RelationInfo relation;
+            FieldInfo field;
+            field.name = "id";
+            field.length = 8;
+            field.type = findDataType("BIGINT");
+            relation.fields.push_back(field);
+            relation.count = 1;
+            snprintf(name, sizeof(name), "catalog%d", i);
+            int ret = kSchema.create(name, relation);
+            REQUIRE((ret == S_OK || ret == EEXIST));
+        }
+        REQUIRE(kSchema.blocks() > 1);
+        REQUIRE(kSchema.lookup("catalog399").second);
+
+        // 重新打开，只登记表名，lookup时才加载
+        Schema schema;
+        schema.init(&kBuffer);
+        REQUIRE(schema.size() == kSchema.size());
+        REQUIRE(schema.blocks() == kSchema.blocks());
+        REQUIRE(schema.loaded() == 1);
+        std::pair<Schema::TableSpace::iterator, bool> bret =
+            schema.lookup("catalog399");
+        REQUIRE(bret.second);
+        REQUIRE(bret.first->second.path == "catalog399.dat");
+        REQUIRE(bret.first->second.count == 1);
+        REQUIRE(bret.first->second.fields[0].name == "id");
+        REQUIRE(bret.first->second.type == RELATION_FIXED);
+        REQUIRE(
+            bret.first->second.spaceid ==
+            kSchema.lookup("catalog399").first->second.spaceid);
+        REQUIRE(schema.loaded() == 2);
+        REQUIRE(schema.lookup("catalog0").second);
+        REQUIRE(schema.loaded() == 3);
+        REQUIRE(!schema.lookup("catalog400").second);
+        RelationInfo copy = bret.first->second;
+        REQUIRE(schema.create("catalog5", copy) == EEXIST);
+    }
+
+    SECTION("intern")
+    {
+        TableId id = kSchema.intern("fixedtable");
+        REQUIRE(kSchema.intern("fixedtable") == id);
+        REQUIRE(kSchema.name(id) == "fixedtable");
+        REQUIRE(kSchema.intern(Schema::META_FILE) == Schema::META_ID);
+        REQUIRE(kSchema.intern("nosuchtable") != id);
+
+        // 按编号和按表名查到同一个定义
+        std::pair<Schema::TableSpace::iterator, bool> byid =
+            kSchema.lookup(id);
+        REQUIRE(byid.second);
+        std::pair<Schema::TableSpace::iterator, bool> byname =
+            kSchema.lookup("fixedtable");
+        REQUIRE(&byid.first->second == &byname.first->second);
+        REQUIRE(!kSchema.lookup("nosuchtable").second);
     }
-}
\ No newline at end of file
+}
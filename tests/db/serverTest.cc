@@ -0,0 +1,261 @@
+////
+// @file serverTest.cc
+// @brief
+// 测试网络服务器，在回环地址上起服务器，用Client发请求
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#if defined(__linux__)
+
+#include "../catch.hpp"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <db/server.h>
+using namespace db;
+
+namespace {
+Value number(long long n)
+{
+    Value value;
+    value.number = n;
+    return value;
+}
+Value text(const char *s)
+{
+    Value value;
+    value.string = true;
+    value.text = s;
+    return value;
+}
+} // namespace
+
+TEST_CASE("db/server.h")
+{
+    Server server;
+    REQUIRE(server.start("127.0.0.1", 0, 2) == S_OK);
+    REQUIRE(server.port() != 0);
+    REQUIRE(server.start("127.0.0.1", 0, 2) == EEXIST);
+
+    Client client;
+    REQUIRE(client.connect("127.0.0.1", server.port()) == S_OK);
+
+    Client::Response response;
+    client.query(
+        "CREATE TABLE servertest (id INT PRIMARY KEY, name CHAR(16))");
+    client.query("DELETE FROM servertest");
+    REQUIRE(client.flush() == S_OK);
+    REQUIRE(client.result(response) == S_OK);
+    REQUIRE(
+        (response.type == MSG_DONE ||
+         (response.type == MSG_ERROR && response.code == EEXIST)));
+    REQUIRE(client.result(response) == S_OK);
+    REQUIRE(response.type == MSG_DONE);
+
+    SECTION("pipeline")
+    {
+        // 连发200个INSERT，一次发出，响应按顺序返回
+        char buf[96];
+        for (int i = 0; i < 200; ++i) {
+            snprintf(
+                buf,
+                sizeof(buf),
+                "INSERT INTO servertest VALUES (%d, 'p%d')",
+                i,
+                i);
+            client.query(buf);
+        }
+        REQUIRE(client.flush() == S_OK);
+        for (int i = 0; i < 200; ++i) {
+            REQUIRE(client.result(response) == S_OK);
+            REQUIRE(response.type == MSG_DONE);
+            REQUIRE(response.affected == 1);
+        }
+
+        // 错误的语句不影响后面的请求
+        client.query("SELEC id FROM servertest");
+        client.query("SELECT id, name FROM servertest ORDER BY id");
+        client.query("SELECT COUNT(*) FROM servertest WHERE id >= 150");
+        REQUIRE(client.flush() == S_OK);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_ERROR);
+        REQUIRE(response.code == EINVAL);
+        REQUIRE(!response.error.empty());
+
+        // 结果分成多个ROWS帧，合并后按id有序
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_DONE);
+        REQUIRE(response.affected == 200);
+        REQUIRE(response.rows.size() == 200);
+        for (int i = 0; i < 200; ++i) {
+            REQUIRE(response.rows[i].size() == 2);
+            REQUIRE(!response.rows[i][0].string);
+            REQUIRE(response.rows[i][0].number == i);
+            snprintf(buf, sizeof(buf), "p%d", i);
+            REQUIRE(response.rows[i][1].string);
+            REQUIRE(response.rows[i][1].text == buf);
+        }
+
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_DONE);
+        REQUIRE(response.rows.size() == 1);
+        REQUIRE(response.rows[0][0].number == 50);
+    }
+
+    SECTION("prepare")
+    {
+        client.prepare("INSERT INTO servertest VALUES (?, ?)");
+        client.prepare("SELECT name FROM servertest WHERE id = ?");
+        REQUIRE(client.flush() == S_OK);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_PREPARED);
+        REQUIRE(response.params == 2);
+        unsigned int insert = response.id;
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_PREPARED);
+        REQUIRE(response.params == 1);
+        unsigned int point = response.id;
+
+        // 执行和查询交错着连发
+        std::vector<Value> params(2);
+        char buf[32];
+        for (int i = 0; i < 50; ++i) {
+            snprintf(buf, sizeof(buf), "q%d", i);
+            params[0] = number(i);
+            params[1] = text(buf);
+            client.execute(insert, params);
+            client.execute(point, std::vector<Value>(1, number(i)));
+        }
+        REQUIRE(client.flush() == S_OK);
+        for (int i = 0; i < 50; ++i) {
+            REQUIRE(client.result(response) == S_OK);
+            REQUIRE(response.type == MSG_DONE);
+            REQUIRE(response.affected == 1);
+            REQUIRE(client.result(response) == S_OK);
+            REQUIRE(response.type == MSG_DONE);
+            REQUIRE(response.rows.size() == 1);
+            snprintf(buf, sizeof(buf), "q%d", i);
+            REQUIRE(response.rows[0][0].text == buf);
+        }
+
+        // 参数个数不对，关闭后再执行
+        client.execute(insert, std::vector<Value>(1, number(100)));
+        client.closeStatement(insert);
+        client.execute(insert, params);
+        client.closeStatement(insert);
+        REQUIRE(client.flush() == S_OK);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_ERROR);
+        REQUIRE(response.code == EINVAL);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_DONE);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_ERROR);
+        REQUIRE(response.code == ENOENT);
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.type == MSG_ERROR);
+        REQUIRE(response.code == ENOENT);
+    }
+
+    SECTION("connections")
+    {
+        char buf[96];
+        for (int i = 0; i < 100; ++i) {
+            snprintf(
+                buf,
+                sizeof(buf),
+                "INSERT INTO servertest VALUES (%d, 'c%d')",
+                i,
+                i);
+            client.query(buf);
+        }
+        REQUIRE(client.flush() == S_OK);
+        for (int i = 0; i < 100; ++i)
+            REQUIRE(client.result(response) == S_OK);
+
+        // 多个连接分到不同的reactor上并发查询
+        const int clients = 4;
+        int failures[clients] = {};
+        std::vector<std::thread> threads;
+        for (int c = 0; c < clients; ++c)
+            threads.push_back(std::thread([&, c] {
+                Client other;
+                if (other.connect("127.0.0.1", server.port())) {
+                    ++failures[c];
+                    return;
+                }
+                for (int i = 0; i < 20; ++i)
+                    other.query("SELECT id FROM servertest WHERE id < 60");
+                if (other.flush()) ++failures[c];
+                for (int i = 0; i < 20; ++i) {
+                    Client::Response r;
+                    if (other.result(r) || r.type != MSG_DONE ||
+                        r.rows.size() != 60)
+                        ++failures[c];
+                }
+            }));
+        for (int c = 0; c < clients; ++c) {
+            threads[c].join();
+            REQUIRE(failures[c] == 0);
+        }
+        REQUIRE(server.accepted() == 1 + clients);
+    }
+
+    SECTION("stream")
+    {
+        // 进程内插入，每行的字节串不带补齐的0
+        Session local;
+        int ret = local.execute(
+            "CREATE TABLE streamtest (id INT PRIMARY KEY, pad CHAR(240))");
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        REQUIRE(local.execute("DELETE FROM streamtest") == S_OK);
+        unsigned int insert;
+        REQUIRE(
+            local.prepare("INSERT INTO streamtest VALUES (?, ?)", insert) ==
+            S_OK);
+        const int total = 20000;
+        std::vector<Value> params(2);
+        params[1] = text(std::string(240, 'x').c_str());
+        for (int i = 0; i < total; ++i) {
+            params[0] = number(i);
+            REQUIRE(local.execute(insert, params) == S_OK);
+        }
+
+        // 三个结果都远大于SERVER_PENDING，客户先不读，服务器停在游标上
+        for (int q = 0; q < 3; ++q)
+            client.query("SELECT id, pad FROM streamtest");
+        client.query("SELECT COUNT(*) FROM streamtest");
+        REQUIRE(client.flush() == S_OK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        REQUIRE(server.paused() > 0);
+
+        for (int q = 0; q < 3; ++q) {
+            REQUIRE(client.result(response) == S_OK);
+            REQUIRE(response.type == MSG_DONE);
+            REQUIRE(response.affected == total);
+            REQUIRE(response.rows.size() == (size_t) total);
+            bool matched = true;
+            for (int i = 0; i < total; ++i)
+                if (response.rows[i][0].number != i ||
+                    response.rows[i][1].text.size() != 240)
+                    matched = false;
+            REQUIRE(matched);
+        }
+        REQUIRE(client.result(response) == S_OK);
+        REQUIRE(response.rows[0][0].number == total);
+        REQUIRE(local.execute("DELETE FROM streamtest") == S_OK);
+    }
+
+    client.close();
+    server.stop();
+    // 停止后可以再启动
+    REQUIRE(server.start("127.0.0.1", 0, 1) == S_OK);
+    REQUIRE(client.connect("127.0.0.1", server.port()) == S_OK);
+    client.query("SELECT id FROM servertest WHERE id = 1");
+    REQUIRE(client.flush() == S_OK);
+    REQUIRE(client.result(response) == S_OK);
+    REQUIRE(response.type == MSG_DONE);
+}
+
+#endif // __linux__
@@ -0,0 +1,254 @@
+////
+// @file sessionTest.cc
+// @brief
+// 测试会话、预备语句和计划缓存
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <stdio.h>
+#include <thread>
+#include <db/session.h>
+using namespace db;
+
+namespace {
+Value number(long long n)
+{
+    Value value;
+    value.number = n;
+    return value;
+}
+Value text(const char *s)
+{
+    Value value;
+    value.string = true;
+    value.text = s;
+    return value;
+}
+} // namespace
+
+TEST_CASE("db/session.h")
+{
+    SECTION("prepare")
+    {
+        Session session;
+        int ret = session.execute(
+            "CREATE TABLE sessiontest (id INT PRIMARY KEY, name CHAR(16))");
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        REQUIRE(session.execute("DELETE FROM sessiontest") == S_OK);
+
+        // 插入用预备语句
+        unsigned int insert;
+        REQUIRE(
+            session.prepare(
+                "INSERT INTO sessiontest VALUES (?, ?)", insert) == S_OK);
+        REQUIRE(session.params(insert) == 2);
+        char buf[32];
+        std::vector<Value> params(2);
+        for (int i = 0; i < 100; ++i) {
+            snprintf(buf, sizeof(buf), "n%d", i);
+            params[0] = number(i);
+            params[1] = text(buf);
+            REQUIRE(session.execute(insert, params) == S_OK);
+        }
+
+        // 参数个数和类型不对
+        params.resize(1);
+        REQUIRE(session.execute(insert, params) == EINVAL);
+        params.resize(2);
+        params[0] = text("x");
+        REQUIRE(session.execute(insert, params) == EINVAL);
+        REQUIRE(!session.error().empty());
+
+        // 键上的参数绑定后走点查
+        unsigned int point;
+        REQUIRE(
+            session.prepare(
+                "SELECT name FROM sessiontest WHERE id = ?", point) == S_OK);
+        for (int i = 0; i < 100; i += 7) {
+            std::string name;
+            size_t rows = 0;
+            REQUIRE(
+                session.execute(
+                    point,
+                    std::vector<Value>(1, number(i)),
+                    [&](Batch &batch) {
+                        size_t row = batch.row(0);
+                        name.assign((const char *) batch.columns[0].data[row]);
+                    },
+                    &rows) == S_OK);
+            snprintf(buf, sizeof(buf), "n%d", i);
+            REQUIRE(rows == 1);
+            REQUIRE(name == buf);
+        }
+
+        // 范围和更新
+        unsigned int range;
+        REQUIRE(
+            session.prepare(
+                "SELECT id FROM sessiontest WHERE id >= ? AND id < ?",
+                range) == S_OK);
+        params[0] = number(10);
+        params[1] = number(30);
+        size_t rows = 0;
+        REQUIRE(session.execute(range, params, Session::Visitor(), &rows) == 0);
+        REQUIRE(rows == 20);
+        unsigned int update;
+        REQUIRE(
+            session.prepare(
+                "UPDATE sessiontest SET name = ? WHERE id < ?", update) ==
+            S_OK);
+        params[0] = text("low");
+        params[1] = number(5);
+        REQUIRE(
+            session.execute(update, params, Session::Visitor(), &rows) == 0);
+        REQUIRE(rows == 5);
+
+        // 游标由调用者拉取，两个游标交替推进
+        Cursor all, some;
+        REQUIRE(session.open("SELECT id, name FROM sessiontest", all) == S_OK);
+        params[0] = number(10);
+        params[1] = number(30);
+        REQUIRE(session.open(range, params, some) == S_OK);
+        REQUIRE(all.next());
+        REQUIRE(some.next());
+        REQUIRE(some.batch().columns[0].ints[some.batch().row(0)] == 10);
+        REQUIRE(all.rows() == 100);
+        REQUIRE(some.rows() == 20);
+        REQUIRE(!all.next());
+        REQUIRE(!some.next());
+        REQUIRE(
+            session.open(update, std::vector<Value>(1, number(1)), some) ==
+            EINVAL);
+        REQUIRE(!some.active());
+
+        // 关闭后编号不可用
+        REQUIRE(session.close(range) == S_OK);
+        REQUIRE(session.execute(range, params) == ENOENT);
+        REQUIRE(session.close(range) == ENOENT);
+        REQUIRE(session.prepare("SELECT * FROM sessiontest", range) == S_OK);
+        REQUIRE(session.execute(range, std::vector<Value>()) == S_OK);
+        REQUIRE(session.execute("SELECT * FROM sessiontest WHERE id = ?") ==
+                EINVAL);
+        REQUIRE(session.prepare("SELECT * FROM nosuch", range) == ENOENT);
+    }
+
+    SECTION("cache")
+    {
+        // 不同会话，写法不同的同一语句共享计划
+        Session first, second;
+        unsigned int a, b;
+        REQUIRE(
+            first.prepare("SELECT name FROM sessiontest WHERE id = ?", a) ==
+            S_OK);
+        size_t hits = kPlans.hits();
+        REQUIRE(
+            second.prepare(
+                "SELECT  name\n FROM sessiontest WHERE id=? ;", b) == S_OK);
+        REQUIRE(kPlans.hits() == hits + 1);
+        REQUIRE(first.execute("SELECT * FROM sessiontest WHERE id = 3") == 0);
+        REQUIRE(second.execute("select * from sessiontest where id = 3") == 0);
+
+        // 建表改变目录，缓存失效，预备语句执行时重新生成计划
+        char buf[64];
+        snprintf(
+            buf,
+            sizeof(buf),
+            "CREATE TABLE sessionx%u (id INT PRIMARY KEY)",
+            (unsigned int) kSchema.version());
+        unsigned long long version = kSchema.version();
+        int ret = first.execute(buf);
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        if (ret == S_OK) {
+            REQUIRE(kSchema.version() == version + 1);
+            size_t misses = kPlans.misses();
+            size_t rows = 0;
+            REQUIRE(
+                second.execute(
+                    b,
+                    std::vector<Value>(1, number(42)),
+                    Session::Visitor(),
+                    &rows) == S_OK);
+            REQUIRE(rows == 1);
+            REQUIRE(kPlans.misses() == misses + 1);
+        }
+
+        // lru淘汰
+        PlanCache cache(2);
+        std::shared_ptr<const Plan> plan(new Plan);
+        cache.insert("a", 1, plan);
+        cache.insert("b", 1, plan);
+        REQUIRE(cache.find("a", 1));
+        cache.insert("c", 1, plan);
+        REQUIRE(cache.size() == 2);
+        REQUIRE(!cache.find("b", 1));
+        REQUIRE(cache.find("a", 1));
+        cache.insert("d", 0, plan);
+        REQUIRE(!cache.find("d", 1));
+        REQUIRE(!cache.find("a", 2));
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION("shared")
+    {
+        // 两个会话交替往同一张表插入，共用同一个Table分配block和分裂
+        Session first, second;
+        int ret = first.execute(
+            "CREATE TABLE sharedtest (id INT PRIMARY KEY, pad CHAR(200))");
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        REQUIRE(first.execute("DELETE FROM sharedtest") == S_OK);
+        unsigned int a, b;
+        REQUIRE(first.prepare("INSERT INTO sharedtest VALUES (?, ?)", a) == 0);
+        REQUIRE(
+            second.prepare("INSERT INTO sharedtest VALUES (?, ?)", b) == 0);
+        std::vector<Value> params(2);
+        params[1] = text("p");
+        for (int i = 0; i < 300; ++i) {
+            params[0] = number(i);
+            REQUIRE((i % 2 ? second : first).execute(i % 2 ? b : a, params) ==
+                    S_OK);
+        }
+
+        // 两个线程各用一个会话同时插入
+        std::thread threads[2];
+        int errors[2] = {0, 0};
+        for (int t = 0; t < 2; ++t)
+            threads[t] = std::thread([&, t]() {
+                Session &session = t ? second : first;
+                std::vector<Value> values(2);
+                values[1] = text("q");
+                for (int i = 300 + t; i < 2000; i += 2) {
+                    values[0] = number(i);
+                    if (session.execute(t ? b : a, values) != S_OK)
+                        ++errors[t];
+                }
+            });
+        threads[0].join();
+        threads[1].join();
+        REQUIRE(errors[0] + errors[1] == 0);
+
+        // 全表扫描和点查都看到全部记录
+        size_t rows = 0;
+        REQUIRE(
+            second.execute(
+                "SELECT id FROM sharedtest", Session::Visitor(), &rows) ==
+            S_OK);
+        REQUIRE(rows == 2000);
+        unsigned int point;
+        REQUIRE(
+            first.prepare("SELECT id FROM sharedtest WHERE id = ?", point) ==
+            S_OK);
+        size_t missed = 0;
+        for (int i = 0; i < 2000; ++i) {
+            rows = 0;
+            first.execute(
+                point,
+                std::vector<Value>(1, number(i)),
+                Session::Visitor(),
+                &rows);
+            if (rows != 1) ++missed;
+        }
+        REQUIRE(missed == 0);
+    }
+}
@@ -0,0 +1,330 @@
+////
+// @file sqlTest.cc
+// @brief
+// 测试SQL解析和planner
+//
+// @author niexw
+// @email niexiaowen@uestc.edu.cn
+//
+#include "../catch.hpp"
+#include <db/sql.h>
+using namespace db;
+
+TEST_CASE("db/sql.h")
+{
+    SECTION("parse")
+    {
+        SQL sql;
+        Statement stmt;
+
+        REQUIRE(
+            sql.parse(
+                "create table t (id bigint primary key, name varchar(32), "
+                "phone char(20));",
+                stmt) == S_OK);
+        REQUIRE(stmt.kind == STMT_CREATE);
+        REQUIRE(stmt.table == "t");
+        REQUIRE(stmt.defs.size() == 3);
+        REQUIRE(stmt.defs[0].type == "BIGINT");
+        REQUIRE(stmt.defs[0].primary);
+        REQUIRE(stmt.defs[1].length == 32);
+
+        REQUIRE(
+            sql.parse(
+                "SELECT id, name FROM t WHERE id >= 10 AND name <> 'it''s' "
+                "ORDER BY name DESC LIMIT 5",
+                stmt) == S_OK);
+        REQUIRE(stmt.kind == STMT_SELECT);
+        REQUIRE(stmt.columns.size() == 2);
+        REQUIRE(stmt.where.size() == 2);
+        REQUIRE(stmt.where[0].op == OP_GE);
+        REQUIRE(stmt.where[0].value.number == 10);
+        REQUIRE(stmt.where[1].op == OP_NE);
+        REQUIRE(stmt.where[1].value.text == "it's");
+        REQUIRE(stmt.orderBy == "name");
+        REQUIRE(stmt.desc);
+        REQUIRE(stmt.limit == 5);
+
+        REQUIRE(sql.parse("insert into t values (-1, 'a', 'b')", stmt) == S_OK);
+        REQUIRE(stmt.kind == STMT_INSERT);
+        REQUIRE(stmt.values.size() == 3);
+        REQUIRE(stmt.values[0].number == -1);
+
+        REQUIRE(sql.parse("UPDATE t SET name = 'x' WHERE id = 3", stmt) == S_OK);
+        REQUIRE(stmt.kind == STMT_UPDATE);
+        REQUIRE(stmt.sets.size() == 1);
+        REQUIRE(sql.parse("DELETE FROM t", stmt) == S_OK);
+        REQUIRE(stmt.kind == STMT_DELETE);
+        REQUIRE(stmt.where.empty());
+
+        // 聚集和分组
+        REQUIRE(
+            sql.parse(
+                "SELECT name, count(*), SUM(id) FROM t WHERE id > 1 "
+                "GROUP BY name, phone LIMIT 3",
+                stmt) == S_OK);
+        REQUIRE(stmt.columns.size() == 1);
+        REQUIRE(stmt.aggregates.size() == 2);
+        REQUIRE(stmt.aggregates[0].func == AGG_COUNT);
+        REQUIRE(stmt.aggregates[0].column.empty());
+        REQUIRE(stmt.aggregates[0].position == 1);
+        REQUIRE(stmt.aggregates[1].func == AGG_SUM);
+        REQUIRE(stmt.aggregates[1].column == "id");
+        REQUIRE(stmt.groupBy.size() == 2);
+        REQUIRE(stmt.limit == 3);
+
+        // 连接
+        REQUIRE(
+            sql.parse(
+                "SELECT t.id, u.name FROM t INNER JOIN u ON t.id = u.tid "
+                "WHERE u.age > 3",
+                stmt) == S_OK);
+        REQUIRE(stmt.join == "u");
+        REQUIRE(stmt.on[0] == "t.id");
+        REQUIRE(stmt.on[1] == "u.tid");
+        REQUIRE(stmt.columns[1] == "u.name");
+        REQUIRE(stmt.where[0].column == "u.age");
+
+        // 错误
+        REQUIRE(sql.parse("SELECT * FROM t INNER u", stmt) == EINVAL);
+        REQUIRE(sql.parse("SELECT * FROM t JOIN u ON t.id", stmt) == EINVAL);
+        REQUIRE(sql.parse("SELECT AVG(id) FROM t", stmt) == EINVAL);
+        REQUIRE(sql.parse("SELECT SUM(*) FROM t", stmt) == EINVAL);
+        REQUIRE(sql.parse("SELECT FROM t", stmt) == EINVAL);
+        REQUIRE(!sql.error().empty());
+        REQUIRE(sql.parse("SELECT * FROM t WHERE id ~ 1", stmt) == EINVAL);
+        REQUIRE(sql.parse("SELECT * FROM t WHERE name = 'x", stmt) == EINVAL);
+        REQUIRE(sql.parse("DROP TABLE t", stmt) == EINVAL);
+        REQUIRE(sql.parse("DELETE FROM t extra", stmt) == EINVAL);
+    }
+
+    SECTION("plan")
+    {
+        SQL sql;
+        Plan plan;
+
+        // CREATE生成RelationInfo
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE sqltest (name VARCHAR(32), id INT, "
+                "phone CHAR(20), PRIMARY KEY (id))",
+                plan) == S_OK);
+        REQUIRE(plan.create.count == 3);
+        REQUIRE(plan.create.key == 1);
+        REQUIRE(plan.create.fields[0].length == -32);
+        REQUIRE(plan.create.fields[1].length == 4);
+        REQUIRE(plan.create.fields[2].length == 20);
+        int ret = kSchema.create("sqltest", plan.create);
+        REQUIRE((ret == S_OK || ret == EEXIST));
+
+        REQUIRE(sql.prepare("SELECT * FROM nosuch", plan) == ENOENT);
+        REQUIRE(sql.prepare("SELECT age FROM sqltest", plan) == EINVAL);
+        REQUIRE(sql.prepare("CREATE TABLE x (a FLOAT)", plan) == EINVAL);
+
+        // INSERT按域的顺序编码
+        REQUIRE(
+            sql.prepare(
+                "INSERT INTO sqltest (id, phone, name) VALUES (258, '123', 'ab')",
+                plan) == S_OK);
+        REQUIRE(plan.row.size() == 3);
+        REQUIRE(plan.row[0] == "ab");
+        REQUIRE(plan.row[1] == std::string("\0\0\1\2", 4));
+        REQUIRE(plan.row[2].size() == 20);
+        REQUIRE(sql.prepare("INSERT INTO sqltest VALUES ('a', 1)", plan) == EINVAL);
+        REQUIRE(
+            sql.prepare("INSERT INTO sqltest VALUES (1, 1, '1')", plan) == EINVAL);
+
+        // 键上等值走b+树
+        REQUIRE(
+            sql.prepare(
+                "SELECT name FROM sqltest WHERE name = 'a' AND id = 7", plan) ==
+            S_OK);
+        REQUIRE(plan.access == ACCESS_INDEX);
+        REQUIRE(plan.low == std::string("\0\0\0\7", 4));
+        REQUIRE(plan.filters.size() == 2);
+        REQUIRE(plan.projection.size() == 1);
+        REQUIRE(plan.projection[0] == 0);
+
+        // 键上范围，取最紧的上下界
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest WHERE id > 3 AND id >= 5 AND id < 9 "
+                "ORDER BY id",
+                plan) == S_OK);
+        REQUIRE(plan.access == ACCESS_RANGE);
+        REQUIRE(plan.low == std::string("\0\0\0\5", 4));
+        REQUIRE(plan.lowInclusive);
+        REQUIRE(plan.high == std::string("\0\0\0\x9", 4));
+        REQUIRE(!plan.highInclusive);
+        REQUIRE(plan.orderField == 1);
+        REQUIRE(plan.sorted);
+
+        // 非键条件全表扫描
+        REQUIRE(
+            sql.prepare(
+                "DELETE FROM sqltest WHERE name = 'a' AND id != 3", plan) ==
+            S_OK);
+        REQUIRE(plan.access == ACCESS_FULL);
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest ORDER BY name DESC LIMIT 3", plan) ==
+            S_OK);
+        REQUIRE(plan.access == ACCESS_FULL);
+        REQUIRE(!plan.sorted);
+        REQUIRE(plan.limit == 3);
+
+        // 分组，投影指向分组列和聚集
+        REQUIRE(
+            sql.prepare(
+                "SELECT MAX(id), name, COUNT(*) FROM sqltest GROUP BY phone, "
+                "name",
+                plan) == S_OK);
+        REQUIRE(plan.groupBy.size() == 2);
+        REQUIRE(plan.groupBy[0] == 2);
+        REQUIRE(plan.aggregates.size() == 2);
+        REQUIRE(plan.aggregates[0].func == AGG_MAX);
+        REQUIRE(plan.aggregates[0].field == 1);
+        REQUIRE(plan.aggregates[1].field == -1);
+        REQUIRE(plan.projection.size() == 3);
+        REQUIRE(plan.projection[0] == 2);
+        REQUIRE(plan.projection[1] == 1);
+        REQUIRE(plan.projection[2] == 3);
+        REQUIRE(
+            sql.prepare(
+                "SELECT COUNT(*) FROM sqltest GROUP BY phone, name ORDER BY "
+                "name DESC",
+                plan) == S_OK);
+        REQUIRE(plan.orderField == 1);
+        REQUIRE(plan.desc);
+        REQUIRE(!plan.sorted);
+        REQUIRE(
+            sql.prepare(
+                "SELECT COUNT(*) FROM sqltest GROUP BY name ORDER BY id",
+                plan) == EINVAL);
+        REQUIRE(
+            sql.prepare("SELECT name, COUNT(*) FROM sqltest", plan) == EINVAL);
+        REQUIRE(
+            sql.prepare("SELECT SUM(name) FROM sqltest GROUP BY id", plan) ==
+            EINVAL);
+
+        // 连接，右表的列排在左表之后
+        REQUIRE(
+            sql.prepare(
+                "CREATE TABLE sqljoin (sid INT PRIMARY KEY, label CHAR(8))",
+                plan) == S_OK);
+        ret = kSchema.create("sqljoin", plan.create);
+        REQUIRE((ret == S_OK || ret == EEXIST));
+        REQUIRE(
+            sql.prepare(
+                "SELECT label, sqltest.name FROM sqltest JOIN sqljoin ON "
+                "sid = id WHERE label = 'a' AND id > 3",
+                plan) == S_OK);
+        REQUIRE(plan.join == JOIN_MERGE);
+        REQUIRE(plan.leftKey == 1);
+        REQUIRE(plan.rightKey == 0);
+        REQUIRE(plan.joined.count == 5);
+        REQUIRE(plan.projection[0] == 4);
+        REQUIRE(plan.projection[1] == 0);
+        REQUIRE(plan.filters.size() == 1);
+        REQUIRE(plan.access == ACCESS_RANGE);
+        REQUIRE(plan.rightFilters.size() == 1);
+        REQUIRE(plan.rightFilters[0].field == 1);
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest JOIN sqljoin ON name = label ORDER BY "
+                "sid",
+                plan) == S_OK);
+        REQUIRE(plan.join == JOIN_HASH);
+        REQUIRE(plan.projection.size() == 5);
+        REQUIRE(!plan.sorted);
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest JOIN sqljoin ON sid = id ORDER BY sid",
+                plan) == S_OK);
+        REQUIRE(plan.sorted);
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest JOIN sqljoin ON id = name", plan) ==
+            EINVAL);
+        REQUIRE(
+            sql.prepare(
+                "SELECT * FROM sqltest JOIN sqljoin ON sid = label", plan) ==
+            EINVAL);
+        REQUIRE(
+            sql.prepare(
+                "SELECT x.id FROM sqltest JOIN sqljoin ON sid = id", plan) ==
+            EINVAL);
+
+        // 参数，绑定后重新选择访问路径
+        REQUIRE(
+            sql.prepare(
+                "SELECT name FROM sqltest WHERE id = ? AND phone = ?", plan) ==
+            S_OK);
+        REQUIRE(plan.params.size() == 2);
+        REQUIRE(plan.params[1].target == PARAM_FILTER);
+        REQUIRE(plan.params[1].index == 1);
+        REQUIRE(plan.access == ACCESS_FULL);
+        std::vector<Value> values(2);
+        values[0].number = 7;
+        values[1].string = true;
+        values[1].text = "123";
+        REQUIRE(sql.bind(plan, values) == S_OK);
+        REQUIRE(plan.access == ACCESS_INDEX);
+        REQUIRE(plan.low == std::string("\0\0\0\7", 4));
+        REQUIRE(plan.filters[1].key.size() == 20);
+        values[0] = values[1];
+        REQUIRE(sql.bind(plan, values) == EINVAL);
+        values.resize(1);
+        REQUIRE(sql.bind(plan, values) == EINVAL);
+        std::string text;
+        REQUIRE(
+            sql.normalize("select  *\nfrom t where a='it''s' ;", text) ==
+            S_OK);
+        REQUIRE(text == "select * from t where a = 'it''s'");
+
+        // 不允许修改键
+        REQUIRE(sql.prepare("UPDATE sqltest SET id = 1", plan) == EINVAL);
+        REQUIRE(
+            sql.prepare("UPDATE sqltest SET name = 'b' WHERE id = 1", plan) ==
+            S_OK);
+        REQUIRE(plan.sets.size() == 1);
+        REQUIRE(plan.access == ACCESS_INDEX);
+    }
+
+    SECTION("match")
+    {
+        FieldInfo field;
+        field.type = findDataType("INT");
+        field.length = 4;
+        Value v;
+        v.number = 10;
+        std::string ten, twenty;
+        REQUIRE(encodeValue(field, v, ten) == S_OK);
+        v.number = 20;
+        REQUIRE(encodeValue(field, v, twenty) == S_OK);
+
+        const unsigned char *x = (const unsigned char *) ten.data();
+        REQUIRE(matchValue(field, OP_LT, x, 4, twenty));
+        REQUIRE(matchValue(field, OP_LE, x, 4, ten));
+        REQUIRE(!matchValue(field, OP_GT, x, 4, twenty));
+        REQUIRE(matchValue(field, OP_NE, x, 4, twenty));
+
+        // 整数都是无符号的，负数越界，最大值排在最后
+        std::string out;
+        v.number = -1;
+        REQUIRE(encodeValue(field, v, out) == EINVAL);
+        v.number = 4294967296LL;
+        REQUIRE(encodeValue(field, v, out) == EINVAL);
+        v.number = 4294967295LL;
+        REQUIRE(encodeValue(field, v, out) == S_OK);
+        x = (const unsigned char *) out.data();
+        REQUIRE(matchValue(field, OP_GT, x, 4, twenty));
+        field.type = findDataType("TINYINT");
+        field.length = 1;
+        v.number = -128;
+        REQUIRE(encodeValue(field, v, out) == EINVAL);
+        v.number = 255;
+        REQUIRE(encodeValue(field, v, out) == S_OK);
+        REQUIRE((unsigned char) out[0] == 255);
+    }
+}
@@ -72,17 +72,13 @@ bool check(Table &table)
 
 TEST_CASE("db/table.h")
 {
-    SECTION("less")
+    SECTION("intern")
     {
-        Buffer::BlockMap::key_compare compare;
+        // 块表以表编号和blockid为键，不同指针的同名表得到同一个编号
         const char *table = "hello";
-        std::pair<const char *, unsigned int> key1(table, 1);
-        const char *table2 = "hello";
-        std::pair<const char *, unsigned int> key2(table2, 1);
-        bool ret = !compare(key1, key2);
-        REQUIRE(ret);
-        ret = !compare(key2, key1);
-        REQUIRE(ret);
+        std::string table2("hello");
+        REQUIRE(kSchema.intern(table) == kSchema.intern(table2.c_str()));
+        REQUIRE(kSchema.intern(table) != kSchema.intern("world"));
     }
 
     SECTION("open")
@@ -92,8 +88,8 @@ TEST_CASE("db/table.h")
         int ret = table.open("table");
         REQUIRE(ret == S_OK);
         REQUIRE(table.name_ == "table");
-        REQUIRE(table.maxid_ == 1);
-        REQUIRE(table.idle_ == 0);
+        REQUIRE(table.maxid_ == 2); // 第2个block是空闲空间映射
+        REQUIRE(table.space_->idles() == 0);
         REQUIRE(table.first_ == 1);
         REQUIRE(table.info_->key == 0);
         REQUIRE(table.info_->count == 3);//3个字段，主键是第一个字段
@@ -152,13 +148,9 @@ TEST_CASE("db/table.h")
         Table::BlockIterator bi = table.beginblock();
         REQUIRE(bi->getSlots() == 5); // 已插入5条记录
         bi.release();
-        // 修正表记录
-        BufDesp *bd = kBuffer.borrow("table", 0);
-        REQUIRE(bd);
-        SuperBlock super;
-        super.attach(bd->buffer);
-        super.setRecords(5);
-        super.setDataCounts(1);
+        // 修正表记录，统计信息在内存中
+        table.stat_->records.reset(5);
+        table.stat_->datacounts.reset(1);
         REQUIRE(!check(table));
 
         // table = id(BIGINT)+phone(CHAR[20])+name(VARCHAR)
@@ -187,19 +179,27 @@ TEST_CASE("db/table.h")
                 table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
             // 插入记录
             ret = table.insert(blkid, iov);
-            if (ret == EEXIST) { printf("id=%lld exist\n", be64toh(nid)); }
+            if (ret == EEXIST) { printf("id=%lld exist\n", (long long) be64toh(nid)); }
             if (ret == EFAULT) break;
         }
         // 这里测试表明插入到95条记录block满了。96条记录block分裂
         REQUIRE(i + 5 == table.recordCount());
         REQUIRE(!check(table));
+
+        // checkpoint后写回超块
+        table.checkpoint();
+        BufDesp *bd = kBuffer.borrow("table", 0);
+        SuperBlock super;
+        super.attach(bd->buffer);
+        REQUIRE(super.getRecords() == i + 5);
+        REQUIRE(super.getDataCounts() == table.dataCount());
+        kBuffer.releaseBuf(bd);
     }
 
     SECTION("split")
     {
         Table table;
         table.open("table");
-        DataType *type = table.info_->fields[table.info_->key].type;
 
         Table::BlockIterator bi = table.beginblock();
 
@@ -255,29 +255,32 @@ TEST_CASE("db/table.h")
         REQUIRE(table.dataCount() == 1);
         REQUIRE(table.idleCount() == 0);
 
-        REQUIRE(table.maxid_ == 1);
-        unsigned int blkid = table.allocate();
+        // 第2个block是空闲空间映射，扩展文件得到第3个block
         REQUIRE(table.maxid_ == 2);
+        unsigned int blkid = table.allocate();
+        REQUIRE(blkid == 3);
+        REQUIRE(table.maxid_ == 3);
         REQUIRE(table.dataCount() == 2);
 
         Table::BlockIterator bi = table.beginblock();
         REQUIRE(bi.bufdesp->blockid == 1);
         ++bi;
-        REQUIRE(bi == table.endblock()); // 新分配block未插入数据链
-        REQUIRE(table.idle_ == 0);       // 也未放在空闲链上
-        bi.release();
+        REQUIRE(bi == table.endblock());     // 新分配block未插入数据链
+        REQUIRE(table.space_->idles() == 0); // 也未标为空闲
 
-        // 回收该block
+        // 回收该block，在映射中标为空闲
         table.deallocate(blkid);
         REQUIRE(table.idleCount() == 1);
         REQUIRE(table.dataCount() == 1);
-        REQUIRE(table.idle_ == blkid);
+        REQUIRE(table.space_->idles() == 1);
+        REQUIRE(table.space_->get(blkid) == FSM_IDLE);
 
-        // 再从idle上分配
+        // 再分配时用映射中的空闲块，不扩展文件
         blkid = table.allocate();
+        REQUIRE(blkid == 3);
         REQUIRE(table.idleCount() == 0);
-        REQUIRE(table.maxid_ == 2);
-        REQUIRE(table.idle_ == 0);
+        REQUIRE(table.maxid_ == 3);
+        REQUIRE(table.space_->idles() == 0);
         table.deallocate(blkid);
         REQUIRE(table.idleCount() == 1);
         REQUIRE(table.dataCount() == 1);
@@ -315,10 +318,10 @@ TEST_CASE("db/table.h")
         Table::BlockIterator bi = table.beginblock();
         REQUIRE(bi.bufdesp->blockid == 1);
         REQUIRE(bi->getSelf() == 1);
-        REQUIRE(bi->getNext() == 2);
+        REQUIRE(bi->getNext() == 3); // 分裂用回收的第3个block
         unsigned short count1 = bi->getSlots();
         ++bi;
-        REQUIRE(bi->getSelf() == 2);
+        REQUIRE(bi->getSelf() == 3);
         REQUIRE(bi->getNext() == 0);
         unsigned short count2 = bi->getSlots();
         REQUIRE(count1 + count2 == 96);
@@ -370,10 +373,10 @@ TEST_CASE("db/table.h")
         Table::BlockIterator bi = table.beginblock();
         REQUIRE(bi.bufdesp->blockid == 1);
         REQUIRE(bi->getSelf() == 1);
-        REQUIRE(bi->getNext() == 2);
+        REQUIRE(bi->getNext() == 3);
         unsigned short count1 = bi->getSlots();
         ++bi;
-        REQUIRE(bi->getSelf() == 2);
+        REQUIRE(bi->getSelf() == 3);
         REQUIRE(bi->getNext() == 0);
         unsigned short count2 = bi->getSlots();
         REQUIRE(count1 + count2 == 97);
@@ -385,32 +388,38 @@ TEST_CASE("db/table.h")
         bi = table.beginblock();
         REQUIRE(bi.bufdesp->blockid == 1);
         REQUIRE(bi->getSelf() == 1);
-        REQUIRE(bi->getNext() == 2);
+        REQUIRE(bi->getNext() == 3);
         count1 = bi->getSlots();
         ++bi;
-        REQUIRE(bi->getSelf() == 2);
+        REQUIRE(bi->getSelf() == 3);
         REQUIRE(bi->getNext() == 0);
         count2 = bi->getSlots();
         REQUIRE(count1 + count2 == 96);
         REQUIRE(count1 + count2 == table.recordCount());
         REQUIRE(!check(table));
 
-    }
+        // 键已不存在，不删除也不修改统计
+        ret = table.remove(
+            blkid, iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        REQUIRE(ret == S_FALSE);
+        REQUIRE(table.recordCount() == 96);
 
-    SECTION("update") {
-        // 生成并插入一条record
-        // 修改这条record的数据
-        // 检测记录是否有变
+    }
 
+    SECTION("update")
+    {
+        // 插入一条记录，修改phone后检查记录是否有变
         Table table;
         table.open("table");
         DataType *type = table.info_->fields[table.info_->key].type;
 
-         // 准备添加
+        // 准备添加
         std::vector<struct iovec> iov(3);
         long long nid;
         char phone[20];
         char addr[128];
+        memset(phone, 0, sizeof(phone));
+        memset(addr, 0, sizeof(addr));
 
         // 构造一个记录
         // record有三个字段，id（长整型），phone（字符串），addr（字符串）
@@ -423,58 +432,49 @@ TEST_CASE("db/table.h")
         iov[2].iov_base = (void *) addr;
         iov[2].iov_len = 128;
 
-        // locate位置
+        // locate位置，插入记录
         unsigned int blkid =
             table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
-
-        
-        Table::BlockIterator bi = table.beginblock();
-
-        // 插入记录
-        int ret = table.insert(blkid, iov);
-
-        DataBlock data;
-        data.setTable(table);
-
-        // 从buffer中借用
-        BufDesp *bd = kBuffer.borrow(name_.c_str(), blkid);
-        data.attach(bd->buffer);
-        
+        REQUIRE(table.insert(blkid, iov) == S_OK);
 
         // 修改记录，并更新
-        iov[1].iov_base = "67889865";
-        int ret_ = table.update(blkid, iov);
+        strcpy(phone, "67889865");
+        blkid = table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        REQUIRE(table.update(blkid, iov) == S_OK);
 
         // 查看记录是否成功改变
-        unsigned int index = data.searchRecord(iov[0].iov_base,iov[0].iov_len);
+        blkid = table.locate(iov[0].iov_base, (unsigned int) iov[0].iov_len);
+        DataBlock data;
+        data.setTable(&table);
+        BufDesp *bd = kBuffer.borrow(table.id_, blkid);
+        data.attach(bd->buffer);
+        unsigned short index =
+            data.searchRecord(iov[0].iov_base, iov[0].iov_len);
+        REQUIRE(index < data.getSlots());
         Record record;
-        data.refslots(index,record);
+        REQUIRE(data.refslots(index, record));
         unsigned int len;
         unsigned char *pkey;
         record.refByIndex(&pkey, &len, 1);
-        REQUIRE(pkey == iov[1].iov_base);
-
+        REQUIRE(len == sizeof(phone));
+        REQUIRE(memcmp(pkey, phone, sizeof(phone)) == 0);
+        data.detach();
+        kBuffer.releaseBuf(bd);
     }
 
-
-    SECTION("search") {
-        // search寻找到的BlockId应该和枚举数据链上每个Block找到的BlockId的结果果一致
+    SECTION("search")
+    {
+        // search找到的blockid应该和枚举数据链找到的一致
         // 选择locate测试中的htobe64(5)的记录
-
         Table table;
         table.open("table");
 
         long long id = htobe64(5);
-        int blkid = table.locate(&id, sizeof(id));
+        unsigned int blkid = table.locate(&id, sizeof(id));
         REQUIRE(blkid == 1);
-        
 
-        // B+树的Search方法得到的结果
+        // B+树的search方法得到的结果
         table.BPlusTreeInit();
-        nid = htobe64(5);
-        int BptSearchBlkid = table.search(&nid,sezeof(nid));
-
-        REQUIRE(blkid == BptSearchBlkid);
-
+        REQUIRE(table.search(&id, sizeof(id)) == blkid);
     }
-}
\ No newline at end of file
+}